@@ -22,6 +22,7 @@ struct booldep_eval_ctx {
     int (*req_cost)(const struct capreq *req, tn_array **providers, void *ctx);
 };
 
+/* dep is not modified, so parsed expression may be evaluated many times */
 tn_array *booldep_eval(struct booldep *dep, const struct booldep_eval_ctx *ctx);
 
 
@@ -26,7 +26,8 @@
 #include "booldep.h"
 
 struct dvalue {
-    struct capreq  *req;
+    struct capreq  *req;        /* leaf's one (borrowed) unless owned_req */
+    bool           owned_req;
     int            cost;
     tn_array       *providers;
     struct dvalue  *next;
@@ -61,7 +62,7 @@ static void dvalue_free(struct dvalue *dv) {
     if (dv->next)
         dvalue_free(dv->next);
 
-    if (dv->req)
+    if (dv->req && dv->owned_req)
         capreq_free(dv->req);
 
     n_array_cfree(&dv->providers);
@@ -69,6 +70,15 @@ static void dvalue_free(struct dvalue *dv) {
     n_cfree(&dv);
 }
 
+static void dvalue_set_req(struct dvalue *dv, struct capreq *req)
+{
+    if (dv->req && dv->owned_req)
+        capreq_free(dv->req);
+
+    dv->req = req;
+    dv->owned_req = true;
+}
+
 static void dvalue_dump(const struct dvalue *dv, const char *label)
 {
     if (poldek_TRACE == 0)
@@ -106,7 +116,8 @@ static struct dvalue *eval_req(struct node *node, const struct booldep_eval_ctx
     n_assert(node->type == 0);
     struct dvalue *dv = dvalue_new();
 
-    dv->req = capreq_clone(NULL, node->cap);
+    dv->req = node->cap;        /* dep is immutable, no need to clone */
+    dv->owned_req = false;
     dv->next = NULL;
 
     dv->cost = 0;
@@ -245,8 +256,7 @@ static struct dvalue *eval_with(struct node *node, const struct booldep_eval_ctx
 
     dvalue_free(right);
 
-    capreq_free(left->req);
-    left->req = take_best(re, ctx);
+    dvalue_set_req(left, take_best(re, ctx));
 
     n_array_free(left->providers);
     left->providers = re;
@@ -295,8 +305,7 @@ static struct dvalue *eval_without(struct node *node, const struct booldep_eval_
     if (n_array_size(left->providers) == 0) /* no packages fullfills both sides */
         goto l_none;
 
-    capreq_free(left->req);
-    left->req = take_best(left->providers, ctx);
+    dvalue_set_req(left, take_best(left->providers, ctx));
 
     dvalue_dump(left, "without.RE");
     dvalue_free(right);
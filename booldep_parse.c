@@ -289,6 +289,9 @@ struct booldep *booldep_parse(const char *expr)
 
 void booldep_free(struct booldep *dep)
 {
+    if (dep == NULL)
+        return;
+
     node_free(dep->node);
     n_cfree(&dep);
 }
@@ -980,5 +980,5 @@ void poclidek_apply_iinf(struct poclidek_ctx *cctx, struct poldek_ts *ts)
     }
 
     if (n)
-        cctx->ts_dbpkgdir = time(0);
+        poclidek__installed_touch(cctx);
 }
@@ -47,6 +47,8 @@ EXPORT void poclidek_apply_iinf(struct poclidek_ctx *cctx, struct poldek_ts *ts)
 EXPORT int poclidek_save_installedcache(struct poclidek_ctx *cctx,
                                  struct pkgdir *pkgdir);
 EXPORT int poclidek__load_installed(struct poclidek_ctx *cctx, int reload);
+EXPORT int poclidek__installed_changed(struct poclidek_ctx *cctx);
+EXPORT void poclidek__installed_touch(struct poclidek_ctx *cctx);
 
 
 EXPORT int poclidek_argv_is_help(int argc, const char **argv);
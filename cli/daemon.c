@@ -0,0 +1,387 @@
+/*
+  Copyright (C) 2000 - 2008 Pawel A. Gajda <mis@pld-linux.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+  Daemon mode: loaded packages are kept in memory and poldek shell
+  command lines are read from the unix socket clients, one per connection.
+  Command output is sent back followed by "!exit RC" line.
+
+  Commands which do not touch the database run in forked child, so
+  they are executed concurrently on a copy of the warm context; install
+  and uninstall are run serially by the daemon itself. Installed packages
+  are reloaded when rpmdb was changed outside, source index changes make
+  the daemon re-executing itself (the listening socket is inherited).
+
+  Commands are run with daemon privileges, so only the same user (or root)
+  is served.
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <trurl/trurl.h>
+#include <vfile/vfile.h>
+#include <sigint/sigint.h>
+
+#include "compiler.h"
+#include "i18n.h"
+#include "log.h"
+#include "pkgdir/pkgdir.h"
+#include "poldek.h"
+#include "cli.h"
+#include "cmd_chain.h"
+
+#define DAEMON_FD_ENV   "POLDEK_DAEMON_FD"
+#define DAEMON_MAXLINE  4096
+#define DAEMON_TIMEOUT  5       /* seconds for client to send its line */
+
+struct idxstamp {
+    time_t  mtime;
+    char    path[0];
+};
+
+static int listen_on(const char *sockpath)
+{
+    struct sockaddr_un addr;
+    const char *fdstr;
+    mode_t mask;
+    int fd, rc;
+
+    if ((fdstr = getenv(DAEMON_FD_ENV))) { /* re-executed */
+        fd = atoi(fdstr);
+        unsetenv(DAEMON_FD_ENV);
+        if (fd > 2 && fcntl(fd, F_GETFD) != -1) {
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+            return fd;
+        }
+    }
+
+    if (strlen(sockpath) >= sizeof(addr.sun_path)) {
+        logn(LOGERR, _("%s: socket path too long"), sockpath);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    n_snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sockpath);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        logn(LOGERR, "socket: %m");
+        return -1;
+    }
+
+    unlink(sockpath);           /* stale one */
+    mask = umask(077);          /* commands are run as we are */
+    rc = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(mask);
+
+    if (rc != 0 || chmod(sockpath, 0600) != 0 || listen(fd, 16) != 0) {
+        logn(LOGERR, "%s: %m", sockpath);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* local paths of loaded indexes (cached copies of remote ones) */
+static tn_array *idxstamps_new(struct poclidek_ctx *cctx)
+{
+    tn_array *pkgdirs, *stamps;
+    int i;
+
+    stamps = n_array_new(8, free, NULL);
+    if ((pkgdirs = poldek_get_pkgdirs(cctx->ctx)) == NULL)
+        return stamps;
+
+    for (i=0; i < n_array_size(pkgdirs); i++) {
+        struct pkgdir *pkgdir = n_array_nth(pkgdirs, i);
+        struct idxstamp *st;
+        char path[PATH_MAX];
+        struct stat sb;
+
+        if (pkgdir->idxpath == NULL)
+            continue;
+
+        if (vf_url_type(pkgdir->idxpath) & VFURL_LOCAL)
+            n_snprintf(path, sizeof(path), "%s", pkgdir->idxpath);
+        else
+            vf_localpath(path, sizeof(path), pkgdir->idxpath);
+
+        if (stat(path, &sb) != 0)
+            continue;
+
+        st = n_malloc(sizeof(*st) + strlen(path) + 1);
+        st->mtime = sb.st_mtime;
+        strcpy(st->path, path);
+        n_array_push(stamps, st);
+    }
+
+    n_array_free(pkgdirs);
+    return stamps;
+}
+
+static int idxstamps_changed(tn_array *stamps)
+{
+    int i;
+
+    for (i=0; i < n_array_size(stamps); i++) {
+        struct idxstamp *st = n_array_nth(stamps, i);
+        struct stat sb;
+
+        if (stat(st->path, &sb) != 0 || sb.st_mtime != st->mtime) {
+            msgn(1, _("%s: index changed"), vf_url_slim_s(st->path, 0));
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void reexec(int sockfd, char **argv)
+{
+    char fdstr[32];
+
+    n_snprintf(fdstr, sizeof(fdstr), "%d", sockfd);
+    setenv(DAEMON_FD_ENV, fdstr, 1);
+    fcntl(sockfd, F_SETFD, 0);
+
+    msgn(1, _("Restarting..."));
+    fflush(NULL);
+    execv("/proc/self/exe", argv);
+    execvp(argv[0], argv);
+
+    logn(LOGERR, "%s: %m", argv[0]);
+    unsetenv(DAEMON_FD_ENV);
+    fcntl(sockfd, F_SETFD, FD_CLOEXEC);
+}
+
+/* is peer running as we are (or root)? */
+static int is_trusted_peer(int fd)
+{
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+        logn(LOGERR, "getsockopt: %m");
+        return 0;
+    }
+
+    if (cred.uid != 0 && cred.uid != geteuid()) {
+        logn(LOGWARN, _("connection from uid %d rejected"), (int)cred.uid);
+        return 0;
+    }
+#endif
+    return 1;
+}
+
+static int read_cmdline(int fd, char *line, int size)
+{
+    time_t deadline = time(NULL) + DAEMON_TIMEOUT;
+    int n = 0;
+
+    while (n < size - 1) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int rc, left = deadline - time(NULL);
+        ssize_t nread;
+        char *nl;
+
+        /* do not let idle client to block the others */
+        if (left <= 0 || (rc = poll(&pfd, 1, left * 1000)) == 0) {
+            logn(LOGWARN, _("client timed out"));
+            return 0;
+        }
+
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+
+        nread = read(fd, &line[n], size - 1 - n);
+        if (nread < 0 && errno == EINTR)
+            continue;
+
+        if (nread <= 0)
+            break;
+
+        n += nread;
+        line[n] = '\0';
+        if ((nl = strchr(line, '\n'))) {
+            *nl = '\0';
+            return 1;
+        }
+    }
+
+    line[n] = '\0';
+    return n > 0;
+}
+
+/* does any command of line modify the database? */
+static int is_modifying(struct poclidek_ctx *cctx, const char *line)
+{
+    tn_array *chain;
+    int i, yes = 0;
+
+    if ((chain = poclidek_prepare_cmdline(cctx, line)) == NULL)
+        return 0;
+
+    for (i=0; i < n_array_size(chain); i++) {
+        struct cmd_chain_ent *ent = n_array_nth(chain, i);
+
+        while (ent) {
+            if (ent->cmd && (ent->cmd->flags & COMMAND_MODIFIESDB))
+                yes = 1;
+            ent = ent->next_piped;
+        }
+    }
+
+    n_array_free(chain);
+    return yes;
+}
+
+/* run line with stdout and stderr redirected to fd */
+static int run_cmdline(struct poclidek_ctx *cctx, int fd, const char *line)
+{
+    int rc, saved_out, saved_err;
+    char tmp[64];
+
+    fflush(NULL);
+    saved_out = dup(STDOUT_FILENO);
+    saved_err = dup(STDERR_FILENO);
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+
+    rc = poclidek_execline(cctx, NULL, line);
+
+    fflush(NULL);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+
+    n_snprintf(tmp, sizeof(tmp), "!exit %d\n", rc ? 0 : 1);
+    if (write(fd, tmp, strlen(tmp)) < 0)
+        logn(LOGWARN, "write: %m");
+
+    return rc;
+}
+
+static void serve(struct poclidek_ctx *cctx, int fd)
+{
+    char line[DAEMON_MAXLINE];
+    pid_t pid;
+
+    if (!is_trusted_peer(fd))
+        return;
+
+    if (!read_cmdline(fd, line, sizeof(line)) || *line == '\0')
+        return;
+
+    msgn(2, _("Executing \"%s\"..."), line);
+
+    /* rpmdb touched by someone else */
+    if (poclidek__installed_changed(cctx)) {
+        msgn(1, _("Installed packages changed, reloading..."));
+        poclidek_load_packages(cctx, POCLIDEK_LOAD_INSTALLED |
+                               POCLIDEK_LOAD_RELOAD);
+    }
+
+    if (is_modifying(cctx, line)) {
+        run_cmdline(cctx, fd, line);
+        return;
+    }
+
+    fflush(NULL);
+    if ((pid = fork()) == 0) {
+        int rc = run_cmdline(cctx, fd, line);
+        _exit(rc ? 0 : 1);
+
+    } else if (pid < 0) {
+        logn(LOGERR, "fork: %m");
+        run_cmdline(cctx, fd, line);
+    }
+}
+
+int poclidek_daemon(struct poclidek_ctx *cctx, const char *sockpath,
+                    char **argv)
+{
+    tn_array *stamps;
+    int sockfd;
+
+    if (!poclidek_load_packages(cctx, POCLIDEK_LOAD_ALL))
+        return 0;
+
+    if ((sockfd = listen_on(sockpath)) < 0)
+        return 0;
+
+    /* there is no one to ask */
+    poldek_configure(cctx->ctx, POLDEK_CONF_OPT, POLDEK_OP_CONFIRM_INST, 0);
+    poldek_configure(cctx->ctx, POLDEK_CONF_OPT, POLDEK_OP_CONFIRM_UNINST, 0);
+    poldek_configure(cctx->ctx, POLDEK_CONF_OPT, POLDEK_OP_EQPKG_ASKUSER, 0);
+
+    stamps = idxstamps_new(cctx);
+    msgn(1, _("Listening on %s"), sockpath);
+
+    while (!sigint_reached()) {
+        struct pollfd pfd = { sockfd, POLLIN, 0 };
+        int fd;
+
+        while (waitpid(-1, NULL, WNOHANG) > 0) /* reap finished ones */
+            ;
+
+        if (poll(&pfd, 1, 1000) <= 0)
+            continue;
+
+        /* pending connection waits in the backlog of inherited socket */
+        if (idxstamps_changed(stamps)) {
+            reexec(sockfd, argv); /* returns on failure only */
+            n_array_free(stamps);
+            stamps = idxstamps_new(cctx);
+        }
+
+        if ((fd = accept(sockfd, NULL, NULL)) < 0) {
+            if (errno != EINTR && errno != EAGAIN)
+                logn(LOGERR, "accept: %m");
+            continue;
+        }
+
+        serve(cctx, fd);
+        close(fd);
+    }
+
+    while (waitpid(-1, NULL, 0) > 0)
+        ;
+
+    n_array_free(stamps);
+    close(sockfd);
+    unlink(sockpath);
+    return 1;
+}
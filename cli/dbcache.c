@@ -129,15 +129,14 @@ struct pkgdir *load_rpmdbcache(const char *cachedir,
     const char       *lc_lang;
     char             path[PATH_MAX];
 
-    n_assert(rpmdb_mtime > 0);
-
     if (mkdbcache_path(path, sizeof(path), cachedir, rpmdb_path) == NULL)
         return NULL;
 
     time_t mtime = poldek_util_mtime(path);
     DBGF("dbcache mtime=%lu, %s\n", (unsigned long) mtime, path);
 
-    if (mtime >= rpmdb_mtime) {
+    /* rpmdb_mtime == 0 => outdated one is fine too */
+    if (mtime > 0 && mtime >= rpmdb_mtime) {
         lc_lang = poldek_util_lc_lang("LC_MESSAGES");
         if (lc_lang == NULL)
             lc_lang = "C";
@@ -157,18 +156,6 @@ struct pkgdir *load_rpmdbcache(const char *cachedir,
         }
     }
 
-#if 0
-    /*
-      outdated cache could be reused as a base for loading raw database,
-      BUT there is no performance gain, as we have to load complete
-      rpm headers from db
-    */
-    if (0 && rpmdb_mtime > mtime) {
-        prev_dir = dir;
-        dir = NULL;
-    }
-#endif
-
     return dir;
 }
 
@@ -223,13 +210,20 @@ struct pkgdir *load_installed_pkgdir(struct poclidek_ctx *cctx, int reload)
         return NULL;
 
     //MEMINF("%s", "before rpmdbload\n");
-    if (!reload) {              /* use cache */
-        time_t mtime_rpmdb = pm_dbmtime(pmctx, rpmdb_path);
-        if (mtime_rpmdb > 0) {
-            dir = load_rpmdbcache(ts->cachedir, dbpath,
-                                  rpmdb_path, mtime_rpmdb,
-                                  ldflags);
-        }
+    time_t mtime_rpmdb = pm_dbmtime(pmctx, rpmdb_path);
+    if (!reload && mtime_rpmdb > 0) { /* use cache */
+        dir = load_rpmdbcache(ts->cachedir, dbpath,
+                              rpmdb_path, mtime_rpmdb,
+                              ldflags);
+    }
+
+    /*
+      outdated cache as a base of database load: headers of unchanged
+      packages are still read, but not parsed again (see rpmdb.c)
+    */
+    if (dir == NULL && mtime_rpmdb > 0) {
+        prev_dir = load_rpmdbcache(ts->cachedir, dbpath, rpmdb_path, 0,
+                                   ldflags & ~PKGDIR_LD_DIRINDEX);
     }
 
     if (dir == NULL) {          /* load database */
@@ -304,3 +298,37 @@ int poclidek_save_installedcache(struct poclidek_ctx *cctx,
                           PKGDIR_CREAT_NOPATCH | PKGDIR_CREAT_NOUNIQ |
                           PKGDIR_CREAT_MINi18n | PKGDIR_CREAT_NOFL);
 }
+
+static time_t rpmdb_mtime(struct poclidek_ctx *cctx)
+{
+    char rpmdb_path[PATH_MAX], dbpath[PATH_MAX];
+    struct poldek_ts *ts = cctx->ctx->ts; /* for short */
+
+    if (!pm_dbpath(cctx->ctx->pmctx, dbpath, sizeof(dbpath)))
+        return 0;
+
+    if (mkrpmdb_path(rpmdb_path, sizeof(rpmdb_path),
+                     ts->rootdir, dbpath) == NULL)
+        return 0;
+
+    return pm_dbmtime(cctx->ctx->pmctx, rpmdb_path);
+}
+
+/* has rpmdb been changed after installed packages were loaded? */
+int poclidek__installed_changed(struct poclidek_ctx *cctx)
+{
+    if (cctx->dbpkgdir == NULL)
+        return 0;
+
+    return rpmdb_mtime(cctx) > cctx->ts_dbpkgdir;
+}
+
+/* installed packages are up to date with rpmdb changed by ourselves */
+void poclidek__installed_touch(struct poclidek_ctx *cctx)
+{
+    time_t mtime = rpmdb_mtime(cctx);
+
+    cctx->ts_dbpkgdir = time(0);
+    if (mtime > cctx->ts_dbpkgdir) /* skewed clock, rpmdb on NFS, etc */
+        cctx->ts_dbpkgdir = mtime;
+}
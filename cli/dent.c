@@ -31,6 +31,81 @@
 #include "arg_packages.h"
 #include "poldek_util.h"
 
+/*
+  Lazy dir content: packages of pkgs, only these from pkgdir with given
+  id if set. Package dents are made and sorted on first access, see
+  pkg_dent_get_ents().
+*/
+#define DENT_VIEW_NOIGNORED (1 << 0) /* skip PKG_IGNORED packages */
+
+struct pkg_dent_view {
+    struct poclidek_ctx  *cctx;
+    tn_array             *pkgs;
+    char                 *pkgdir_id;
+    unsigned             flags;
+};
+
+struct view_it {
+    struct pkg_dent_view *view;
+    struct pkgdir        *pkgdir;    /* last seen one */
+    int                  pkgdir_ok;
+    int                  i;
+};
+
+static void view_it_init(struct view_it *it, struct pkg_dent_view *view)
+{
+    it->view = view;
+    it->pkgdir = NULL;
+    it->pkgdir_ok = 0;
+    it->i = 0;
+}
+
+static struct pkg *view_it_get(struct view_it *it)
+{
+    struct pkg_dent_view *v = it->view;
+
+    while (it->i < n_array_size(v->pkgs)) {
+        struct pkg *pkg = n_array_nth(v->pkgs, it->i++);
+
+        if ((v->flags & DENT_VIEW_NOIGNORED) && pkg_is_scored(pkg, PKG_IGNORED))
+            continue;
+
+        if (v->pkgdir_id) {
+            if (pkg->pkgdir != it->pkgdir) { /* packages come in pkgdir runs */
+                char idbuf[256];
+
+                it->pkgdir = pkg->pkgdir;
+                it->pkgdir_ok = pkg->pkgdir &&
+                    n_str_eq(pkgdir_idstr(pkg->pkgdir, idbuf, sizeof(idbuf)),
+                             v->pkgdir_id);
+            }
+
+            if (!it->pkgdir_ok)
+                continue;
+        }
+
+        return pkg;
+    }
+
+    return NULL;
+}
+
+static void view_free(struct pkg_dent_view *v)
+{
+    n_array_free(v->pkgs);
+    n_cfree(&v->pkgdir_id);
+    free(v);
+}
+
+static tn_array *dent_ents_new(int size)
+{
+    tn_array *ents;
+
+    ents = n_array_new(size, (tn_fn_free)pkg_dent_free, (tn_fn_cmp)pkg_dent_cmp);
+    n_array_ctl(ents, TN_ARRAY_AUTOSORTED);
+    return ents;
+}
+
 static inline
 struct pkg_dent *pkg_dent_new(struct poclidek_ctx *cctx, const char *name,
                               struct pkg *pkg, int flags, const char *dirpath)
@@ -81,9 +156,7 @@ struct pkg_dent *pkg_dent_new(struct poclidek_ctx *cctx, const char *name,
     }
 
     if (flags & PKG_DENT_DIR) {
-        ent->pkg_dent_ents = n_array_new(128, (tn_fn_free)pkg_dent_free,
-                                         (tn_fn_cmp)pkg_dent_cmp);
-        n_array_ctl(ent->pkg_dent_ents, TN_ARRAY_AUTOSORTED);
+        ent->pkg_dent_ents = dent_ents_new(128);
 
     } else {
         ent->name = pkg_id(pkg);
@@ -111,7 +184,12 @@ void pkg_dent_free(struct pkg_dent *ent)
         return;
     }
 
-    if (ent->flags & PKG_DENT_DIR) {
+    if (ent->flags & PKG_DENT_LAZY) {
+        view_free(ent->ent.view);
+        ent->ent.view = NULL;
+        ent->flags &= ~PKG_DENT_LAZY;
+
+    } else if (ent->flags & PKG_DENT_DIR) {
         n_assert(ent->pkg_dent_ents);
         n_array_free(ent->pkg_dent_ents);
         ent->pkg_dent_ents = NULL;
@@ -126,6 +204,66 @@ void pkg_dent_free(struct pkg_dent *ent)
     //free(ent); - obstacked
 }
 
+/* make dir lazy view of pkgs, drops its current content */
+static void dent_set_view(struct poclidek_ctx *cctx, struct pkg_dent *dir,
+                          tn_array *pkgs, const char *pkgdir_id,
+                          unsigned flags)
+{
+    struct pkg_dent_view *v;
+
+    n_assert(pkg_dent_isdir(dir));
+
+    if (dir->flags & PKG_DENT_LAZY)
+        view_free(dir->ent.view);
+    else
+        n_array_free(dir->pkg_dent_ents);
+
+    v = n_malloc(sizeof(*v));
+    v->cctx = cctx;
+    v->pkgs = n_ref(pkgs);
+    v->pkgdir_id = pkgdir_id ? n_strdup(pkgdir_id) : NULL;
+    v->flags = flags;
+
+    dir->ent.view = v;
+    dir->flags |= PKG_DENT_LAZY;
+}
+
+tn_array *pkg_dent_get_ents(struct pkg_dent *dir)
+{
+    struct pkg_dent_view *v;
+    struct view_it it;
+    struct pkg *pkg;
+    tn_array *ents;
+
+    n_assert(pkg_dent_isdir(dir));
+
+    if ((dir->flags & PKG_DENT_LAZY) == 0)
+        return dir->pkg_dent_ents;
+
+    v = dir->ent.view;
+    ents = dent_ents_new(v->pkgdir_id ? 128 : n_array_size(v->pkgs) + 1);
+
+    view_it_init(&it, v);
+    while ((pkg = view_it_get(&it)))
+        n_array_push(ents, pkg_dent_new_pkg(v->cctx, pkg));
+    n_array_sort(ents);
+
+    DBGF("%s: %d ents\n", dir->name, n_array_size(ents));
+    view_free(v);
+    dir->pkg_dent_ents = ents;
+    dir->flags &= ~PKG_DENT_LAZY;
+
+    return ents;
+}
+
+static int dent_isempty(struct pkg_dent *dir)
+{
+    if (dir->flags & PKG_DENT_LAZY)
+        return n_array_size(dir->ent.view->pkgs) == 0;
+
+    return n_array_size(dir->pkg_dent_ents) == 0;
+}
+
 static inline struct pkg *pkg_dent_getpkg(struct pkg_dent *ent)
 {
     if (ent->flags & PKG_DENT_DIR)
@@ -196,20 +334,27 @@ struct pkg_dent *pkg_dent_add_pkg(struct poclidek_ctx *cctx,
                                   struct pkg_dent *dent, struct pkg *pkg)
 {
     struct pkg_dent *ent;
+    tn_array *ents = pkg_dent_get_ents(dent);
+
+    /* lazy dir might have been built from already updated pkgs */
+    ent = n_array_bsearch_ex(ents, pkg_id(pkg), (tn_fn_cmp)pkg_dent_strcmp);
+    if (ent && !pkg_dent_isdir(ent) && ent->pkg_dent_pkg == pkg)
+        return ent;
 
     ent = pkg_dent_new_pkg(cctx, pkg);
-    n_array_push(dent->pkg_dent_ents, ent);
-    n_array_sort(dent->pkg_dent_ents);
+    n_array_push(ents, ent);
+    n_array_sort(ents);
     return ent;
 }
 
 void pkg_dent_remove_pkg(struct pkg_dent *dent, struct pkg *pkg)
 {
     struct pkg_dent tmp;
+    tn_array *ents = pkg_dent_get_ents(dent);
 
-    n_array_sort(dent->pkg_dent_ents);
+    n_array_sort(ents);
     tmp.name = pkg_id(pkg);
-    n_array_remove(dent->pkg_dent_ents, &tmp);
+    n_array_remove(ents, &tmp);
 }
 
 
@@ -220,60 +365,22 @@ int pkg_dent_add_pkgs(struct poclidek_ctx *cctx,
 {
     int i;
     struct pkg_dent *ent;
-
-    for (i=0; i < n_array_size(pkgs); i++) {
-        struct pkg *pkg = n_array_nth(pkgs, i);
-        if (pkg_is_scored(pkg, PKG_IGNORED))
-            continue;
-        ent = pkg_dent_new_pkg(cctx, pkg);
-        n_array_push(dent->pkg_dent_ents, ent);
-    }
-    n_array_sort(dent->pkg_dent_ents);
-    return 1;
-}
-
-static
-int pkg_dent_replace_pkgs(struct poclidek_ctx *cctx, struct pkg_dent *dent,
-                          tn_array *pkgs)
-{
-    int i, n;
-    struct pkg_dent *ent;
     tn_array *ents;
 
-
-    ents = n_array_dup(dent->pkg_dent_ents, (tn_fn_dup)pkg_dent_link);
-    n_array_clean(dent->pkg_dent_ents);
-
-    n = 0;
-    for (i=0; i < n_array_size(pkgs); i++) {
-        struct pkg *pkg = n_array_nth(pkgs, i);
-
-        if (pkg_is_scored(pkg, PKG_IGNORED))
-            continue;
-
-        if (n == n_array_size(ents))
-            break;
-
-        ent = n_array_nth(ents, n);
-        n++;
-
-        ent->name = pkg_id(pkg);
-        pkg_free(ent->pkg_dent_pkg);
-        ent->pkg_dent_pkg = pkg_link(pkg);
-        n_array_push(dent->pkg_dent_ents, pkg_dent_link(ent));
+    if (dent_isempty(dent)) {   /* dents will be made on demand */
+        dent_set_view(cctx, dent, pkgs, NULL, DENT_VIEW_NOIGNORED);
+        return 1;
     }
 
-    for (; i < n_array_size(pkgs); i++) { /* the rest */
+    ents = pkg_dent_get_ents(dent);
+    for (i=0; i < n_array_size(pkgs); i++) {
         struct pkg *pkg = n_array_nth(pkgs, i);
-
         if (pkg_is_scored(pkg, PKG_IGNORED))
             continue;
         ent = pkg_dent_new_pkg(cctx, pkg);
-        n_array_push(dent->pkg_dent_ents, ent);
+        n_array_push(ents, ent);
     }
-
-    n_array_sort(dent->pkg_dent_ents);
-    n_array_free(ents);
+    n_array_sort(ents);
     return 1;
 }
 
@@ -326,9 +433,11 @@ struct pkg_dent *pkg_dent_add_dir(struct poclidek_ctx *cctx,
     DBGF("adddir %s, %s\n", name, path);
 
     if (parent) {
+        tn_array *ents = pkg_dent_get_ents(parent);
+
         ent->parent = parent;
-        n_array_push(parent->pkg_dent_ents, ent);
-        n_array_sort(parent->pkg_dent_ents);
+        n_array_push(ents, ent);
+        n_array_sort(ents);
     }
     return ent;
 }
@@ -358,22 +467,18 @@ char *poclidek_dent_dirpath(char *path, int size, const struct pkg_dent *dent)
 }
 
 
-static void dent_sort(const char *foo, void *dent)
-{
-    struct pkg_dent *ent = dent;
-    foo = foo;
-    n_assert(pkg_dent_isdir(ent));
-    n_array_sort(ent->pkg_dent_ents);
-}
-
+/*
+  Directories are set up as lazy views over pkgs, package dents are not
+  made until the directory is accessed.
+*/
 struct pkg_dent *poclidek_dent_setup(struct poclidek_ctx *cctx,
                                      const char *path, tn_array *pkgs,
                                      int force)
 {
     struct pkgdir    *curr_pkgdir = NULL;
-    struct pkg_dent  *dest = NULL, *curr_ent = NULL;
+    struct pkg_dent  *dest = NULL;
     tn_hash          *dent_ht;
-    int i, add = 0, add_subdirs = 0, replace = 0;
+    int i, add = 0, add_subdirs = 0;
 
 
     if (n_str_eq(path, POCLIDEK_INSTALLEDDIR))
@@ -388,17 +493,12 @@ struct pkg_dent *poclidek_dent_setup(struct poclidek_ctx *cctx,
 
     if ((dest = poclidek_dent_find(cctx, path)) == NULL)
         dest = pkg_dent_add_dir(cctx, cctx->rootdir, path);
-    else if (force)
-        replace = 1;
-    else if (!pkg_dent_isstub(dest))
+    else if (!force && !pkg_dent_isstub(dest))
         n_die("%s: duplicate directory", path);
 
     n_assert(dest);
     pkg_dent_clr_isstub(dest);
-    if (replace)
-        pkg_dent_replace_pkgs(cctx, dest, pkgs);
-    else
-        pkg_dent_add_pkgs(cctx, dest, pkgs);
+    dent_set_view(cctx, dest, pkgs, NULL, DENT_VIEW_NOIGNORED);
 
     if (!add_subdirs)
         return dest;
@@ -409,34 +509,36 @@ struct pkg_dent *poclidek_dent_setup(struct poclidek_ctx *cctx,
     dent_ht = n_hash_new(32, NULL);
     for (i=0; i < n_array_size(pkgs); i++) {
         struct pkg *pkg = n_array_nth(pkgs, i);
+        struct pkg_dent *dent;
+        char idbuf[256], name[256], *p;
+        const char *id;
 
-        if (pkg->pkgdir != curr_pkgdir) {
-            struct pkg_dent *dent;
-            char idbuf[256];
-            const char *id;
-
-            n_assert(pkg->pkgdir);
-            curr_pkgdir = pkg->pkgdir;
-
-            id = pkgdir_idstr(pkg->pkgdir, idbuf, sizeof(idbuf));
-            if ((dent = n_hash_get(dent_ht, id)) == NULL) {
-                char name[256], *p;
-                n_snprintf(name, sizeof(name), "%s", id);
-                p = name;
-                while (*p) {
-                    if (!isprint(*p)) *p = '.';
-                    p++;
-                }
-                dent = pkg_dent_add_dir(cctx, cctx->rootdir, name);
-                n_hash_insert(dent_ht, id, dent);
-            }
+        if (pkg->pkgdir == curr_pkgdir)
+            continue;
+
+        n_assert(pkg->pkgdir);
+        curr_pkgdir = pkg->pkgdir;
 
-            curr_ent = dent;
+        id = pkgdir_idstr(pkg->pkgdir, idbuf, sizeof(idbuf));
+        if (n_hash_exists(dent_ht, id))
+            continue;
+
+        n_snprintf(name, sizeof(name), "%s", id);
+        p = name;
+        while (*p) {
+            if (!isprint(*p)) *p = '.';
+            p++;
         }
-        n_array_push(curr_ent->pkg_dent_ents, pkg_dent_new_pkg(cctx, pkg));
+
+        dent = n_array_bsearch_ex(pkg_dent_get_ents(cctx->rootdir), name,
+                                  (tn_fn_cmp)pkg_dent_strcmp);
+        if (dent == NULL || !pkg_dent_isdir(dent)) /* reloaded otherwise */
+            dent = pkg_dent_add_dir(cctx, cctx->rootdir, name);
+
+        dent_set_view(cctx, dent, pkgs, id, 0);
+        n_hash_insert(dent_ht, id, dent);
     }
 
-    n_hash_map(dent_ht, dent_sort);
     n_hash_free(dent_ht);
     return dest;
 }
@@ -455,7 +557,10 @@ struct pkg_dent *get_dir_dent(struct poclidek_ctx *cctx,
     n_assert(currdir);
 
     if ((p = strchr(path, '/')) == NULL) {
-        ent = n_array_bsearch_ex(currdir->pkg_dent_ents, path,
+        if (!pkg_dent_isdir(currdir))
+            return NULL;
+
+        ent = n_array_bsearch_ex(pkg_dent_get_ents(currdir), path,
                                  (tn_fn_cmp)pkg_dent_strcmp);
         return ent;
     }
@@ -499,9 +604,9 @@ int poclidek_chdir(struct poclidek_ctx *cctx, const char *path)
     }
 
     if ((p = strchr(path, '/')) == NULL) {
-        ent = n_array_bsearch_ex(cctx->currdir->pkg_dent_ents, path,
+        ent = n_array_bsearch_ex(pkg_dent_get_ents(cctx->currdir), path,
                                  (tn_fn_cmp)pkg_dent_strcmp);
-        if (ent) {
+        if (ent && pkg_dent_isdir(ent)) {
             cctx->currdir = ent;
             return 1;
 
@@ -542,13 +647,13 @@ struct pkg_dent *poclidek_dent_ldfind(struct poclidek_ctx *cctx, const char *pat
     DBGF("path %s, currdir=%s\n", path, cctx->currdir ? cctx->currdir->name : NULL);
 
     if ((dent = poclidek_dent_find(cctx, path)) != NULL) {
-        DBGF("dent %s, stub %d, ents %d\n", dent->name, pkg_dent_isstub(dent),
-             n_array_size(dent->pkg_dent_ents));
+        DBGF("dent %s, stub %d, empty %d\n", dent->name, pkg_dent_isstub(dent),
+             dent_isempty(dent));
 
         n_assert(pkg_dent_isdir(dent));
 
         if (flags & PKG_DENT_LDFIND_STUBSONLY) {
-            if (pkg_dent_isstub(dent) && n_array_size(dent->pkg_dent_ents) > 0)
+            if (pkg_dent_isstub(dent) && !dent_isempty(dent))
                 return dent;
 
             return NULL;
@@ -557,7 +662,7 @@ struct pkg_dent *poclidek_dent_ldfind(struct poclidek_ctx *cctx, const char *pat
         if (!pkg_dent_isstub(dent))
             return dent;
 
-        if ((flags & PKG_DENT_LDFIND_STUBSOK) && n_array_size(dent->pkg_dent_ents) > 0) /* have package stubs */
+        if ((flags & PKG_DENT_LDFIND_STUBSOK) && !dent_isempty(dent)) /* have package stubs */
             return dent;
     }
 
@@ -617,7 +722,7 @@ tn_array *poclidek_get_dent_ents(struct poclidek_ctx *cctx, const char *path, un
 
     DBGF("path %s, %d\n", path, flags);
     if ((ent = poclidek_dent_ldfind(cctx, path, flags)))
-        return ent->pkg_dent_ents;
+        return pkg_dent_get_ents(ent);
 
     return NULL;
 }
@@ -625,12 +730,29 @@ tn_array *poclidek_get_dent_ents(struct poclidek_ctx *cctx, const char *path, un
 
 tn_array *poclidek_get_dent_packages(struct poclidek_ctx *cctx, const char *dir, unsigned flags)
 {
+    struct pkg_dent *dent;
     tn_array *pkgs, *ents;
     register int i;
 
-    if ((ents = poclidek_get_dent_ents(cctx, dir, flags)) == NULL)
+    if ((dent = poclidek_dent_ldfind(cctx, dir, flags)) == NULL)
         return NULL;
 
+    if (dent->flags & PKG_DENT_LAZY) { /* packages only, dents are not needed */
+        struct view_it it;
+        struct pkg *pkg;
+
+        pkgs = pkgs_array_new_ex(n_array_size(dent->ent.view->pkgs),
+                                 pkg_cmp_name_evr_rev);
+
+        view_it_init(&it, dent->ent.view);
+        while ((pkg = view_it_get(&it)))
+            n_array_push(pkgs, pkg_link(pkg));
+
+        n_array_sort(pkgs);
+        return pkgs;
+    }
+
+    ents = dent->pkg_dent_ents;
     pkgs = pkgs_array_new_ex(n_array_size(ents), pkg_cmp_name_evr_rev);
 
     for (i=0; i < n_array_size(ents); i++) {
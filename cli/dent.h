@@ -20,11 +20,13 @@
 #endif
 
 struct poclidek_ctx;
+struct pkg_dent_view;
 
 #define PKG_DENT_DIR           (1 << 0)
 #define PKG_DENT_DELETED       (1 << 1)
 #define PKG_DENT_STUB_EMPTY    (1 << 2)
 #define PKG_DENT_STUB          (1 << 3)
+#define PKG_DENT_LAZY          (1 << 4) /* dir content not built yet */
 
 struct pkg_dent {
     uint16_t         _refcnt;
@@ -32,8 +34,9 @@ struct pkg_dent {
     struct pkg_dent  *parent;
 
     union {
-        tn_array        *ents;
-        struct pkg      *pkg;
+        tn_array              *ents;
+        struct pkg            *pkg;
+        struct pkg_dent_view  *view;   /* PKG_DENT_LAZY dirs */
     } ent;
 
     const char *name;
@@ -52,6 +55,9 @@ EXPORT struct pkg_dent *pkg_dent_link(struct pkg_dent *ent);
 
 EXPORT void pkg_dent_free(struct pkg_dent *ent);
 
+/* dir entries, builds lazy dir on first call */
+EXPORT tn_array *pkg_dent_get_ents(struct pkg_dent *dir);
+
 EXPORT struct pkg_dent *pkg_dent_add_dir(struct poclidek_ctx *cctx,
                                          struct pkg_dent *parent, const char *name);
 
@@ -41,6 +41,7 @@
 
 #include "cmd.h"
 #include "cli.h"
+#include "json.h"
 #include "sigint/sigint.h"
 
 #define IDENT     16
@@ -61,6 +62,7 @@ static int desc(struct cmdctx *cmdctx);
 #define OPT_DESC_FL           (1 << 7)
 #define OPT_DESC_FL_LONGFMT   (1 << 8)
 #define OPT_DESC_CHANGELOG    (1 << 9)
+#define OPT_DESC_JSON         (1 << 10)
 #define OPT_DESC_ALL          (OPT_DESC_CAPS | OPT_DESC_REQS | \
                                OPT_DESC_REQDIRS |                       \
                                OPT_DESC_REQPKGS | OPT_DESC_REVREQPKGS | \
@@ -97,6 +99,8 @@ static struct argp_option options[] = {
     { NULL,        'l', 0,  OPTION_ALIAS, 0, 1},
 
     { "log", 'L', 0, 0, N_("Show package changelog"), 1 },
+    { "json", OPT_DESC_JSON, 0, 0,
+      N_("Print packages as JSON objects, one per line"), 1 },
     { 0, 0, 0, 0, 0, 0 },
 };
 
@@ -163,6 +167,11 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
             cmdctx->_flags |= OPT_DESC_DESCR;
             break;
 
+        case OPT_DESC_JSON:
+            cmdctx->_flags |= OPT_DESC_JSON;
+            cmdctx->rtflags |= CMDCTX_NOCTRLMSGS;
+            break;
+
         default:
             return ARGP_ERR_UNKNOWN;
     }
@@ -846,7 +855,8 @@ int is_older_installed(struct poldek_ctx *ctx, const struct pkg *pkg, time_t *bu
     return installed;
 }
 
-static void show_changelog(struct cmdctx *cmdctx, struct pkg *pkg, struct pkguinf *pkgu)
+static const char *get_changelog(struct cmdctx *cmdctx, struct pkg *pkg,
+                                 struct pkguinf *pkgu)
 {
     const char *log = NULL;
 
@@ -859,6 +869,13 @@ static void show_changelog(struct cmdctx *cmdctx, struct pkg *pkg, struct pkguin
     if (log == NULL)
         log = pkguinf_get(pkgu, PKGUINF_CHANGELOG);
 
+    return log;
+}
+
+static void show_changelog(struct cmdctx *cmdctx, struct pkg *pkg, struct pkguinf *pkgu)
+{
+    const char *log = get_changelog(cmdctx, pkg, pkgu);
+
     if (log) {
         cmdctx_printf_c(cmdctx, PRCOLOR_CYAN, "%-16s\n", "Changelog:");
         cmdctx_printf(cmdctx, "%s", log);
@@ -1028,9 +1045,202 @@ static void show_description(struct cmdctx *cmdctx, struct pkg *pkg, struct pkgu
     }
 }
 
+/* --json */
+enum json_capreqs {
+    JSON_PROVIDES,
+    JSON_REQUIRES,
+    JSON_REQUIRES_PRE,
+    JSON_REQUIRES_UN,
+    JSON_CONFLICTS,
+    JSON_OBSOLETES,
+    JSON_ANY,
+};
+
+static int json_capreq_ok(struct pkg *pkg, struct capreq *cr,
+                          enum json_capreqs kind)
+{
+    switch (kind) {
+        case JSON_PROVIDES:
+            return !pkg_eq_capreq(pkg, cr);
+
+        case JSON_REQUIRES:
+        case JSON_REQUIRES_PRE:
+        case JSON_REQUIRES_UN:
+            if (pkg_eq_capreq(pkg, cr) || capreq_is_bastard(cr) ||
+                capreq_is_rpmlib(cr))
+                return 0;
+
+            if (kind == JSON_REQUIRES_PRE)
+                return capreq_is_prereq(cr) != 0;
+
+            if (kind == JSON_REQUIRES_UN)
+                return capreq_is_prereq_un(cr) != 0;
+
+            return !capreq_is_prereq(cr) && !capreq_is_prereq_un(cr);
+
+        case JSON_CONFLICTS:
+            return !capreq_is_obsl(cr);
+
+        case JSON_OBSOLETES:
+            return capreq_is_obsl(cr) != 0;
+
+        default:
+            break;
+    }
+
+    return 1;
+}
+
+static void json_capreqs(tn_buf *nbuf, const char *key, struct pkg *pkg,
+                         tn_array *crs, enum json_capreqs kind)
+{
+    int i, n = 0;
+
+    for (i=0; crs && i < n_array_size(crs); i++) {
+        struct capreq *cr = n_array_nth(crs, i);
+
+        if (!json_capreq_ok(pkg, cr, kind))
+            continue;
+
+        if (n++ == 0)
+            json_array_begin(nbuf, key);
+
+        json_str(nbuf, NULL, capreq_snprintf_s(cr));
+    }
+
+    if (n)
+        json_array_end(nbuf);
+}
+
+static void json_reqpkgs(tn_buf *nbuf, struct cmdctx *cmdctx, struct pkg *pkg)
+{
+    tn_array *pkgs;
+    int i;
+
+    if ((pkgs = poldek_ts_get_required_packages(cmdctx->ts, pkg))) {
+        tn_buf *alts = n_buf_new(128);
+
+        json_array_begin(nbuf, "required_pkgs");
+        for (i=0; i < n_array_size(pkgs); i++) {
+            struct reqpkg *rp = n_array_nth(pkgs, i);
+            int n = 0;
+
+            n_buf_clean(alts);
+            n_buf_puts_z(alts, rp->pkg->name);
+
+            if (rp->flags & REQPKG_MULTI) /* alternatives as "a | b" */
+                while (rp->adds[n])
+                    n_buf_printf(alts, " | %s", rp->adds[n++]->pkg->name);
+
+            json_str(nbuf, NULL, n_buf_ptr(alts));
+        }
+        json_array_end(nbuf);
+
+        n_buf_free(alts);
+        n_array_cfree(&pkgs);
+    }
+}
+
+static void json_revreqpkgs(tn_buf *nbuf, struct cmdctx *cmdctx,
+                            struct pkg *pkg)
+{
+    tn_array *pkgs;
+
+    if ((pkgs = poldek_ts_get_requiredby_packages(cmdctx->ts, pkg)) == NULL)
+        return;
+
+    json_array_begin(nbuf, "required_by");
+    for (int i=0; i < n_array_size(pkgs); i++) {
+        struct pkg *p = n_array_nth(pkgs, i);
+        json_str(nbuf, NULL, p->name);
+    }
+    json_array_end(nbuf);
+
+    n_array_cfree(&pkgs);
+}
+
+static void json_files(tn_buf *nbuf, struct pkg *pkg)
+{
+    struct pkgflist *flist;
+    struct pkgfl_it it;
+    const char *path;
+
+    if ((flist = pkg_get_flist(pkg)) == NULL)
+        return;
+
+    json_array_begin(nbuf, "files");
+    pkgfl_it_init(&it, flist->fl);
+    while ((path = pkgfl_it_get(&it, NULL)))
+        json_str(nbuf, NULL, path);
+    json_array_end(nbuf);
+
+    pkgflist_free(flist);
+}
+
+static void desc_json(struct cmdctx *cmdctx, tn_buf *nbuf, struct pkg *pkg,
+                      struct pkguinf *pkgu, unsigned flags)
+{
+    json_object_begin(nbuf, NULL);
+    json_pkg(nbuf, pkg);
+
+    if (flags & OPT_DESC_DESCR) {
+        char fnbuf[PATH_MAX];
+        const char *fn;
+        static const struct { const char *key; int tag; } tags[] = {
+            { "summary",     PKGUINF_SUMMARY     },
+            { "description", PKGUINF_DESCRIPTION },
+            { "url",         PKGUINF_URL         },
+            { "license",     PKGUINF_LICENSE     },
+            { "vendor",      PKGUINF_VENDOR      },
+            { "buildhost",   PKGUINF_BUILDHOST   },
+        };
+
+        for (unsigned i=0; i < sizeof(tags)/sizeof(tags[0]); i++)
+            json_str(nbuf, tags[i].key,
+                     pkgu ? pkguinf_get(pkgu, tags[i].tag) : NULL);
+
+        fn = pkg_srcfilename(pkg, fnbuf, sizeof(fnbuf));
+        if (fn == NULL && pkgu)
+            fn = pkguinf_get(pkgu, PKGUINF_LEGACY_SOURCERPM);
+        json_str(nbuf, "sourcerpm", fn);
+        json_str(nbuf, "path", pkg_pkgdirpath(pkg));
+    }
+
+    if (flags & OPT_DESC_CAPS)
+        json_capreqs(nbuf, "provides", pkg, pkg->caps, JSON_PROVIDES);
+
+    if (flags & OPT_DESC_REQS) {
+        json_capreqs(nbuf, "requires", pkg, pkg->reqs, JSON_REQUIRES);
+        json_capreqs(nbuf, "requires_pre", pkg, pkg->reqs, JSON_REQUIRES_PRE);
+        json_capreqs(nbuf, "requires_un", pkg, pkg->reqs, JSON_REQUIRES_UN);
+        json_capreqs(nbuf, "suggests", pkg, pkg->sugs, JSON_ANY);
+    }
+
+    if (flags & OPT_DESC_CNFLS) {
+        json_capreqs(nbuf, "conflicts", pkg, pkg->cnfls, JSON_CONFLICTS);
+        json_capreqs(nbuf, "obsoletes", pkg, pkg->cnfls, JSON_OBSOLETES);
+    }
+
+    if (flags & OPT_DESC_REQPKGS)
+        json_reqpkgs(nbuf, cmdctx, pkg);
+
+    if (flags & OPT_DESC_REVREQPKGS)
+        json_revreqpkgs(nbuf, cmdctx, pkg);
+
+    if ((flags & OPT_DESC_CHANGELOG) && pkgu)
+        json_str(nbuf, "changelog", get_changelog(cmdctx, pkg, pkgu));
+
+    if (flags & OPT_DESC_FL)
+        json_files(nbuf, pkg);
+
+    json_object_end(nbuf);
+    cmdctx_json_write(cmdctx, nbuf);
+}
+
 static int desc(struct cmdctx *cmdctx)
 {
     tn_array               *pkgs = NULL;
+    tn_buf                 *json = NULL;
     int                    i, err = 0, term_width;
     const char             *pwd;
 
@@ -1042,8 +1252,11 @@ static int desc(struct cmdctx *cmdctx)
         goto l_end;
     }
 
-    if (cmdctx->_flags == 0)
-        cmdctx->_flags = OPT_DESC_DESCR;
+    if ((cmdctx->_flags & ~OPT_DESC_JSON) == 0)
+        cmdctx->_flags |= OPT_DESC_DESCR;
+
+    if (cmdctx->_flags & OPT_DESC_JSON)
+        json = n_buf_new(4096);
 
     term_width = poldek_term_get_width() - RMARGIN;
     if (cmdctx->pipe_right)
@@ -1052,7 +1265,6 @@ static int desc(struct cmdctx *cmdctx)
     if (term_width < 50)
         term_width = 79 - RMARGIN;
 
-
     for (i=0; i < n_array_size(pkgs); i++) {
         struct pkg *pkg;
         struct pkguinf *pkgu = NULL;
@@ -1065,6 +1277,11 @@ static int desc(struct cmdctx *cmdctx)
                                "packages info loaded?)\n"), pkg_id(pkg));
         }
 
+        if (json) {
+            desc_json(cmdctx, json, pkg, pkgu, cmdctx->_flags);
+            goto l_next;
+        }
+
         cmdctx_printf(cmdctx, "\n");
         cmdctx_printf_c(cmdctx, PRCOLOR_YELLOW, "%-16s", "Package:");
         cmdctx_printf(cmdctx, "%s\n", pkg_id(pkg));
@@ -1083,6 +1300,7 @@ static int desc(struct cmdctx *cmdctx)
             show_files(cmdctx, pkg, cmdctx->_flags & OPT_DESC_FL_LONGFMT, term_width);
         }
 
+    l_next:
         if (pkgu) {
             pkguinf_free(pkgu);
             pkgu = NULL;
@@ -1093,6 +1311,8 @@ static int desc(struct cmdctx *cmdctx)
     }
 
  l_end:
+    if (json)
+        n_buf_free(json);
 
     n_array_cfree(&pkgs);
 
@@ -72,6 +72,7 @@ static int install(struct cmdctx *cmdctx);
 #define OPT_INST_PARSABLETS       (OPT_GID + 37)
 #define OPT_INST_MKDIR            (OPT_GID + 38)
 #define OPT_INST_CAPLOOKUP        (OPT_GID + 39)
+#define OPT_INST_PREFETCH         (OPT_GID + 40)
 
 static struct argp_option options[] = {
 {0, 'I', 0, 0, N_("Install, not upgrade packages"), OPT_GID },
@@ -97,6 +98,11 @@ N_("Install packages ignoring broken dependencies, conflicts, etc"), OPT_GID },
      N_("Download packages to DIR (poldek's cache directory by default)"
         "instead of install them"), OPT_GID },
 
+{"prefetch", OPT_INST_PREFETCH, 0, 0,
+     N_("Download packages to poldek's cache directory in the background "
+        "(with idle I/O priority), so later installation will not verify "
+        "them again"), OPT_GID },
+
 {"noask", OPT_INST_NOASK, 0, 0, N_("Don't ask about anything"), OPT_GID },
 
 {"nodeps", OPT_INST_NODEPS, 0, 0,
@@ -514,6 +520,11 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
             ts->setop(ts, POLDEK_OP_JUSTFETCH, 1);
             break;
 
+        case OPT_INST_PREFETCH:
+            ts->setop(ts, POLDEK_OP_JUSTFETCH, 1);
+            ts->setop(ts, POLDEK_OP_PREFETCH, 1);
+            break;
+
         case OPT_PMONLY_FORCE:
             poldek_ts_configure(ts, POLDEK_CONF_RPMOPTS, "--force");
             break;
@@ -0,0 +1,212 @@
+/*
+  Copyright (C) 2000 - 2008 Pawel A. Gajda <mis@pld-linux.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <trurl/nassert.h>
+#include <trurl/nbuf.h>
+
+#include "compiler.h"
+#include "pkg.h"
+#include "cmd_pipe.h"
+#include "json.h"
+
+/* separate from previous member unless we are just after an opening */
+static void json_sep(tn_buf *nbuf)
+{
+    int size = n_buf_size(nbuf);
+    char c;
+
+    if (size == 0)
+        return;
+
+    c = ((const char*)n_buf_ptr(nbuf))[size - 1];
+    if (c != '{' && c != '[')
+        n_buf_putc(nbuf, ',');
+}
+
+/* length of valid UTF-8 sequence at s, 0 if it is not */
+static int utf8_seqlen(const unsigned char *s)
+{
+    uint32_t c;
+    int i, n;
+
+    if (*s < 0xc2)              /* continuation byte or overlong */
+        return 0;
+
+    if (*s < 0xe0) {
+        n = 2;
+        c = *s & 0x1f;
+
+    } else if (*s < 0xf0) {
+        n = 3;
+        c = *s & 0x0f;
+
+    } else if (*s < 0xf5) {
+        n = 4;
+        c = *s & 0x07;
+
+    } else {
+        return 0;
+    }
+
+    for (i=1; i < n; i++) {     /* stops at '\0' too */
+        if ((s[i] & 0xc0) != 0x80)
+            return 0;
+        c = (c << 6) | (s[i] & 0x3f);
+    }
+
+    if ((n == 3 && c < 0x800) || (n == 4 && (c < 0x10000 || c > 0x10ffff)))
+        return 0;
+
+    if (c >= 0xd800 && c <= 0xdfff) /* surrogates */
+        return 0;
+
+    return n;
+}
+
+/* invalid UTF-8 bytes (headers of old packages are not always UTF-8)
+   are replaced with U+FFFD, output must be valid JSON */
+static void json_quote(tn_buf *nbuf, const char *s)
+{
+    const unsigned char *p = (const unsigned char*)s;
+
+    n_buf_putc(nbuf, '"');
+    while (*p) {
+        const unsigned char *q = p;
+        int n;
+
+        /* copy plain runs at once */
+        for (;;) {
+            if (*q >= 0x80 && (n = utf8_seqlen(q)) > 0)
+                q += n;
+
+            else if (*q >= 0x20 && *q < 0x80 && *q != '"' && *q != '\\')
+                q++;
+
+            else
+                break;
+        }
+
+        if (q > p)
+            n_buf_add(nbuf, p, q - p);
+
+        if (*q == '\0')
+            break;
+
+        switch (*q) {
+            case '"':  n_buf_puts(nbuf, "\\\""); break;
+            case '\\': n_buf_puts(nbuf, "\\\\"); break;
+            case '\n': n_buf_puts(nbuf, "\\n"); break;
+            case '\r': n_buf_puts(nbuf, "\\r"); break;
+            case '\t': n_buf_puts(nbuf, "\\t"); break;
+            default:
+                if (*q >= 0x80)
+                    n_buf_puts(nbuf, "\\ufffd");
+                else
+                    n_buf_printf(nbuf, "\\u%.4x", *q);
+                break;
+        }
+        p = q + 1;
+    }
+    n_buf_putc(nbuf, '"');
+}
+
+static void json_key(tn_buf *nbuf, const char *key)
+{
+    json_sep(nbuf);
+    if (key) {
+        json_quote(nbuf, key);
+        n_buf_putc(nbuf, ':');
+    }
+}
+
+void json_object_begin(tn_buf *nbuf, const char *key)
+{
+    json_key(nbuf, key);
+    n_buf_putc(nbuf, '{');
+}
+
+void json_object_end(tn_buf *nbuf)
+{
+    n_buf_putc(nbuf, '}');
+}
+
+void json_array_begin(tn_buf *nbuf, const char *key)
+{
+    json_key(nbuf, key);
+    n_buf_putc(nbuf, '[');
+}
+
+void json_array_end(tn_buf *nbuf)
+{
+    n_buf_putc(nbuf, ']');
+}
+
+void json_str(tn_buf *nbuf, const char *key, const char *val)
+{
+    json_key(nbuf, key);
+    if (val == NULL)
+        n_buf_puts(nbuf, "null");
+    else
+        json_quote(nbuf, val);
+}
+
+void json_int(tn_buf *nbuf, const char *key, long long val)
+{
+    json_key(nbuf, key);
+    n_buf_printf(nbuf, "%lld", val);
+}
+
+void json_pkg(tn_buf *nbuf, const struct pkg *pkg)
+{
+    json_str(nbuf, "name", pkg->name);
+    json_int(nbuf, "epoch", pkg->epoch);
+    json_str(nbuf, "version", pkg->ver);
+    json_str(nbuf, "release", pkg->rel);
+    json_str(nbuf, "arch", pkg_arch(pkg));
+    json_str(nbuf, "id", pkg_id(pkg));
+    json_int(nbuf, "size", pkg->size);
+    json_int(nbuf, "fsize", pkg->fsize);
+    json_int(nbuf, "buildtime", pkg->btime);
+    if (pkg->itime)
+        json_int(nbuf, "installtime", pkg->itime);
+    json_str(nbuf, "group", pkg_group(pkg));
+}
+
+/*
+  Not piped objects go straight to stdout, no colors, flushed one by one,
+  so the reader gets each object as soon as it is made.
+*/
+int cmdctx_json_write(struct cmdctx *cmdctx, tn_buf *nbuf)
+{
+    int n;
+
+    n_buf_putc(nbuf, '\n');
+    n = n_buf_size(nbuf);
+
+    if (cmdctx->pipe_right)
+        cmd_pipe_writeline(cmdctx->pipe_right, n_buf_ptr(nbuf), n);
+
+    else if (fwrite(n_buf_ptr(nbuf), 1, n, stdout) != (size_t)n ||
+             fflush(stdout) != 0)
+        n = -1;
+
+    n_buf_clean(nbuf);
+    return n;
+}
@@ -0,0 +1,38 @@
+/*
+  Copyright (C) 2000 - 2008 Pawel A. Gajda <mis@pld-linux.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef POCLIDEK_JSON_H
+#define POCLIDEK_JSON_H
+
+#include <trurl/nbuf.h>
+
+#include "cmd.h"
+#include "pkg.h"
+
+/*
+  --json output: one object per line, written out by cmdctx_json_write()
+  as soon as it is built. key is NULL for array items.
+*/
+void json_object_begin(tn_buf *nbuf, const char *key);
+void json_object_end(tn_buf *nbuf);
+void json_array_begin(tn_buf *nbuf, const char *key);
+void json_array_end(tn_buf *nbuf);
+
+void json_str(tn_buf *nbuf, const char *key, const char *val);
+void json_int(tn_buf *nbuf, const char *key, long long val);
+
+/* name, epoch, version, release, arch, id, sizes, times and group */
+void json_pkg(tn_buf *nbuf, const struct pkg *pkg);
+
+int cmdctx_json_write(struct cmdctx *cmdctx, tn_buf *nbuf);
+
+#endif
@@ -26,6 +26,7 @@
 #include "cli.h"
 #include "log.h"
 #include "ls_queryfmt.h"
+#include "json.h"
 #include "arg_packages.h"
 
 static int ls(struct cmdctx *cmdctx);
@@ -61,6 +62,7 @@ int pkg_cmp_lookup(struct pkg *lpkg, tn_array *pkgs, int compare_ver,
 #define OPT_LS_NOSTUBS         (1 << 15) /* need to operate on full packages */
 
 #define OPT_LS_ERR             (1 << 16)
+#define OPT_LS_JSON            (1 << 17)
 
 static struct argp_option options[] = {
  { "long", 'l', 0, 0, N_("Use a long listing format"), 1},
@@ -80,6 +82,7 @@ static struct argp_option options[] = {
  { 0, 0, 0, 0, N_("Query format options:"), 2},
  { "qf", OPT_LS_QUERYFMT, "QUERYFMT", 0, N_("Use the following query format"), 2},
  { "querytags", OPT_LS_QUERYTAGS, 0, 0, N_("Show supported tags"), 2},
+ { "json", OPT_LS_JSON, 0, 0, N_("Print packages as JSON objects, one per line"), 2},
  { 0, 0, 0, 0, 0, 0 },
 };
 
@@ -184,6 +187,11 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
 	    lsqf_show_querytags(cmdctx);
 	    return EINVAL;
 
+        case OPT_LS_JSON:
+            cmdctx->_flags |= OPT_LS_JSON | OPT_LS_NOSTUBS;
+            cmdctx->rtflags |= CMDCTX_NOCTRLMSGS;
+            break;
+
         default:
             return ARGP_ERR_UNKNOWN;
     }
@@ -499,6 +507,45 @@ static int print_pair(int colored, char *line, size_t size,
 }
 
 
+/* --qf output is collected and printed in large chunks */
+#define LS_QFBUF_SIZE (64 * 1024)
+
+static void qfbuf_flush(struct cmdctx *cmdctx, tn_buf *qfbuf)
+{
+    if (qfbuf && n_buf_size(qfbuf) > 0) {
+        cmdctx_printf(cmdctx, "%.*s", n_buf_size(qfbuf), (char*)n_buf_ptr(qfbuf));
+        n_buf_clean(qfbuf);
+    }
+}
+
+static void ls_json(struct cmdctx *cmdctx, tn_buf *nbuf, struct pkg *pkg,
+                    struct pkg *epkg)
+{
+    json_object_begin(nbuf, NULL);
+    json_pkg(nbuf, pkg);
+
+    if (cmdctx->_flags & OPT_LS_SOURCERPM) {
+        char buf[512];
+        json_str(nbuf, "sourcerpm", pkg_srcfilename(pkg, buf, sizeof(buf)));
+    }
+
+    if (cmdctx->_flags & OPT_LS_SUMMARY) {
+        struct pkguinf *pkgu = pkg_uinf(pkg);
+
+        json_str(nbuf, "summary",
+                 pkgu ? pkguinf_get(pkgu, PKGUINF_SUMMARY) : NULL);
+        if (pkgu)
+            pkguinf_free(pkgu);
+    }
+
+    if (epkg)                   /* -u: installed or available counterpart */
+        json_str(nbuf, (cmdctx->_flags & OPT_LS_INSTALLED) ?
+                 "available" : "installed", pkg_id(epkg));
+
+    json_object_end(nbuf);
+    cmdctx_json_write(cmdctx, nbuf);
+}
+
 static
 int do_ls(const tn_array *ents, struct cmdctx *cmdctx, const tn_array *evrs)
 {
@@ -506,6 +553,7 @@ int do_ls(const tn_array *ents, struct cmdctx *cmdctx, const tn_array *evrs)
     int                  i, size, err = 0, npkgs = 0;
     register int         incstep = 0;
     int                  term_width, term_width_div2;
+    tn_buf               *qfbuf = NULL;
     unsigned             flags;
 
     if (n_array_size(ents) == 0)
@@ -556,6 +604,27 @@ int do_ls(const tn_array *ents, struct cmdctx *cmdctx, const tn_array *evrs)
         i = n_array_size(ents) - 1;
     }
 
+    if (flags & OPT_LS_QUERYFMT)
+        qfbuf = n_buf_new(LS_QFBUF_SIZE + 4096);
+
+    if (flags & OPT_LS_JSON) {
+        tn_buf *nbuf = n_buf_new(1024);
+
+        while (i < n_array_size(ents) && i >= 0 && !sigint_reached()) {
+            struct pkg_dent *ent = n_array_nth(ents, i);
+
+            if (!pkg_dent_isdir(ent)) {
+                cmdctx_addtoresult(cmdctx, ent->pkg_dent_pkg);
+                ls_json(cmdctx, nbuf, ent->pkg_dent_pkg,
+                        evrs ? n_array_nth(evrs, i) : NULL);
+            }
+            i += incstep;
+        }
+
+        n_buf_free(nbuf);
+        return 1;
+    }
+
     while (i < n_array_size(ents) && i >= 0) {
         struct pkg_dent *ent = n_array_nth(ents, i);
         struct pkg      *pkg;
@@ -565,6 +634,7 @@ int do_ls(const tn_array *ents, struct cmdctx *cmdctx, const tn_array *evrs)
             break;
 
         if (pkg_dent_isdir(ent)) {
+            qfbuf_flush(cmdctx, qfbuf);
             cmdctx_printf_c(cmdctx, PRCOLOR_GREEN, "%s/\n", ent->name);
             i += incstep;
             continue;
@@ -594,13 +664,10 @@ int do_ls(const tn_array *ents, struct cmdctx *cmdctx, const tn_array *evrs)
 			  (term_width/7), srcrpm ? srcrpm : "(unset)");
 
         } else if (flags & OPT_LS_QUERYFMT) {
-	    char *queryfmt = NULL;
+	    lsqf_to_buf(cmdctx->_data, pkg, qfbuf);
 
-	    if ((queryfmt = lsqf_to_string(cmdctx->_data, pkg))) {
-		cmdctx_printf(cmdctx, "%s", queryfmt);
-
-                n_free(queryfmt);
-	    }
+	    if (n_buf_size(qfbuf) >= LS_QFBUF_SIZE)
+		qfbuf_flush(cmdctx, qfbuf);
 
         } else if ((flags & OPT_LS_LONG) == 0) {
             cmdctx_printf(cmdctx, "%s\n", pkg_name);
@@ -673,13 +740,20 @@ int do_ls(const tn_array *ents, struct cmdctx *cmdctx, const tn_array *evrs)
             n_assert(0);
         }
 
-        if (flags & OPT_LS_SUMMARY)
+        if (flags & OPT_LS_SUMMARY) {
+            qfbuf_flush(cmdctx, qfbuf);
             ls_summary(cmdctx, pkg);
+        }
 
         npkgs++;
         i += incstep;
     }
 
+    if (qfbuf) {
+        qfbuf_flush(cmdctx, qfbuf);
+        n_buf_free(qfbuf);
+    }
+
     if (npkgs) {
         char buf[1024];
         int n;
@@ -14,11 +14,7 @@
 # include "config.h"
 #endif
 
-/* for asprintf() from stdio.h */
-#ifndef _GNU_SOURCE
-# define _GNU_SOURCE
-#endif
-
+#include <limits.h>
 #include <sys/stat.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -37,9 +33,6 @@
 
 #define n_strcase_eq(s, p) (strcasecmp(s, p) == 0)
 
-/* to avoid gcc warn about ignored result */
-#define do_asprintf(buf, fmt, args...)   n_assert(asprintf(buf, fmt, ## args) >= 0)
-
 static const char *invalid_format = N_("invalid format:");
 
 enum LsqfParseMode {
@@ -155,25 +148,27 @@ static const struct lsqf_tags lsqf_tags[] = {
     { LSQF_N_TAGS,              0, 0, 0, { NULL } }
 };
 
+struct lsqf_file {
+    struct pkgfl_ent  *flent;
+    struct flfile     *file;
+};
+
+/* package data loaded on demand, once per package */
 struct lsqf_pkgdata {
     const struct pkg  *pkg;
     struct pkgflist   *flist;
     struct pkguinf    *uinf;
+    struct lsqf_file  *files;    /* flist flattened for FILE* tags */
+    int               nfiles;
+    tn_array          *cnfls;    /* pkg->cnfls split to conflicts */
+    tn_array          *obsls;    /* and obsoletes */
 };
 
-static struct lsqf_pkgdata *lsqf_pkgdata_new(const struct pkg *pkg)
+static void lsqf_pkgdata_init(struct lsqf_pkgdata *pkgdata, const struct pkg *pkg)
 {
-    struct lsqf_pkgdata *pkgdata = NULL;
-
-    pkgdata = n_malloc(sizeof(struct lsqf_pkgdata));
-
-    if (pkgdata) {
-	pkgdata->pkg = pkg;
-	pkgdata->flist = NULL;
-	pkgdata->uinf = NULL;
-    }
-
-    return pkgdata;
+    memset(pkgdata, 0, sizeof(*pkgdata));
+    pkgdata->pkg = pkg;
+    pkgdata->nfiles = -1;
 }
 
 static struct pkgflist *lsqf_pkgdata_flist(struct lsqf_pkgdata *pkgdata)
@@ -184,6 +179,64 @@ static struct pkgflist *lsqf_pkgdata_flist(struct lsqf_pkgdata *pkgdata)
     return pkgdata->flist;
 }
 
+static int lsqf_pkgdata_nfiles(struct lsqf_pkgdata *pkgdata)
+{
+    struct pkgflist *flist;
+    int i, j, n = 0;
+
+    if (pkgdata->nfiles >= 0)
+	return pkgdata->nfiles;
+
+    pkgdata->nfiles = 0;
+    if ((flist = lsqf_pkgdata_flist(pkgdata)) == NULL)
+	return 0;
+
+    for (i = 0; i < n_tuple_size(flist->fl); i++) {
+	struct pkgfl_ent *flent = n_tuple_nth(flist->fl, i);
+	n += flent->items;
+    }
+
+    pkgdata->files = n_malloc(sizeof(*pkgdata->files) * (n ? n : 1));
+
+    n = 0;
+    for (i = 0; i < n_tuple_size(flist->fl); i++) {
+	struct pkgfl_ent *flent = n_tuple_nth(flist->fl, i);
+
+	for (j = 0; j < flent->items; j++) {
+	    pkgdata->files[n].flent = flent;
+	    pkgdata->files[n].file = flent->files[j];
+	    n++;
+	}
+    }
+
+    pkgdata->nfiles = n;
+    return n;
+}
+
+static tn_array *lsqf_pkgdata_cnfls(struct lsqf_pkgdata *pkgdata, int obsoletes)
+{
+    const struct pkg *pkg = pkgdata->pkg;
+    int i;
+
+    if (pkgdata->cnfls == NULL) {
+	int n = pkg->cnfls ? n_array_size(pkg->cnfls) : 0;
+
+	pkgdata->cnfls = n_array_new(n ? n : 1, NULL, NULL);
+	pkgdata->obsls = n_array_new(n ? n : 1, NULL, NULL);
+
+	for (i = 0; i < n; i++) {
+	    struct capreq *cr = n_array_nth(pkg->cnfls, i);
+
+	    if (capreq_is_obsl(cr))
+		n_array_push(pkgdata->obsls, cr);
+	    else
+		n_array_push(pkgdata->cnfls, cr);
+	}
+    }
+
+    return obsoletes ? pkgdata->obsls : pkgdata->cnfls;
+}
+
 static struct pkguinf *lsqf_pkgdata_uinf(struct lsqf_pkgdata *pkgdata)
 {
     if (pkgdata->uinf == NULL)
@@ -192,16 +245,20 @@ static struct pkguinf *lsqf_pkgdata_uinf(struct lsqf_pkgdata *pkgdata)
     return pkgdata->uinf;
 }
 
-static void lsqf_pkgdata_free(struct lsqf_pkgdata *pkgdata)
+static void lsqf_pkgdata_destroy(struct lsqf_pkgdata *pkgdata)
 {
-    if (pkgdata) {
-	if (pkgdata->flist)
-	    pkgflist_free(pkgdata->flist);
+    if (pkgdata->flist)
+	pkgflist_free(pkgdata->flist);
+
+    if (pkgdata->uinf)
+	pkguinf_free(pkgdata->uinf);
 
-	if (pkgdata->uinf)
-	    pkguinf_free(pkgdata->uinf);
+    if (pkgdata->files)
+	n_free(pkgdata->files);
 
-	n_free(pkgdata);
+    if (pkgdata->cnfls) {
+	n_array_free(pkgdata->cnfls);
+	n_array_free(pkgdata->obsls);
     }
 }
 
@@ -258,32 +315,26 @@ static int capreq_snprintf_evr(char *str, size_t size, const struct capreq *cr)
     return n;
 }
 
-static char *format_date(int outfmtfnid, uint32_t time)
+static const char *format_date(int outfmtfnid, uint32_t time, char *buf, int size)
 {
-    char *buf = NULL, datestr[32];
-
-    if (outfmtfnid == LSQF_TAG_OUTFMTFN_DATE) {
-	strftime(datestr, sizeof(datestr), "%c", gmtime((time_t *)&time));
-	do_asprintf(&buf, "%s", datestr);
-    } else if (outfmtfnid == LSQF_TAG_OUTFMTFN_DAY) {
-	strftime(datestr, sizeof(datestr), "%a %b %d %Y", gmtime((time_t *)&time));
-	do_asprintf(&buf, "%s", datestr);
-    } else {
-	do_asprintf(&buf, "%u", time);
-    }
+    time_t t = time;
+
+    if (outfmtfnid == LSQF_TAG_OUTFMTFN_DATE)
+	strftime(buf, size, "%c", gmtime(&t));
+    else if (outfmtfnid == LSQF_TAG_OUTFMTFN_DAY)
+	strftime(buf, size, "%a %b %d %Y", gmtime(&t));
+    else
+	n_snprintf(buf, size, "%u", time);
 
     return buf;
 }
 
-static char *format_flags(int outfmtfnid, struct capreq *cr)
+static const char *format_flags(int outfmtfnid, struct capreq *cr, char *buf, int size)
 {
-    char *buf = NULL;
-
     if (outfmtfnid == LSQF_TAG_OUTFMTFN_DEPFLAGS) {
-	char relstr[3], *p;
+	char *p = buf;
 
-	p = relstr;
-	*p = '\0';
+	*p++ = ' ';
 
 	if (cr->cr_relflags & REL_LT)
 	    *p++ = '<';
@@ -293,266 +344,227 @@ static char *format_flags(int outfmtfnid, struct capreq *cr)
 	if (cr->cr_relflags & REL_EQ)
 	    *p++ = '=';
 
+	*p++ = ' ';
 	*p = '\0';
-
-	do_asprintf(&buf, " %s ", relstr);
     } else {
-	do_asprintf(&buf, "%u", cr->cr_relflags);
+	n_snprintf(buf, size, "%u", cr->cr_relflags);
     }
 
     return buf;
 }
 
-static char *get_str_by_tagid(const struct lsqf_ent *ent, struct lsqf_pkgdata *pkgdata,
-                              int num)
+static const char *format_evr(struct capreq *cr, char *buf, int size)
+{
+    if (capreq_snprintf_evr(buf, size, cr) > 0)
+	return buf;
+
+    return NULL;
+}
+
+/**
+ * get_str_by_tagid:
+ *
+ * Returns: tag value, either package's own string or one formatted in buf,
+ * NULL if there is nothing to print.
+ **/
+static const char *get_str_by_tagid(const struct lsqf_ent *ent, struct lsqf_pkgdata *pkgdata,
+                                    int num, char *buf, int size)
 {
     const struct pkg *pkg = pkgdata->pkg;
     struct capreq *c = NULL;
-    char *buf = NULL, evr[32];
-    int i;
+    tn_array *cnfls;
+    const char *str = NULL;
 
     if (lsqf_tags[ent->tag.id].need_uinf) {
 	struct pkguinf *pkgu = lsqf_pkgdata_uinf(pkgdata);
-	const char *str = NULL;
-
-	switch (ent->tag.id) {
-	    case LSQF_TAG_BUILDHOST:
-		str = pkguinf_get(pkgu, PKGUINF_BUILDHOST);
-		break;
 
-	    case LSQF_TAG_DESCRIPTION:
-		str = pkguinf_get(pkgu, PKGUINF_DESCRIPTION);
-		break;
-
-	    case LSQF_TAG_LICENSE:
-		str = pkguinf_get(pkgu, PKGUINF_LICENSE);
-		break;
-
-	    case LSQF_TAG_SUMMARY:
-		str = pkguinf_get(pkgu, PKGUINF_SUMMARY);
-		break;
-
-	    case LSQF_TAG_URL:
-		str = pkguinf_get(pkgu, PKGUINF_URL);
-		break;
-
-	    case LSQF_TAG_VENDOR:
-		str = pkguinf_get(pkgu, PKGUINF_VENDOR);
-		break;
-
-	    default:
-		n_assert(0);
-	}
-
-	if (str)
-	    buf = n_strdup(str);
-	else
-	    buf = n_strdup("(none)");
+	if (pkgu) {
+	    switch (ent->tag.id) {
+		case LSQF_TAG_BUILDHOST:
+		    str = pkguinf_get(pkgu, PKGUINF_BUILDHOST);
+		    break;
 
-    } else if (lsqf_tags[ent->tag.id].need_flist) {
-	struct pkgflist *flist = lsqf_pkgdata_flist(pkgdata);
-	struct pkgfl_ent *flent = NULL;
+		case LSQF_TAG_DESCRIPTION:
+		    str = pkguinf_get(pkgu, PKGUINF_DESCRIPTION);
+		    break;
 
-	if (flist) {
-	    switch (ent->tag.id) {
-		case LSQF_TAG_BASENAMES:
-    		case LSQF_TAG_FILELINKTOS:
-    		case LSQF_TAG_FILEMODES:
-    		case LSQF_TAG_FILENAMES:
-		case LSQF_TAG_FILESIZES:
-		    for (i = 0; i < n_tuple_size(flist->fl); i++) {
-			flent = n_tuple_nth(flist->fl, i);
-
-			if (flent->items <= num)
-			    num -= flent->items;
-			else
-			    break;
-		    }
-
-		    if (ent->tag.id == LSQF_TAG_BASENAMES)
-			buf = n_strdup(flent->files[num]->basename);
-		    else if (ent->tag.id == LSQF_TAG_FILEMODES)
-			do_asprintf(&buf, "%u", flent->files[num]->mode);
-		    else if (ent->tag.id == LSQF_TAG_FILENAMES) {
-			if (*flent->dirname == '/')
-			    do_asprintf(&buf, "%s%s", flent->dirname, flent->files[num]->basename);
-			else
-			    do_asprintf(&buf, "/%s%s%s", flent->dirname,
-						      *flent->files[num]->basename ? "/" : "",
-						      flent->files[num]->basename);
-		    } else if (ent->tag.id == LSQF_TAG_FILESIZES)
-			do_asprintf(&buf, "%u", flent->files[num]->size);
-		    else
-			if (S_ISLNK(flent->files[num]->mode))
-			    buf = n_strdup(flent->files[num]->basename + strlen(flent->files[num]->basename) + 1);
+		case LSQF_TAG_LICENSE:
+		    str = pkguinf_get(pkgu, PKGUINF_LICENSE);
+		    break;
 
+		case LSQF_TAG_SUMMARY:
+		    str = pkguinf_get(pkgu, PKGUINF_SUMMARY);
 		    break;
 
-		case LSQF_TAG_DIRNAMES:
-		    flent = n_tuple_nth(flist->fl, num);
+		case LSQF_TAG_URL:
+		    str = pkguinf_get(pkgu, PKGUINF_URL);
+		    break;
 
-		    do_asprintf(&buf, "%s%s", *flent->dirname == '/' ? "" : "/",
-					   flent->dirname);
+		case LSQF_TAG_VENDOR:
+		    str = pkguinf_get(pkgu, PKGUINF_VENDOR);
 		    break;
 
 		default:
 		    n_assert(0);
 	    }
 	}
-    } else {
-	switch (ent->tag.id) {
-	    case LSQF_TAG_ARCH:
-		buf = n_strdup(pkg_arch(pkg));
-		break;
 
-	    case LSQF_TAG_BUILDTIME:
-		buf = format_date(ent->tag.outfmtfnid, pkg->btime);
-		break;
+	return str ? str : "(none)";
+    }
 
-	    case LSQF_TAG_CONFLICTFLAGS:
-	    case LSQF_TAG_CONFLICTS:
-	    case LSQF_TAG_CONFLICTVERSION:
-	    case LSQF_TAG_OBSOLETEFLAGS:
-	    case LSQF_TAG_OBSOLETES:
-	    case LSQF_TAG_OBSOLETEVERSION:
-	    {
-		int n = 0;
-
-		for (i = 0; i < n_array_size(pkg->cnfls); i++) {
-		    struct capreq *cr = n_array_nth(pkg->cnfls, i);
-
-		    if (ent->tag.id == LSQF_TAG_CONFLICTS || ent->tag.id == LSQF_TAG_CONFLICTFLAGS) {
-			if (!capreq_is_obsl(cr)) {
-			    if (n == num) {
-				c = cr;
-				break;
-			    }
-
-			    n++;
-			}
-		    } else {
-			if (capreq_is_obsl(cr)) {
-			    if (n == num) {
-				c = cr;
-				break;
-			    }
-
-			    n++;
-			}
-		    }
-		}
+    if (lsqf_tags[ent->tag.id].need_flist) {
+	struct pkgflist *flist;
+	struct pkgfl_ent *flent;
+	struct flfile *file;
 
-		if (c) {
-		    if (ent->tag.id == LSQF_TAG_CONFLICTS || ent->tag.id == LSQF_TAG_OBSOLETES)
-			buf = n_strdup(capreq_name(c));
-		    else if (ent->tag.id == LSQF_TAG_CONFLICTFLAGS || ent->tag.id == LSQF_TAG_OBSOLETEFLAGS)
-			buf = format_flags(ent->tag.outfmtfnid, c);
-		    else if (ent->tag.id == LSQF_TAG_CONFLICTVERSION || ent->tag.id == LSQF_TAG_OBSOLETEVERSION)
-			if (capreq_snprintf_evr(evr, sizeof(evr), c) > 0)
-			    buf = n_strdup(evr);
+	if (ent->tag.id == LSQF_TAG_DIRNAMES) {
+	    if ((flist = lsqf_pkgdata_flist(pkgdata)) == NULL)
+		return NULL;
 
-		}
-		break;
-	    }
+	    flent = n_tuple_nth(flist->fl, num);
+	    n_snprintf(buf, size, "%s%s", *flent->dirname == '/' ? "" : "/",
+		       flent->dirname);
+	    return buf;
+	}
 
-	    case LSQF_TAG_EPOCH:
-		do_asprintf(&buf, "%d", pkg->epoch);
-		break;
+	if (num >= lsqf_pkgdata_nfiles(pkgdata))
+	    return NULL;
 
-	    case LSQF_TAG_GROUP:
-		buf = n_strdup(pkg_group(pkg));
-		break;
+	flent = pkgdata->files[num].flent;
+	file = pkgdata->files[num].file;
 
-	    case LSQF_TAG_NAME:
-		buf = n_strdup(pkg->name);
-		break;
+	switch (ent->tag.id) {
+	    case LSQF_TAG_BASENAMES:
+		return file->basename;
 
-	    case LSQF_TAG_NVRA:
-		buf = n_strdup(pkg_id(pkg));
-		break;
+	    case LSQF_TAG_FILEMODES:
+		n_snprintf(buf, size, "%u", file->mode);
+		return buf;
 
-	    case LSQF_TAG_PACKAGECOLOR:
-		do_asprintf(&buf, "%d", pkg->color);
-		break;
+	    case LSQF_TAG_FILENAMES:
+		if (*flent->dirname == '/')
+		    n_snprintf(buf, size, "%s%s", flent->dirname, file->basename);
+		else
+		    n_snprintf(buf, size, "/%s%s%s", flent->dirname,
+			       *file->basename ? "/" : "", file->basename);
+		return buf;
 
-	    case LSQF_TAG_PROVIDEFLAGS:
-		buf = format_flags(ent->tag.outfmtfnid, n_array_nth(pkg->caps, num));
-		break;
+	    case LSQF_TAG_FILESIZES:
+		n_snprintf(buf, size, "%u", file->size);
+		return buf;
 
-	    case LSQF_TAG_PROVIDES:
-		c = n_array_nth(pkg->caps, num);
-		buf = n_strdup(capreq_name(c));
-		break;
+	    case LSQF_TAG_FILELINKTOS:
+		if (S_ISLNK(file->mode))
+		    return file->basename + strlen(file->basename) + 1;
+		return NULL;
 
-	    case LSQF_TAG_PROVIDEVERSION:
-		c = n_array_nth(pkg->caps, num);
+	    default:
+		n_assert(0);
+	}
+    }
 
-		if (capreq_snprintf_evr(evr, sizeof(evr), c) > 0)
-		    buf = n_strdup(evr);
+    switch (ent->tag.id) {
+	case LSQF_TAG_ARCH:
+	    return pkg_arch(pkg);
+
+	case LSQF_TAG_BUILDTIME:
+	    return format_date(ent->tag.outfmtfnid, pkg->btime, buf, size);
+
+	case LSQF_TAG_CONFLICTFLAGS:
+	case LSQF_TAG_CONFLICTS:
+	case LSQF_TAG_CONFLICTVERSION:
+	case LSQF_TAG_OBSOLETEFLAGS:
+	case LSQF_TAG_OBSOLETES:
+	case LSQF_TAG_OBSOLETEVERSION:
+	{
+	    int obsl = (ent->tag.id == LSQF_TAG_OBSOLETEFLAGS ||
+			ent->tag.id == LSQF_TAG_OBSOLETES ||
+			ent->tag.id == LSQF_TAG_OBSOLETEVERSION);
+
+	    cnfls = lsqf_pkgdata_cnfls(pkgdata, obsl);
+	    if (num >= n_array_size(cnfls))
+		return NULL;
+
+	    c = n_array_nth(cnfls, num);
+
+	    if (ent->tag.id == LSQF_TAG_CONFLICTS || ent->tag.id == LSQF_TAG_OBSOLETES)
+		return capreq_name(c);
+	    else if (ent->tag.id == LSQF_TAG_CONFLICTFLAGS || ent->tag.id == LSQF_TAG_OBSOLETEFLAGS)
+		return format_flags(ent->tag.outfmtfnid, c, buf, size);
+	    else
+		return format_evr(c, buf, size);
+	}
 
-		break;
+	case LSQF_TAG_EPOCH:
+	    n_snprintf(buf, size, "%d", pkg->epoch);
+	    return buf;
 
-	    case LSQF_TAG_RELEASE:
-		buf = n_strdup(pkg->rel);
-		break;
+	case LSQF_TAG_GROUP:
+	    return pkg_group(pkg);
 
-	    case LSQF_TAG_REQUIREFLAGS:
-		buf = format_flags(ent->tag.outfmtfnid, n_array_nth(pkg->reqs, num));
-		break;
+	case LSQF_TAG_NAME:
+	    return pkg->name;
 
-	    case LSQF_TAG_REQUIRES:
-		c = n_array_nth(pkg->reqs, num);
+	case LSQF_TAG_NVRA:
+	    return pkg_id(pkg);
 
-		if (capreq_is_rpmlib(c))
-		    do_asprintf(&buf, "rpmlib(%s)", capreq_name(c));
-		else
-		    buf = n_strdup(capreq_name(c));
+	case LSQF_TAG_PACKAGECOLOR:
+	    n_snprintf(buf, size, "%d", pkg->color);
+	    return buf;
 
-		break;
+	case LSQF_TAG_PROVIDEFLAGS:
+	    return format_flags(ent->tag.outfmtfnid, n_array_nth(pkg->caps, num), buf, size);
 
-	    case LSQF_TAG_REQUIREVERSION:
-		c = n_array_nth(pkg->reqs, num);
+	case LSQF_TAG_PROVIDES:
+	    c = n_array_nth(pkg->caps, num);
+	    return capreq_name(c);
 
-		if (capreq_snprintf_evr(evr, sizeof(evr), c) > 0)
-		    buf = n_strdup(evr);
+	case LSQF_TAG_PROVIDEVERSION:
+	    return format_evr(n_array_nth(pkg->caps, num), buf, size);
 
-		break;
+	case LSQF_TAG_RELEASE:
+	    return pkg->rel;
 
-	    case LSQF_TAG_VERSION:
-		buf = n_strdup(pkg->ver);
-		break;
+	case LSQF_TAG_REQUIREFLAGS:
+	    return format_flags(ent->tag.outfmtfnid, n_array_nth(pkg->reqs, num), buf, size);
 
-	    case LSQF_TAG_SIZE:
-		do_asprintf(&buf, "%u", pkg->size);
-		break;
+	case LSQF_TAG_REQUIRES:
+	    c = n_array_nth(pkg->reqs, num);
 
-	    case LSQF_TAG_SOURCERPM:
-		buf = n_strdup(pkg_srcfilename_s(pkg));
-		break;
+	    if (capreq_is_rpmlib(c)) {
+		n_snprintf(buf, size, "rpmlib(%s)", capreq_name(c));
+		return buf;
+	    }
+	    return capreq_name(c);
 
-	    case LSQF_TAG_SUGGESTSFLAGS:
-		buf = format_flags(ent->tag.outfmtfnid, n_array_nth(pkg->sugs, num));
-		break;
+	case LSQF_TAG_REQUIREVERSION:
+	    return format_evr(n_array_nth(pkg->reqs, num), buf, size);
 
-	    case LSQF_TAG_SUGGESTS:
-		c = n_array_nth(pkg->sugs, num);
-		buf = n_strdup(capreq_name(c));
-		break;
+	case LSQF_TAG_VERSION:
+	    return pkg->ver;
 
-	    case LSQF_TAG_SUGGESTSVERSION:
-		c = n_array_nth(pkg->sugs, num);
+	case LSQF_TAG_SIZE:
+	    n_snprintf(buf, size, "%u", pkg->size);
+	    return buf;
 
-		if (capreq_snprintf_evr(evr, sizeof(evr), c) > 0)
-		    buf = n_strdup(evr);
+	case LSQF_TAG_SOURCERPM:
+	    return pkg_srcfilename(pkg, buf, size);
 
-		break;
+	case LSQF_TAG_SUGGESTSFLAGS:
+	    return format_flags(ent->tag.outfmtfnid, n_array_nth(pkg->sugs, num), buf, size);
 
-	    default:
-		n_assert(0);
-	}
+	case LSQF_TAG_SUGGESTS:
+	    c = n_array_nth(pkg->sugs, num);
+	    return capreq_name(c);
+
+	case LSQF_TAG_SUGGESTSVERSION:
+	    return format_evr(n_array_nth(pkg->sugs, num), buf, size);
+
+	default:
+	    n_assert(0);
     }
 
-    return buf;
+    return NULL;
 }
 
 static char get_escaped_char(char zn)
@@ -872,7 +884,6 @@ struct lsqf_ent_array *lsqf_parse(char *fmt)
 static int get_tag_array_size(const struct lsqf_ent *ent, struct lsqf_pkgdata *pkgdata)
 {
     const struct pkg *pkg = pkgdata->pkg;
-    int i;
     int size = 1;
 
     n_assert(ent->type == LSQF_ENT_TYPE_TAG);
@@ -880,85 +891,59 @@ static int get_tag_array_size(const struct lsqf_ent *ent, struct lsqf_pkgdata *p
     if (lsqf_tags[ent->tag.id].is_array) {
 	size = 0;
 
-	if (lsqf_tags[ent->tag.id].need_flist) {
-	    struct pkgflist *flist = lsqf_pkgdata_flist(pkgdata);
-
-	    if (flist) {
-		switch (ent->tag.id) {
-		    case LSQF_TAG_BASENAMES:
-		    case LSQF_TAG_FILELINKTOS:
-		    case LSQF_TAG_FILEMODES:
-		    case LSQF_TAG_FILENAMES:
-		    case LSQF_TAG_FILESIZES:
-			for (i = 0; i < n_tuple_size(flist->fl); i++) {
-			    struct pkgfl_ent *flent = n_tuple_nth(flist->fl, i);
-
-			    size += flent->items;
-			}
-
-			break;
+	switch (ent->tag.id) {
+	    case LSQF_TAG_BASENAMES:
+	    case LSQF_TAG_FILELINKTOS:
+	    case LSQF_TAG_FILEMODES:
+	    case LSQF_TAG_FILENAMES:
+	    case LSQF_TAG_FILESIZES:
+		size = lsqf_pkgdata_nfiles(pkgdata);
+		break;
 
-	    	    case LSQF_TAG_DIRNAMES:
-		        size = n_tuple_size(flist->fl);
-			break;
+	    case LSQF_TAG_DIRNAMES:
+	    {
+		struct pkgflist *flist = lsqf_pkgdata_flist(pkgdata);
 
-		    default:
-			n_assert(0);
-		}
+		if (flist)
+		    size = n_tuple_size(flist->fl);
+		break;
 	    }
-	} else {
-	    switch (ent->tag.id) {
-		case LSQF_TAG_CONFLICTFLAGS:
-		case LSQF_TAG_CONFLICTS:
-		case LSQF_TAG_CONFLICTVERSION:
-		case LSQF_TAG_OBSOLETEFLAGS:
-		case LSQF_TAG_OBSOLETES:
-		case LSQF_TAG_OBSOLETEVERSION:
-		    if (pkg->cnfls) {
-			int nobsl = 0, ncnfls = 0;
-
-			for (i = 0; i < n_array_size(pkg->cnfls); i++) {
-			    struct capreq *cr = n_array_nth(pkg->cnfls, i);
-
-			    if (capreq_is_obsl(cr))
-				nobsl++;
-			    else
-				ncnfls++;
-			}
-
-			if (ent->tag.id == LSQF_TAG_CONFLICTFLAGS || ent->tag.id == LSQF_TAG_CONFLICTS
-			 || ent->tag.id == LSQF_TAG_CONFLICTVERSION)
-			    size = ncnfls;
-			else
-			    size = nobsl;
-		    }
 
-		    break;
+	    case LSQF_TAG_CONFLICTFLAGS:
+	    case LSQF_TAG_CONFLICTS:
+	    case LSQF_TAG_CONFLICTVERSION:
+		size = n_array_size(lsqf_pkgdata_cnfls(pkgdata, 0));
+		break;
 
-		case LSQF_TAG_PROVIDEFLAGS:
-		case LSQF_TAG_PROVIDES:
-		case LSQF_TAG_PROVIDEVERSION:
-		    if (pkg->caps)
-			size = n_array_size(pkg->caps);
-		    break;
+	    case LSQF_TAG_OBSOLETEFLAGS:
+	    case LSQF_TAG_OBSOLETES:
+	    case LSQF_TAG_OBSOLETEVERSION:
+		size = n_array_size(lsqf_pkgdata_cnfls(pkgdata, 1));
+		break;
 
-		case LSQF_TAG_REQUIREFLAGS:
-		case LSQF_TAG_REQUIRES:
-		case LSQF_TAG_REQUIREVERSION:
-		    if (pkg->reqs)
-			size = n_array_size(pkg->reqs);
-		    break;
+	    case LSQF_TAG_PROVIDEFLAGS:
+	    case LSQF_TAG_PROVIDES:
+	    case LSQF_TAG_PROVIDEVERSION:
+		if (pkg->caps)
+		    size = n_array_size(pkg->caps);
+		break;
 
-		case LSQF_TAG_SUGGESTSFLAGS:
-		case LSQF_TAG_SUGGESTS:
-		case LSQF_TAG_SUGGESTSVERSION:
-		    if (pkg->sugs)
-			size = n_array_size(pkg->sugs);
-		    break;
+	    case LSQF_TAG_REQUIREFLAGS:
+	    case LSQF_TAG_REQUIRES:
+	    case LSQF_TAG_REQUIREVERSION:
+		if (pkg->reqs)
+		    size = n_array_size(pkg->reqs);
+		break;
 
-		default:
-		    n_assert(0);
-	    }
+	    case LSQF_TAG_SUGGESTSFLAGS:
+	    case LSQF_TAG_SUGGESTS:
+	    case LSQF_TAG_SUGGESTSVERSION:
+		if (pkg->sugs)
+		    size = n_array_size(pkg->sugs);
+		break;
+
+	    default:
+		n_assert(0);
 	}
     }
 
@@ -1000,28 +985,63 @@ static int check_size(const struct lsqf_ent_array *array, struct lsqf_pkgdata *p
     return 0;
 }
 
+/**
+ * check_arrays:
+ *
+ * Validates sizes of (nested) arrays which are going to be printed, so
+ * nothing is written to the output buffer for invalid format.
+ *
+ * Returns: 1 on error.
+ **/
+static int check_arrays(const struct lsqf_ent_array *array, struct lsqf_pkgdata *pkgdata)
+{
+    unsigned int i, size = 0;
+
+    for (i = 0; i < array->items; i++) {
+	struct lsqf_ent *ent = array->ents[i];
+
+	if (ent->type != LSQF_ENT_TYPE_ARRAY)
+	    continue;
+
+	if (check_size(ent->array, pkgdata, &size)) {
+	    logn(LOGERR, _("%s array iterator used with different sized arrays"), invalid_format);
+	    return 1;
+	}
+
+	if (size > 0 && check_arrays(ent->array, pkgdata))
+	    return 1;
+    }
+
+    return 0;
+}
+
+static void add_padded_str(tn_buf *nbuf, int pad, const char *str)
+{
+    if (pad == 0)
+	n_buf_puts_z(nbuf, str);
+    else
+	n_buf_printf(nbuf, "%*s", pad, str);
+}
+
 static void add_tagstr_to_nbuf(tn_buf *nbuf, const struct lsqf_ent *ent, struct lsqf_pkgdata *pkgdata, unsigned int num)
 {
-    char *str = NULL, fmt[16];
+    char buf[PATH_MAX];
+    const char *str;
 
     if (ent->tag.countArray) {
-	n_snprintf(fmt, sizeof(fmt), "%%%dd", ent->tag.pad);
-	n_buf_printf(nbuf, fmt, get_tag_array_size(ent, pkgdata));
-
-    } else if ((str = get_str_by_tagid(ent, pkgdata, num))) {
-	n_snprintf(fmt, sizeof(fmt), "%%%ds", ent->tag.pad);
-	n_buf_printf(nbuf, fmt, str);
+	n_buf_printf(nbuf, "%*d", ent->tag.pad, get_tag_array_size(ent, pkgdata));
 
-	n_free(str);
+    } else if ((str = get_str_by_tagid(ent, pkgdata, num, buf, sizeof(buf)))) {
+	add_padded_str(nbuf, ent->tag.pad, str);
     }
 }
 
 /**
  * tags_size - number of items in tags. It's mostly used by tag-arrays (for example REQUIRES)
  */
-static int ent_array_to_string(const struct lsqf_ent_array *array,
-                               struct lsqf_pkgdata *pkgdata,
-                               tn_buf *nbuf, int tags_size)
+static void ent_array_to_string(const struct lsqf_ent_array *array,
+                                struct lsqf_pkgdata *pkgdata,
+                                tn_buf *nbuf, int tags_size)
 {
     unsigned i, size = 0;
     int j;
@@ -1029,7 +1049,6 @@ static int ent_array_to_string(const struct lsqf_ent_array *array,
     for (j = 0; j < tags_size; j++) {
 	for (i = 0; i < array->items; i++) {
 	    struct lsqf_ent *ent = array->ents[i];
-	    int ret = 1;
 
 	    switch (ent->type) {
 		case LSQF_ENT_TYPE_TAG:
@@ -1041,45 +1060,60 @@ static int ent_array_to_string(const struct lsqf_ent_array *array,
 		    break;
 
 		case LSQF_ENT_TYPE_ARRAY:
-		    if (check_size(ent->array, pkgdata, &size)) {
-			logn(LOGERR, _("%s array iterator used with different sized arrays"), invalid_format);
-			ret = 0;
-		    } else {
-			ret = ent_array_to_string(ent->array, pkgdata, nbuf, size);
-		    }
-
+		    /* sizes are verified by check_arrays() */
+		    if (check_size(ent->array, pkgdata, &size) == 0)
+			ent_array_to_string(ent->array, pkgdata, nbuf, size);
 		    break;
 
 		default:
 		    n_assert(0);
 	    }
-
-	    /* break on error */
-	    if (ret == 0)
-		return 0;
 	}
     }
+}
 
-    return 1;
+/**
+ * lsqf_to_buf:
+ *
+ * Appends pkg formatted according to array to nbuf. Package info and file
+ * list are loaded only if the format refers to them.
+ *
+ * Returns: 1 on success, 0 if format cannot be applied to pkg.
+ **/
+int lsqf_to_buf(const struct lsqf_ent_array *array, const struct pkg *pkg, tn_buf *nbuf)
+{
+    struct lsqf_pkgdata pkgdata;
+    int rc = 0;
+
+    lsqf_pkgdata_init(&pkgdata, pkg);
+
+    if (check_arrays(array, &pkgdata) == 0) {
+	/* In the first array there can't be more than one item per tag,
+	 * so force tags_size = 1 */
+	ent_array_to_string(array, &pkgdata, nbuf, 1);
+	rc = 1;
+    }
+
+    lsqf_pkgdata_destroy(&pkgdata);
+
+    return rc;
 }
 
 char *lsqf_to_string(const struct lsqf_ent_array *array, const struct pkg *pkg)
 {
-    struct lsqf_pkgdata *pkgdata = NULL;
     tn_buf		*nbuf = NULL;
     char		*buf = NULL;
 
-    pkgdata = lsqf_pkgdata_new(pkg);
     nbuf = n_buf_new(64);
 
-    /* In the first array there can't be more than one item per tag,
-     * so force tags_size = 1 */
-    if (ent_array_to_string(array, pkgdata, nbuf, 1)) {
-	buf = n_strdup(n_buf_ptr(nbuf));
+    if (lsqf_to_buf(array, pkg, nbuf)) {
+	if (n_buf_size(nbuf) > 0)
+	    buf = n_strdupl(n_buf_ptr(nbuf), n_buf_size(nbuf));
+	else
+	    buf = n_strdup("");
     }
 
     n_buf_free(nbuf);
-    lsqf_pkgdata_free(pkgdata);
 
     return buf;
 }
@@ -43,6 +43,8 @@
 #endif
 
 extern int poclidek_shell(struct poclidek_ctx *cctx);
+extern int poclidek_daemon(struct poclidek_ctx *cctx, const char *sockpath,
+                           char **argv);
 
 const char *argp_program_version = poldek_VERSION_BANNER;
 const char *argp_program_bug_address = poldek_BUG_MAILADDR;
@@ -82,6 +84,7 @@ static void argp_as_docbook(struct argp *argp);
 #define OPT_NOPROGRESS          (OPT_GID + 20)
 #define OPT_FORCECOLOR        (OPT_GID + 21)
 #define OPT_DOCB              (OPT_GID + 24)
+#define OPT_DAEMON            (OPT_GID + 25)
 
 #define OPT_AS_FLAG(OPT)       (1 << (OPT - OPT_GID))
 
@@ -107,6 +110,9 @@ static struct argp_option common_options[] = {
 
 {"shcmd", OPT_SHELL_CMD, "COMMAND", OPTION_HIDDEN,
                  N_("Run poldek shell COMMAND and exit"), OPT_GID },
+{"daemon", OPT_DAEMON, "SOCKET", 0,
+     N_("Keep packages loaded and run shell commands read from unix "
+        "SOCKET"), OPT_GID },
 
 {"skip-installed", OPT_SKIPINSTALLED, 0, 0,
      N_("Don't load installed packages at startup"), OPT_GID },
@@ -178,6 +184,8 @@ struct args {
     char        *path_log;
 
     char        *shcmd;
+    char        *daemon_sock;
+    char        **main_argv;
 
     tn_array    *opgroup_rts;
 
@@ -282,6 +290,12 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
             argsp->cnflags |= OPT_AS_FLAG(OPT_SHELL);
             break;
 
+        case OPT_DAEMON:
+            argsp->daemon_sock = arg;
+            argsp->mjrmode = MODE_SHELL;
+            argsp->cnflags |= OPT_AS_FLAG(OPT_SHELL);
+            break;
+
         case 'f':
             logn(LOGWARN, "-f is obsoleted, use --skip-installed instead");
             /* fallthru */
@@ -650,6 +664,9 @@ static int run_poldek(struct poclidek_ctx *cctx)
     if (g_args.shcmd) {
         // batch mode
         rc = poclidek_execline(cctx, g_args.ts, g_args.shcmd);
+    } else if (g_args.daemon_sock) {
+        poclidek_setup(cctx);
+        rc = poclidek_daemon(cctx, g_args.daemon_sock, g_args.main_argv);
     } else {
         // shell
         poclidek_setup(cctx);
@@ -714,6 +731,7 @@ int main(int argc, char **argv)
     cctx = poclidek_new(ctx);
 
     parse_options(cctx, ts, argc, argv, mode);
+    g_args.main_argv = argv;    /* for daemon restart */
 
     if (!poldek_setup(ctx))
         exit(EXIT_FAILURE);
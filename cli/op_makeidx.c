@@ -84,6 +84,14 @@ static struct mopt valid_mopts[] = {
     },
 
     { "nodiff", PKGDIR_CREAT_NOPATCH, N_("Don't create index delta files") },
+    {
+        "ftindex", PKGDIR_CREAT_FTINDEX,
+        N_("Create full-text index of package descriptions (pndir only)")
+    },
+    {
+        "flindex", PKGDIR_CREAT_FLINDEX,
+        N_("Create index of package file paths (pndir only)")
+    },
     { "gzip", 0, N_("Gzip compressed index (default)") },
     { "gz", 0, N_("Gzip compressed index (default)") },
     { "zstd", 0, N_("ZSTD compressed index") },
@@ -14,6 +14,7 @@
 # include "config.h"
 #endif
 
+#include <ctype.h>
 #include <limits.h>
 #include <stdint.h>
 #include <string.h>
@@ -50,7 +51,10 @@
 #include "capreq.h"
 #include "search.h"
 #include "pkgu.h"
+#include "pkgdir/pkgdir.h"
+#include "thread.h"
 #include "cli.h"
+#include "json.h"
 
 static const unsigned char   *pcre_chartable = NULL;
 static int                    pcre_established = 0;
@@ -65,12 +69,50 @@ struct pattern {
     unsigned         pcre_flags;
     pcre             *pcre;
     pcre_extra       *pcre_extra;
+    char             *literal;  /* required substring, for index lookups */
+    int              literal_len;
+    int              prefilter; /* 0, PREFILTER_{CASE,ICASE} */
+    tn_array         *ftcands;  /* struct ftcands per pkgdir and type */
 };
 
+/* pattern_match() skips strings without literal */
+#define PREFILTER_CASE   1
+#define PREFILTER_ICASE  2
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+# define PATTERN_STUDY_FLAGS PCRE_STUDY_JIT_COMPILE
+#else
+# define PATTERN_STUDY_FLAGS 0
+#endif
+
+/* full-text index candidates */
+struct ftcands {
+    struct pkgdir    *pkgdir;
+    int              type;      /* PKGDIR_FTS_* */
+    tn_array         *pkgs;     /* NULL => no index, all are candidates */
+};
+
+/* package being matched */
+struct search_item {
+    struct pkg       *pkg;
+    struct pkgflist  *flist;       /* non-depdir file list */
+    struct pkguinf   *pkgu;
+    const char       *group;
+    unsigned         loaded : 1;   /* data above loaded by search_item_load() */
+    unsigned         fl_cand : 1;
+    unsigned         text_cand : 1;
+    unsigned         match : 1;
+};
+
+#define OPT_SEARCH_TEXT (OPT_SEARCH_SUMM | OPT_SEARCH_DESC | OPT_SEARCH_CHANGELOG)
+/* fields loaded by search_item_load(), the rest is in memory */
+#define OPT_SEARCH_LOADED (OPT_SEARCH_TEXT | OPT_SEARCH_FL | OPT_SEARCH_GROUP)
+
 static error_t parse_opt(int key, char *arg, struct argp_state *state);
 static int search(struct cmdctx *cmdctx);
 
 #define OPT_PATTERN_PCRE     (1 << 10)
+#define OPT_SEARCH_JSON      (1 << 11)
 
 #define OPT_SEARCH_CAP       (1 << 0)
 #define OPT_SEARCH_REQ       (1 << 1)
@@ -95,7 +137,7 @@ static int search(struct cmdctx *cmdctx);
 			    OPT_SEARCH_CHANGELOG)
 
 
-#define OPT_NO_SEARCHSW    OPT_PATTERN_PCRE
+#define OPT_NO_SEARCHSW    (OPT_PATTERN_PCRE | OPT_SEARCH_JSON)
 
 static struct argp_option options[] = {
     { "provides",    'p', 0, 0, N_("Search capabilities"), 1},
@@ -113,6 +155,8 @@ static struct argp_option options[] = {
       N_("Search all described fields, the defaults are: -sd"), 1
     },
     { "perlre",    OPT_PATTERN_PCRE, 0, 0, N_("Threat PATTERN as Perl regular expression"), 1},
+    { "json",      OPT_SEARCH_JSON, 0, 0,
+      N_("Print matched packages as JSON objects, one per line"), 1},
     { 0, 0, 0, 0, 0, 0 },
 };
 
@@ -208,6 +252,10 @@ static struct pattern *build_pattern(struct cmdctx *cmdctx, char *arg)
     pt->pcre_flags = flags;
     pt->pcre = NULL;
     pt->pcre_extra = NULL;
+    pt->literal = NULL;
+    pt->literal_len = 0;
+    pt->prefilter = 0;
+    pt->ftcands = NULL;
     return pt;
 }
 
@@ -269,6 +317,11 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
             cmdctx->_flags |= OPT_PATTERN_PCRE;
             break;
 
+        case OPT_SEARCH_JSON:
+            cmdctx->_flags |= OPT_SEARCH_JSON;
+            cmdctx->rtflags |= CMDCTX_NOCTRLMSGS;
+            break;
+
 
         case ARGP_KEY_ARG:
             if (arg == NULL)
@@ -311,8 +364,162 @@ void init_pcre(void)
     }
 }
 
+static void literal_end(char *run, int *n, char **best)
+{
+    if (*n == 0)
+        return;
+
+    run[*n] = '\0';
+    if (*best == NULL || (int)strlen(*best) < *n) {
+        free(*best);
+        *best = n_strdup(run);
+    }
+    *n = 0;
+}
+
+/* the longest substring of any matching string or NULL if unknown */
+static char *pattern_literal(const struct pattern *pt)
+{
+    const char *p = pt->regexp;
+    char *run, *best = NULL;
+    int n = 0, depth = 0;
+
+    /* (?x), (?i) and others change meaning of the rest */
+    if (pt->type == PATTERN_PCRE &&
+        ((pt->pcre_flags & PCRE_EXTENDED) || strchr(p, '|') ||
+         strstr(p, "(?")))
+        return NULL;
+
+    run = alloca(strlen(p) + 1);
+    while (*p) {
+        char c = *p++;
+
+        switch (c) {
+            case '\\':
+                if (*p == '\0')
+                    break;
+
+                c = *p++;
+                /* \x41, \101, \cA, \Q..\E, backreferences etc */
+                if (pt->type == PATTERN_PCRE &&
+                    (isdigit((unsigned char)c) || strchr("xcQEgko", c)))
+                    goto l_unknown;
+
+                /* \d, \w, \b, etc are not literals */
+                if (pt->type == PATTERN_PCRE && isalnum((unsigned char)c))
+                    literal_end(run, &n, &best);
+                else if (depth == 0)
+                    run[n++] = c;
+                break;
+
+            case '[':           /* skip class */
+                literal_end(run, &n, &best);
+                if (*p == '!' || *p == '^')
+                    p++;
+                if (*p == ']')
+                    p++;
+                while (*p && *p != ']') {
+                    /* [:digit:], escaped ']' and so on */
+                    if (*p == '\\' ||
+                        (*p == '[' && p[1] && strchr(":.=", p[1])))
+                        goto l_unknown;
+                    p++;
+                }
+                if (*p)
+                    p++;
+                break;
+
+            default:
+                if (pt->type == PATTERN_FMASK) {
+                    if (c == '*' || c == '?')
+                        literal_end(run, &n, &best);
+                    else
+                        run[n++] = c;
+                    break;
+                }
+
+                switch (c) {
+                    case '?': case '*': case '{': /* last char is optional */
+                        if (n > 0)
+                            n--;
+                        literal_end(run, &n, &best);
+                        if (c == '{')
+                            while (*p && *p++ != '}')
+                                ;
+                        break;
+
+                    case '(':
+                        depth++;
+                        literal_end(run, &n, &best);
+                        break;
+
+                    case ')':
+                        depth--;
+                        literal_end(run, &n, &best);
+                        break;
+
+                    case '+': case '.': case '^': case '$':
+                        literal_end(run, &n, &best);
+                        break;
+
+                    default:
+                        if (depth == 0)
+                            run[n++] = c;
+                        break;
+                }
+        }
+    }
+    literal_end(run, &n, &best);
+
+    return best;
+
+ l_unknown:
+    free(best);
+    return NULL;
+}
+
+static int pattern_prefilter(const struct pattern *pt)
+{
+    const unsigned char *p;
+    int icase = 0;
+
+    if (pt->literal == NULL)
+        return 0;
+
+    if (pt->type == PATTERN_FMASK) {
+#ifdef FNM_CASEFOLD
+        icase = (pt->fnmatch_flags & FNM_CASEFOLD);
+#endif
+    } else {                    /* no literal for patterns with (?i) */
+        icase = (pt->pcre_flags & PCRE_CASELESS);
+    }
+
+    if (!icase)
+        return PREFILTER_CASE;
+
+    /* multibyte chars are case folded by matchers in their own way */
+    for (p = (const unsigned char*)pt->literal; *p; p++)
+        if (*p >= 0x80)
+            return 0;
+
+    return PREFILTER_ICASE;
+}
+
+static const char *memcasemem(const char *s, int len, const char *lit, int llen)
+{
+    int lc = tolower((unsigned char)*lit), uc = toupper((unsigned char)*lit);
+    const char *p, *end = s + len - llen;
+
+    for (p = s; p <= end; p++) {
+        if ((*p == lc || *p == uc) && strncasecmp(p, lit, llen) == 0)
+            return p;
+    }
+
+    return NULL;
+}
+
 static
-int pattern_compile(struct pattern *pt, int ntimes)
+int pattern_compile(struct pattern *pt)
 {
     const char       *pcre_err = NULL;
     int              pcre_err_off = 0;
@@ -325,6 +532,13 @@ int pattern_compile(struct pattern *pt, int ntimes)
     pt->fnmatch_flags |= FNM_CASEFOLD;
 #endif
 
+    pt->literal = pattern_literal(pt);
+    if (pt->literal) {
+        pt->literal_len = strlen(pt->literal);
+        pt->prefilter = pattern_prefilter(pt);
+    }
+    DBGF("literal %s, prefilter %d\n", pt->literal, pt->prefilter);
+
     if (pt->type != PATTERN_PCRE)
         return 1;
 
@@ -337,14 +551,13 @@ int pattern_compile(struct pattern *pt, int ntimes)
         return 0;
     }
 
-    if (ntimes > 10) {
-        pcre_err = NULL;
-        pt->pcre_extra = pcre_study(pt->pcre, 0, &pcre_err);
-        if (pt->pcre_extra == NULL && pcre_err) {
-            logn(LOGERR, _("search: pattern study: %s: %s"), pt->regexp,
-                 pcre_err);
-            return 0;
-        }
+    /* pattern is matched against lots of strings, JIT it if possible */
+    pcre_err = NULL;
+    pt->pcre_extra = pcre_study(pt->pcre, PATTERN_STUDY_FLAGS, &pcre_err);
+    if (pt->pcre_extra == NULL && pcre_err) {
+        logn(LOGERR, _("search: pattern study: %s: %s"), pt->regexp,
+             pcre_err);
+        return 0;
     }
     return 1;
 }
@@ -357,6 +570,19 @@ int pattern_match(struct pattern *pt, const char *s, int len)
     if (len == 0)
         len = strlen(s);
 
+    if (pt->prefilter) {        /* cannot match without literal */
+        if (len < pt->literal_len)
+            return 0;
+
+        if (pt->prefilter == PREFILTER_CASE) {
+            if (memmem(s, len, pt->literal, pt->literal_len) == NULL)
+                return 0;
+
+        } else if (memcasemem(s, len, pt->literal, pt->literal_len) == NULL) {
+            return 0;
+        }
+    }
+
     switch (pt->type) {
         case PATTERN_FMASK:
             n_assert(s[len] == '\0');
@@ -392,13 +618,65 @@ void pattern_free(struct pattern *pt)
     }
 
     if (pt->pcre_extra) {
+#ifdef PCRE_STUDY_JIT_COMPILE
+        pcre_free_study(pt->pcre_extra);
+#else
         free(pt->pcre_extra);
+#endif
         pt->pcre_extra = NULL;
     }
 
+    n_cfree(&pt->literal);
+
+    if (pt->ftcands)
+        n_array_free(pt->ftcands);
+
     free(pt);
 }
 
+static void ftcands_free(struct ftcands *fc)
+{
+    if (fc->pkgs)
+        n_array_free(fc->pkgs);
+    free(fc);
+}
+
+/* may pkg's summary, description, etc (PKGDIR_FTS_TEXT) or file paths
+   (PKGDIR_FTS_FILES) match? asks full-text index */
+static int pkg_text_candidate(struct pattern *pt, struct pkg *pkg, int type)
+{
+    struct ftcands *fc = NULL;
+    int i;
+
+    if (pt->literal == NULL || pkg->pkgdir == NULL)
+        return 1;
+
+    if (pt->ftcands == NULL)
+        pt->ftcands = n_array_new(4, (tn_fn_free)ftcands_free, NULL);
+
+    for (i=0; i < n_array_size(pt->ftcands); i++) {
+        struct ftcands *c = n_array_nth(pt->ftcands, i);
+        if (c->pkgdir == pkg->pkgdir && c->type == type) {
+            fc = c;
+            break;
+        }
+    }
+
+    if (fc == NULL) {
+        fc = n_malloc(sizeof(*fc));
+        fc->pkgdir = pkg->pkgdir;
+        fc->type = type;
+        fc->pkgs = pkgdir_ftsearch(pkg->pkgdir, type, pt->literal);
+        if (fc->pkgs)
+            msgn(3, _("%s: %d package(s) may match '%s'"),
+                 pkgdir_idstr_s(pkg->pkgdir), n_array_size(fc->pkgs),
+                 pt->literal);
+        n_array_push(pt->ftcands, fc);
+    }
+
+    return fc->pkgs == NULL || n_array_bsearch(fc->pkgs, pkg) != NULL;
+}
+
 
 static int fl_match(tn_tuple *fl, struct pattern *pt)
 {
@@ -442,8 +720,9 @@ l_end:
 }
 
 
-static int search_pkg_files(struct pkg *pkg, struct pattern *pt)
+static int search_pkg_files(struct search_item *it, struct pattern *pt)
 {
+    struct pkg      *pkg = it->pkg;
     struct pkgflist *flist;
     int       match = 0;
 
@@ -451,18 +730,67 @@ static int search_pkg_files(struct pkg *pkg, struct pattern *pt)
     if (pkg->fl && fl_match(pkg->fl, pt))
         return 1;
 
-    if ((flist = pkg_get_nodep_flist(pkg)) != NULL) {
+    flist = it->loaded ? it->flist : pkg_get_nodep_flist(pkg);
+    if (flist != NULL) {
         match = fl_match(flist->fl, pt);
-        pkgflist_free(flist);
+        if (!it->loaded)
+            pkgflist_free(flist);
     }
 
     return match;
 }
 
+/* Loads file list, package info and group up front as index reads and
+   group lookups are not thread-safe; pkg_match() of loaded item may be
+   run in any thread then */
+static void search_item_load(struct search_item *it, struct pattern *pt,
+                             unsigned flags)
+{
+    struct pkg *pkg = it->pkg;
 
+    it->flist = NULL;
+    it->pkgu = NULL;
+    it->group = NULL;
+    it->fl_cand = it->text_cand = 0;
 
-static int pkg_match(struct pkg *pkg, struct pattern *pt, unsigned flags)
+    if (flags & OPT_SEARCH_GROUP)
+        it->group = pkg_group(pkg);
+
+    if ((flags & OPT_SEARCH_FL) &&
+        pkg_text_candidate(pt, pkg, PKGDIR_FTS_FILES)) {
+        it->fl_cand = 1;
+        it->flist = pkg_get_nodep_flist(pkg);
+    }
+
+    if ((flags & OPT_SEARCH_TEXT) &&
+        pkg_text_candidate(pt, pkg, PKGDIR_FTS_TEXT)) {
+        it->text_cand = 1;
+        if ((it->pkgu = pkg_uinf(pkg)) == NULL)
+            logn(LOGERR, _("%s: load package info failed"),
+                 pkg_snprintf_s(pkg));
+    }
+
+    it->loaded = 1;
+}
+
+static void search_item_clean(struct search_item *it)
 {
+    if (it->flist)
+        pkgflist_free(it->flist);
+
+    if (it->pkgu)
+        pkguinf_free(it->pkgu);
+
+    it->flist = NULL;
+    it->pkgu = NULL;
+    it->loaded = 0;
+}
+
+
+
+static int pkg_match(struct search_item *it, struct pattern *pt, unsigned flags)
+{
+    struct pkg *pkg = it->pkg;
     int i, match = 0;
     struct capreq *cr;
     const char *p;
@@ -527,21 +855,29 @@ static int pkg_match(struct pkg *pkg, struct pattern *pt, unsigned flags)
 	}
     }
 
-    if ((flags & OPT_SEARCH_GROUP) && (p = (char*)pkg_group(pkg))) {
+    if ((flags & OPT_SEARCH_GROUP) &&
+        (p = it->loaded ? it->group : pkg_group(pkg))) {
         if ((match = pattern_match(pt, p, strlen(p))))
             goto l_end;
     }
 
-    if (flags & (OPT_SEARCH_FL))
-        if ((match = search_pkg_files(pkg, pt)))
+    if ((flags & OPT_SEARCH_FL) &&
+        (it->loaded ? it->fl_cand :
+         pkg_text_candidate(pt, pkg, PKGDIR_FTS_FILES)))
+        if ((match = search_pkg_files(it, pt)))
             goto l_end;
 
-    if (flags & (OPT_SEARCH_SUMM | OPT_SEARCH_DESC | OPT_SEARCH_CHANGELOG)) {
+    if ((flags & OPT_SEARCH_TEXT) &&
+        (it->loaded ? it->text_cand :
+         pkg_text_candidate(pt, pkg, PKGDIR_FTS_TEXT))) {
         struct pkguinf *pkgu;
         const char *s;
 
-        if ((pkgu = pkg_uinf(pkg)) == NULL) {
-            logn(LOGERR, _("%s: load package info failed"), pkg_snprintf_s(pkg));
+        pkgu = it->loaded ? it->pkgu : pkg_uinf(pkg);
+        if (pkgu == NULL) {
+            if (!it->loaded)
+                logn(LOGERR, _("%s: load package info failed"),
+                     pkg_snprintf_s(pkg));
 
         } else {
             if (flags & OPT_SEARCH_SUMM) {
@@ -567,7 +903,8 @@ static int pkg_match(struct pkg *pkg, struct pattern *pt, unsigned flags)
 		    match = pattern_match(pt, s, strlen(s));
 	    }
 
-            pkguinf_free(pkgu);
+            if (!it->loaded)
+                pkguinf_free(pkgu);
         }
 
     }
@@ -578,14 +915,100 @@ l_end:
 }
 
 
+/* a batch of packages matched by search workers */
+struct search_job {
+    struct search_item *items;
+    int                nitems;
+    int                next;      /* next item to take */
+    struct pattern     *pt;
+    unsigned           flags;
+};
+
+static void *search_worker(void *job_)
+{
+    struct search_job *job = job_;
+    int i;
+
+    while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) <
+           job->nitems) {
+        struct search_item *it = &job->items[i];
+
+        if (sigint_reached())
+            break;
+
+        if (!it->match)         /* by previous pass */
+            it->match = pkg_match(it, job->pt, job->flags);
+    }
+
+    return NULL;
+}
+
+#define SEARCH_MAXTHREADS  8
+#define SEARCH_BATCH       64   /* packages per thread */
+
+static int search_nthreads(int npkgs)
+{
+    long n = 1;
+
+#ifdef ENABLE_THREADS
+    if (poldek_enabled_threads() && npkgs >= SEARCH_BATCH * 2) {
+        if ((n = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+            n = 1;
+
+        if (n > SEARCH_MAXTHREADS)
+            n = SEARCH_MAXTHREADS;
+    }
+#endif
+    (void)npkgs;
+    return n;
+}
+
+/* match job's items with nthreads workers, calling thread is one of them */
+static void search_run_job(struct search_job *job, int nthreads)
+{
+#ifdef ENABLE_THREADS
+    pthread_t tids[SEARCH_MAXTHREADS];
+    int i, n = 0;
+
+    n_assert(nthreads <= SEARCH_MAXTHREADS);
+    poldek_threading_toggle(true);
+    for (i=0; i < nthreads - 1; i++)
+        if (pthread_create(&tids[n], NULL, search_worker, job) == 0)
+            n++;
+
+    search_worker(job);
+
+    for (i=0; i < n; i++)
+        pthread_join(tids[i], NULL);
+    poldek_threading_toggle(false);
+#else
+    (void)nthreads;
+    search_worker(job);
+#endif
+}
+
+/* --json: matches are written out as soon as their batch is done */
+static void search_json(struct cmdctx *cmdctx, tn_buf *nbuf, struct pkg *pkg)
+{
+    cmdctx_addtoresult(cmdctx, pkg);
+
+    json_object_begin(nbuf, NULL);
+    json_pkg(nbuf, pkg);
+    json_object_end(nbuf);
+    cmdctx_json_write(cmdctx, nbuf);
+}
+
 static int search(struct cmdctx *cmdctx)
 {
     struct poclidek_ctx   *cctx = NULL;
     tn_array               *pkgs = NULL;
     tn_array               *matched_pkgs = NULL;
     int                    i, err = 0, display_bar = 0, bar_v;
-    int                    term_height;
+    int                    term_height, nthreads, batch;
     struct pattern         *pt;
+    struct search_item     *items = NULL;
+    struct search_job      job;
+    tn_buf                 *json = NULL;
     unsigned               flags;
 
     if ((pt = cmdctx->_data) == NULL) {
@@ -603,7 +1026,7 @@ static int search(struct cmdctx *cmdctx)
         cmdctx->_flags |= OPT_SEARCH_DEFAULT;
 
     init_pcre();
-    if (!pattern_compile(pt, poldek_ts_get_arg_count(cmdctx->ts))) {
+    if (!pattern_compile(pt)) {
         err++;
         goto l_end;
     }
@@ -620,7 +1043,10 @@ static int search(struct cmdctx *cmdctx)
     n_assert(n_array_size(pkgs) > 0);
 
     matched_pkgs = n_array_new(32, NULL, NULL);
-    if (n_array_size(pkgs) > 5 && (cmdctx->_flags & OPT_SEARCH_HDD)) {
+    if (cmdctx->_flags & OPT_SEARCH_JSON)
+        json = n_buf_new(1024);
+
+    else if (n_array_size(pkgs) > 5 && (cmdctx->_flags & OPT_SEARCH_HDD)) {
         display_bar = 1;
         msg(0, _("Searching packages..."));
     }
@@ -637,16 +1063,72 @@ static int search(struct cmdctx *cmdctx)
             n_array_sort_ex(pkgs, (tn_fn_cmp)pkg_cmp_seqno);
     }
 
-    for (i=0; i < n_array_size(pkgs); i++) {
-        struct pkg *pkg = n_array_nth(pkgs, i);
+    /*
+       Packages are matched in batches by nthreads workers. Index reads
+       are serialized: file lists and package infos of a batch are loaded
+       by this thread (see search_item_load()), and only for packages not
+       matched by their in-memory fields in the first pass.
+    */
+    nthreads = search_nthreads(n_array_size(pkgs));
+    batch = nthreads > 1 ? SEARCH_BATCH * nthreads : 1;
+    items = n_calloc(batch, sizeof(*items));
+    if (nthreads > 1)
+        msgn(3, "search: using %d threads", nthreads);
+
+    memset(&job, 0, sizeof(job));
+    job.items = items;
+    job.pt = pt;
 
-        if (pkg_match(pkg, pt, cmdctx->_flags))
-            n_array_push(matched_pkgs, pkg);
+    for (i=0; i < n_array_size(pkgs); i += batch) {
+        int j, n = n_array_size(pkgs) - i;
+
+        if (n > batch)
+            n = batch;
+
+        for (j=0; j < n; j++) {
+            struct search_item *it = &items[j];
+
+            it->pkg = n_array_nth(pkgs, i + j);
+            it->match = 0;
+        }
+        job.nitems = n;
+
+        if (nthreads == 1) {
+            job.flags = cmdctx->_flags;
+            job.next = 0;
+            search_run_job(&job, nthreads);
+
+        } else {
+            job.flags = cmdctx->_flags & ~(OPT_SEARCH_LOADED | OPT_NO_SEARCHSW);
+            if (job.flags) {
+                job.next = 0;
+                search_run_job(&job, nthreads);
+            }
+
+            job.flags = cmdctx->_flags & OPT_SEARCH_LOADED;
+            if (job.flags) {
+                for (j=0; j < n; j++)
+                    if (!items[j].match)
+                        search_item_load(&items[j], pt, job.flags);
+
+                job.next = 0;
+                search_run_job(&job, nthreads);
+            }
+        }
+
+        for (j=0; j < n; j++) {     /* in original order */
+            if (items[j].match && json)
+                search_json(cmdctx, json, items[j].pkg);
+
+            else if (items[j].match)
+                n_array_push(matched_pkgs, items[j].pkg);
+            search_item_clean(&items[j]);
+        }
 
         if (display_bar) {
-            int v, j;
+            int v;
 
-            v = i * 40 / n_array_size(pkgs);
+            v = (i + n - 1) * 40 / n_array_size(pkgs);
             for (j = bar_v; j < v; j++)
                 msg(0, "_.");
             bar_v = v;
@@ -661,6 +1143,9 @@ static int search(struct cmdctx *cmdctx)
     if (display_bar)
         msgn(0, _("_done."));
 
+    if (json)                   /* already written */
+        goto l_end;
+
     term_height = poldek_term_get_height();
     if (n_array_size(matched_pkgs) == 0)
         cmdctx_printf_c(cmdctx, PRCOLOR_YELLOW, "!No package matches '%s'\n",
@@ -684,6 +1169,11 @@ static int search(struct cmdctx *cmdctx)
                         n_array_size(matched_pkgs));
 
 l_end:
+    if (items)
+        free(items);
+
+    if (json)
+        n_buf_free(json);
 
     if (pkgs)
         n_array_free(pkgs);
@@ -89,10 +89,17 @@ static int ts_fetch_or_dump_packages(struct poldek_ts *ts)
 
     } else if (ts->getop(ts, POLDEK_OP_JUSTFETCH)) {
         const char *destdir = ts->fetchdir;
+        unsigned flags = 0;
+
         if (destdir == NULL)
             destdir = ts->cachedir;
+        else
+            flags |= PKGFETCH_NOSUBDIRS;
+
+        if (ts->getop(ts, POLDEK_OP_PREFETCH))
+            flags |= PKGFETCH_PREFETCH;
 
-        rc = packages_fetch(ts->pmctx, pkgs, destdir, ts->fetchdir ? 1 : 0);
+        rc = packages_fetch_ext(ts->pmctx, ts->db, pkgs, destdir, flags);
     }
 
     n_array_free(pkgs);
@@ -0,0 +1,393 @@
+/*
+  Copyright (C) 2000 - 2008 Pawel A. Gajda <mis@pld-linux.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+  Solver state kept across transactions of one poldek_ctx (i.e. across
+  shell commands). Everything here is derived from the available set
+  and installed database only, so it is dropped as soon as pkgset
+  generation, database path or database mtime changes.
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "ictx.h"
+
+#define I3CACHE_MAX_RECNOS 64   /* more matches than that are not cached */
+
+struct i3dbmatch {
+    int        nrecnos;
+    unsigned   recnos[0];
+};
+
+struct i3solution {
+    char       *signature;
+    tn_array   *inpkgs;         /* dependencies (PKGMARK_DEP) */
+    tn_array   *unpkgs;         /* packages to remove */
+};
+
+struct i3cache {
+    struct poldek_ts  *ts;        /* transaction cache is attached to */
+
+    struct pkgset     *ps;
+    uint32_t          ps_generation;
+    char              *dbpath;
+    time_t            dbmtime;
+
+    tn_hash           *dbmatch;   /* "ma_flags:req" => struct i3dbmatch* */
+    tn_hash           *installed; /* name => dbpkg[] */
+    tn_hash           *booldeps;  /* expr => struct booldep* (or NULL) */
+    struct i3solution *solution;  /* last one */
+
+    unsigned          nhits;
+    unsigned          nmisses;
+};
+
+static void solution_free(struct i3solution *sol)
+{
+    free(sol->signature);
+    n_array_cfree(&sol->inpkgs);
+    n_array_cfree(&sol->unpkgs);
+    free(sol);
+}
+
+struct i3cache *i3cache_new(void)
+{
+    struct i3cache *cache = n_calloc(sizeof(*cache), 1);
+
+    cache->dbmatch = n_hash_new(1024, free);
+    n_hash_ctl(cache->dbmatch, TN_HASH_REHASH);
+
+    cache->installed = n_hash_new(512, (tn_fn_free)n_array_free);
+    n_hash_ctl(cache->installed, TN_HASH_REHASH);
+
+    cache->booldeps = n_hash_new(256, (tn_fn_free)booldep_free);
+    n_hash_ctl(cache->booldeps, TN_HASH_REHASH);
+
+    return cache;
+}
+
+void i3cache_invalidate(struct i3cache *cache)
+{
+    if (n_hash_size(cache->dbmatch) || cache->solution)
+        msgn(3, "i3cache: invalidated (%u hits, %u misses)",
+             cache->nhits, cache->nmisses);
+
+    n_hash_clean(cache->dbmatch);
+    n_hash_clean(cache->installed);
+
+    if (cache->solution) {
+        solution_free(cache->solution);
+        cache->solution = NULL;
+    }
+
+    n_cfree(&cache->dbpath);
+    cache->ps = NULL;
+    cache->ps_generation = 0;
+    cache->dbmtime = 0;
+    cache->nhits = cache->nmisses = 0;
+}
+
+void i3cache_free(struct i3cache *cache)
+{
+    i3cache_invalidate(cache);
+    n_hash_free(cache->dbmatch);
+    n_hash_free(cache->installed);
+    n_hash_free(cache->booldeps);
+    free(cache);
+}
+
+/* attach cache to transaction, drop its content if anything has changed */
+void i3cache_attach(struct i3cache *cache, struct poldek_ts *ts)
+{
+    struct pkgset *ps = ts->ctx->ps;
+    const char *dbpath = ts->db ? ts->db->path : NULL;
+    time_t dbmtime = ts->db ? pkgdb_mtime(ts->db) : 0;
+    int valid = 1;
+
+    /* mtime has 1s resolution, database touched within the current
+       second may be changed again unnoticed */
+    if (dbmtime >= time(NULL) - 1)
+        dbmtime = 0;
+
+    if (cache->ps != ps || cache->ps_generation != ps->_generation)
+        valid = 0;
+
+    else if (dbmtime == 0 || cache->dbmtime != dbmtime)
+        valid = 0;
+
+    else if (cache->dbpath == NULL || dbpath == NULL ||
+             strcmp(cache->dbpath, dbpath) != 0)
+        valid = 0;
+
+    if (!valid) {
+        i3cache_invalidate(cache);
+        cache->ps = ps;
+        cache->ps_generation = ps->_generation;
+        cache->dbpath = dbpath ? n_strdup(dbpath) : NULL;
+        cache->dbmtime = dbmtime;
+    }
+
+    /* unknown database state => do not cache anything */
+    cache->ts = dbmtime ? ts : NULL;
+}
+
+void i3cache_detach(struct i3cache *cache)
+{
+    cache->ts = NULL;
+}
+
+static inline int is_attached(const struct i3cache *cache,
+                              const struct poldek_ts *ts)
+{
+    return cache && cache->ts == ts;
+}
+
+static int recnos_excluded(const struct i3dbmatch *m, const tn_array *exclude)
+{
+    struct pkg tmp;
+
+    if (exclude == NULL || n_array_size(exclude) == 0)
+        return m->nrecnos == 0;
+
+    for (int i=0; i < m->nrecnos; i++) {
+        tmp.recno = m->recnos[i];
+        if (n_array_bsearch((tn_array*)exclude, &tmp) == NULL)
+            return 0;
+    }
+
+    return 1;
+}
+
+/* RET: 1 - matched, 0 - not matched, -1 - not cached */
+int i3cache_pkgdb_match_req(struct i3cache *cache, struct poldek_ts *ts,
+                            const struct capreq *req, unsigned ma_flags,
+                            const tn_array *exclude)
+{
+    struct i3dbmatch *m;
+    unsigned recnos[I3CACHE_MAX_RECNOS];
+    char key[512];
+    int n;
+
+    if (!is_attached(cache, ts))
+        return -1;
+
+    n_snprintf(key, sizeof(key), "%x:%s", ma_flags, capreq_stra(req));
+
+    if ((m = n_hash_get(cache->dbmatch, key))) {
+        cache->nhits++;
+        return !recnos_excluded(m, exclude);
+    }
+
+    n = pkgdb_match_req_recnos(ts->db, req, ma_flags, recnos, I3CACHE_MAX_RECNOS);
+    if (n < 0)
+        return -1;
+
+    cache->nmisses++;
+    m = n_malloc(sizeof(*m) + n * sizeof(*recnos));
+    m->nrecnos = n;
+    if (n)
+        memcpy(m->recnos, recnos, n * sizeof(*recnos));
+
+    n_hash_insert(cache->dbmatch, key, m);
+    return !recnos_excluded(m, exclude);
+}
+
+/* RET: installed packages named name (new array) or NULL */
+tn_array *i3cache_installed(struct i3cache *cache, struct poldek_ts *ts,
+                            const char *name, int *nfound)
+{
+    tn_array *dbpkgs;
+
+    if (!is_attached(cache, ts))
+        return NULL;
+
+    if ((dbpkgs = n_hash_get(cache->installed, name)) == NULL) {
+        cache->nmisses++;
+        dbpkgs = pkgs_array_new_ex(4, pkg_cmp_recno);
+        pkgdb_search(ts->db, &dbpkgs, PMTAG_NAME, name, NULL, PKG_LDNEVR);
+        n_hash_insert(cache->installed, name, dbpkgs);
+    } else {
+        cache->nhits++;
+    }
+
+    *nfound = n_array_size(dbpkgs);
+    return n_array_dup(dbpkgs, (tn_fn_dup)pkg_link);
+}
+
+/* parsed boolean dependency; expressions do not depend on anything
+   else, so they are kept as long as cache is */
+const struct booldep *i3cache_booldep(struct i3cache *cache, const char *expr)
+{
+    struct booldep *dep;
+
+    if ((dep = n_hash_get(cache->booldeps, expr)))
+        return dep;
+
+    if (n_hash_exists(cache->booldeps, expr)) /* invalid one */
+        return NULL;
+
+    if ((dep = booldep_parse(expr)) == NULL)
+        logn(LOGERR, "%s: boolean dependency parse error", expr);
+
+    n_hash_insert(cache->booldeps, expr, dep);
+    return dep;
+}
+
+static void signature_add_patterns(tn_buf *nbuf, char tag,
+                                   const tn_array *patterns)
+{
+    n_buf_printf(nbuf, ":%c", tag);
+    for (int i=0; patterns && i < n_array_size(patterns); i++)
+        n_buf_printf(nbuf, "%s,", (char*)n_array_nth(patterns, i));
+}
+
+/* solution signature: ts type, flags and options affecting resolving,
+   hold and ignore patterns, and hand marked packages */
+static char *make_signature(struct i3ctx *ictx)
+{
+    struct poldek_ts *ts = ictx->ts;
+    const tn_array *pkgs = iset_packages(ictx->inset);
+    tn_array *ids;
+    tn_buf *nbuf;
+    char *sig;
+    int op;
+
+    nbuf = n_buf_new(1024);
+    n_buf_printf(nbuf, "%d:%x:", ts->type, ts->_flags);
+
+    for (op = POLDEK_OP_NULL + 1; op < POLDEK_OP___MAXOP; op++) {
+        switch (op) {       /* not affecting dependency processing */
+            case POLDEK_OP_TEST:
+            case POLDEK_OP_RPMTEST:
+            case POLDEK_OP_JUSTDB:
+            case POLDEK_OP_JUSTFETCH:
+            case POLDEK_OP_PREFETCH:
+            case POLDEK_OP_JUSTPRINT:
+            case POLDEK_OP_JUSTPRINT_N:
+            case POLDEK_OP_MKDBDIR:
+            case POLDEK_OP_USESUDO:
+            case POLDEK_OP_USETHREADS:
+            case POLDEK_OP_KEEP_DOWNLOADS:
+            case POLDEK_OP_CONFIRM_INST:
+            case POLDEK_OP_CONFIRM_UNINST:
+            case POLDEK_OP_IS_INTERACTIVE_ON:
+            case POLDEK_OP_NOFETCH:
+            case POLDEK_OP_PARSABLETS:
+            case POLDEK_OP_PROGRESS_NONE:
+                continue;
+
+            default:
+                n_buf_printf(nbuf, "%c", ts->getop(ts, op) ? '1' : '0');
+                break;
+        }
+    }
+
+    signature_add_patterns(nbuf, 'h', ts->hold_patterns);
+    signature_add_patterns(nbuf, 'i', ts->ign_patterns);
+
+    ids = n_array_new(n_array_size(pkgs), NULL, (tn_fn_cmp)strcmp);
+    for (int i=0; i < n_array_size(pkgs); i++) {
+        struct pkg *pkg = n_array_nth(pkgs, i);
+        if (i3_is_hand_marked(ictx, pkg))
+            n_array_push(ids, (char*)pkg_id(pkg));
+    }
+    n_array_sort(ids);
+
+    for (int i=0; i < n_array_size(ids); i++)
+        n_buf_printf(nbuf, ":%s", (char*)n_array_nth(ids, i));
+
+    sig = n_strdup(n_buf_ptr(nbuf));
+    n_array_free(ids);
+    n_buf_free(nbuf);
+
+    return sig;
+}
+
+int i3cache_store_solution(struct i3cache *cache, struct i3ctx *ictx)
+{
+    const tn_array *inpkgs = iset_packages(ictx->inset);
+    struct i3solution *sol;
+
+    if (!is_attached(cache, ictx->ts))
+        return 0;
+
+    if (ictx->abort || n_hash_size(ictx->errors) ||
+        n_hash_size(ictx->multi_obsoleted))
+        return 0;
+
+    sol = n_malloc(sizeof(*sol));
+    sol->signature = make_signature(ictx);
+    sol->inpkgs = pkgs_array_new(n_array_size(inpkgs));
+    sol->unpkgs = n_array_dup(iset_packages(ictx->unset), (tn_fn_dup)pkg_link);
+
+    for (int i=0; i < n_array_size(inpkgs); i++) {
+        struct pkg *pkg = n_array_nth(inpkgs, i);
+        if (i3_is_dep_marked(ictx, pkg))
+            n_array_push(sol->inpkgs, pkg_link(pkg));
+    }
+
+    if (cache->solution)
+        solution_free(cache->solution);
+    cache->solution = sol;
+
+    return 1;
+}
+
+/* replay last solution if request and state are the same */
+int i3cache_restore_solution(struct i3cache *cache, struct i3ctx *ictx)
+{
+    struct i3solution *sol = cache ? cache->solution : NULL;
+    char *sig;
+    int matched;
+
+    if (sol == NULL || !is_attached(cache, ictx->ts))
+        return 0;
+
+    sig = make_signature(ictx);
+    matched = strcmp(sig, sol->signature) == 0;
+    free(sig);
+
+    if (!matched)
+        return 0;
+
+    /* not installable anymore => let the solver find another way */
+    for (int i=0; i < n_array_size(sol->inpkgs); i++) {
+        struct pkg *pkg = n_array_nth(sol->inpkgs, i);
+
+        if (i3_is_marked(ictx, pkg))
+            continue;
+
+        if (i3_is_pkg_installable(ictx->ts, pkg,
+                                  pkg_is_marked_i(ictx->ts->pms, pkg)) <= 0)
+            return 0;
+    }
+
+    msgn(2, _("Reusing dependency resolution of previous command"));
+
+    for (int i=0; i < n_array_size(sol->inpkgs); i++) {
+        struct pkg *pkg = n_array_nth(sol->inpkgs, i);
+
+        if (!i3_is_marked(ictx, pkg) &&
+            !i3_mark_package(ictx, pkg, PKGMARK_DEP))
+            break;              /* processing is stopped */
+    }
+
+    for (int i=0; i < n_array_size(sol->unpkgs); i++) {
+        struct pkg *dbpkg = n_array_nth(sol->unpkgs, i);
+        if (!i3_is_marked_for_removal(ictx, dbpkg))
+            iset_add(ictx->unset, dbpkg, PKGMARK_DEP);
+    }
+
+    return 1;
+}
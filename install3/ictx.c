@@ -218,6 +218,13 @@ void i3ctx_init(struct i3ctx *ictx, struct poldek_ts *ts)
     ictx->ts = ts;
     ictx->ps = ts->ctx->ps;
 
+    if (ts->ctx->_i3cache == NULL)
+        ts->ctx->_i3cache = i3cache_new();
+
+    ictx->cache = ts->ctx->_i3cache;
+    i3cache_attach(ictx->cache, ts);
+    ictx->boolmemo = i3_boolmemo_new();
+
     ictx->processed = pkgmark_set_new(NULL, 0, PKGMARK_SET_IDPTR);
 
     ictx->multi_obsoleted = n_hash_new(8, (tn_fn_free)n_array_free);
@@ -231,6 +238,11 @@ void i3ctx_destroy(struct i3ctx *ictx)
     iset_free(ictx->inset);
     iset_free(ictx->unset);
 
+    if (ictx->cache)
+        i3cache_detach(ictx->cache);
+
+    ictx->cache = NULL;
+    n_hash_free(ictx->boolmemo);
     ictx->ts = NULL;
     ictx->ps = NULL;
     pkgmark_set_free(ictx->processed);
@@ -255,7 +267,11 @@ void i3ctx_reset(struct i3ctx *ictx)
 
     n_hash_clean(ictx->multi_obsoleted);
     n_hash_clean(ictx->errors);
+    n_hash_clean(ictx->boolmemo);
     ictx->abort = 0;
+
+    if (ictx->cache)            /* re-validate, database could be changed */
+        i3cache_attach(ictx->cache, ictx->ts);
 }
 
 int i3_stop_processing(struct i3ctx *ictx, int stop)
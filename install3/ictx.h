@@ -103,6 +103,9 @@ struct i3ctx {
 
     tn_hash           *multi_obsoleted; /* pkg_id => real obsoleted packages (muli-instances upgrade) */
 
+    struct i3cache     *cache;      /* ts->ctx->_i3cache alias */
+    tn_hash            *boolmemo;   /* booldep leaf req => evaluation memo */
+
     unsigned           ma_flags;    /* match flags (POLDEK_MA_*) */
     int                abort;       /* abort processing? */
 };
@@ -112,6 +115,28 @@ void i3ctx_init(struct i3ctx *ictx, struct poldek_ts *ts);
 void i3ctx_reset(struct i3ctx *ictx);
 void i3ctx_destroy(struct i3ctx *ictx);
 
+/* icache.c - solver state reused across transactions of poldek_ctx */
+struct i3cache;
+struct i3cache *i3cache_new(void);
+void i3cache_free(struct i3cache *cache);
+void i3cache_invalidate(struct i3cache *cache);
+
+void i3cache_attach(struct i3cache *cache, struct poldek_ts *ts);
+void i3cache_detach(struct i3cache *cache);
+
+int i3cache_pkgdb_match_req(struct i3cache *cache, struct poldek_ts *ts,
+                            const struct capreq *req, unsigned ma_flags,
+                            const tn_array *exclude);
+
+tn_array *i3cache_installed(struct i3cache *cache, struct poldek_ts *ts,
+                            const char *name, int *nfound);
+
+struct booldep;
+const struct booldep *i3cache_booldep(struct i3cache *cache, const char *expr);
+
+int i3cache_store_solution(struct i3cache *cache, struct i3ctx *ictx);
+int i3cache_restore_solution(struct i3cache *cache, struct i3ctx *ictx);
+
 extern int poldek_conf_MULTILIB;
 
 /* set stop flag */
@@ -176,6 +201,9 @@ void i3_req_iter_init(struct i3_req_iter *it, int indent, struct i3ctx *ictx,
 
 void i3_req_iter_destroy(struct i3_req_iter *it);
 
+/* per transaction memo of booldep leaf requirements, see misc.c */
+tn_hash *i3_boolmemo_new(void);
+
 
 const struct i3req *i3_req_iter_get(struct i3_req_iter *it);
 
@@ -256,15 +256,20 @@ static int install_packages(struct i3ctx *ictx)
     msgn(1, _("Processing dependencies..."));
     //pkgs_array_dump(toinstall, "inset");
 
-    for (i = 0; i < n_array_size(toinstall); i++) {
-        struct pkg *pkg = n_array_nth(toinstall, i);
+    if (!i3cache_restore_solution(ictx->cache, ictx)) {
+        for (i = 0; i < n_array_size(toinstall); i++) {
+            struct pkg *pkg = n_array_nth(toinstall, i);
 
-        DBGF("%s\n", pkg_id(pkg));
-        DBGF("%s %d\n", pkg_id(pkg), i3_is_hand_marked(ictx, pkg));
-        i3_install_package(ictx, pkg);
+            DBGF("%s\n", pkg_id(pkg));
+            DBGF("%s %d\n", pkg_id(pkg), i3_is_hand_marked(ictx, pkg));
+            i3_install_package(ictx, pkg);
 
-        if (sigint_reached())
-            break;
+            if (sigint_reached())
+                break;
+        }
+
+        if (!sigint_reached())
+            i3cache_store_solution(ictx->cache, ictx);
     }
     n_array_free(toinstall);
 
@@ -323,10 +328,17 @@ static int install_packages(struct i3ctx *ictx)
 
     if (ts->getop(ts, POLDEK_OP_JUSTFETCH)) {
         const char *destdir = ts->fetchdir;
+        unsigned flags = 0;
+
         if (destdir == NULL)
             destdir = ts->cachedir;
+        else
+            flags |= PKGFETCH_NOSUBDIRS;
+
+        if (ts->getop(ts, POLDEK_OP_PREFETCH))
+            flags |= PKGFETCH_PREFETCH;
 
-        rc = packages_fetch(ts->pmctx, pkgs, destdir, ts->fetchdir ? 1 : 0);
+        rc = packages_fetch_ext(ts->pmctx, ts->db, pkgs, destdir, flags);
 
     } else if (!ts->getop(ts, POLDEK_OP_HOLD) || (rc = verify_held_packages(ictx))) {
         int is_test = ts->getop(ts, POLDEK_OP_RPMTEST);
@@ -337,13 +349,20 @@ static int install_packages(struct i3ctx *ictx)
         }
 
         if (!ts->getop(ts, POLDEK_OP_NOFETCH))
-            if (!packages_fetch(ts->pmctx, pkgs, ts->cachedir, 0)) {
+            if (!packages_fetch_ext(ts->pmctx, ts->db, pkgs,
+                                    ts->cachedir, 0)) {
                 rc = 0;
                 goto l_end;
             }
 
         rc = do_install(ictx, pkgs);
 
+        /* database has been (probably) modified */
+        if (!is_test) {
+            i3cache_invalidate(ictx->cache);
+            i3cache_detach(ictx->cache);
+        }
+
         if (!is_test && poldek_ts_issetf(ictx->ts, POLDEK_TS_TRACK))
             update_iinf(ictx, rc <= 0);
 
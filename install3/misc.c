@@ -26,10 +26,13 @@ int i3_is_pkg_installed(struct poldek_ts *ts, const struct pkg *pkg, int *cmprc)
 	    || poldek_ts_issetf(ts, POLDEK_TS_DOWNGRADE)
 	    || poldek_ts_issetf(ts, POLDEK_TS_UPGRADEDIST);
 
-    n = pkgdb_search(ts->db, &dbpkgs, PMTAG_NAME, pkg->name, NULL, PKG_LDNEVR);
+    dbpkgs = i3cache_installed(ts->ctx->_i3cache, ts, pkg->name, &n);
+    if (dbpkgs == NULL)
+        n = pkgdb_search(ts->db, &dbpkgs, PMTAG_NAME, pkg->name, NULL, PKG_LDNEVR);
     n_assert(n >= 0);
 
     if (n == 0) {
+        n_array_cfree(&dbpkgs); /* empty one from cache */
         n_assert(dbpkgs == NULL);
         return 0;
     }
@@ -609,6 +612,12 @@ int i3_pkgdb_match_req(struct i3ctx *ictx, const struct capreq *req)
 {
     /* missing epoch in db package is not a problem, usually */
     unsigned ma_flags = ictx->ma_flags | POLDEK_MA_PROMOTE_CAPEPOCH;
+    int rc;
+
+    rc = i3cache_pkgdb_match_req(ictx->cache, ictx->ts, req, ma_flags,
+                                 iset_packages_by_recno(ictx->unset));
+    if (rc >= 0)
+        return rc;
 
     return pkgdb_match_req(ictx->ts->db, req, ma_flags,
                            iset_packages_by_recno(ictx->unset));
@@ -678,6 +687,83 @@ struct eval_ctx {
     struct pkg   *pkg;
 };
 
+/*
+  Available set lookup of booldep leaf requirement. Leaves are shared by
+  many expressions and evaluated several times each (take_best() too),
+  while the available set does not change during transaction. Result
+  depends on requiring package only if it provides req itself, so memo
+  made for other package is reused unless it is among the providers.
+*/
+struct boolmemo {
+    const struct pkg *pkg;      /* package lookup was made for */
+    int              found;
+    tn_array         *providers;
+};
+
+static void boolmemo_free(struct boolmemo *m)
+{
+    n_array_cfree(&m->providers);
+    free(m);
+}
+
+tn_hash *i3_boolmemo_new(void)
+{
+    tn_hash *h = n_hash_new(256, (tn_fn_free)boolmemo_free);
+    n_hash_ctl(h, TN_HASH_REHASH);
+    return h;
+}
+
+static int boolmemo_usable(const struct boolmemo *m, const struct pkg *pkg)
+{
+    if (m->pkg == pkg)
+        return 1;
+
+    if (m->providers == NULL)   /* not found or possibly self matched */
+        return !m->found;
+
+    for (int i=0; i < n_array_size(m->providers); i++)
+        if (n_array_nth(m->providers, i) == pkg)
+            return 0;
+
+    return 1;
+}
+
+static void boolmemo_providers(const struct boolmemo *m, tn_array **providers)
+{
+    if (providers == NULL || m->providers == NULL)
+        return;
+
+    if (*providers == NULL)
+        *providers = pkgs_array_new(n_array_size(m->providers));
+
+    for (int i=0; i < n_array_size(m->providers); i++)
+        n_array_push(*providers, pkg_link(n_array_nth(m->providers, i)));
+}
+
+static int find_match_packages(struct i3ctx *ictx, const struct pkg *pkg,
+                               const struct capreq *req, tn_array **providers)
+{
+    struct boolmemo *m;
+    const char *key = capreq_stra(req);
+
+    if ((m = n_hash_get(ictx->boolmemo, key)) && boolmemo_usable(m, pkg)) {
+        boolmemo_providers(m, providers);
+        return m->found;
+    }
+
+    if (m)                      /* made for other package, do not cache */
+        return pkgset_find_match_packages(ictx->ps, pkg, req, providers, 1);
+
+    m = n_malloc(sizeof(*m));
+    m->pkg = pkg;
+    m->providers = NULL;
+    m->found = pkgset_find_match_packages(ictx->ps, pkg, req, &m->providers, 1);
+    n_hash_insert(ictx->boolmemo, key, m);
+
+    boolmemo_providers(m, providers);
+    return m->found;
+}
+
 static
 int req_cost_cb(const struct capreq *req, tn_array **providers, void *ctxptr)
 {
@@ -685,10 +771,10 @@ int req_cost_cb(const struct capreq *req, tn_array **providers, void *ctxptr)
     struct i3ctx *ictx = ctx->ictx;
     struct pkg *pkg = ctx->pkg;
     int indent = ctx->indent;
+    int found;
 
     /* TODO: get providers from installed set too */
-    if (providers)
-        pkgset_find_match_packages(ictx->ps, pkg, req, providers, 1);
+    found = find_match_packages(ictx, pkg, req, providers);
 
     if (iset_provides(ictx->inset, req)) {
         tracef(indent, "%s %s => iset", pkg_id(pkg), capreq_stra(req));
@@ -700,7 +786,7 @@ int req_cost_cb(const struct capreq *req, tn_array **providers, void *ctxptr)
         return 0;
     }
 
-    if (pkgset_find_match_packages(ictx->ps, pkg, req, NULL, 1)) {
+    if (found) {
         tracef(indent, "%s %s => aset", pkg_id(pkg), capreq_stra(req));
         return 1;
     }
@@ -755,15 +841,12 @@ tn_array *eval_boolreq(const struct capreq *req,
         DBGF_F("%s => %s\n", req->name, expr);
     }
 
-    struct booldep *dep = booldep_parse(expr);
-    if (!dep) {
-        logn(LOGERR, "%s: boolean dependency parse error", expr);
+    struct eval_ctx *ectx = bctx->ctx;
+    const struct booldep *dep = i3cache_booldep(ectx->ictx->cache, expr);
+    if (!dep)                   /* parse error, already logged */
         return NULL;
-    }
 
-    tn_array *reqs = booldep_eval(dep, bctx);
-
-    struct eval_ctx *ectx = bctx->ctx;
+    tn_array *reqs = booldep_eval((struct booldep*)dep, bctx);
     const char *to = NULL;
 
     if (reqs == NULL) {
@@ -783,7 +866,6 @@ tn_array *eval_boolreq(const struct capreq *req,
     }
 
     msgn_i(2, ectx->indent, "%s boolean dependency resolved to %s", expr, to);
-    booldep_free(dep);
 
     return reqs;
 }
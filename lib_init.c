@@ -39,6 +39,7 @@
 #include "poldek_term.h"
 #include "pm/pm.h"
 #include "conf_intern.h"
+#include "install3/ictx.h"
 
 extern int (*poldek_log_say_goodbye)(const char *msg); /* log.c */
 
@@ -224,6 +225,7 @@ struct source *do_source_new_htcnf(struct poldek_ctx *ctx,
                                    tn_hash *htcnf, int no)
 {
     struct source *src;
+    tn_array *mirrors;
     const char *vs;
 
     /* set the name if missing; all sources loaded from config must be named */
@@ -237,6 +239,12 @@ struct source *do_source_new_htcnf(struct poldek_ctx *ctx,
     if (src == NULL)
         return NULL;
 
+    if (src->path && (mirrors = poldek_conf_get_multi(htcnf, "mirror"))) {
+        for (int i=0; i < n_array_size(mirrors); i++)
+            vf_mirror_add(src->path, n_array_nth(mirrors, i));
+        n_array_free(mirrors);
+    }
+
     if (n_array_size(src->exclude_path) == 0 && /* take global exclude path */
         n_array_size(ctx->ts->exclude_path) > 0) {
 
@@ -375,6 +383,9 @@ static int source_to_htconf(struct source *src, int no, tn_hash *htcnf)
     if (src->flags & PKGSOURCE_VRFY_SIGN)
         poldek_conf_add_to_section(sect, "signed", "yes");
 
+    if (src->flags & PKGSOURCE_DELTAS)
+        poldek_conf_add_to_section(sect, "deltas", "yes");
+
     if (src->flags & PKGSOURCE_COMPR)
         poldek_conf_add_to_section(sect, "compr", "yes");
 
@@ -1044,9 +1055,30 @@ int poldek_load_config(struct poldek_ctx *ctx, const char *path,
     else if (poldek_conf_get_bool(htcnf, "auto_zlib_in_rpm", 0))
         zlib_in_rpm(ctx);
 
+    if (poldek_conf_get_bool(htcnf, "shared_package_cache", 0))
+        vfile_configure(VFILE_CONF_STORE, 1);
+
     if ((v = poldek_conf_get_int(htcnf, "vfile_retries", 100)) > 0)
         vfile_configure(VFILE_CONF_STUBBORN_NRETRIES, v);
 
+    if ((v = poldek_conf_get_int(htcnf, "vfile_max_connections", 4)) > 0)
+        vfile_configure(VFILE_CONF_MAXCONN, v);
+
+    if ((v = poldek_conf_get_int(htcnf, "vfile_max_connections_per_host", 2)) > 0)
+        vfile_configure(VFILE_CONF_MAXCONN_PERHOST, v);
+
+    if ((v = poldek_conf_get_int(htcnf, "vfile_timeout", 30)) > 0)
+        vfile_configure(VFILE_CONF_TIMEOUT, v);
+
+    if (!poldek_conf_get_bool(htcnf, "vfile_tls_verify", 1))
+        vfile_configure(VFILE_CONF_TLS_NOVERIFY, 1);
+
+    if ((v = poldek_conf_get_int(htcnf, "vfile_rate_limit", 0)) > 0)
+        vfile_configure(VFILE_CONF_RATE_LIMIT, v);
+
+    if ((v = poldek_conf_get_int(htcnf, "vfile_host_rate_limit", 0)) > 0)
+        vfile_configure(VFILE_CONF_HOST_RATE_LIMIT, v);
+
     return 1;
 }
 
@@ -1157,6 +1189,11 @@ void poldek_destroy(struct poldek_ctx *ctx)
         ctx->pkgdirs = NULL;
     }
 
+    if (ctx->_i3cache) {
+        i3cache_free(ctx->_i3cache);
+        ctx->_i3cache = NULL;
+    }
+
     if (ctx->ps)
         pkgset_free(ctx->ps);
 
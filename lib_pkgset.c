@@ -128,7 +128,12 @@ tn_array *poldek_load_stubs(struct poldek_ctx *ctx)
     }
 
     n_array_isort_ex(sources, (tn_fn_cmp)source_cmp_pri);
-    tn_array *stubpkgs = pkgs_array_new(4096);
+
+    struct poldek_ts *ts = ctx->ts;
+    tn_buf *stamp = n_buf_new(1024);
+    int nstamps = 0;
+
+    n_buf_printf(stamp, "#uniqn %d\n", ts->getop(ts, POLDEK_OP_UNIQN) ? 1 : 0);
 
     for (i=0; i < n_array_size(sources); i++) {
         struct source *src = n_array_nth(sources, i);
@@ -139,9 +144,33 @@ tn_array *poldek_load_stubs(struct poldek_ctx *ctx)
         if (src->type == NULL)
             source_set_type(src, poldek_conf_PKGDIR_DEFAULT_TYPE);
 
+        if (!source_stubstamp(src, stamp)) { /* need all stubs or nothing */
+            n_buf_free(stamp);
+            return NULL;
+        }
+        nstamps++;
+    }
+    n_buf_putc(stamp, '\0');
+
+    /* nothing changed since previous session? */
+    tn_array *stubpkgs = NULL;
+    if (nstamps > 0 &&
+        (stubpkgs = sources_stubload_session(n_buf_ptr(stamp)))) {
+        n_buf_free(stamp);
+        return stubpkgs;
+    }
+
+    stubpkgs = pkgs_array_new(4096);
+    for (i=0; i < n_array_size(sources); i++) {
+        struct source *src = n_array_nth(sources, i);
+
+        if (src->flags & PKGSOURCE_NOAUTO)
+            continue;
+
         tn_array *pkgs = source_stubload(src);
         if (pkgs == NULL) {     /* need all stubs or nothing */
             n_array_cfree(&stubpkgs);
+            n_buf_free(stamp);
             return 0;
         }
 
@@ -156,10 +185,12 @@ tn_array *poldek_load_stubs(struct poldek_ctx *ctx)
         n_array_free(pkgs);
     }
     n_array_sort_ex(stubpkgs, (tn_fn_cmp)pkg_cmp_name_evr_arch_rev_srcpri);
-
-    struct poldek_ts *ts = ctx->ts;
     packages_uniq(stubpkgs, ts->getop(ts, POLDEK_OP_UNIQN) ? true : false);
 
+    if (nstamps > 0)
+        sources_stubsave_session(n_buf_ptr(stamp), stubpkgs);
+    n_buf_free(stamp);
+
     return stubpkgs;
 }
 
@@ -40,32 +40,11 @@ struct pkgdir;                  /* defined in pkgdir/pkgdir.h */
 #define PKG_IGNORED         (1 << 13) /* invisible      */
 #define PKG_IGNORED_UNIQ    (1 << 14) /* uniqued        */
 
-#define PKG_ORDER_PREREQ    (1 << 15) /* see pkgset-order.c */
-
 #define PKG_DBPKG           (1 << 16) /* loaded from database, i.e. installed */
 #define PKG_INCLUDED_DIRREQS (1 << 17) /* auto-dir-reqs added directly to reqs */
 
-#ifdef POLDEK_PKG_DAG_COLOURS
-/* DAG node colours (pkgset-order.c) */
-# define PKG_COLOR_WHITE    (1 << 20)
-# define PKG_COLOR_GRAY     (1 << 21)
-# define PKG_COLOR_BLACK    (1 << 22)
-# define PKG_ALL_COLORS     (PKG_COLOR_WHITE | PKG_COLOR_GRAY | PKG_COLOR_BLACK)
-
-/* colours */
-# define pkg_set_color(pkg, color) \
-   ((pkg)->flags &= ~(PKG_ALL_COLORS), (pkg)->flags |= (color))
-
-# define pkg_is_color(pkg, color) \
-   ((pkg)->flags & color)
-#endif  /* POLDEK_PKG_DAG_COLOURS */
-
 #define pkg_is_noarch(pkg)  (0 == strcmp(pkg_arch((pkg)), "noarch"))
 
-#define pkg_set_prereqed(pkg) ((pkg)->flags |= PKG_ORDER_PREREQ)
-#define pkg_clr_prereqed(pkg)  ((pkg)->flags &= ~PKG_ORDER_PREREQ)
-#define pkg_is_prereqed(pkg)  ((pkg)->flags & PKG_ORDER_PREREQ)
-
 #define pkg_score(pkg, v) ((pkg)->flags |= v)
 #define pkg_is_scored(pkg, v) ((pkg)->flags & v)
 #define pkg_clr_score(pkg, v) ((pkg)->flags &= ~(v))
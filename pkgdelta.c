@@ -0,0 +1,387 @@
+/*
+  Copyright (C) 2000 - 2008 Pawel A. Gajda <mis@pld-linux.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+/*
+  Deltarpm support. Source with "deltas" option provides deltas.toc
+  next to its index, one delta per line:
+
+    PACKAGE-FILE BASE-EVR DELTA-PATH SIZE
+
+  where BASE-EVR is [EPOCH:]VERSION-RELEASE of package the delta is
+  made against and DELTA-PATH is relative to the source path. Packages
+  are rebuilt by applydeltarpm(8) either from base package file kept in
+  the cache or, when installing to the system root, from installed files.
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/param.h>          /* for PATH_MAX */
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <trurl/nassert.h>
+#include <trurl/narray.h>
+#include <trurl/nmalloc.h>
+#include <trurl/nhash.h>
+#include <trurl/nstr.h>
+#include <trurl/nstream.h>
+#include <trurl/n_snprintf.h>
+
+#include <vfile/vfile.h>
+
+#include <sigint/sigint.h>
+
+#include "compiler.h"
+#include "i18n.h"
+#include "log.h"
+#include "pkg.h"
+#include "pkgmisc.h"
+#include "pkgdelta.h"
+#include "pkgdir/pkgdir.h"
+#include "pm/pm.h"
+
+#define DELTAS_TOC "deltas.toc"
+
+struct deltaent {
+    char      *base;            /* [E:]V-R of base package */
+    char      *path;            /* relative to source path */
+    unsigned  size;
+    char      _buf[0];
+};
+
+struct pkgdelta_ctx {
+    struct pm_ctx  *pmctx;
+    struct pkgdb   *db;
+    int            db_reopened;    /* db has been closed by caller */
+    char           cmd[PATH_MAX];  /* applydeltarpm */
+    tn_hash        *tocs;          /* source path => toc (or NULL) */
+};
+
+struct pkgdelta_ctx *pkgdelta_ctx_new(struct pm_ctx *pmctx, struct pkgdb *db)
+{
+    struct pkgdelta_ctx *ctx;
+    char cmd[PATH_MAX];
+
+    if (db == NULL)
+        return NULL;
+
+    if (!vf_find_external_command(cmd, sizeof(cmd), "applydeltarpm", NULL)) {
+        msgn(2, _("applydeltarpm not found, deltarpms will not be used"));
+        return NULL;
+    }
+
+    ctx = n_calloc(sizeof(*ctx), 1);
+    ctx->pmctx = pmctx;
+    ctx->db = db;
+    n_snprintf(ctx->cmd, sizeof(ctx->cmd), "%s", cmd);
+    ctx->tocs = n_hash_new(16, (tn_fn_free)n_hash_free);
+    return ctx;
+}
+
+void pkgdelta_ctx_free(struct pkgdelta_ctx *ctx)
+{
+    if (ctx->db_reopened)
+        pkgdb_close(ctx->db);
+
+    n_hash_free(ctx->tocs);
+    free(ctx);
+}
+
+void pkgdelta_free(struct pkgdelta *d)
+{
+    free(d->url);
+    free(d->path);
+    free(d->destpath);
+    free(d->baserpm);
+    free(d);
+}
+
+static struct deltaent *deltaent_new(const char *base, const char *path,
+                                     unsigned size)
+{
+    struct deltaent *ent;
+    int blen = strlen(base) + 1, plen = strlen(path) + 1;
+
+    ent = n_malloc(sizeof(*ent) + blen + plen);
+    ent->base = ent->_buf;
+    memcpy(ent->base, base, blen);
+    ent->path = ent->_buf + blen;
+    memcpy(ent->path, path, plen);
+    ent->size = size;
+    return ent;
+}
+
+static tn_hash *load_toc(const char *srcpath)
+{
+    char path[PATH_MAX], buf[1024];
+    struct vfile *vf;
+    tn_hash *toc;
+    int nline = 0;
+
+    n_snprintf(path, sizeof(path), "%s/%s", srcpath, DELTAS_TOC);
+    vf = vfile_open_ul(path, VFT_TRURLIO, VFM_RO | VFM_NOEMPTY | VFM_QUITERR,
+                       NULL);
+    if (vf == NULL) {
+        msgn(2, _("%s: no deltarpms available"), vf_url_slim_s(path, 0));
+        return NULL;
+    }
+
+    toc = n_hash_new(512, free);
+    while (n_stream_gets(vf->vf_tnstream, buf, sizeof(buf) - 1)) {
+        char *tl[5], *p, *sp = NULL;
+        unsigned size;
+        int n = 0;
+
+        nline++;
+        while (n < 5 && (p = strtok_r(n == 0 ? buf : NULL, " \t\r\n", &sp)))
+            tl[n++] = p;
+
+        if (n == 0 || *tl[0] == '#')
+            continue;
+
+        if (n != 4 || sscanf(tl[3], "%u", &size) != 1) {
+            logn(LOGWARN, _("%s:%d: invalid line, skipped"),
+                 vf_url_slim_s(path, 0), nline);
+            continue;
+        }
+
+        if (!n_hash_exists(toc, tl[0]))
+            n_hash_insert(toc, tl[0], deltaent_new(tl[1], tl[2], size));
+    }
+
+    vfile_close(vf);
+    return toc;
+}
+
+static struct deltaent *find_deltaent(struct pkgdelta_ctx *ctx,
+                                      const struct pkg *pkg)
+{
+    const char *srcpath = pkg->pkgdir->path;
+    tn_hash *toc;
+
+    if (n_hash_exists(ctx->tocs, srcpath)) {
+        toc = n_hash_get(ctx->tocs, srcpath);
+    } else {
+        toc = load_toc(srcpath);
+        n_hash_insert(ctx->tocs, srcpath, toc);
+    }
+
+    if (toc == NULL)
+        return NULL;
+
+    return n_hash_get(toc, pkg_filename_s(pkg));
+}
+
+static int is_base(const struct pkg *dbpkg, const struct pkg *pkg,
+                   const char *base)
+{
+    char evr[256];
+
+    if (n_str_ne(pkg_arch(dbpkg), pkg_arch(pkg)))
+        return 0;
+
+    if (dbpkg->epoch)
+        n_snprintf(evr, sizeof(evr), "%d:%s-%s", dbpkg->epoch, dbpkg->ver,
+                   dbpkg->rel);
+    else
+        n_snprintf(evr, sizeof(evr), "%s-%s", dbpkg->ver, dbpkg->rel);
+
+    return n_str_eq(evr, base);
+}
+
+struct pkgdelta *pkgdelta_find(struct pkgdelta_ctx *ctx, struct pkg *pkg,
+                               const char *destdir)
+{
+    struct deltaent *ent;
+    struct pkgdelta *d;
+    tn_array *dbpkgs = NULL;
+    struct pkg *base = NULL;
+    char path[PATH_MAX], *baserpm = NULL;
+    const char *rootdir;
+
+    if (pkg->pkgdir == NULL || (pkg->pkgdir->flags & PKGDIR_DELTAS) == 0)
+        return NULL;
+
+    if ((ent = find_deltaent(ctx, pkg)) == NULL)
+        return NULL;
+
+    if (pkg->fsize && ent->size >= pkg->fsize)
+        return NULL;
+
+    if (!ctx->db->_opened) {
+        if (!pkgdb_reopen(ctx->db, O_RDONLY))
+            return NULL;
+        ctx->db_reopened = 1;
+    }
+
+    pkgdb_search(ctx->db, &dbpkgs, PMTAG_NAME, pkg->name, NULL, PKG_LDNEVR);
+    for (int i=0; dbpkgs && i < n_array_size(dbpkgs); i++) {
+        struct pkg *dbpkg = n_array_nth(dbpkgs, i);
+        if (is_base(dbpkg, pkg, ent->base)) {
+            base = dbpkg;
+            break;
+        }
+    }
+
+    if (base == NULL) {
+        n_array_cfree(&dbpkgs);
+        return NULL;
+    }
+
+    /* base package kept in cache (keep_downloads), or installed files
+       if we are installing to the root of running system */
+    n_snprintf(path, sizeof(path), "%s/%s", destdir, pkg_filename_s(base));
+    n_array_free(dbpkgs);
+
+    rootdir = ctx->db->rootdir;
+    if (access(path, R_OK) == 0)
+        baserpm = n_strdup(path);
+
+    else if (rootdir && n_str_ne(rootdir, "/"))
+        return NULL;
+
+    d = n_calloc(sizeof(*d), 1);
+    d->pkg = pkg;
+    d->baserpm = baserpm;
+    d->size = ent->size;
+
+    n_snprintf(path, sizeof(path), "%s/%s", pkg->pkgdir->path, ent->path);
+    d->url = n_strdup(path);
+
+    n_snprintf(path, sizeof(path), "%s/%s", destdir, n_basenam(ent->path));
+    d->path = n_strdup(path);
+
+    n_snprintf(path, sizeof(path), "%s/%s", destdir, pkg_filename_s(pkg));
+    d->destpath = n_strdup(path);
+
+    return d;
+}
+
+static pid_t apply_start(const char *cmd, const struct pkgdelta *d)
+{
+    char *argv[8];
+    pid_t pid;
+    int n = 0;
+
+    argv[n++] = "applydeltarpm";
+    if (d->baserpm) {
+        argv[n++] = "-r";
+        argv[n++] = d->baserpm;
+    }
+    argv[n++] = d->path;
+    argv[n++] = d->destpath;
+    argv[n] = NULL;
+
+    unlink(d->destpath);
+    msgn(2, _("Rebuilding %s..."), n_basenam(d->destpath));
+
+    fflush(NULL);
+    if ((pid = fork()) == 0) {
+        execv(cmd, argv);
+        _exit(127);
+
+    } else if (pid < 0) {
+        logn(LOGERR, "fork: %m");
+    }
+
+    return pid;
+}
+
+static void apply_done(struct pkgdelta_ctx *ctx, struct pkgdelta *d,
+                       int status)
+{
+    const char *name = n_basenam(d->destpath);
+
+    d->rc = 0;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        logn(LOGWARN, _("%s: rebuild from deltarpm failed"), name);
+
+    } else if (!pm_verify_signature(ctx->pmctx, d->destpath, PKGVERIFY_MD)) {
+        logn(LOGWARN, _("%s: rebuilt package MD5 signature verification "
+                        "failed"), name);
+    } else {
+        d->rc = 1;
+    }
+
+    if (!d->rc)
+        vf_unlink(d->destpath);
+
+    vf_unlink(d->path);
+}
+
+int pkgdelta_apply(struct pkgdelta_ctx *ctx, tn_array *deltas)
+{
+    int i, n = n_array_size(deltas), nrunning = 0, nrebuilt = 0;
+    long maxproc;
+    pid_t *pids;
+
+    if (n == 0)
+        return 0;
+
+    /* rebuilding is CPU bound */
+    if ((maxproc = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+        maxproc = 1;
+
+    msgn(1, _("Rebuilding %d package(s) from deltarpms..."), n);
+
+    pids = alloca(sizeof(*pids) * n);
+    memset(pids, 0, sizeof(*pids) * n);
+
+    i = 0;
+    while (i < n || nrunning > 0) {
+        struct pkgdelta *d;
+        int status, j;
+        pid_t pid;
+
+        if (i < n && nrunning < maxproc && !sigint_reached()) {
+            d = n_array_nth(deltas, i);
+            d->rc = 0;
+            if ((pids[i] = apply_start(ctx->cmd, d)) > 0)
+                nrunning++;
+            else
+                vf_unlink(d->path);
+            i++;
+            continue;
+        }
+
+        if (nrunning == 0)
+            break;
+
+        if ((pid = waitpid(-1, &status, 0)) < 0) {
+            if (errno == EINTR)
+                continue;
+            logn(LOGERR, "waitpid: %m");
+            break;
+        }
+
+        for (j=0; j < n; j++)
+            if (pids[j] == pid)
+                break;
+
+        if (j == n)             /* not ours */
+            continue;
+
+        pids[j] = 0;
+        nrunning--;
+
+        d = n_array_nth(deltas, j);
+        apply_done(ctx, d, status);
+        if (d->rc)
+            nrebuilt++;
+    }
+
+    return nrebuilt;
+}
@@ -0,0 +1,44 @@
+/*
+  Copyright (C) 2000 - 2008 Pawel A. Gajda <mis@pld-linux.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+#ifndef POLDEK_PKGDELTA_H
+#define POLDEK_PKGDELTA_H
+
+#include <trurl/narray.h>
+
+struct pkg;
+struct pkgdb;
+struct pm_ctx;
+
+struct pkgdelta {
+    struct pkg  *pkg;           /* package to rebuild */
+    char        *url;           /* deltarpm url */
+    char        *path;          /* downloaded deltarpm */
+    char        *destpath;      /* rebuilt package */
+    char        *baserpm;       /* base package file, NULL => installed one */
+    unsigned    size;           /* deltarpm size */
+    int         rc;             /* 1 if package has been rebuilt */
+};
+
+struct pkgdelta_ctx;
+
+/* NULL if deltas cannot be used at all (no applydeltarpm) */
+struct pkgdelta_ctx *pkgdelta_ctx_new(struct pm_ctx *pmctx, struct pkgdb *db);
+void pkgdelta_ctx_free(struct pkgdelta_ctx *ctx);
+
+/* delta of pkg to be fetched into destdir, or NULL if there is no
+   usable one (no base version installed, delta not smaller, etc) */
+struct pkgdelta *pkgdelta_find(struct pkgdelta_ctx *ctx, struct pkg *pkg,
+                               const char *destdir);
+void pkgdelta_free(struct pkgdelta *d);
+
+/* rebuild packages from downloaded deltas, pkgdelta->rc is set;
+   RET: number of rebuilt packages */
+int pkgdelta_apply(struct pkgdelta_ctx *ctx, tn_array *deltas);
+
+#endif
@@ -451,6 +451,9 @@ struct pkgdir *pkgdir_srcopen(const struct source *src, unsigned flags)
     if (src->flags & PKGSOURCE_VRFY_PGP)
         pkgdir->flags |= PKGDIR_VRFY_PGP;
 
+    if (src->flags & PKGSOURCE_DELTAS)
+        pkgdir->flags |= PKGDIR_DELTAS;
+
     pkgdir->pri = src->pri;
     pkgdir->src = source_link((struct source *)src);
     return pkgdir;
@@ -882,6 +885,14 @@ const char *pkgdir_localidxpath(const struct pkgdir *pkgdir)
     return pkgdir->idxpath;
 }
 
+tn_array *pkgdir_ftsearch(struct pkgdir *pkgdir, int type, const char *text)
+{
+    if (pkgdir->mod == NULL || pkgdir->mod->ftsearch == NULL)
+        return NULL;
+
+    return pkgdir->mod->ftsearch(pkgdir, type, text);
+}
+
 time_t pkgdir_mtime(const struct pkgdir *pkgdir)
 {
     const char *path = pkgdir_localidxpath(pkgdir);
@@ -37,6 +37,8 @@
 #define PKGDIR_VRFY_GPG            (1 << 10) /* verify package GPG signatures */
 #define PKGDIR_VRFY_PGP            (1 << 11) /* verify package PGP signatures */
 
+#define PKGDIR_DELTAS              (1 << 12) /* deltarpms are available */
+
 #define PKGDIR_VRFYSIGN            (PKGDIR_VRFY_GPG | PKGDIR_VRFY_PGP)
 
 struct pkgdir_module;
@@ -151,6 +153,9 @@ EXPORT int pkgdir_load(struct pkgdir *pkgdir, const tn_array *depdirs, unsigned
 #define PKGDIR_CREAT_v018x    (1 << 9) /* pdir: do not store package timestamps
                                           cause it brokes inremental updates
                                           by 0.18.x */
+#define PKGDIR_CREAT_FTINDEX  (1 << 10) /* pndir: create full-text index of
+                                           package descriptions */
+#define PKGDIR_CREAT_FLINDEX  (1 << 11) /* pndir: create index of file paths */
 
 EXPORT int pkgdir_save(struct pkgdir *pkgdir, unsigned flags);
 
@@ -159,6 +164,8 @@ EXPORT int pkgdir_save_as(struct pkgdir *pkgdir, const char *type,
 
 EXPORT struct pkgdir *pkgdir_diff(struct pkgdir *pkgdir, struct pkgdir *pkgdir2);
 EXPORT struct pkgdir *pkgdir_patch(struct pkgdir *pkgdir, struct pkgdir *pkgdir2);
+/* apply patches (successive diffs, struct pkgdir *[]) at once */
+EXPORT struct pkgdir *pkgdir_patch_many(struct pkgdir *pkgdir, tn_array *patches);
 
 EXPORT int pkgdir_update(struct pkgdir *pkgdir);
 EXPORT int pkgdir_update_a(const struct source *src);
@@ -216,6 +223,16 @@ EXPORT tn_array *pkgdir_dirindex_get_required(const struct pkgdir *pkgdir,
 EXPORT tn_array *pkgdir_dirindex_get_provided(const struct pkgdir *pkgdir,
                                        const struct pkg *pkg);
 
+/* Full-text index lookup, candidates only: packages whose summary,
+   description, license, url or changelog (PKGDIR_FTS_TEXT, see
+   PKGDIR_CREAT_FTINDEX) or file paths and symlink targets (PKGDIR_FTS_FILES,
+   see PKGDIR_CREAT_FLINDEX) may contain text. NULL if index is not
+   available or text is too short */
+#define PKGDIR_FTS_TEXT   0
+#define PKGDIR_FTS_FILES  1
+EXPORT tn_array *pkgdir_ftsearch(struct pkgdir *pkgdir, int type,
+                                 const char *text);
+
 #endif  /* SWIG */
 
 #endif /* POLDEK_PKGDIR_H*/
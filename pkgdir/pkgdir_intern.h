@@ -91,6 +91,8 @@ typedef int (*pkgdir_fn_unlink)(const char *path, int allfiles);
 typedef void (*pkgdir_fn_free)(struct pkgdir *pkgdir);
 
 typedef const char *(*pkgdir_fn_localidxpath)(const struct pkgdir *pkgdir);
+typedef tn_array *(*pkgdir_fn_ftsearch)(struct pkgdir *pkgdir, int type,
+                                        const char *text);
 typedef int (*pkgdir_fn_setpaths)(struct pkgdir *pkgdir,
                                   const char *path, const char *pkg_prefix);
 
@@ -113,6 +115,7 @@ struct pkgdir_module {
 
     pkgdir_fn_localidxpath  localidxpath;
     int (*posthook_diff) (struct pkgdir*, struct pkgdir*, struct pkgdir*);
+    pkgdir_fn_ftsearch      ftsearch;
 };
 
 //int pkgdir_mod_register(const struct pkgdir_module *mod);
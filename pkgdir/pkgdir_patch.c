@@ -194,61 +194,122 @@ struct pkgdir *pkgdir_diff(struct pkgdir *pkgdir, struct pkgdir *pkgdir2)
 }
 
 
-struct pkgdir *pkgdir_patch(struct pkgdir *pkgdir, struct pkgdir *patch)
+static void remap_groupids(tn_array *pkgs, struct pkgroup_idx *idx_to,
+                           struct pkgroup_idx *idx_from)
 {
-    struct pkg *pkg;
     int i;
 
+    for (i=0; i < n_array_size(pkgs); i++) {
+        struct pkg *pkg = n_array_nth(pkgs, i);
+        if (pkg->groupid > 0)
+            pkg->groupid = pkgroup_idx_remap_groupid(idx_to, idx_from,
+                                                     pkg->groupid, 1);
+    }
+}
+
+/*
+  Apply successive patches at once: their removed and added packages
+  are merged first (package added by one patch and removed by a later
+  one is dropped), then pkgdir->pkgs is rebuilt in one pass and sorted
+  once, instead of being patched and resorted for each patch.
+*/
+struct pkgdir *pkgdir_patch_many(struct pkgdir *pkgdir, tn_array *patches)
+{
+    struct pkgroup_idx *groups = pkgdir->pkgroups;
+    struct pkgdir *patch = NULL;
+    tn_array *plus_pkgs, *minus_pkgs, *kept_pkgs;
+    time_t ts = pkgdir->ts;
+    struct pkg *pkg;
+    int i, j;
+
     n_assert((pkgdir->flags & PKGDIR_DIFF) == 0);
+    n_assert(n_array_size(patches) > 0);
 
-    n_assert(patch->flags & PKGDIR_DIFF);
-    n_assert(patch->ts > pkgdir->ts);
-    DBGF("orig=%s, ts=%s, pdir=%s\n", strtime_(patch->orig_ts), strtime_(patch->ts),
-           strtime_(pkgdir->ts));
-    n_assert(patch->orig_ts >= pkgdir->ts);
+    plus_pkgs = pkgs_array_new(256);
+    minus_pkgs = pkgs_array_new(256);
 
-    pkgdir->ts = patch->ts;
+    for (i=0; i < n_array_size(patches); i++) {
+        patch = n_array_nth(patches, i);
 
-    if (patch->removed_pkgs)
-        for (i=0; i < n_array_size(patch->removed_pkgs); i++) {
-            pkg = n_array_nth(patch->removed_pkgs, i);
-            msg(2, "-- %s\n", pkg_snprintf_s(pkg));
-            n_array_remove(pkgdir->pkgs, pkg);
+        n_assert(patch->flags & PKGDIR_DIFF);
+        n_assert(patch->ts > ts);
+        DBGF("orig=%s, ts=%s, pdir=%s\n", strtime_(patch->orig_ts),
+             strtime_(patch->ts), strtime_(ts));
+        n_assert(patch->orig_ts >= ts);
+        ts = patch->ts;
+
+        if (patch->removed_pkgs) {
+            for (j=0; j < n_array_size(patch->removed_pkgs); j++) {
+                pkg = n_array_nth(patch->removed_pkgs, j);
+
+                if (n_array_bsearch(plus_pkgs, pkg))
+                    n_array_remove(plus_pkgs, pkg);
+
+                else if (n_array_bsearch(minus_pkgs, pkg) == NULL)
+                    n_array_push(minus_pkgs, pkg_link(pkg));
+            }
         }
 
-    if (patch->pkgroups) {
-        for (i=0; i < n_array_size(pkgdir->pkgs); i++) {
-            pkg = n_array_nth(pkgdir->pkgs, i);
-            if (pkg->groupid > 0)
-                pkg->groupid = pkgroup_idx_remap_groupid(patch->pkgroups,
-                                                         pkgdir->pkgroups,
-                                                         pkg->groupid, 1);
+        /* packages of previous patches to this patch groups */
+        if (patch->pkgroups) {
+            if (groups)
+                remap_groupids(plus_pkgs, patch->pkgroups, groups);
+            groups = patch->pkgroups;
         }
 
-        pkgroup_idx_free(pkgdir->pkgroups);
-        pkgdir->pkgroups = pkgroup_idx_link(patch->pkgroups);
+        if (patch->pkgs) {
+            tn_array *langs;
+
+            for (j=0; j < n_array_size(patch->pkgs); j++)
+                n_array_push(plus_pkgs, pkg_link(n_array_nth(patch->pkgs, j)));
+
+            /* assume that diff packages have all languages, not true but it
+               just for estimation */
+            langs = n_hash_keys(patch->avlangs_h);
+            for (j=0; j < n_array_size(langs); j++)
+                pkgdir__update_avlangs(pkgdir, n_array_nth(langs, j),
+                                       n_array_size(patch->pkgs));
+            n_array_free(langs);
+        }
     }
 
-    if (patch->pkgs) {
-        tn_array *langs;
+    n_array_sort(minus_pkgs);
+    kept_pkgs = n_array_new(n_array_size(pkgdir->pkgs), NULL, NULL);
 
-        for (i=0; i < n_array_size(patch->pkgs); i++) {
-            pkg = n_array_nth(patch->pkgs, i);
-            msg(2, "++ %s\n", pkg_snprintf_s(pkg));
-            n_array_push(pkgdir->pkgs, pkg_link(pkg));
+    for (i=0; i < n_array_size(pkgdir->pkgs); i++) {
+        pkg = n_array_nth(pkgdir->pkgs, i);
+
+        if (n_array_bsearch(minus_pkgs, pkg)) {
+            msg(2, "-- %s\n", pkg_snprintf_s(pkg));
+            continue;
         }
+        n_array_push(kept_pkgs, pkg_link(pkg));
+    }
 
+    if (groups != pkgdir->pkgroups) {
+        if (pkgdir->pkgroups)
+            remap_groupids(kept_pkgs, groups, pkgdir->pkgroups);
 
-        /* assume that diff packages have all languages, not true but it
-           just for estimation */
-        langs = n_hash_keys(patch->avlangs_h);
-        for (i=0; i < n_array_size(langs); i++) /*  */
-            pkgdir__update_avlangs(pkgdir, n_array_nth(langs, i),
-                                   n_array_size(patch->pkgs));
-        n_array_free(langs);
+        pkgroup_idx_free(pkgdir->pkgroups);
+        pkgdir->pkgroups = pkgroup_idx_link(groups);
     }
 
+    n_array_clean(pkgdir->pkgs);
+    for (i=0; i < n_array_size(kept_pkgs); i++)
+        n_array_push(pkgdir->pkgs, n_array_nth(kept_pkgs, i));
 
+    for (i=0; i < n_array_size(plus_pkgs); i++) {
+        pkg = n_array_nth(plus_pkgs, i);
+        msg(2, "++ %s\n", pkg_snprintf_s(pkg));
+        n_array_push(pkgdir->pkgs, pkg_link(pkg));
+    }
+    n_array_sort(pkgdir->pkgs);
+
+    n_array_free(kept_pkgs);
+    n_array_free(plus_pkgs);
+    n_array_free(minus_pkgs);
+
+    /* the last patch has the current ones */
     if (pkgdir->depdirs) {
         n_array_free(pkgdir->depdirs);
         pkgdir->depdirs = NULL;
@@ -261,6 +322,19 @@ struct pkgdir *pkgdir_patch(struct pkgdir *pkgdir, struct pkgdir *patch)
 
         n_array_sort(pkgdir->depdirs);
     }
+
+    pkgdir->ts = ts;
     pkgdir->flags |= PKGDIR_PATCHED;
     return pkgdir;
 }
+
+struct pkgdir *pkgdir_patch(struct pkgdir *pkgdir, struct pkgdir *patch)
+{
+    tn_array *patches = n_array_new(1, NULL, NULL);
+
+    n_array_push(patches, patch);
+    pkgdir_patch_many(pkgdir, patches);
+    n_array_free(patches);
+
+    return pkgdir;
+}
@@ -94,6 +94,55 @@ static int stubindex_path(char *path, int size, const struct pkgdir *pkgdir)
     return n;
 }
 
+static void write_stubs(tn_stream *st, tn_array *pkgs)
+{
+    for (int i=0; i < n_array_size(pkgs); i++) {
+        struct pkg *pkg = n_array_nth(pkgs, i);
+        char key[PATH_MAX];
+
+        int n = pndir_make_pkgkey(key, sizeof(key), pkg);
+        n_snprintf(&key[n], sizeof(key) - n, "^%u:%u:%u", pkg->color, pkg->size, pkg->btime);
+        n_stream_printf(st, "%s\n", key);
+    }
+}
+
+/* reads stubs, lines starting with '#' are passed to hdr (if not NULL) */
+static tn_array *read_stubs(tn_stream *st, tn_buf *hdr)
+{
+    tn_array *pkgs;
+    char *buf;
+    int n;
+
+    pkgs = pkgs_array_new(512);
+    buf = n_malloc(128);
+
+    while ((n = n_stream_getline(st, &buf, 128)) > 0) {
+        char *b = n_str_strip_ws(buf);
+
+        if (*b == '#') {
+            if (hdr)
+                n_buf_printf(hdr, "%s\n", b);
+            continue;
+        }
+
+        char *csb = strrchr(b, '^');
+        if (csb != NULL) {
+            *csb = '\0';
+            csb++;
+        }
+
+        struct pkg *pkg = pndir_parse_pkgkey(b, n, NULL);
+        if (pkg) {
+            if (csb)
+                sscanf(csb, "%u:%u:%u", &pkg->color, &pkg->size, &pkg->btime);
+            n_array_push(pkgs, pkg);
+        }
+    }
+    n_free(buf);
+
+    return pkgs;
+}
+
 static int stubindex_create(const struct pkgdir *pkgdir, const char *path)
 {
     struct vflock *lock;
@@ -117,15 +166,7 @@ static int stubindex_create(const struct pkgdir *pkgdir, const char *path)
         return 0;
     }
 
-    for (int i=0; i < n_array_size(pkgdir->pkgs); i++) {
-        struct pkg *pkg = n_array_nth(pkgdir->pkgs, i);
-        char key[PATH_MAX];
-
-        int n = pndir_make_pkgkey(key, sizeof(key), pkg);
-        n_snprintf(&key[n], sizeof(key) - n, "^%u:%u:%u", pkg->color, pkg->size, pkg->btime);
-        n_stream_printf(st, "%s\n", key);
-    }
-
+    write_stubs(st, pkgdir->pkgs);
     n_stream_close(st);
     vf_lock_release(lock);
 
@@ -141,41 +182,22 @@ tn_array *load_stubindex(const char *path)
 {
     tn_stream *st;
     tn_array *pkgs;
-    char *buf;
-    int n;
 
     st = n_stream_open(path, "r", TN_STREAM_UNKNOWN);
     if (st == NULL)
         return NULL;
 
-    pkgs = pkgs_array_new(512);
-    buf = n_malloc(128);
-
-    while ((n = n_stream_getline(st, &buf, 128)) > 0) {
-        char *b = n_str_strip_ws(buf);
-        char *csb = strrchr(b, '^');
-        if (csb != NULL) {
-            *csb = '\0';
-            csb++;
-        }
-
-        struct pkg *pkg = pndir_parse_pkgkey(b, n, NULL);
-        if (pkg) {
-            sscanf(csb, "%u:%u:%u", &pkg->color, &pkg->size, &pkg->btime);
-            n_array_push(pkgs, pkg);
-        }
-    }
+    pkgs = read_stubs(st, NULL);
     n_stream_close(st);
-    n_free(buf);
 
     return pkgs;
 }
 
-tn_array *source_stubload(struct source *src)
+/* RET: stubindex path of source or 0 if it is outdated */
+static int source_stubindex_path(struct source *src, char *path, int size)
 {
-    char path[PATH_MAX], ipath[PATH_MAX];
+    char ipath[PATH_MAX];
     time_t idx_mtime = 0;
-    tn_array *pkgs;
     int n;
 
     pkgdir__make_idxpath(ipath, sizeof(ipath), src->path, src->type, src->compr);
@@ -187,18 +209,29 @@ tn_array *source_stubload(struct source *src)
 
     char *dn = n_dirname(ipath);
     if (dn == NULL)
-        return NULL;
+        return 0;
 
-    n = vf_cachepath(path, sizeof(path), dn);
-    n += n_snprintf(&path[n], sizeof(path) - n, "/%s.%s.zst",
+    n = vf_cachepath(path, size, dn);
+    n += n_snprintf(&path[n], size - n, "/%s.%s.zst",
                     pkgdir_stubindex_basename, src->type);
 
     if (idx_mtime > 0) {
         time_t mtime = poldek_util_mtime(path);
         if (mtime > 0 && mtime < idx_mtime) /* outdated */
-            return NULL;
+            return 0;
     }
 
+    return n;
+}
+
+tn_array *source_stubload(struct source *src)
+{
+    char path[PATH_MAX];
+    tn_array *pkgs;
+
+    if (!source_stubindex_path(src, path, sizeof(path)))
+        return NULL;
+
     msgn_i(2, 2, "Loading stub index of %s...", source_idstr(src));
     pkgs = load_stubindex(path);
     if (pkgs == NULL)
@@ -239,3 +272,102 @@ void pkgdir__stubindex_update(struct pkgdir *pkgdir)
     stubindex_create(pkgdir, path);
     poldek_set_verbose(verbosity);
 }
+
+/*
+  Session stubs: stubs of all sources already filtered, sorted and
+  uniqued by poldek_load_stubs(), saved as a single file. Its '#' header
+  is made of source_stubstamp()s, so any index change invalidates it.
+*/
+int source_stubstamp(struct source *src, tn_buf *nbuf)
+{
+    char path[PATH_MAX];
+    time_t mtime;
+
+    if (!source_stubindex_path(src, path, sizeof(path)))
+        return 0;
+
+    if ((mtime = poldek_util_mtime(path)) == 0)
+        return 0;
+
+    n_buf_printf(nbuf, "#%s %s %lu", path, src->type, (unsigned long)mtime);
+    for (int i=0; src->ign_patterns && i < n_array_size(src->ign_patterns); i++)
+        n_buf_printf(nbuf, " -%s", (char*)n_array_nth(src->ign_patterns, i));
+    n_buf_printf(nbuf, "\n");
+
+    return 1;
+}
+
+static int stubsession_path(char *path, int size)
+{
+    return n_snprintf(path, size, "%s/%s.session.zst", vf_cachedir(),
+                      pkgdir_stubindex_basename);
+}
+
+tn_array *sources_stubload_session(const char *stamp)
+{
+    char path[PATH_MAX];
+    tn_stream *st;
+    tn_array *pkgs;
+    tn_buf *hdr;
+
+    stubsession_path(path, sizeof(path));
+    if ((st = n_stream_open(path, "r", TN_STREAM_UNKNOWN)) == NULL)
+        return NULL;
+
+    hdr = n_buf_new(1024);
+    pkgs = read_stubs(st, hdr);
+    n_stream_close(st);
+
+    n_buf_putc(hdr, '\0');
+    if (n_str_ne(n_buf_ptr(hdr), stamp)) { /* sources changed */
+        n_array_cfree(&pkgs);
+
+    } else {
+        msgn_i(2, 2, "Loaded stubs of session %s", vf_url_slim_s(path, 0));
+    }
+
+    n_buf_free(hdr);
+    return pkgs;
+}
+
+int sources_stubsave_session(const char *stamp, tn_array *pkgs)
+{
+    char path[PATH_MAX], tmpath[PATH_MAX];
+    tn_stream *st;
+
+    stubsession_path(path, sizeof(path));
+
+    /* no lock, written aside and renamed as concurrent sessions may read it */
+    n_snprintf(tmpath, sizeof(tmpath), "%s/.%s-%d.zst", vf_cachedir(),
+               pkgdir_stubindex_basename, getpid());
+
+    if ((st = n_stream_open(tmpath, "w", TN_STREAM_UNKNOWN)) == NULL) {
+        logn(LOGERR, "%s: open failed (%m)\n", tmpath);
+        return 0;
+    }
+
+    n_stream_printf(st, "%s", stamp);
+    write_stubs(st, pkgs);
+    n_stream_close(st);
+
+    if (rename(tmpath, path) != 0) {
+        logn(LOGERR, "rename %s: %m", tmpath);
+        unlink(tmpath);
+        return 0;
+    }
+
+    return 1;
+}
+
+void pkgdir__stubsession_clean(int test)
+{
+    char path[PATH_MAX];
+
+    stubsession_path(path, sizeof(path));
+    if (access(path, F_OK) != 0)
+        return;
+
+    msgn(2, _(" Removing %s"), n_basenam(path));
+    if (!test)
+        vf_localunlink(path);
+}
@@ -23,5 +23,6 @@ struct pkgdir;
 // tn_array *source_stubload(struct source *src);
 
 void pkgdir__stubindex_update(struct pkgdir *pkgdir);
+void pkgdir__stubsession_clean(int test);
 
 #endif
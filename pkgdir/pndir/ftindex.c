@@ -0,0 +1,366 @@
+/*
+  Copyright (C) 2000 - 2008 Pawel A. Gajda <mis@pld-linux.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+  Trigram index of package texts or file paths, a tndb with
+
+    %__h_md    - digest of the index it was made for
+    %__h_pkgs  - '\0' separated package keys, position is package number
+    TRIGRAM    - varint encoded, delta compressed package numbers of
+                 packages whose text contains TRIGRAM
+
+  Only ASCII trigrams are indexed (case folded), so lookup gives
+  candidates which must be verified by the caller.
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <trurl/nassert.h>
+#include <trurl/narray.h>
+#include <trurl/nbuf.h>
+#include <trurl/nstr.h>
+#include <trurl/nmalloc.h>
+
+#define PKGDIR_INTERNAL
+
+#include "i18n.h"
+#include "log.h"
+#include "pndir.h"
+
+static const char tag_md[] = "%__h_md";
+static const char tag_pkgs[] = "%__h_pkgs";
+
+struct posting {
+    int     last;               /* last added package number */
+    tn_buf  *nbuf;
+};
+
+/* 7-bit chars only, so trigram fits in 21 bits */
+#define TRIGRAM_NO(tg) (((tg)[0] << 14) | ((tg)[1] << 7) | (tg)[2])
+#define NTRIGRAMS      (1 << 21)
+
+struct pndir_ftidx {
+    struct posting  **postings;  /* TRIGRAM_NO => struct posting */
+    int             npostings;
+    tn_buf          *keys;
+    int             nth;         /* current package number */
+};
+
+static int put_varint(tn_buf *nbuf, uint32_t v)
+{
+    unsigned char buf[8];
+    int n = 0;
+
+    while (v >= 0x80) {
+        buf[n++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    buf[n++] = v;
+    return n_buf_add(nbuf, buf, n);
+}
+
+static const unsigned char *get_varint(const unsigned char *p,
+                                       const unsigned char *end, uint32_t *v)
+{
+    int shift = 0;
+
+    *v = 0;
+    while (p < end && shift < 32) {
+        *v |= (uint32_t)(*p & 0x7f) << shift;
+        if ((*p++ & 0x80) == 0)
+            return p;
+        shift += 7;
+    }
+
+    return NULL;
+}
+
+/* fold ASCII char, 0 for anything not indexed */
+static inline int fold(unsigned char c)
+{
+    if (c == '\0' || c >= 0x80)
+        return 0;
+
+    if (c >= 'A' && c <= 'Z')
+        return c + ('a' - 'A');
+
+    return c;
+}
+
+/* walk trigrams of text, RET: number of trigrams visited */
+static int trigrams(const char *text,
+                    void (*fn)(const char *tg, void *arg), void *arg)
+{
+    const unsigned char *s = (const unsigned char*)text;
+    char tg[4];
+    int n = 0, len = 0;
+
+    tg[3] = '\0';
+    while (*s) {
+        int c = fold(*s++);
+
+        if (c == 0) {
+            len = 0;
+            continue;
+        }
+
+        tg[0] = tg[1];
+        tg[1] = tg[2];
+        tg[2] = c;
+
+        if (++len >= 3) {
+            fn(tg, arg);
+            n++;
+        }
+    }
+
+    return n;
+}
+
+struct pndir_ftidx *pndir_ftidx_new(void)
+{
+    struct pndir_ftidx *ft;
+
+    ft = n_malloc(sizeof(*ft));
+    ft->postings = n_calloc(NTRIGRAMS, sizeof(*ft->postings));
+    ft->npostings = 0;
+    ft->keys = n_buf_new(1024 * 64);
+    ft->nth = -1;
+    return ft;
+}
+
+void pndir_ftidx_free(struct pndir_ftidx *ft)
+{
+    int i;
+
+    for (i=0; i < NTRIGRAMS; i++) {
+        struct posting *p = ft->postings[i];
+        if (p) {
+            n_buf_free(p->nbuf);
+            free(p);
+        }
+    }
+    free(ft->postings);
+    n_buf_free(ft->keys);
+    free(ft);
+}
+
+void pndir_ftidx_add_pkg(struct pndir_ftidx *ft, const char *key, int klen)
+{
+    n_buf_add(ft->keys, key, klen);
+    n_buf_add(ft->keys, "", 1);
+    ft->nth++;
+}
+
+static void add_trigram(const char *tg, void *ft_)
+{
+    struct pndir_ftidx *ft = ft_;
+    struct posting *p, **pp;
+
+    pp = &ft->postings[TRIGRAM_NO((const unsigned char*)tg)];
+    if ((p = *pp) == NULL) {
+        p = n_malloc(sizeof(*p));
+        p->last = -1;
+        p->nbuf = n_buf_new(16);
+        *pp = p;
+        ft->npostings++;
+    }
+
+    if (p->last == ft->nth)     /* already here */
+        return;
+
+    put_varint(p->nbuf, ft->nth - p->last - 1); /* delta from the last one */
+    p->last = ft->nth;
+}
+
+void pndir_ftidx_add_text(struct pndir_ftidx *ft, const char *text)
+{
+    n_assert(ft->nth >= 0);     /* pndir_ftidx_add_pkg() first */
+    if (text)
+        trigrams(text, add_trigram, ft);
+}
+
+int pndir_ftidx_save(struct pndir_ftidx *ft, const char *path,
+                     const char *md)
+{
+    struct tndb *db;
+    int i;
+
+    unlink(path);
+    if ((db = tndb_creat(path, PNDIR_COMPRLEVEL, TNDB_SIGN_DIGEST)) == NULL) {
+        logn(LOGERR, "%s: %m", path);
+        return 0;
+    }
+
+    tndb_put(db, tag_md, strlen(tag_md), md, strlen(md));
+    tndb_put(db, tag_pkgs, strlen(tag_pkgs), n_buf_ptr(ft->keys),
+             n_buf_size(ft->keys));
+
+    msgn(2, _(" Writing %s (%d trigrams)..."), vf_url_slim_s(path, 0),
+         ft->npostings);
+
+    for (i=0; i < NTRIGRAMS; i++) { /* in key order */
+        struct posting *p = ft->postings[i];
+        char tg[3];
+
+        if (p == NULL)
+            continue;
+
+        tg[0] = (i >> 14) & 0x7f;
+        tg[1] = (i >> 7) & 0x7f;
+        tg[2] = i & 0x7f;
+        tndb_put(db, tg, 3, n_buf_ptr(p->nbuf), n_buf_size(p->nbuf));
+    }
+
+    tndb_close(db);
+    return 1;
+}
+
+int pndir_ftidx_verify(struct tndb *db, const char *md)
+{
+    char val[TNIDX_DIGEST_SIZE + 1];
+    int vlen;
+
+    vlen = tndb_get(db, tag_md, strlen(tag_md), val, sizeof(val) - 1);
+    if (vlen <= 0)
+        return 0;
+
+    val[vlen] = '\0';
+    return n_str_eq(val, md);
+}
+
+struct lookup_s {
+    tn_array  *tgs;
+};
+
+static void push_trigram(const char *tg, void *ls_)
+{
+    struct lookup_s *ls = ls_;
+
+    if (n_array_bsearch(ls->tgs, tg) == NULL) {
+        n_array_push(ls->tgs, n_strdup(tg));
+        n_array_sort(ls->tgs);
+    }
+}
+
+/* decode posting list of tg and intersect it with nums (if not NULL);
+   RET: NULL on broken list */
+static tn_array *intersect(struct tndb *db, const char *tg, tn_array *nums)
+{
+    const unsigned char *p, *end;
+    unsigned char *val = NULL;
+    tn_array *result;
+    uint32_t delta;
+    int64_t nth = -1;
+    int vlen, i = 0;
+
+    result = n_array_new(nums ? n_array_size(nums) : 256, NULL, NULL);
+    if ((vlen = tndb_get_all(db, tg, strlen(tg), (void**)&val)) <= 0)
+        goto l_end;
+
+    p = val;
+    end = val + vlen;
+
+    while (p < end) {
+        if ((p = get_varint(p, end, &delta)) == NULL) {
+            logn(LOGERR, _("%s: broken text index"), tndb_path(db));
+            n_array_cfree(&result);
+            break;
+        }
+
+        nth += delta + 1;
+
+        if (nums == NULL) {
+            n_array_push(result, (void*)(uintptr_t)nth);
+            continue;
+        }
+
+        while (i < n_array_size(nums) &&
+               (int64_t)(uintptr_t)n_array_nth(nums, i) < nth)
+            i++;
+
+        if (i == n_array_size(nums))
+            break;
+
+        if ((int64_t)(uintptr_t)n_array_nth(nums, i) == nth)
+            n_array_push(result, (void*)(uintptr_t)nth);
+    }
+
+ l_end:
+    free(val);
+    if (nums)
+        n_array_free(nums);
+    return result;
+}
+
+tn_array *pndir_ftidx_lookup(struct tndb *db, const char *text)
+{
+    struct lookup_s ls;
+    tn_array *nums = NULL, *keys = NULL;
+    char *val = NULL, *p;
+    int i, vlen, nth;
+
+    ls.tgs = n_array_new(16, free, (tn_fn_cmp)strcmp);
+    trigrams(text, push_trigram, &ls);
+
+    /* too short text tells nothing */
+    for (i=0; i < n_array_size(ls.tgs); i++) {
+        if ((nums = intersect(db, n_array_nth(ls.tgs, i), nums)) == NULL)
+            break;
+
+        if (n_array_size(nums) == 0)
+            break;
+    }
+    n_array_free(ls.tgs);
+
+    if (nums == NULL)
+        return NULL;
+
+    if (n_array_size(nums) == 0) {
+        keys = n_array_new(2, free, (tn_fn_cmp)strcmp);
+        goto l_end;
+    }
+
+    vlen = tndb_get_all(db, tag_pkgs, strlen(tag_pkgs), (void**)&val);
+    if (vlen <= 0)
+        goto l_end;
+
+    keys = n_array_new(n_array_size(nums), free, (tn_fn_cmp)strcmp);
+
+    p = val;                    /* nums are sorted */
+    nth = 0;
+    i = 0;
+    while (p < val + vlen && i < n_array_size(nums)) {
+        int len = strlen(p);
+
+        if ((uintptr_t)nth == (uintptr_t)n_array_nth(nums, i)) {
+            n_array_push(keys, n_strdupl(p, len));
+            i++;
+        }
+        p += len + 1;
+        nth++;
+    }
+    n_array_sort(keys);
+    free(val);
+
+ l_end:
+    n_array_free(nums);
+    return keys;
+}
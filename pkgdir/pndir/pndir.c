@@ -70,6 +70,9 @@ static void do_free(struct pkgdir *pkgdir);
 static
 int posthook_diff(struct pkgdir *pd1, struct pkgdir* pd2, struct pkgdir *diff);
 
+static tn_array *do_ftsearch(struct pkgdir *pkgdir, int type,
+                             const char *text);
+
 struct pkgdir_module pkgdir_module_pndir = {
     NULL,
     PKGDIR_CAP_UPDATEABLE_INC | PKGDIR_CAP_UPDATEABLE |
@@ -88,6 +91,7 @@ struct pkgdir_module pkgdir_module_pndir = {
     do_free,
     pndir_localidxpath,
     posthook_diff,
+    do_ftsearch,
 };
 
 
@@ -160,6 +164,7 @@ void pndir_init(struct pndir *idx)
     idx->idxpath[0] = '\0';
     idx->md_orig = NULL;
     idx->db_dscr_h = NULL;
+    idx->db_ftidx[0] = idx->db_ftidx[1] = NULL;
 }
 
 static struct tndb *do_dbopen(const char *path, int vfmode, struct vfile **vf,
@@ -288,6 +293,89 @@ int open_dscr(struct pndir *idx, int vfmode, time_t ts, const char *lang)
     return pndir_db_dscr_h_get(idx->db_dscr_h, lang) != NULL;
 }
 
+static
+int open_ftidx(struct pndir *idx, int type, int vfmode)
+{
+    char          path[PATH_MAX];
+    const char    *suffix;
+    struct tndb   *db;
+    struct vfile  *vf = NULL;
+    int           valid, cached;
+
+    suffix = pndir_ftidx_suffix;
+    if (type == PKGDIR_FTS_FILES)
+        suffix = pndir_flidx_suffix;
+
+    pndir_mkidx_pathname(path, sizeof(path), idx->idxpath, suffix);
+
+    msgn(3, _("Opening %s..."), vf_url_slim_s(path, 0));
+    if ((db = do_dbopen(path, vfmode, &vf, idx->srcnam)) == NULL)
+        return 0;
+
+    valid = tndb_verify(db) && pndir_ftidx_verify(db, idx->dg->md);
+    cached = (vf->vf_flags & VF_FRMCACHE);
+    vfile_close(vf);
+
+    if (valid) {
+        idx->db_ftidx[type] = db;
+        return 1;
+    }
+
+    tndb_close(db);
+    if (cached && (vfmode & VFM_CACHE)) { /* outdated or not fully downloaded */
+        vfmode &= ~VFM_CACHE;
+        return open_ftidx(idx, type, vfmode);
+    }
+
+    msgn(2, _("%s: outdated index, not used"), vf_url_slim_s(path, 0));
+    return 0;
+}
+
+/* packages which may contain text in summary, description, etc or
+   in file paths */
+static tn_array *do_ftsearch(struct pkgdir *pkgdir, int type,
+                             const char *text)
+{
+    struct pndir  *idx = pkgdir->mod_data;
+    tn_array      *keys, *pkgs;
+    unsigned      crflag;
+    int           i;
+
+    n_assert(type == PKGDIR_FTS_TEXT || type == PKGDIR_FTS_FILES);
+    crflag = PKGDIR_CREAT_FTINDEX;
+    if (type == PKGDIR_FTS_FILES)
+        crflag = PKGDIR_CREAT_FLINDEX;
+
+    if (idx == NULL || idx->dg == NULL || pkgdir->pkgs == NULL ||
+        (idx->crflags & crflag) == 0)
+        return NULL;
+
+    if (!idx->ftidx_tried[type]) {
+        idx->ftidx_tried[type] = 1;
+        open_ftidx(idx, type, VFM_RO | VFM_NOEMPTY | VFM_NODEL | VFM_CACHE);
+    }
+
+    if (idx->db_ftidx[type] == NULL)
+        return NULL;
+
+    if ((keys = pndir_ftidx_lookup(idx->db_ftidx[type], text)) == NULL)
+        return NULL;
+
+    pkgs = pkgs_array_new(n_array_size(keys) + 1);
+    for (i=0; i < n_array_size(pkgdir->pkgs) && n_array_size(keys); i++) {
+        struct pkg *pkg = n_array_nth(pkgdir->pkgs, i);
+        char key[512];
+
+        pndir_make_pkgkey(key, sizeof(key), pkg);
+        if (n_array_bsearch(keys, key))
+            n_array_push(pkgs, pkg_link(pkg));
+    }
+    n_array_free(keys);
+    n_array_sort(pkgs);
+
+    return pkgs;
+}
+
 static
 int pndir_open(struct pndir *idx, struct pkgdir *pkgdir, int vfmode, unsigned flags)
 {
@@ -356,6 +444,12 @@ void pndir_close(struct pndir *idx)
     if (idx->db_dscr_h)
 	n_hash_free(idx->db_dscr_h);
 
+    if (idx->db_ftidx[PKGDIR_FTS_TEXT])
+        tndb_close(idx->db_ftidx[PKGDIR_FTS_TEXT]);
+
+    if (idx->db_ftidx[PKGDIR_FTS_FILES])
+        tndb_close(idx->db_ftidx[PKGDIR_FTS_FILES]);
+
     if (idx->_vf)
         vfile_close(idx->_vf);
 
@@ -366,6 +460,8 @@ void pndir_close(struct pndir *idx)
     n_cfree(&idx->srcnam);
     idx->_vf = NULL;
     idx->db = NULL;
+    idx->db_ftidx[0] = idx->db_ftidx[1] = NULL;
+    idx->ftidx_tried[0] = idx->ftidx_tried[1] = 0;
     idx->dg = NULL;
     idx->idxpath[0] = '\0';
 }
@@ -477,6 +573,10 @@ int do_open(struct pkgdir *pkgdir, unsigned flags)
                     idx.crflags |= PKGDIR_CREAT_NOFL;
                 else if (strcmp(opt, "nouniq") == 0)
                     idx.crflags |= PKGDIR_CREAT_NOUNIQ;
+                else if (strcmp(opt, "ftidx") == 0)
+                    idx.crflags |= PKGDIR_CREAT_FTINDEX;
+                else if (strcmp(opt, "flidx") == 0)
+                    idx.crflags |= PKGDIR_CREAT_FLINDEX;
                 else if (poldek_VERBOSE > 2)
                     logn(LOGWARN, _("%s:%s: unknown index opt"), pkgdir->idxpath, opt);
             }
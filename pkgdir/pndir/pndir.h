@@ -47,6 +47,8 @@ struct pndir {
     unsigned             crflags;
     struct tndb          *db;
     tn_hash              *db_dscr_h;
+    struct tndb          *db_ftidx[2]; /* PKGDIR_FTS_{TEXT,FILES} indexes */
+    int                  ftidx_tried[2]; /* db_ftidx open was attempted */
     char                 idxpath[PATH_MAX];
     struct pndir_digest  *dg;
     char                 *md_orig;
@@ -115,4 +117,18 @@ struct tndb *pndir_db_dscr_h_get(tn_hash *db_dscr_h, const char *lang);
 struct pkguinf *pndir_load_pkguinf(tn_alloc *na, tn_hash *db_dscr_h,
                                    const struct pkg *pkg, tn_array *langs);
 
+/* ftindex.c */
+struct pndir_ftidx;
+struct pndir_ftidx *pndir_ftidx_new(void);
+void pndir_ftidx_free(struct pndir_ftidx *ft);
+/* starts next package */
+void pndir_ftidx_add_pkg(struct pndir_ftidx *ft, const char *key, int klen);
+void pndir_ftidx_add_text(struct pndir_ftidx *ft, const char *text);
+int pndir_ftidx_save(struct pndir_ftidx *ft, const char *path, const char *md);
+
+/* index is made for index with md digest? */
+int pndir_ftidx_verify(struct tndb *db, const char *md);
+/* sorted keys of packages which may contain text, NULL if text is too short */
+tn_array *pndir_ftidx_lookup(struct tndb *db, const char *text);
+
 #endif /* POLDEK_PKGDIR_H*/
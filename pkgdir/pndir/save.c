@@ -42,6 +42,7 @@
 #include "pkgdir.h"
 #include "pkg.h"
 #include "pkgu.h"
+#include "pkgfl.h"
 #include "pkgmisc.h"
 #include "pkgroup.h"
 #include "pndir.h"
@@ -210,6 +211,8 @@ void put_pndir_header(struct tndb *db, struct pkgdir *pkgdir, unsigned flags,
     if (flags & PKGDIR_CREAT_NODESC) n_buf_printf(nbuf, "nodesc:");
     if (flags & PKGDIR_CREAT_NOFL)   n_buf_printf(nbuf, "nofl:");
     if (flags & PKGDIR_CREAT_NOUNIQ) n_buf_printf(nbuf, "nouniq:");
+    if (flags & PKGDIR_CREAT_FTINDEX) n_buf_printf(nbuf, "ftidx:");
+    if (flags & PKGDIR_CREAT_FLINDEX) n_buf_printf(nbuf, "flidx:");
     if (n_buf_size(nbuf) > 0)
         tndb_put(db, pndir_tag_opt, strlen(pndir_tag_opt),
                  n_buf_ptr(nbuf), n_buf_size(nbuf) - 1); /* eat last ':' */
@@ -628,6 +631,52 @@ int pndir_save_pkginfo(int nth, struct pkguinf *pkgu, tn_hash *langstosave_h,
     return 1;
 }
 
+static void ftidx_add_pkguinf(struct pndir_ftidx *ft, struct pkguinf *pkgu)
+{
+    tn_array *langs = pkguinf_langs(pkgu);
+    int i;
+
+    pndir_ftidx_add_text(ft, pkguinf_get(pkgu, PKGUINF_LICENSE));
+    pndir_ftidx_add_text(ft, pkguinf_get(pkgu, PKGUINF_URL));
+    pndir_ftidx_add_text(ft, pkguinf_get(pkgu, PKGUINF_CHANGELOG));
+
+    /* all translations, searched one depends on user's locale */
+    for (i=0; langs && i < n_array_size(langs); i++) {
+        const char *lang = n_array_nth(langs, i);
+
+        pndir_ftidx_add_text(ft, pkguinf_get_lang(pkgu, PKGUINF_SUMMARY, lang));
+        pndir_ftidx_add_text(ft, pkguinf_get_lang(pkgu, PKGUINF_DESCRIPTION,
+                                                  lang));
+    }
+}
+
+static void flidx_add_fl(struct pndir_ftidx *ft, tn_tuple *fl)
+{
+    struct pkgfl_it it;
+    struct flfile *f;
+    const char *path;
+
+    if (fl == NULL || n_tuple_size(fl) == 0)
+        return;
+
+    pkgfl_it_init(&it, fl);
+    while ((path = pkgfl_it_get(&it, &f))) {
+        pndir_ftidx_add_text(ft, path);
+        if (S_ISLNK(f->mode))   /* symlink target, searched too */
+            pndir_ftidx_add_text(ft, f->basename + strlen(f->basename) + 1);
+    }
+}
+
+static void flidx_add_pkg(struct pndir_ftidx *ft, struct pkg *pkg)
+{
+    struct pkgflist *flist;
+
+    flidx_add_fl(ft, pkg->fl);
+    if ((flist = pkg_get_nodep_flist(pkg))) {
+        flidx_add_fl(ft, flist->fl);
+        pkgflist_free(flist);
+    }
+}
 
 int pndir_m_create(struct pkgdir *pkgdir, const char *pathname, unsigned flags)
 {
@@ -642,10 +691,27 @@ int pndir_m_create(struct pkgdir *pkgdir, const char *pathname, unsigned flags)
     tn_array         *langstosave = NULL;
     struct pndir_paths paths;
     tn_array         *exclpath = NULL;
+    struct pndir_ftidx *ftidx = NULL, *flidx = NULL;
+    unsigned         hdr_flags;
 
     //idx = pkgdir->mod_data; // unused?
     n_assert(pkgdir->ts > 0);   /* must be set by the caller */
 
+    hdr_flags = flags;
+    if (pkgdir->flags & PKGDIR_DIFF) {
+        flags &= ~(PKGDIR_CREAT_FTINDEX | PKGDIR_CREAT_FLINDEX);
+        hdr_flags = flags;
+
+    } else if (pkgdir->mod_data && pkgdir_is_type(pkgdir, "pndir")) {
+        struct pndir *idx = pkgdir->mod_data;
+
+        /* locally updated index, text indexes are still the repository ones */
+        hdr_flags |= idx->crflags & (PKGDIR_CREAT_FTINDEX | PKGDIR_CREAT_FLINDEX);
+    }
+
+    if (flags & PKGDIR_CREAT_NOFL)
+        flags &= ~PKGDIR_CREAT_FLINDEX;
+
     if (pathname == NULL) {
         if (pkgdir->flags & PKGDIR_DIFF)
             pathname = pkgdir->orig_idxpath;
@@ -672,7 +738,7 @@ int pndir_m_create(struct pkgdir *pkgdir, const char *pathname, unsigned flags)
     }
 
     langstosave_h = NULL;
-    put_pndir_header(db, pkgdir, flags, &langstosave_h);
+    put_pndir_header(db, pkgdir, hdr_flags, &langstosave_h);
     if (langstosave_h)
         langstosave = n_hash_keys(langstosave_h);
 
@@ -697,6 +763,12 @@ int pndir_m_create(struct pkgdir *pkgdir, const char *pathname, unsigned flags)
     if (pkgdir->avlangs_h && (flags & PKGDIR_CREAT_NODESC) == 0)
         save_descr = 1;
 
+    if (save_descr && (flags & PKGDIR_CREAT_FTINDEX))
+        ftidx = pndir_ftidx_new();
+
+    if (flags & PKGDIR_CREAT_FLINDEX)
+        flidx = pndir_ftidx_new();
+
     DBGF("avlangs_h %p %d, %d\n", pkgdir->avlangs_h,
          pkgdir->avlangs_h ? n_hash_size(pkgdir->avlangs_h) : 0, save_descr);
 
@@ -716,6 +788,14 @@ int pndir_m_create(struct pkgdir *pkgdir, const char *pathname, unsigned flags)
         klen = pndir_make_pkgkey(key, sizeof(key), pkg);
         n_array_push(keys, n_strdupl(key, klen));
 
+        if (ftidx)
+            pndir_ftidx_add_pkg(ftidx, key, klen);
+
+        if (flidx) {
+            pndir_ftidx_add_pkg(flidx, key, klen);
+            flidx_add_pkg(flidx, pkg);
+        }
+
         n_buf_clean(nbuf);
         if (pkg_store(pkg, nbuf, exclpath, pkgdir->depdirs, st_flags))
             tndb_put(db, key, klen, n_buf_ptr(nbuf), n_buf_size(nbuf));
@@ -731,6 +811,8 @@ int pndir_m_create(struct pkgdir *pkgdir, const char *pathname, unsigned flags)
 
             v = pndir_save_pkginfo(i, pkgu, langstosave_h, db_dscr_h, key, klen,
                                    nbuf, paths.fmt_dscr);
+            if (ftidx)
+                ftidx_add_pkguinf(ftidx, pkgu);
             pkguinf_free(pkgu);
             if (!v) {
                 nerr++;
@@ -771,6 +853,24 @@ int pndir_m_create(struct pkgdir *pkgdir, const char *pathname, unsigned flags)
             nerr++;
         else if (!pndir_digest_save(&dg, paths.path, pkgdir))
             nerr++;
+
+        if (nerr == 0 && ftidx) {
+            char path[PATH_MAX];
+
+            pndir_mkidx_pathname(path, sizeof(path), paths.path,
+                                 pndir_ftidx_suffix);
+            if (!pndir_ftidx_save(ftidx, path, dg.md))
+                nerr++;
+        }
+
+        if (nerr == 0 && flidx) {
+            char path[PATH_MAX];
+
+            pndir_mkidx_pathname(path, sizeof(path), paths.path,
+                                 pndir_flidx_suffix);
+            if (!pndir_ftidx_save(flidx, path, dg.md))
+                nerr++;
+        }
     }
 
 
@@ -793,6 +893,12 @@ int pndir_m_create(struct pkgdir *pkgdir, const char *pathname, unsigned flags)
     if (langstosave_h)
         n_hash_free(langstosave_h);
 
+    if (ftidx)
+        pndir_ftidx_free(ftidx);
+
+    if (flidx)
+        pndir_ftidx_free(flidx);
+
     MEMINF("END");
     return nerr == 0;
 }
@@ -3,6 +3,8 @@ static const char pndir_packages_idx[]    = "packages.dir.tn";
 static const char pndir_extension[]       = "ndir";
 static const char pndir_desc_suffix[]     = ".dscr";
 static const char pndir_difftoc_suffix[]  = ".diff.toc";
+static const char pndir_ftidx_suffix[]    = ".ftidx";
+static const char pndir_flidx_suffix[]    = ".flidx";
 static const char pndir_packages_incdir[] = "packages.i";
 
 static const char pndir_poldeksindex[] = "poldeks-pndir";
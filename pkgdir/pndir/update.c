@@ -28,6 +28,8 @@
 
 
 #include <trurl/nassert.h>
+#include <trurl/nmalloc.h>
+#include <trurl/narray.h>
 #include <trurl/nstr.h>
 #include <trurl/nbuf.h>
 #include <trurl/nstream.h>
@@ -65,7 +67,7 @@ static
 int is_uptodate(const char *path, const struct pndir_digest *dg_local,
                 struct pndir_digest *dg, const char *pdir_name)
 {
-    char                   mdpath[PATH_MAX], mdtmpath[PATH_MAX];
+    char                   mdpath[PATH_MAX], mdtmpath[PATH_MAX], *mddn;
     struct pndir_digest    dg_remote;
     int                    fd = 0, n, rc = 0;
     const char             *ext = pndir_digest_ext;
@@ -84,14 +86,21 @@ int is_uptodate(const char *path, const struct pndir_digest *dg_local,
 
     pndir_mkdigest_path(mdpath, sizeof(mdpath), path, ext);
 
-    snprintf(&mdtmpath[n], sizeof(mdtmpath) - n, "/%s", n_basenam(mdpath));
+    /* sources may be updated concurrently (see sources_update()) and
+       digests of many of them have the same name, so each gets its
+       own directory */
+    mdtmpath[n++] = '/';
+    n += vf_url_as_path(&mdtmpath[n], sizeof(mdtmpath) - n, mdpath);
+    if (n >= (int)sizeof(mdtmpath))
+        goto l_end;
+
     unlink(mdtmpath);
-    mdtmpath[n] = '\0';
+    n_strdupap(mdtmpath, &mddn);
+    mddn = n_dirname(mddn);
 
-    if (!vf_fetch(mdpath, mdtmpath, 0, NULL, pdir_name))
+    if (!vf_fetch(mdpath, mddn, 0, NULL, pdir_name))
         goto l_end;
 
-    mdtmpath[n] = '/';
     if ((fd = open(mdtmpath, O_RDONLY)) < 0)
         goto l_end;
 
@@ -225,6 +234,42 @@ static int parse_toc_line(char *line, time_t *tsp, char **mdp)
 }
 
 
+struct diff_file {
+    struct vf_fetchq_job job;   /* must be first */
+    char                 url[PATH_MAX];
+    char                 destdir[PATH_MAX];
+};
+
+/* diff file to be fetched before diffs are opened */
+static void add_diff_file(tn_array *files, const char *url, off_t size,
+                          const char *label)
+{
+    struct diff_file *df = n_calloc(sizeof(*df), 1);
+    char dn[PATH_MAX], *p;
+
+    snprintf(df->url, sizeof(df->url), "%s", url);
+    snprintf(dn, sizeof(dn), "%s", url);
+    if ((p = strrchr(dn, '/')))
+        *p = '\0';
+
+    /* the place vfile_open_ul() looks for cached copy */
+    vf_localdirpath(df->destdir, sizeof(df->destdir), dn);
+
+    df->job.url = df->url;
+    df->job.destdir = df->destdir;
+    df->job.label = label;
+    df->job.size = size;
+    n_array_push(files, df);
+}
+
+/* fetch all needed diff files in parallel, they are opened from
+   cache then; failed ones are retried by pkgdir_open_ext() */
+static void fetch_diff_files(tn_array *files)
+{
+    if (n_array_size(files) > 0)
+        vf_fetchq(files, 0);
+}
+
 int pndir_m_update(struct pkgdir *pkgdir, enum pkgdir_uprc *uprc)
 {
     char                idxpath[PATH_MAX], tmpath[PATH_MAX], path[PATH_MAX];
@@ -232,7 +277,8 @@ int pndir_m_update(struct pkgdir *pkgdir, enum pkgdir_uprc *uprc)
     struct pndir_digest dg_remote;
     struct pndir        *idx;
     char                line[1024], *dn, *bn;
-    int                 nread, nerr = 0, rc, npatch, first_patch_found;
+    tn_array            *diffs, *files;
+    int                 nread, nerr = 0, rc, first_patch_found = 0;
     const char          *errmsg_broken_difftoc = _("%s: broken patch list");
     char                current_md[TNIDX_DIGEST_SIZE + 1];
 
@@ -323,6 +369,8 @@ int pndir_m_update(struct pkgdir *pkgdir, enum pkgdir_uprc *uprc)
 
     msgn(2, "pndir_m_update idxsize: %lld\n", (long long)mdsize);
 
+    files = n_array_new(16, free, NULL);
+
     while ((nread = n_stream_gets(vf->vf_tnstream, line, sizeof(line))) > 0) {
         char *md, *pdate;
         time_t ts;
@@ -352,18 +400,21 @@ int pndir_m_update(struct pkgdir *pkgdir, enum pkgdir_uprc *uprc)
 	if (vf_stat(path, tmpath, &stats, pkgdir->name)) {
 	  mdpatchsize += stats.vf_size;
 	  msgn(3, "_\n%lld bytes %s\n", (long long)stats.vf_size, path);
+	  add_diff_file(files, path, stats.vf_size, pkgdir->name);
 	}
         snprintf(path, sizeof(path), "%s/%s/%s.ndir.dscr.%s",
 		 dn, pndir_packages_incdir, line, pdate);
 	if (vf_stat(path, tmpath, &stats, pkgdir->name)) {
 	  mdpatchsize += stats.vf_size;
 	  msgn(3, "_\n%lld bytes %s\n", (long long)stats.vf_size, path);
+	  add_diff_file(files, path, stats.vf_size, pkgdir->name);
 	}
         snprintf(path, sizeof(path), "%s/%s/%s.ndir.dscr.i18n.%s",
 		 dn, pndir_packages_incdir, line, pdate);
 	if (vf_stat(path, tmpath, &stats, pkgdir->name)) {
 	  mdpatchsize += stats.vf_size;
 	  msgn(3, "_\n%lld bytes %s\n", (long long)stats.vf_size, path);
+	  add_diff_file(files, path, stats.vf_size, pkgdir->name);
 	}
 
 	msgn(2, "pndir_m_update idxpatches/idxsize: %lld/%lld bytes\n",
@@ -371,6 +422,7 @@ int pndir_m_update(struct pkgdir *pkgdir, enum pkgdir_uprc *uprc)
 
 	if (mdpatchsize * 9 / 10 > mdsize) {
 	    vfile_close(vf);
+	    n_array_free(files);
 	    msgn(1, _("Index patches size too big\n"));
 	    msgn(1, _("Retrieving whole index ...\n"));
 	    rc = update_whole_idx(pkgdir->src);
@@ -381,10 +433,13 @@ int pndir_m_update(struct pkgdir *pkgdir, enum pkgdir_uprc *uprc)
     }
 
     vfile_configure(VFILE_CONF_VERBOSE, &poldek_VERBOSE);
+    fetch_diff_files(files);
+    n_array_free(files);
+
     n_stream_seek(vf->vf_tnstream, 0L, SEEK_SET); // to the begining
 
     first_patch_found = 0;
-    npatch = 0;
+    diffs = n_array_new(16, (tn_fn_free)pkgdir_free, NULL);
     while ((nread = n_stream_gets(vf->vf_tnstream, line, sizeof(line))) > 0) {
         struct pkgdir *diff;
         char *md;
@@ -431,26 +486,29 @@ int pndir_m_update(struct pkgdir *pkgdir, enum pkgdir_uprc *uprc)
             break;
         }
 
-        if ((pkgdir->flags & PKGDIR_LOADED) == 0) {
-            if (!pkgdir_load(pkgdir, NULL, 0)) {
-                logn(LOGERR, _("%s: load failed"), pkgdir->idxpath);
-                nerr++;
-                break;
-            }
-        }
         msgn(1, _("Applying %s..."), n_basenam(diff->idxpath));
         pkgdir_load(diff, NULL, 0);
-        pkgdir_patch(pkgdir, diff);
-        pkgdir_free(diff);
-
-        npatch++;
+        n_array_push(diffs, diff);
     }
 
     vfile_close(vf);
-    if (npatch == 0) {        /* outdated and no patches */
+
+    /* all of them at once, index is rebuilt once */
+    if (nerr == 0 && n_array_size(diffs) > 0) {
+        if ((pkgdir->flags & PKGDIR_LOADED) == 0 && !pkgdir_load(pkgdir, NULL, 0)) {
+            logn(LOGERR, _("%s: load failed"), pkgdir->idxpath);
+            nerr++;
+
+        } else {
+            pkgdir_patch_many(pkgdir, diffs);
+        }
+    }
+
+    if (nerr == 0 && n_array_size(diffs) == 0) { /* outdated and no patches */
         *uprc = PKGDIR_UPRC_ERR_DESYNCHRONIZED;
         nerr++;
     }
+    n_array_free(diffs);
 
     if (nerr == 0)
         if (pkgdir__uniq(pkgdir) > 0) { /* duplicates? -> error */
@@ -140,26 +140,72 @@ tn_tuple *load_nodep_fl(tn_alloc *na, const struct pkg *pkg, void *ptr,
     return fl;
 }
 
+/* package of previous (cached) db state with the same record number,
+   installation time and NEVR as header */
+static
+struct pkg *search_in_prev(tn_array *prev, unsigned int recno, void *header)
+{
+    const char  *name = NULL, *ver = NULL, *rel = NULL;
+    struct pkg  tmp, *pkg;
+    uint32_t    itime = 0;
+    int32_t     epoch = 0;
+
+    memset(&tmp, 0, sizeof(tmp));
+    tmp.recno = recno;
+
+    if ((pkg = n_array_bsearch(prev, &tmp)) == NULL)
+        return NULL;
+
+    if (!pm_rpmhdr_get_int(header, RPMTAG_INSTALLTIME, &itime) ||
+        (int32_t)itime != pkg->itime)
+        return NULL;
+
+    if (!pm_rpmhdr_nevr(header, &name, &epoch, &ver, &rel, NULL, NULL))
+        return NULL;
+
+    if (epoch != pkg->epoch || n_str_ne(name, pkg->name) ||
+        n_str_ne(ver, pkg->ver) || n_str_ne(rel, pkg->rel))
+        return NULL;
+
+    return pkg;
+}
+
 /* load package from header and add it to pkgdir */
 static
-int load_package(unsigned int recno, void *header, struct pkgdir *pkgdir, unsigned ldflags)
+int load_package(unsigned int recno, void *header, struct pkgdir *pkgdir,
+                 tn_array *prev, unsigned ldflags)
 {
-    struct pkg  *pkg;
+    struct pkg  *pkg = NULL;
     tn_array    *langs;
     unsigned    pkg_ldflags = PKG_LDCAPREQS;
 
     if (ldflags & PKGDIR_LD_FULLFLIST)
         pkg_ldflags = PKG_LDWHOLE;
 
-    pkg = pm_rpm_ldhdr(pkgdir->na, header, NULL, 0, pkg_ldflags);
-
-    if (pkg == NULL)
-        return 0;
+    if (prev && (pkg = search_in_prev(prev, recno, header))) {
+        pkg = pkg_link(pkg);    /* unchanged, reuse it */
+
+        /* cache's lazy loading data, headers are read from db now */
+        if (pkg->pkgdir_data && pkg->pkgdir_data_free)
+            pkg->pkgdir_data_free(pkg->na, pkg->pkgdir_data);
+        pkg->pkgdir_data = NULL;
+        pkg->pkgdir_data_free = NULL;
+
+        if (pkg->groupid > 0 && pkgdir->prev_pkgdir->pkgroups)
+            pkg->groupid = pkgroup_idx_remap_groupid(pkgdir->pkgroups,
+                                                     pkgdir->prev_pkgdir->pkgroups,
+                                                     pkg->groupid, 1);
+    } else {
+        pkg = pm_rpm_ldhdr(pkgdir->na, header, NULL, 0, pkg_ldflags);
+        if (pkg == NULL)
+            return 0;
+
+        pkg->recno = recno;
+        pkg->groupid = pkgroup_idx_update_rpmhdr(pkgdir->pkgroups, header);
+    }
 
-    pkg->recno = recno;
     pkg->load_pkguinf = load_pkguinf;
     pkg->load_nodep_fl = load_nodep_fl;
-    pkg->groupid = pkgroup_idx_update_rpmhdr(pkgdir->pkgroups, header);
 
     if (poldek_VERBOSE > 3)
         msgn(4, "rpmdb: ld %s", pkg_id(pkg));
@@ -184,6 +230,7 @@ int load_db_packages(struct pm_ctx *pmctx, struct pkgdir *pkgdir,
     struct pkgdb_it    it;
     const struct pm_dbrec *dbrec;
     char               dbfull_path[PATH_MAX];
+    tn_array           *prev = NULL;
     int                n;
 
     snprintf(dbfull_path, sizeof(dbfull_path), "%s%s",
@@ -197,12 +244,26 @@ int load_db_packages(struct pm_ctx *pmctx, struct pkgdir *pkgdir,
     msg(3, _("Loading db packages%s%s%s..."), *dbfull_path ? " [":"",
         dbfull_path, *dbfull_path ? "]":"");
 
+    /* outdated cache given, load changed headers only */
+    if (pkgdir->prev_pkgdir) {
+        tn_array *pkgs = pkgdir->prev_pkgdir->pkgs;
+        int i;
+
+        prev = n_array_new(n_array_size(pkgs), NULL, (tn_fn_cmp)pkg_cmp_recno);
+        for (i=0; i < n_array_size(pkgs); i++) {
+            struct pkg *pkg = n_array_nth(pkgs, i);
+            if (pkg->recno)     /* not ones installed in session */
+                n_array_push(prev, pkg);
+        }
+        n_array_sort(prev);
+    }
+
     pkgdb_it_init(db, &it, PMTAG_RECNO, NULL);
 
     n = 0;
     while ((dbrec = pkgdb_it_get(&it))) {
         if (dbrec->hdr) {
-            if (load_package(dbrec->recno, dbrec->hdr, pkgdir, ldflags))
+            if (load_package(dbrec->recno, dbrec->hdr, pkgdir, prev, ldflags))
                 n++;
         }
 
@@ -219,6 +280,9 @@ int load_db_packages(struct pm_ctx *pmctx, struct pkgdir *pkgdir,
     pkgdb_it_destroy(&it);
     pkgdb_free(db);
 
+    if (prev)
+        n_array_free(prev);
+
     if (n == 0)
         n_array_clean(pkgdir->pkgs);
 
@@ -262,7 +326,16 @@ int do_load(struct pkgdir *pkgdir, unsigned ldflags)
 
     DBGF("prev_dir %p\n", pkgdir->prev_pkgdir);
 
-    if (!load_db_packages(pkgdir->mod_data, pkgdir, "/", ldflags))
+    int rc = load_db_packages(pkgdir->mod_data, pkgdir, "/", ldflags);
+
+    /* reused packages are linked, previous dir is useless now and
+       would be taken as a base of patch by pkgdir_save() */
+    if (pkgdir->prev_pkgdir) {
+        pkgdir_free(pkgdir->prev_pkgdir);
+        pkgdir->prev_pkgdir = NULL;
+    }
+
+    if (!rc)
         return 0;
 
     for (i=0; i < n_array_size(pkgdir->pkgs); i++) {
@@ -19,6 +19,8 @@
 #include <sys/param.h>          /* for PATH_MAX */
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <errno.h>
 #include <unistd.h>
 
 #include <trurl/nmalloc.h>
@@ -28,10 +30,12 @@
 #include <trurl/nhash.h>
 
 #include <vfile/vfile.h>
+#include <sigint/sigint.h>
 
 #include "compiler.h"
 #include "pkgdir.h"
 #include "pkgdir_intern.h"
+#include "pkgdir_stubindex.h"
 #include "source.h"
 #include "misc.h"
 #include "log.h"
@@ -73,6 +77,7 @@ static struct src_option source_options[] = {
     { "gpg",      0, PKGSOURCE_VRFY_GPG,    NULL},
     { "pgp",      0, PKGSOURCE_VRFY_PGP,    NULL},
     { "sign",     0, PKGSOURCE_VRFY_SIGN,   NULL},
+    { "deltas",   0, PKGSOURCE_DELTAS,      NULL},
     { "type",     0, PKGSOURCE_TYPE |
                      PKGSRC_OPTION_STRING | PKGSRC_OPTION_SUBOPT, NULL },
     { "lang",     0, PKGSOURCE_DSCR |
@@ -610,6 +615,9 @@ struct source *source_new_htcnf(const tn_hash *htcnf)
     else if ((v = poldek_conf_get_bool(htcnf, "sign", 0)))
         n += n_snprintf(&spec[n], sizeof(spec) - n, ",sign");
 
+    if ((v = poldek_conf_get_bool(htcnf, "deltas", 0)))
+        n += n_snprintf(&spec[n], sizeof(spec) - n, ",deltas");
+
     if ((vs = poldek_conf_get(htcnf, "lang", NULL)))
         n += n_snprintf(&spec[n], sizeof(spec) - n, ",lang=%s", vs);
 
@@ -922,20 +930,152 @@ void source_printf(const struct source *src) {
     source_printf_w(src, 12);
 }
 
+/* update sources one by one in a child process, RET: its pid */
+static pid_t start_updater(tn_array *sources, unsigned flags)
+{
+    pid_t pid;
+    int nerr = 0;
+
+    fflush(NULL);               /* do not duplicate buffered output */
+
+    if ((pid = fork()) < 0) {
+        logn(LOGERR, "fork: %m");
+        return 0;
+    }
+
+    if (pid > 0)
+        return pid;
+
+    vfile_forget_connections(); /* parent's keep-alive ones */
+
+    /* several bars at once would be unreadable */
+    vfile_configure(VFILE_CONF_PROGRESS_NONE, 1);
+
+    for (int i=0; i < n_array_size(sources); i++) {
+        if (sigint_reached())
+            break;
+
+        if (!source_update(n_array_nth(sources, i), flags))
+            nerr++;
+    }
+
+    fflush(NULL);
+    _exit(nerr || sigint_reached() ? 1 : 0);
+}
+
+/* sources from one host are updated by one process (reusing its
+   connections), different hosts concurrently, up to vf_maxconn() of
+   them at once */
+static int sources_update_parallel(tn_array *hosts, unsigned flags,
+                                   int maxproc)
+{
+    pid_t *pids = alloca(maxproc * sizeof(*pids));
+    int nrunning = 0, next = 0, nerr = 0;
+
+    memset(pids, 0, maxproc * sizeof(*pids));
+
+    while (next < n_array_size(hosts) || nrunning > 0) {
+        pid_t pid;
+        int st, i;
+
+        while (nrunning < maxproc && next < n_array_size(hosts) &&
+               !sigint_reached()) {
+
+            if ((pid = start_updater(n_array_nth(hosts, next), flags)) == 0) {
+                nerr++;
+                next = n_array_size(hosts);
+                break;
+            }
+
+            for (i=0; i < maxproc; i++) {
+                if (pids[i] == 0) {
+                    pids[i] = pid;
+                    break;
+                }
+            }
+
+            nrunning++;
+            next++;
+        }
+
+        if (nrunning == 0)
+            break;
+
+        if ((pid = wait(&st)) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (i=0; i < maxproc; i++) {
+            if (pids[i] == pid) {
+                pids[i] = 0;
+                nrunning--;
+
+                if (!WIFEXITED(st) || WEXITSTATUS(st) != 0)
+                    nerr++;
+                break;
+            }
+        }
+    }
+
+    return nerr == 0 && !sigint_reached();
+}
+
 int sources_update(tn_array *sources, unsigned flags)
 {
-    int i, nerr = 0;
+    tn_array *hosts;
+    tn_hash *byhost;
+    int i, maxproc, nerr = 0;
+
+    hosts = n_array_new(8, (tn_fn_free)n_array_free, NULL);
+    byhost = n_hash_new(21, NULL);
 
     for (i=0; i < n_array_size(sources); i++) {
         struct source *src = n_array_nth(sources, i);
+        tn_array *srcs;
+        char host[256];
 
         if (src->flags & PKGSOURCE_NOAUTOUP)
             continue;
 
-        if (!source_update(src, flags))
+        /* local ones are quick, do not bother */
+        if ((vf_url_type(src->path) & VFURL_LOCAL) ||
+            vf_url_host(host, sizeof(host), src->path) == 0) {
+            if (!source_update(src, flags))
+                nerr++;
+            continue;
+        }
+
+        if ((srcs = n_hash_get(byhost, host)) == NULL) {
+            srcs = n_array_new(4, NULL, NULL);
+            n_array_push(hosts, srcs);
+            n_hash_insert(byhost, host, srcs);
+        }
+        n_array_push(srcs, src);
+    }
+
+    maxproc = vf_maxconn();
+    if (maxproc > n_array_size(hosts))
+        maxproc = n_array_size(hosts);
+
+    if (maxproc > 1) {
+        if (!sources_update_parallel(hosts, flags, maxproc))
             nerr++;
+
+    } else {
+        for (i=0; i < n_array_size(hosts); i++) {
+            tn_array *srcs = n_array_nth(hosts, i);
+
+            for (int j=0; j < n_array_size(srcs); j++)
+                if (!source_update(n_array_nth(srcs, j), flags))
+                    nerr++;
+        }
     }
 
+    n_hash_free(byhost);
+    n_array_free(hosts);
+
     return nerr == 0;
 }
 
@@ -1019,6 +1159,9 @@ int sources_clean(tn_array *sources, unsigned flags)
             nerr++;
     }
 
+    if (flags & PKGSOURCE_CLEAN) /* made of all sources stubindexes */
+        pkgdir__stubsession_clean(flags & PKGSOURCE_CLEAN_TEST);
+
     return nerr == 0;
 }
 
@@ -15,6 +15,7 @@
 
 #include <trurl/narray.h>
 #include <trurl/nhash.h>
+#include <trurl/nbuf.h>
 
 #ifndef EXPORT
 #  define EXPORT extern
@@ -37,6 +38,7 @@ EXPORT const char source_TYPE_GROUP[]; /* "group" */
 #define PKGSOURCE_NODESC     (1 << 12)
 #define PKGSOURCE_AUTOUPA    (1 << 13) /* do --upa if --up said "desynchronized"
                                           index */
+#define PKGSOURCE_DELTAS     (1 << 14) /* deltarpms are available (deltas.toc) */
 #define PKGSOURCE_ISGROUP    (1 << 15) /* an alias for one or more sources */
 
 struct source {
@@ -118,6 +120,11 @@ EXPORT int source_clean(struct source *src, unsigned flags);
 
 EXPORT tn_array *source_stubload(struct source *src);
 
+/* snapshot of stubs of all sources, stamp is made of source_stubstamp()s */
+EXPORT int source_stubstamp(struct source *src, tn_buf *nbuf);
+EXPORT tn_array *sources_stubload_session(const char *stamp);
+EXPORT int sources_stubsave_session(const char *stamp, tn_array *pkgs);
+
 EXPORT int sources_clean(tn_array *sources, unsigned flags);
 
 /* flags = PKGDIR_CREAT_* */
@@ -26,6 +26,7 @@
 
 #include <trurl/nassert.h>
 #include <trurl/narray.h>
+#include <trurl/nmalloc.h>
 #include <trurl/nhash.h>
 #include <trurl/nstr.h>
 #include <trurl/n_snprintf.h>
@@ -39,6 +40,7 @@
 #include "log.h"
 #include "pkg.h"
 #include "pkgmisc.h"
+#include "pkgdelta.h"
 #include "pkgdir/pkgdir.h"
 #include "misc.h"
 #include "pm/pm.h"
@@ -111,16 +113,217 @@ void packages_fetch_summary(struct pm_ctx *pmctx, const tn_array *pkgs,
     msg(1, "_\n");
 }
 
+/* vf_fetchq_job's verify callback, may be called by download process */
+static int verify_fetched(const char *path, void *pmctx)
+{
+    if (pm_verify_signature(pmctx, path, PKGVERIFY_MD))
+        return 1;
+
+    logn(LOGERR, _("%s: MD5 signature verification failed"), n_basenam(path));
+    return 0;
+}
+
+/* key of package in vfile's shared store; indexes do not carry package
+   file digests, so it is identified by file name, build time and size,
+   and digest is verified before store copy is used */
+static const char *store_key(char *buf, int size, const struct pkg *pkg)
+{
+    if (pkg->btime == 0 || pkg->fsize == 0)
+        return NULL;
+
+    n_snprintf(buf, size, "%x-%x-%s", pkg->btime, pkg->fsize,
+               pkg_filename_s(pkg));
+    return buf;
+}
+
+/* RET: 1 if package has been hardlinked from shared store */
+static int store_get(struct pm_ctx *pmctx, const struct pkg *pkg,
+                     const char *path)
+{
+    char key[PATH_MAX], dir[PATH_MAX];
+    char *p;
+
+    if (!vf_store_enabled() || store_key(key, sizeof(key), pkg) == NULL)
+        return 0;
+
+    n_snprintf(dir, sizeof(dir), "%s", path);
+    if ((p = strrchr(dir, '/')) && p != dir) {
+        *p = '\0';
+        vf_mkdir(dir);
+    }
+
+    if (!vf_store_get(key, path))
+        return 0;
+
+    if (pm_verify_signature(pmctx, path, PKGVERIFY_MD))
+        return 1;
+
+    logn(LOGWARN, _("%s: broken shared cache copy, removed"),
+         n_basenam(path));
+    vf_unlink(path);
+    vf_store_remove(key);
+    return 0;
+}
+
+static void store_put(const struct pkg *pkg, const char *path)
+{
+    char key[PATH_MAX];
+
+    if (vf_store_enabled() && store_key(key, sizeof(key), pkg))
+        vf_store_put(key, path);
+}
+
+/* packages verified by prefetch are marked with .NAME.verified file
+   holding package size and mtime, so installation does not check
+   their digests again */
+static void vmark_path(char *buf, int size, const char *path)
+{
+    const char *name = n_basenam(path);
+
+    n_snprintf(buf, size, "%.*s.%s.verified", (int)(name - path), path, name);
+}
+
+static int vmark_fmt(char *buf, int size, const char *path)
+{
+    struct stat st;
+
+    if (stat(path, &st) != 0)
+        return 0;
+
+    return n_snprintf(buf, size, "%lld %ld\n", (long long)st.st_size,
+                      (long)st.st_mtime);
+}
+
+static int is_marked_verified(const struct pkg *pkg, const char *path)
+{
+    char mpath[PATH_MAX], expected[128], buf[128];
+    int rc = 0;
+    FILE *f;
+
+    if (!vmark_fmt(expected, sizeof(expected), path))
+        return 0;
+
+    if (pkg->fsize && atoll(expected) != (long long)pkg->fsize)
+        return 0;
+
+    vmark_path(mpath, sizeof(mpath), path);
+    if ((f = fopen(mpath, "r")) == NULL)
+        return 0;
+
+    if (fgets(buf, sizeof(buf), f) && strcmp(buf, expected) == 0)
+        rc = 1;
+
+    fclose(f);
+    return rc;
+}
+
+static void mark_verified(const char *path)
+{
+    char mpath[PATH_MAX], buf[128];
+    FILE *f;
+
+    if (!vmark_fmt(buf, sizeof(buf), path))
+        return;
+
+    vmark_path(mpath, sizeof(mpath), path);
+    if ((f = fopen(mpath, "w")) == NULL) {
+        logn(LOGWARN, "%s: %m", mpath);
+        return;
+    }
+
+    fputs(buf, f);
+    fclose(f);
+}
+
+static void unmark_verified(const char *path)
+{
+    char mpath[PATH_MAX];
+
+    vmark_path(mpath, sizeof(mpath), path);
+    unlink(mpath);
+}
+
+struct fetch_job {
+    struct vf_fetchq_job job;   /* must be first, jobs are passed to vfile */
+    struct pkg           *pkg;
+    const char           *url;  /* full package */
+    struct pkgdelta      *delta;
+};
+
+static void fetch_job_free(struct fetch_job *fj)
+{
+    if (fj->delta)
+        pkgdelta_free(fj->delta);
+    free(fj);
+}
+
+/* rebuild packages from fetched deltas; jobs of failed ones are turned
+   back into full package downloads and pushed to refetch */
+static void rebuild_from_deltas(struct pm_ctx *pmctx,
+                                struct pkgdelta_ctx *dctx, tn_array *jobs,
+                                tn_array *refetch)
+{
+    tn_array *deltas;
+    int i;
+
+    deltas = n_array_new(n_array_size(jobs), NULL, NULL);
+    for (i=0; i < n_array_size(jobs); i++) {
+        struct fetch_job *fj = n_array_nth(jobs, i);
+
+        if (fj->delta && fj->job.rc)
+            n_array_push(deltas, fj->delta);
+    }
+
+    pkgdelta_apply(dctx, deltas);
+    n_array_free(deltas);
+
+    for (i=0; i < n_array_size(jobs); i++) {
+        struct fetch_job *fj = n_array_nth(jobs, i);
+
+        if (fj->delta == NULL)
+            continue;
+
+        if (fj->job.rc && fj->delta->rc) /* rebuilt */
+            continue;
+
+        if (!sigint_reached())
+            msgn(1, _("%s: falling back to full package"),
+                 pkg_snprintf_s(fj->pkg));
+
+        fj->job.url = fj->url;
+        fj->job.size = fj->pkg->fsize;
+        fj->job.verify = verify_fetched;
+        fj->job.verify_arg = pmctx;
+        fj->job.rc = 0;
+        pkgdelta_free(fj->delta);
+        fj->delta = NULL;
+        n_array_push(refetch, fj);
+    }
+}
+
 int packages_fetch(struct pm_ctx *pmctx,
                    tn_array *pkgs, const char *destdir, int is_destdir_custom)
 {
-    int       i, nerr, urltype, ncdroms;
+    return packages_fetch_ext(pmctx, NULL, pkgs, destdir,
+                              is_destdir_custom ? PKGFETCH_NOSUBDIRS : 0);
+}
+
+int packages_fetch_ext(struct pm_ctx *pmctx, struct pkgdb *db,
+                       tn_array *pkgs, const char *destdir, unsigned flags)
+{
+    int is_destdir_custom = (flags & PKGFETCH_NOSUBDIRS) != 0;
+    int prefetch = (flags & PKGFETCH_PREFETCH) != 0;
+    int       i, nerr, urltype, ncdroms, ndeltas = 0;
     tn_array  *urls = NULL, *packages = NULL;
-    tn_array  *urls_arr = NULL;
+    tn_array  *urls_arr = NULL, *jobs = NULL;
     tn_hash   *urls_h, *pkgs_h = NULL;
     tn_hash   *pkgdir_labels_h = NULL;
+    struct pkgdelta_ctx *dctx = NULL;
 
     n_assert(destdir);
+    if (prefetch)
+        vfile_configure(VFILE_CONF_IDLE_IO, 1);
+
     urls_h = n_hash_new(21, (tn_fn_free)n_array_free);
     pkgs_h = n_hash_new(21, (tn_fn_free)n_array_free);
     pkgdir_labels_h = n_hash_new(21, NULL);
@@ -182,15 +385,35 @@ int packages_fetch(struct pm_ctx *pmctx,
         }
 
         if (access(path, R_OK) == 0) {
-            int pkg_ok;
+            struct stat st;
+
+            /* interrupted download is kept, vf_fetch() resumes it */
+            if (stat(path, &st) == 0 && pkg->fsize > 0 &&
+                st.st_size < (off_t)pkg->fsize) {
+                ;
+
+            } else if (is_marked_verified(pkg, path)) {
+                msgn(3, "%s: verified by prefetch", pkg_basename);
+                pkgs_count--;
+                continue;
 
-            pkg_ok = pm_verify_signature(pmctx, path, PKGVERIFY_MD);
-            if (pkg_ok) {         /* we got it  */
-		pkgs_count--;
+            } else if (pm_verify_signature(pmctx, path, PKGVERIFY_MD)) {
+                store_put(pkg, path);
+                if (prefetch)
+                    mark_verified(path);
+		pkgs_count--;   /* we got it  */
                 continue;
-	    }
-            else
+
+            } else {
+                unmark_verified(path);
                 vf_unlink(path);
+            }
+
+        } else if (store_get(pmctx, pkg, path)) {
+            if (prefetch)
+                mark_verified(path);
+            pkgs_count--;
+            continue;
         }
 
         if ((urls = n_hash_get(urls_h, pkgpath)) == NULL) {
@@ -227,54 +450,106 @@ int packages_fetch(struct pm_ctx *pmctx,
     else if (ncdroms == 1)
         putenv("POLDEK_VFJUGGLE_CPMODE=link");
 
-    int counter = 0;
+    /* all packages are queued at once, so vfile may download them
+       from many hosts and over many connections at the same time; each
+       one is verified as soon as it is retrieved */
+    jobs = n_array_new(pkgs_count > 0 ? pkgs_count : 1,
+                       (tn_fn_free)fetch_job_free, NULL);
+
+    if (db && pkgs_count > 0)
+        dctx = pkgdelta_ctx_new(pmctx, db);
     for (i=0; i < n_array_size(urls_arr); i++) {
         char path[PATH_MAX];
         const char *real_destdir, *pkgdir_name;
         char *pkgpath = n_array_nth(urls_arr, i);
 
-        if (sigint_reached())
-            break;
-
         urls = n_hash_get(urls_h, pkgpath);
         packages = n_hash_get(pkgs_h, pkgpath);
         real_destdir = destdir;
         if (is_destdir_custom == 0) {
             char buf[1024];
+            int len;
 
             vf_url_as_dirpath(buf, sizeof(buf), pkgpath);
-            snprintf(path, sizeof(path), "%s/%s", destdir, buf);
-            real_destdir = path;
+            len = n_snprintf(path, sizeof(path), "%s/%s", destdir, buf);
+            real_destdir = alloca(len + 1);
+            memcpy((char*)real_destdir, path, len + 1);
         }
 
         pkgdir_name = n_hash_get(pkgdir_labels_h, pkgpath);
-        if (!vf_fetcha(urls, real_destdir, 0, pkgdir_name, counter, pkgs_count)) {
-            nerr++;
-        } else {
-            for (int j=0; j < n_array_size(urls); j++) {
-                char localpath[PATH_MAX];
-                n_snprintf(localpath, sizeof(localpath), "%s/%s", real_destdir,
-                         n_basenam(n_array_nth(urls, j)));
+        for (int j=0; j < n_array_size(urls); j++) {
+            struct fetch_job *fj = n_calloc(sizeof(*fj), 1);
+            struct vf_fetchq_job *job = &fj->job;
+            struct pkg *pkg = n_array_nth(packages, j);
 
-                if (!pm_verify_signature(pmctx, localpath, PKGVERIFY_MD)) {
-                    logn(LOGERR, _("%s: MD5 signature verification failed"),
-                         n_basenam(localpath));
-                    nerr++;
-                }
+            fj->pkg = pkg;
+            fj->url = n_array_nth(urls, j);
+            if (dctx)
+                fj->delta = pkgdelta_find(dctx, pkg, real_destdir);
+
+            job->destdir = real_destdir;
+            job->label = pkgdir_name;
+            job->rc = 0;
+
+            if (fj->delta) {    /* verified after rebuild */
+                job->url = fj->delta->url;
+                job->size = fj->delta->size;
+                ndeltas++;
 
-		counter++;
+            } else {
+                job->url = fj->url;
+                job->size = pkg->fsize;
+                job->verify = verify_fetched;
+                job->verify_arg = pmctx;
             }
+            n_array_push(jobs, fj);
+        }
+    }
+
+    vf_fetchq(jobs, 0);
+
+    if (ndeltas && !sigint_reached()) {
+        tn_array *refetch = n_array_new(ndeltas, NULL, NULL);
+
+        rebuild_from_deltas(pmctx, dctx, jobs, refetch);
+        vf_fetchq(refetch, 0);
+        n_array_free(refetch);
+    }
+
+    for (i=0; i < n_array_size(jobs); i++) {
+        struct fetch_job *fj = n_array_nth(jobs, i);
+        char path[PATH_MAX];
+
+        if (!fj->job.rc) {
+            nerr++;
+            continue;
         }
+
+        if (fj->delta)
+            n_snprintf(path, sizeof(path), "%s", fj->delta->destpath);
+        else
+            n_snprintf(path, sizeof(path), "%s/%s", fj->job.destdir,
+                       n_basenam(fj->job.url));
+        store_put(fj->pkg, path);
+        if (prefetch)
+            mark_verified(path);
     }
 
  l_end:
     if (sigint_reached())
         nerr++;
 
+    n_array_cfree(&jobs);
+    if (dctx)
+        pkgdelta_ctx_free(dctx);
     n_array_free(urls_arr);
     n_hash_free(urls_h);
     n_hash_free(pkgs_h);
     n_hash_free(pkgdir_labels_h);
+
+    if (prefetch)               /* installation may follow */
+        vfile_configure(VFILE_CONF_IDLE_IO, 0);
+
     return nerr == 0;
 }
 
@@ -290,6 +565,7 @@ int packages_fetch_remove(tn_array *pkgs, const char *destdir)
             if (pkg_localpath(pkg, path, sizeof(path), destdir)) {
                 DBGF("unlink %s\n", path);
                 unlink(path);
+                unmark_verified(path);
             }
     }
     return 1;
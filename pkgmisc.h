@@ -49,6 +49,17 @@ EXPORT void packages_fetch_summary(struct pm_ctx *pmctx, const tn_array *pkgs,
 EXPORT int packages_fetch(struct pm_ctx *pmctx,
                    tn_array *pkgs, const char *destdir, int nosubdirs);
 
+#define PKGFETCH_NOSUBDIRS  (1 << 0) /* is_destdir_custom */
+#define PKGFETCH_PREFETCH   (1 << 1) /* background download: idle I/O,
+                                        verified packages are marked so,
+                                        next fetch skips their verification */
+/* like packages_fetch(), but deltarpms are used for packages which
+   base versions are installed in db (sources with "deltas" option) */
+struct pkgdb;
+EXPORT int packages_fetch_ext(struct pm_ctx *pmctx, struct pkgdb *db,
+                              tn_array *pkgs, const char *destdir,
+                              unsigned flags);
+
 EXPORT int packages_fetch_remove(tn_array *pkgs, const char *destdir);
 
 
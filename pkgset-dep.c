@@ -17,6 +17,7 @@
 #include <limits.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
@@ -29,6 +30,7 @@
 #include "capreqidx.h"
 #include "pkg.h"
 #include "pkgset.h"
+#include "misc.h"
 
 void *pkg_na_malloc(const struct pkg *pkg, size_t size);
 
@@ -256,8 +258,8 @@ int process_reqs(int indent, tn_array *reqpkgs, struct pkgset *ps, const struct
     return nerrors;
 }
 
-tn_array *pkgset_get_required_packages_x(int indent, struct pkgset *ps,
-                                         const struct pkg *pkg, tn_hash **unreqh)
+static tn_array *get_required_packages(int indent, struct pkgset *ps,
+                                       const struct pkg *pkg, tn_hash **unreqh)
 {
     if (pkg->reqs == NULL) {
         return NULL;
@@ -286,26 +288,151 @@ tn_array *pkgset_get_required_packages_x(int indent, struct pkgset *ps,
     return reqpkgs;
 }
 
-tn_array *pkgset_get_required_packages(int indent, struct pkgset *ps,
-                                       const struct pkg *pkg)
+/*
+  Requirement graph: resolved requirements of every ps->pkgs member,
+  computed once per package and shared by all consumers (ordering,
+  verification, marking, desc). Nodes are kept sorted by package address,
+  edges are reqpkg[] arrays (with REQPKG_* flags and alternatives).
+  Required-by queries are not answered from it but from the requirement
+  index, see pkgset_get_requiredby_packages().
+*/
+#define RGNODE_RESOLVED  (1 << 0)
+
+struct reqgraph_node {
+    struct pkg *pkg;
+    tn_array   *reqpkgs;        /* struct reqpkg *[] or NULL */
+    tn_array   *unreqs;         /* struct pkg_unreq *[] or NULL */
+    uint32_t   flags;
+};
+
+struct pkgset_reqgraph {
+    int                   nnodes;
+    struct reqgraph_node  *nodes;
+    uint32_t              generation; /* of ps */
+    int                   nresolved;
+    tn_hash               *unreqh;    /* scratch for get_required_packages() */
+};
+
+static int reqgraph_node_cmp(const void *a, const void *b)
 {
-    tn_array *reqpkgs = NULL;
+    const struct reqgraph_node *n1 = a, *n2 = b;
 
-    if (ps->_reqpkgs_cache == NULL) {
-        ps->_reqpkgs_cache = n_hash_new(n_array_size(ps->pkgs), (tn_fn_free)n_array_free);
-        n_hash_ctl(ps->_reqpkgs_cache, TN_HASH_REHASH);
-    } else {
-        reqpkgs = n_hash_get(ps->_reqpkgs_cache, pkg_id(pkg));
-        if (reqpkgs)
-            return n_ref(reqpkgs);
+    if (n1->pkg == n2->pkg)
+        return 0;
+
+    return (uintptr_t)n1->pkg < (uintptr_t)n2->pkg ? -1 : 1;
+}
+
+void pkgset_reqgraph_free(struct pkgset_reqgraph *g)
+{
+    for (int i=0; i < g->nnodes; i++) {
+        struct reqgraph_node *node = &g->nodes[i];
+
+        n_array_cfree(&node->reqpkgs);
+        n_array_cfree(&node->unreqs);
     }
 
-    reqpkgs = pkgset_get_required_packages_x(indent, ps, pkg, NULL);
+    n_hash_free(g->unreqh);
+    free(g->nodes);
+    free(g);
+}
 
-    if (reqpkgs)
-        n_hash_insert(ps->_reqpkgs_cache, pkg_id(pkg), n_ref(reqpkgs));
+static struct pkgset_reqgraph *reqgraph(struct pkgset *ps)
+{
+    struct pkgset_reqgraph *g = ps->_reqgraph;
 
-    return reqpkgs;
+    if (g && g->generation == ps->_generation)
+        return g;
+
+    if (g) {                    /* ps has been changed */
+        pkgset_reqgraph_free(g);
+        ps->_reqgraph = NULL;
+
+        if (ps->_req_cache) {
+            n_hash_free(ps->_req_cache);
+            ps->_req_cache = NULL;
+        }
+    }
+
+    g = n_calloc(sizeof(*g), 1);
+    g->unreqh = n_hash_new(16, (tn_fn_free)n_array_free);
+    g->nnodes = n_array_size(ps->pkgs);
+    g->nodes = n_calloc(sizeof(*g->nodes), g->nnodes + 1);
+    g->generation = ps->_generation;
+
+    for (int i=0; i < g->nnodes; i++)
+        g->nodes[i].pkg = n_array_nth(ps->pkgs, i);
+
+    qsort(g->nodes, g->nnodes, sizeof(*g->nodes), reqgraph_node_cmp);
+
+    ps->_reqgraph = g;
+    return g;
+}
+
+static struct reqgraph_node *reqgraph_node(struct pkgset *ps, const struct pkg *pkg)
+{
+    struct pkgset_reqgraph *g = reqgraph(ps);
+    struct reqgraph_node tmp, *node;
+
+    tmp.pkg = (struct pkg*)pkg;
+    node = bsearch(&tmp, g->nodes, g->nnodes, sizeof(*g->nodes), reqgraph_node_cmp);
+    if (node == NULL)           /* not a ps member */
+        return NULL;
+
+    if ((node->flags & RGNODE_RESOLVED) == 0) {
+        node->reqpkgs = get_required_packages(0, ps, pkg, &g->unreqh);
+        node->unreqs = n_hash_remove(g->unreqh, pkg_id(pkg));
+
+        node->flags |= RGNODE_RESOLVED;
+        g->nresolved++;
+    }
+
+    return node;
+}
+
+int pkgset_reqgraph_build(struct pkgset *ps)
+{
+    struct pkgset_reqgraph *g = reqgraph(ps);
+
+    if (g->nresolved == g->nnodes)
+        return g->nnodes;
+
+    tt_start;
+    for (int i=0; i < g->nnodes; i++)
+        reqgraph_node(ps, g->nodes[i].pkg);
+    tt_stop("ps.reqgraph");
+
+    return g->nnodes;
+}
+
+tn_array *pkgset_get_required_packages_x(int indent, struct pkgset *ps,
+                                         const struct pkg *pkg, tn_hash **unreqh)
+{
+    struct reqgraph_node *node;
+
+    if (pkg->reqs == NULL)
+        return NULL;
+
+    if ((node = reqgraph_node(ps, pkg)) == NULL) /* not a ps member, not cached */
+        return get_required_packages(indent, ps, pkg, unreqh);
+
+    if (unreqh) {
+        if (*unreqh == NULL) {
+            *unreqh = n_hash_new(128, (tn_fn_free)n_array_free);
+            n_hash_ctl(*unreqh, TN_HASH_REHASH);
+        }
+
+        if (node->unreqs && !n_hash_exists(*unreqh, pkg_id(pkg)))
+            n_hash_insert(*unreqh, pkg_id(pkg), n_ref(node->unreqs));
+    }
+
+    return node->reqpkgs ? n_ref(node->reqpkgs) : NULL;
+}
+
+tn_array *pkgset_get_required_packages(int indent, struct pkgset *ps,
+                                       const struct pkg *pkg)
+{
+    return pkgset_get_required_packages_x(indent, ps, pkg, NULL);
 }
 
 static
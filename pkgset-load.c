@@ -228,6 +228,7 @@ int pkgset_load(struct pkgset *ps, int ldflags, tn_array *sources)
     }
 
     init_depdirs(ps->depdirs);
+    ps->_generation++;
 
     if (n_array_size(ps->pkgs)) {
         int n = n_array_size(ps->pkgs);
@@ -262,6 +263,7 @@ int pkgset_add_pkgdir(struct pkgset *ps, struct pkgdir *pkgdir)
     }
     */
     n_array_push(ps->pkgdirs, pkgdir);
+    ps->_generation++;
 
     return 1;
 }
@@ -16,10 +16,12 @@
 
 #include <limits.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
 #include <trurl/nassert.h>
+#include <trurl/nmalloc.h>
 #include <trurl/narray.h>
 #include <trurl/nhash.h>
 #include <trurl/n_snprintf.h>
@@ -27,214 +29,303 @@
 #include "compiler.h"
 #include "i18n.h"
 #include "log.h"
-#define POLDEK_PKG_DAG_COLOURS 1  /* for pkg_*color */
 #include "pkg.h"
 #include "pkgset.h"
 #include "misc.h"
 
 /*
  * Ordering: sort packages topologically
+ *
+ * Requirements of ordered packages are resolved once into compact graph
+ * (CSR adjacency over package positions), then graph is visited by
+ * iterative DFS. Node colours and Requires(pre) marks live in side arrays,
+ * so neither package flags nor C stack depth are involved.
  */
-struct visit_install_order_s {
-    struct pkgset *ps;
-    tn_array *ordered_pkgs;
-    tn_array *stack;
-    int nerrors;
-    int verbose_level;
+#define ORDER_WHITE  0
+#define ORDER_GRAY   1
+#define ORDER_BLACK  2
+
+#define ORDER_PREREQED (1 << 0) /* entered by Requires(pre) edge */
+
+struct order_edge {
+    int32_t  to;
+    uint8_t  flags;             /* REQPKG_* */
 };
 
+struct order_node {
+    struct pkg *pkg;
+    int32_t    node;
+};
 
-static
-int visit_install_order(struct visit_install_order_s *vs, struct pkg *pkg,
-                        unsigned reqpkg_flag, int deep)
+struct order_frame {
+    int32_t  node;
+    int32_t  ei;                /* next edge to visit */
+};
+
+struct order_graph {
+    int                nnodes;
+    struct pkg         **pkgs;  /* node => package */
+    struct order_node  *index;  /* sorted by package address */
+    int32_t            *offs;   /* node edges: edges[offs[i]..offs[i+1]) */
+    struct order_edge  *edges;
+
+    /* per pass state */
+    uint8_t            *colours;
+    uint8_t            *marks;
+    struct order_frame *stack;
+};
+
+static int order_node_cmp(const void *a, const void *b)
 {
-    int i, last_stack_i = -1;
-    int verb = vs->verbose_level;
+    const struct order_node *n1 = a, *n2 = b;
 
-    deep += 2;
+    if (n1->pkg == n2->pkg)
+        return 0;
 
-    pkg_set_color(pkg, PKG_COLOR_GRAY);
+    return (uintptr_t)n1->pkg < (uintptr_t)n2->pkg ? -1 : 1;
+}
 
-    tn_array *reqpkgs = pkgset_get_required_packages(deep, vs->ps, pkg);
+static int order_graph_lookup(const struct order_graph *g, const struct pkg *pkg)
+{
+    struct order_node tmp, *n;
 
-    if (reqpkgs == NULL || n_array_size(reqpkgs) == 0) {
-        msg(verb, "_\n");
-        msg_i(verb, deep, "_ visit %s  (NO REQS)", pkg->name);
-        goto l_end;
-    }
+    tmp.pkg = (struct pkg*)pkg;
+    n = bsearch(&tmp, g->index, g->nnodes, sizeof(*g->index), order_node_cmp);
 
-    n_array_push(vs->stack, pkg);
-    last_stack_i = n_array_size(vs->stack) - 1;
+    return n ? n->node : -1;
+}
 
-    msg(verb, "_\n");
-    msg_i(verb, deep, "_ visit %s -> (", pkg->name);
-    for (i=0; i < n_array_size(reqpkgs); i++) {
-        struct reqpkg *rp = n_array_nth(reqpkgs, i);
+/* push rpkg and its alternatives as edges, skipping packages out of pool */
+static int add_edges(struct order_graph *g, int32_t n, const struct reqpkg *rpkg)
+{
+    const struct reqpkg *rp = rpkg;
+    int np = 0, nedges = 0;
 
-        msg(verb, "_%s%s, ", (rp->flags & reqpkg_flag) ? "*" : "",
-            rp->pkg->name);
+    while (rp != NULL) {
+        int to = order_graph_lookup(g, rp->pkg);
 
-        if (rp->flags & REQPKG_MULTI) {
-            int n = 0;
-            while (rp->adds[n]) {
-                msg(verb, "_%s%s, ",
-                    (rp->adds[n]->flags & reqpkg_flag) ? "*" : "",
-                    rp->adds[n]->pkg->name);
-                n++;
+        if (to >= 0) {
+            if (g->edges) {
+                g->edges[n + nedges].to = to;
+                g->edges[n + nedges].flags = rp->flags;
             }
+            nedges++;
         }
+
+        if (rpkg->flags & REQPKG_MULTI)
+            rp = rpkg->adds[np++];
+        else
+            rp = NULL;
     }
-    msg(verb, "_) {");
 
-    for (i=0; i < n_array_size(reqpkgs); i++) {
-        struct reqpkg *rpkg, *rp;
-        int np = 0;
+    return nedges;
+}
 
-        rpkg = rp = n_array_nth(reqpkgs, i);
+static struct order_graph *order_graph_new(struct pkgset *ps, const tn_array *pkgs)
+{
+    struct order_graph *g;
+    tn_array **reqpkgs;
+    int i, j, nedges = 0;
+
+    g = n_calloc(sizeof(*g), 1);
+    g->nnodes = n_array_size(pkgs);
+    g->pkgs = n_malloc(sizeof(*g->pkgs) * g->nnodes);
+    g->index = n_malloc(sizeof(*g->index) * g->nnodes);
+
+    for (i=0; i < g->nnodes; i++) {
+        g->pkgs[i] = n_array_nth(pkgs, i);
+        g->index[i].pkg = g->pkgs[i];
+        g->index[i].node = i;
+    }
+    qsort(g->index, g->nnodes, sizeof(*g->index), order_node_cmp);
 
-        while (rp != NULL) {
-            if (pkg_is_color(rp->pkg, PKG_ALL_COLORS) == 0) { // skip, it is not in our pool
-                (void)0;
+    /* 1st pass: count edges */
+    reqpkgs = n_malloc(sizeof(*reqpkgs) * g->nnodes);
+    g->offs = n_malloc(sizeof(*g->offs) * (g->nnodes + 1));
 
-            } else if (pkg_is_color(rp->pkg, PKG_COLOR_WHITE)) {
-                if (rp->flags & reqpkg_flag)
-                    pkg_set_prereqed(rp->pkg);
-                else
-                    pkg_clr_prereqed(rp->pkg);
+    for (i=0; i < g->nnodes; i++) {
+        reqpkgs[i] = pkgset_get_required_packages(0, ps, g->pkgs[i]);
+        g->offs[i] = nedges;
 
-                if (reqpkg_flag == 0 || (rp->flags & reqpkg_flag))
-                    visit_install_order(vs, rp->pkg, reqpkg_flag, deep);
+        if (reqpkgs[i])
+            for (j=0; j < n_array_size(reqpkgs[i]); j++)
+                nedges += add_edges(g, 0, n_array_nth(reqpkgs[i], j));
+    }
+    g->offs[g->nnodes] = nedges;
 
-            } else if (pkg_is_color(rp->pkg, PKG_COLOR_BLACK)) {
-                msg(verb, "_\n");
-                msg_i(verb, deep, "_   visited %s", rp->pkg->name);
+    /* 2nd pass: fill them */
+    g->edges = n_malloc(sizeof(*g->edges) * (nedges + 1));
+    for (i=0; i < g->nnodes; i++) {
+        int n = g->offs[i];
 
-            } else if (pkg_is_color(rp->pkg, PKG_COLOR_GRAY)) { /* cycle  */
-                int is_loop = 0;
+        if (reqpkgs[i] == NULL)
+            continue;
 
-                if (rp->flags & reqpkg_flag) {
-                    int j, nn = 0, nprereqs = 0;
+        for (j=0; j < n_array_size(reqpkgs[i]); j++)
+            n += add_edges(g, n, n_array_nth(reqpkgs[i], j));
 
-                    for (j=n_array_size(vs->stack)-1; j >= 0; j--) {
-                        struct pkg *p = n_array_nth(vs->stack, j);
+        n_assert(n == g->offs[i + 1]);
+        n_array_free(reqpkgs[i]);
+    }
+    free(reqpkgs);
 
-                        if (p == rp->pkg)
-                            break;
+    g->colours = n_malloc(g->nnodes);
+    g->marks = n_malloc(g->nnodes);
+    g->stack = n_malloc(sizeof(*g->stack) * g->nnodes);
 
-                        nn++;
-                        if (!pkg_is_prereqed(p))
-                            break;
+    return g;
+}
 
-                        nprereqs++;
-                    }
+static void order_graph_free(struct order_graph *g)
+{
+    free(g->pkgs);
+    free(g->index);
+    free(g->offs);
+    free(g->edges);
+    free(g->colours);
+    free(g->marks);
+    free(g->stack);
+    free(g);
+}
 
-                    if (nn > 0 && nn == nprereqs)
-                        is_loop = 1;
-                }
+/* is g->stack[0..top] -> to a Requires(pre) loop? */
+static int is_prereq_loop(const struct order_graph *g, int top, int to)
+{
+    int j, nn = 0, nprereqs = 0;
 
-                if (is_loop) {
-                    vs->nerrors++;
+    for (j = top; j >= 0; j--) {
+        int n = g->stack[j].node;
 
-                    if (verb > 2) {
-                        msg(verb, "\n");
-                        msg_i(verb, deep, "   cycle   %s -> %s", pkg->name,
-                              rp->pkg->name);
+        if (n == to)
+            break;
 
-                    } else {
-                        char *error;
-                        int size, ne = 0;
-
-                        size = n_array_size(vs->stack) * 128;
-                        error = alloca(size);
-
-                        ne += n_snprintf(error, size, _("Requires(pre) loop: "));
-                        ne += n_snprintf(&error[ne], size - ne, "%s", rp->pkg->name);
-                        for (int ii=n_array_size(vs->stack)-1; ii >= 0; ii--) {
-                            struct pkg *p = n_array_nth(vs->stack, ii);
-                            ne += n_snprintf(&error[ne], size - ne, " <- %s", p->name);
-                        }
-                        log(LOGERR, "%s\n", error);
-                    }
+        nn++;
+        if ((g->marks[n] & ORDER_PREREQED) == 0)
+            break;
 
-                } else {
-                    msg(verb, "\n");
-                    msg_i(verb, deep, "   fakecycle   %s -> %s", pkg->name,
-                          rp->pkg->name);
-                }
+        nprereqs++;
+    }
 
-            } else {
-                n_assert(0);
-            }
+    return nn > 0 && nn == nprereqs;
+}
 
-            if (rpkg->flags & REQPKG_MULTI)
-                rp = rpkg->adds[np++];
-            else
-                rp = NULL;
-        }
-    }
+static void log_prereq_loop(const struct order_graph *g, int top, int to)
+{
+    char *error;
+    int size, ne = 0;
+
+    size = (top + 2) * 128;
+    error = alloca(size);
 
-    msg(verb, "\n");
-    msg_i(verb, deep, "_ } ");
-    msg(verb, "_%s",  pkg->name);
-    for (i=n_array_size(vs->stack)-2; i >= 0; i--) {
-        struct pkg *p = n_array_nth(vs->stack, i);
-        if (p != pkg)
-            msg(verb, "_ <- %s", p->name);
+    ne += n_snprintf(error, size, _("Requires(pre) loop: "));
+    ne += n_snprintf(&error[ne], size - ne, "%s", g->pkgs[to]->name);
+    for (int j = top; j >= 0; j--) {
+        struct pkg *p = g->pkgs[g->stack[j].node];
+        ne += n_snprintf(&error[ne], size - ne, " <- %s", p->name);
     }
-    msg(verb, "_\n");
+    log(LOGERR, "%s\n", error);
+}
+
+/* iterative DFS from root, finished nodes are appended to ordered */
+static int visit_install_order(struct order_graph *g, int root, tn_array *ordered,
+                               unsigned reqpkg_flag, int verb)
+{
+    int top = 0, nerrors = 0;
+    int deep0 = reqpkg_flag ? 1 : 0;
+
+    g->stack[0].node = root;
+    g->stack[0].ei = g->offs[root];
+    g->colours[root] = ORDER_GRAY;
+    msgn_i(verb, deep0 + 2, "visit %s", g->pkgs[root]->name);
+
+    while (top >= 0) {
+        struct order_frame *f = &g->stack[top];
+        int deep = deep0 + 2 * (top + 1);
+
+        if (f->ei < g->offs[f->node + 1]) {
+            const struct order_edge *e = &g->edges[f->ei++];
+            int to = e->to;
+
+            switch (g->colours[to]) {
+                case ORDER_WHITE:
+                    if (e->flags & reqpkg_flag)
+                        g->marks[to] |= ORDER_PREREQED;
+                    else
+                        g->marks[to] &= ~ORDER_PREREQED;
+
+                    if (reqpkg_flag == 0 || (e->flags & reqpkg_flag)) {
+                        top++;
+                        n_assert(top < g->nnodes);
+                        g->stack[top].node = to;
+                        g->stack[top].ei = g->offs[to];
+                        g->colours[to] = ORDER_GRAY;
+                        msgn_i(verb, deep + 2, "visit %s", g->pkgs[to]->name);
+                    }
+                    break;
 
- l_end:
-    pkg_set_color(pkg, PKG_COLOR_BLACK);
-    pkg_clr_prereqed(pkg);
-    msgn(verb, "push %s", pkg_snprintf_s(pkg));
-    n_array_push(vs->ordered_pkgs, pkg_link(pkg));
+                case ORDER_BLACK:
+                    msgn_i(verb, deep, "  visited %s", g->pkgs[to]->name);
+                    break;
 
-    n_array_cfree(&reqpkgs);
+                case ORDER_GRAY: /* cycle */
+                    if ((e->flags & reqpkg_flag) && is_prereq_loop(g, top, to)) {
+                        nerrors++;
 
-    if (last_stack_i != -1)
-        for (i=last_stack_i; i < n_array_size(vs->stack); i++) {
-            pkg = n_array_pop(vs->stack);
-            pkg_clr_prereqed(pkg);
+                        if (verb > 2)
+                            msgn_i(verb, deep, "  cycle   %s -> %s",
+                                   g->pkgs[f->node]->name, g->pkgs[to]->name);
+                        else
+                            log_prereq_loop(g, top, to);
+
+                    } else {
+                        msgn_i(verb, deep, "  fakecycle   %s -> %s",
+                               g->pkgs[f->node]->name, g->pkgs[to]->name);
+                    }
+                    break;
+
+                default:
+                    n_assert(0);
+                    break;
+            }
+
+            continue;
         }
 
-    return 0;
-}
+        /* all requirements visited */
+        g->colours[f->node] = ORDER_BLACK;
+        g->marks[f->node] &= ~ORDER_PREREQED;
+        msgn(verb, "push %s", pkg_snprintf_s(g->pkgs[f->node]));
+        n_array_push(ordered, pkg_link(g->pkgs[f->node]));
+        top--;
+    }
 
-static void mapfn_clean_pkg_color(struct pkg *pkg)
-{
-    pkg_set_color(pkg, PKG_COLOR_WHITE);
-    pkg_clr_prereqed(pkg);
+    return nerrors;
 }
 
-static int do_order(struct pkgset *ps, const tn_array *pkgs, tn_array **ordered_pkgs,
+static int do_order(struct order_graph *g, const tn_array *pkgs, tn_array **ordered_pkgs,
                     unsigned reqpkg_flag, int verbose_level)
 {
-    struct pkg *pkg;
-    struct visit_install_order_s vs;
-    int i;
+    tn_array *ordered;
+    int i, nerrors = 0;
 
-    vs.ps = ps;
-    vs.ordered_pkgs = n_array_new(n_array_size(pkgs), (tn_fn_free)pkg_free, NULL);
-    vs.nerrors = 0;
-    vs.stack = n_array_new(128, NULL, NULL);
-    vs.verbose_level = verbose_level;
+    ordered = n_array_new(n_array_size(pkgs), (tn_fn_free)pkg_free, NULL);
 
-    n_array_map(pkgs, (tn_fn_map1)mapfn_clean_pkg_color);
+    memset(g->colours, ORDER_WHITE, g->nnodes);
+    memset(g->marks, 0, g->nnodes);
 
     for (i=0; i<n_array_size(pkgs); i++) {
-        pkg = n_array_nth(pkgs, i);
-        if (pkg_is_color(pkg, PKG_COLOR_WHITE)) {
-            visit_install_order(&vs, pkg, reqpkg_flag, reqpkg_flag ? 1 : 0);
-            n_array_clean(vs.stack);
-        }
+        int n = order_graph_lookup(g, n_array_nth(pkgs, i));
+
+        n_assert(n >= 0);
+        if (g->colours[n] == ORDER_WHITE)
+            nerrors += visit_install_order(g, n, ordered, reqpkg_flag, verbose_level);
     }
 
-    n_assert(n_array_size(vs.ordered_pkgs) == n_array_size(pkgs));
+    n_assert(n_array_size(ordered) == n_array_size(pkgs));
 
     n_assert(*ordered_pkgs == NULL);
-    n_array_free(vs.stack);
-    *ordered_pkgs = vs.ordered_pkgs;
-    return vs.nerrors;
+    *ordered_pkgs = ordered;
+    return nerrors;
 }
 
 
@@ -255,9 +346,11 @@ static int do_packages_order(struct pkgset *ps, const tn_array *pkgs,
        by pkg_cmp_pri_name_evr_rev() */
     n_array_isort_ex(inpkgs, (tn_fn_cmp)pkg_cmp_pri_name_evr_rev);
 
+    struct order_graph *g = order_graph_new(ps, inpkgs);
+
     /* Preordering packages using Requires: */
     msgn(verbose_level + 2, "Preordering packages...");
-    do_order(ps, inpkgs, &preordered, 0, verbose_level + 2);
+    do_order(g, inpkgs, &preordered, 0, verbose_level + 2);
 
     switch (ordertype) {
         case PKGORDER_INSTALL:
@@ -273,8 +366,9 @@ static int do_packages_order(struct pkgset *ps, const tn_array *pkgs,
     }
     msgn(verbose_level + 2, "Ordering packages...");
     *ordered_pkgs = NULL;
-    nloops = do_order(ps, preordered, ordered_pkgs, reqpkg_flag, verbose_level + 1);
+    nloops = do_order(g, preordered, ordered_pkgs, reqpkg_flag, verbose_level + 1);
 
+    order_graph_free(g);
     n_array_free(preordered);
     n_array_free(inpkgs);
 
@@ -87,9 +87,9 @@ void pkgset_free(struct pkgset *ps)
         ps->_req_cache = NULL;
     }
 
-    if (ps->_reqpkgs_cache) {
-        n_hash_free(ps->_reqpkgs_cache);
-        ps->_reqpkgs_cache = NULL;
+    if (ps->_reqgraph) {
+        pkgset_reqgraph_free(ps->_reqgraph);
+        ps->_reqgraph = NULL;
     }
 
     n_array_cfree(&ps->pkgs);
@@ -234,6 +234,7 @@ int pkgset_add_package(struct pkgset *ps, struct pkg *pkg)
         return 0;
 
     n_array_push(ps->pkgs, pkg_link(pkg));
+    ps->_generation++;
 
     if (ps->cap_idx.na != NULL) /* already indexed caps */
         index_package_caps(ps, pkg);
@@ -288,6 +289,7 @@ int pkgset_remove_package(struct pkgset *ps, struct pkg *pkg)
     }
 
     n_array_remove_nth(ps->pkgs, nth);
+    ps->_generation++;
     return 1;
 }
 
@@ -36,7 +36,9 @@ struct pkgset {
     struct file_index  *file_idx;   /* 'file'  => *pkg[]  */
 
     tn_hash            *_req_cache;
-    tn_hash            *_reqpkgs_cache;
+    struct pkgset_reqgraph *_reqgraph; /* pkgset-dep.c */
+
+    uint32_t           _generation; /* bumped on every package add/remove */
 };
 
 struct pm_ctx;
@@ -82,6 +84,12 @@ tn_array *pkgset_get_required_packages_x(int indent, struct pkgset *ps, const st
 tn_array *pkgset_get_required_packages(int indent, struct pkgset *ps, const struct pkg *pkg);
 tn_array *pkgset_get_requiredby_packages(int indent, struct pkgset *ps, const struct pkg *pkg);
 
+/* requirement graph, see pkgset-dep.c */
+struct pkgset_reqgraph;
+void pkgset_reqgraph_free(struct pkgset_reqgraph *g);
+/* resolve requirements of all packages, RET: number of graph nodes */
+int pkgset_reqgraph_build(struct pkgset *ps);
+
 /* pkgset-order.c */
 #define PKGORDER_INSTALL     1
 #define PKGORDER_UNINSTALL   2
@@ -977,6 +977,21 @@ const char *pkguinf_get(const struct pkguinf *pkgu, int tag)
     return NULL;
 }
 
+/* summary or description in given language as stored (not recoded) */
+const char *pkguinf_get_lang(const struct pkguinf *pkgu, int tag,
+                             const char *lang)
+{
+    struct pkguinf_i18n *inf;
+
+    if (tag != PKGUINF_SUMMARY && tag != PKGUINF_DESCRIPTION)
+        return pkguinf_get(pkgu, tag);
+
+    if (pkgu->_ht == NULL || (inf = n_hash_get(pkgu->_ht, lang)) == NULL)
+        return NULL;
+
+    return tag == PKGUINF_SUMMARY ? inf->summary : inf->description;
+}
+
 int pkguinf_set(struct pkguinf *pkgu, int tag, const char *val,
                 const char *lang)
 {
@@ -47,6 +47,8 @@ EXPORT const char *pkguinf_get_changelog(struct pkguinf *inf, time_t since);
 EXPORT int pkguinf_changelog_with_security_fixes(struct pkguinf *inf, time_t since);
 
 EXPORT tn_array *pkguinf_langs(struct pkguinf *pkgu);
+EXPORT const char *pkguinf_get_lang(const struct pkguinf *pkgu, int tag,
+                                    const char *lang);
 
 #ifndef SWIG
 
@@ -381,6 +381,32 @@ int pkgdb_search(struct pkgdb *db, tn_array **dbpkgs,
     return nfound;
 }
 
+int pkgdb_load_all(struct pkgdb *db, tn_array *dbpkgs, unsigned ldflags)
+{
+    struct pkgdb_it        it;
+    const struct pm_dbrec  *dbrec;
+    int                    n = 0;
+
+    pkgdb_it_init(db, &it, PMTAG_RECNO, NULL);
+    while ((dbrec = pkgdb_it_get(&it))) {
+        struct pkg *pkg;
+
+        if (sigint_reached()) {
+            n = -1;
+            break;
+        }
+
+        if (dbrec->hdr && (pkg = load_pkg(NULL, db, dbrec, ldflags))) {
+            n_array_push(dbpkgs, pkg);
+            n++;
+        }
+    }
+    pkgdb_it_destroy(&it);
+    n_array_sort(dbpkgs);
+
+    return n;
+}
+
 
 static int header_evr_match_req(struct pm_ctx *ctx, void *hdr,
                                 const struct capreq *req)
@@ -453,6 +479,79 @@ static int db_match(struct pkgdb *db, enum pkgdb_it_tag tag,
 }
 
 
+/* collect recnos of all records matching cap, no exclusion */
+static int db_match_recnos(struct pkgdb *db, enum pkgdb_it_tag tag,
+                           const struct capreq *cap, unsigned ma_flags,
+                           unsigned *recnos, int size, int n)
+{
+    struct pkgdb_it        it;
+    const struct pm_dbrec  *dbrec;
+    int                    is_file;
+
+    is_file = (*capreq_name(cap) == '/' ? 1 : 0);
+
+    pkgdb_it_init(db, &it, tag, capreq_name(cap));
+    while ((dbrec = pkgdb_it_get(&it))) {
+        int i, has = 0;
+
+        for (i=0; i < n; i++) {
+            if (recnos[i] == dbrec->recno) {
+                has = 1;
+                break;
+            }
+        }
+
+        if (has)
+            continue;
+
+        if (is_file || header_cap_match_req(db->_ctx, dbrec->hdr, cap, ma_flags)) {
+            if (n == size) {    /* no room */
+                n = -1;
+                break;
+            }
+            recnos[n++] = dbrec->recno;
+        }
+    }
+
+    pkgdb_it_destroy(&it);
+    return n;
+}
+
+int pkgdb_match_req_recnos(struct pkgdb *db, const struct capreq *req,
+                           unsigned ma_flags, unsigned *recnos, int size)
+{
+    int n = 0, is_file;
+
+    is_file = (*capreq_name(req) == '/' ? 1 : 0);
+
+    if (!is_file)
+        n = db_match_recnos(db, PMTAG_NAME, req, ma_flags, recnos, size, n);
+
+    if (n >= 0)
+        n = db_match_recnos(db, PMTAG_CAP, req, ma_flags, recnos, size, n);
+
+    if (n >= 0 && is_file)
+        n = db_match_recnos(db, PMTAG_FILE, req, ma_flags, recnos, size, n);
+
+    return n;
+}
+
+time_t pkgdb_mtime(struct pkgdb *db)
+{
+    char path[PATH_MAX];
+    const char *dbpath = db->path;
+
+    if (db->rootdir && *db->rootdir && dbpath) {
+        n_snprintf(path, sizeof(path), "%s%s", db->rootdir, dbpath);
+        dbpath = path;
+    }
+
+    if (dbpath == NULL)
+        return 0;
+
+    return pm_dbmtime(db->_ctx, dbpath);
+}
+
 int pkgdb_match_req(struct pkgdb *db, const struct capreq *req, unsigned ma_flags,
                     const tn_array *exclude)
 {
@@ -98,6 +98,15 @@ EXPORT int pkgdb_match_req(struct pkgdb *db,
                            const struct capreq *req, unsigned ma_flags,
                            const tn_array *exclude);
 
+/* Collect (up to size) recnos of packages matching req, no exclusion.
+   RET: number of recnos or -1 if there are more than size of them */
+EXPORT int pkgdb_match_req_recnos(struct pkgdb *db,
+                                  const struct capreq *req, unsigned ma_flags,
+                                  unsigned *recnos, int size);
+
+/* database modification time, 0 if unknown */
+EXPORT time_t pkgdb_mtime(struct pkgdb *db);
+
 struct pm_dbrec {
     unsigned  recno;
     void      *hdr;
@@ -171,6 +180,10 @@ EXPORT int pkgdb_search(struct pkgdb *db, tn_array **dbpkgs,
                         enum pkgdb_it_tag tag, const char *value,
                         const tn_array *exclude, unsigned ldflags);
 
+/* Load all installed packages into dbpkgs, returns number of packages
+   loaded or -1 if interrupted */
+EXPORT int pkgdb_load_all(struct pkgdb *db, tn_array *dbpkgs, unsigned ldflags);
+
 
 EXPORT int pkgdb_q_what_requires(struct pkgdb *db, tn_array *dbpkgs,
                                  const struct capreq *cap,
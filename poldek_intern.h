@@ -26,6 +26,9 @@ struct pkgset;
 struct pm_ctx;
 struct poldek_ts;
 
+// install3/ictx.h
+struct i3cache;
+
 struct poldek_ctx {
     tn_hash        *htconf;     /* poldek configuration */
     tn_array       *sources;    /* struct source *[]  */
@@ -41,6 +44,8 @@ struct poldek_ctx {
     int              _depsolver;
     unsigned         _ps_setup_flags;
 
+    struct i3cache   *_i3cache;    /* solver state kept between transactions */
+
     /* callbacks, don't call them directly */
     void *data_confirm_fn;
     int  (*confirm_fn)(void *data, const struct poldek_ts *ts, int hint,
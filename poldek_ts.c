@@ -962,6 +962,7 @@ static int ts_run_verify(struct poldek_ts *ts)
 
     if (poldek_ts_get_arg_count(ts) == 0) { /* no args */
         arg_packages_add_pkgs(ts->aps, ts->ctx->ps->pkgs);
+        pkgset_reqgraph_build(ts->ctx->ps); /* whole set is to be verified */
     } else {
         flags |= TS_MARK_VERBOSE;
     }
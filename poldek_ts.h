@@ -84,6 +84,7 @@ enum poldek_ts_opt {
     POLDEK_OP_RPMTEST,    /* rpm --test */
     POLDEK_OP_JUSTDB,      /* rpm --justdb */
     POLDEK_OP_JUSTFETCH,
+    POLDEK_OP_PREFETCH,     /* --prefetch, background JUSTFETCH */
     POLDEK_OP_JUSTPRINT,
     POLDEK_OP_JUSTPRINT_N,  /* names, not filenames */
     POLDEK_OP_MKDBDIR,      /* --mkdir */
@@ -200,4 +200,30 @@ START_TEST (test_eval) {
 }
 END_TEST
 
-NTEST_RUNNER("boolean deps", test_parse, test_eval);
+/* parsed expression is evaluated many times (cached by install3) */
+START_TEST (test_eval_reuse) {
+    struct booldep *dep = booldep_parse("((a and c) if b else (b or c))");
+    struct booldep_eval_ctx ctx = { NULL, NULL };
+    tn_array *re;
+
+    expect_notnull(dep);
+
+    for (int i = 0; i < 3; i++) {
+        ctx.req_cost = req_cost_satisfied_b;
+        re = booldep_eval(dep, &ctx);
+        expect_notnull(re);
+        expect_str(array_str(re), "a,c");
+        n_array_free(re);
+
+        ctx.req_cost = req_cost_satisfied_c;
+        re = booldep_eval(dep, &ctx);
+        expect_notnull(re);
+        expect_str(array_str(re), "c");
+        n_array_free(re);
+    }
+
+    booldep_free(dep);
+}
+END_TEST
+
+NTEST_RUNNER("boolean deps", test_parse, test_eval, test_eval_reuse);
@@ -15,6 +15,7 @@
 #endif
 
 #include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -66,13 +67,295 @@ struct uninstall_ctx {
     int                ndep;
     int                nerr_fatal;
     int                nerr_dep;
+    struct dbidx       *dbidx;     /* installed packages snapshot */
+    int                nqueries;   /* rpmdb queries done without it */
 };
 
+/*
+  In-memory snapshot of installed packages with reverse requirement
+  index. Loading whole database costs about as much as a few thousands
+  of rpmdb queries, so it is built once closure computation turns out to
+  be large; no more rpmdb I/O is done after that.
+*/
+#define DBIDX_QUERY_THRESHOLD  2048
+
+struct dbidx {
+    tn_array  *pkgs;            /* installed packages, sorted by recno */
+    tn_hash   *caps;            /* name or provided cap => pkg*[] */
+    tn_hash   *reqs;            /* required name => pkg*[] */
+    tn_hash   *files;           /* required path => owners pkg*[] */
+    tn_hash   *dirs;            /* dirname => pkg*[] having files there */
+};
+
+static tn_hash *dbidx_hash_new(int size)
+{
+    tn_hash *h = n_hash_new(size, (tn_fn_free)n_array_free);
+    n_hash_ctl(h, TN_HASH_REHASH);
+    return h;
+}
+
+static void dbidx_add(tn_hash *h, const char *key, struct pkg *pkg)
+{
+    tn_array *pkgs;
+
+    if ((pkgs = n_hash_get(h, key)) == NULL) {
+        pkgs = n_array_new(2, NULL, NULL);
+        n_hash_insert(h, key, pkgs);
+    }
+
+    /* packages are indexed one by one, so dup may be the last one only */
+    if (n_array_size(pkgs) == 0 ||
+        n_array_nth(pkgs, n_array_size(pkgs) - 1) != pkg)
+        n_array_push(pkgs, pkg);
+}
+
+static void dbidx_free(struct dbidx *idx)
+{
+    n_hash_free(idx->caps);
+    n_hash_free(idx->reqs);
+    n_hash_free(idx->files);
+    n_hash_free(idx->dirs);
+    n_array_free(idx->pkgs);
+    free(idx);
+}
+
+static void dbidx_index_files(struct dbidx *idx, struct pkg *pkg,
+                              tn_hash *wanted)
+{
+    char path[PATH_MAX];
+    int i, j;
+
+    for (i=0; i < n_tuple_size(pkg->fl); i++) {
+        struct pkgfl_ent *flent = n_tuple_nth(pkg->fl, i);
+        int n;
+
+        if (*flent->dirname == '/') /* root dir */
+            n = n_snprintf(path, sizeof(path), "/");
+        else
+            n = n_snprintf(path, sizeof(path), "/%s", flent->dirname);
+
+        if (n > 1)
+            dbidx_add(idx->dirs, path, pkg);
+
+        if (n_hash_size(wanted) == 0)
+            continue;
+
+        for (j=0; j < flent->items; j++) {
+            n_snprintf(&path[n], sizeof(path) - n, "%s%s", n > 1 ? "/" : "",
+                       flent->files[j]->basename);
+
+            if (n_hash_exists(wanted, path))
+                dbidx_add(idx->files, path, pkg);
+        }
+    }
+}
+
+static struct dbidx *dbidx_new(struct pkgdb *db)
+{
+    struct dbidx *idx;
+    tn_hash *wanted;
+    int i, j;
+
+    idx = n_calloc(sizeof(*idx), 1);
+    idx->pkgs = pkgs_array_new_ex(1024, pkg_cmp_recno);
+
+    msgn(2, _("Loading installed packages..."));
+    if (pkgdb_load_all(db, idx->pkgs, uninst_LDFLAGS) < 0) {
+        n_array_free(idx->pkgs);
+        free(idx);
+        return NULL;
+    }
+
+    idx->caps = dbidx_hash_new(4 * n_array_size(idx->pkgs));
+    idx->reqs = dbidx_hash_new(4 * n_array_size(idx->pkgs));
+    idx->files = dbidx_hash_new(1024);
+    idx->dirs = dbidx_hash_new(4 * n_array_size(idx->pkgs));
+    wanted = n_hash_new(1024, NULL); /* required paths */
+    n_hash_ctl(wanted, TN_HASH_REHASH);
+
+    for (i=0; i < n_array_size(idx->pkgs); i++) {
+        struct pkg *pkg = n_array_nth(idx->pkgs, i);
+
+        dbidx_add(idx->caps, pkg->name, pkg);
+
+        if (pkg->caps)
+            for (j=0; j < n_array_size(pkg->caps); j++) {
+                struct capreq *cap = n_array_nth(pkg->caps, j);
+                dbidx_add(idx->caps, capreq_name(cap), pkg);
+            }
+
+        if (pkg->reqs)
+            for (j=0; j < n_array_size(pkg->reqs); j++) {
+                struct capreq *req = n_array_nth(pkg->reqs, j);
+
+                dbidx_add(idx->reqs, capreq_name(req), pkg);
+                if (capreq_is_file(req) && !n_hash_exists(wanted, capreq_name(req)))
+                    n_hash_insert(wanted, capreq_name(req), NULL);
+            }
+    }
+
+    /* file owners are indexed for required paths only */
+    for (i=0; i < n_array_size(idx->pkgs); i++) {
+        struct pkg *pkg = n_array_nth(idx->pkgs, i);
+        if (pkg->fl)
+            dbidx_index_files(idx, pkg, wanted);
+    }
+
+    msgn(3, "dbidx: %d packages, %d caps, %d reqs, %d files, %d dirs",
+         n_array_size(idx->pkgs), n_hash_size(idx->caps),
+         n_hash_size(idx->reqs), n_hash_size(idx->files),
+         n_hash_size(idx->dirs));
+
+    n_hash_free(wanted);
+    return idx;
+}
+
+/* RET: snapshot if it is (or just became) worth to use */
+static struct dbidx *uninstall_dbidx(struct uninstall_ctx *uctx)
+{
+    if (uctx->dbidx == NULL && uctx->nqueries > DBIDX_QUERY_THRESHOLD) {
+        uctx->dbidx = dbidx_new(uctx->db);
+        if (uctx->dbidx == NULL) /* interrupted, do not try again */
+            uctx->nqueries = INT_MIN;
+    }
+
+    return uctx->dbidx;
+}
+
+static inline int is_excluded(const tn_array *exclude, struct pkg *pkg)
+{
+    return exclude && n_array_bsearch((tn_array*)exclude, pkg) != NULL;
+}
+
+/* adds to dbpkgs those of pkgs not providing cap themselves */
+static int add_requirers(tn_array *dbpkgs, tn_array *pkgs,
+                         const struct capreq *cap, const tn_array *exclude)
+{
+    int i, n = 0;
+
+    if (pkgs == NULL)
+        return 0;
+
+    for (i=0; i < n_array_size(pkgs); i++) {
+        struct pkg *pkg = n_array_nth(pkgs, i);
+
+        if (is_excluded(exclude, pkg))
+            continue;
+
+        if (pkg_satisfies_req(pkg, cap, 1)) /* self matched? */
+            continue;
+
+        n_array_push(dbpkgs, pkg_link(pkg));
+        n++;
+    }
+
+    return n;
+}
+
+/* adds to dbpkgs packages requiring cap, as pkgdb_q_what_requires() does,
+   but without sorting, dbpkgs is to be sorted and uniqued by the caller */
+static int dbidx_what_requires(struct dbidx *idx, tn_array *dbpkgs,
+                               const struct capreq *cap,
+                               const tn_array *exclude)
+{
+    const char *name = capreq_name(cap);
+    int n;
+
+    n = add_requirers(dbpkgs, n_hash_get(idx->reqs, name), cap, exclude);
+
+    /* directory => packages having files in it */
+    if (n == 0 && capreq_isdir(cap))
+        n = add_requirers(dbpkgs, n_hash_get(idx->dirs, name), cap, exclude);
+
+    return n;
+}
+
+static int has_not_excluded(tn_array *pkgs, const tn_array *exclude)
+{
+    int i;
+
+    if (pkgs == NULL)
+        return 0;
+
+    for (i=0; i < n_array_size(pkgs); i++)
+        if (!is_excluded(exclude, n_array_nth(pkgs, i)))
+            return 1;
+
+    return 0;
+}
+
+static int dbidx_is_required(struct dbidx *idx, const struct capreq *cap,
+                             const tn_array *exclude)
+{
+    const char *name = capreq_name(cap);
+
+    if (has_not_excluded(n_hash_get(idx->reqs, name), exclude))
+        return 1;
+
+    if (*name == '/' && has_not_excluded(n_hash_get(idx->dirs, name), exclude))
+        return 1;
+
+    return 0;
+}
+
+static int dbidx_match_req(struct dbidx *idx, const struct capreq *req,
+                           unsigned ma_flags, const tn_array *exclude)
+{
+    tn_array *pkgs;
+    int i;
+
+    if ((pkgs = n_hash_get(idx->caps, capreq_name(req)))) {
+        for (i=0; i < n_array_size(pkgs); i++) {
+            struct pkg *pkg = n_array_nth(pkgs, i);
+
+            if (!is_excluded(exclude, pkg) &&
+                pkg_caps_match_req(pkg, req, ma_flags))
+                return 1;
+        }
+    }
+
+    if (capreq_is_file(req) &&
+        has_not_excluded(n_hash_get(idx->files, capreq_name(req)), exclude))
+        return 1;
+
+    return 0;
+}
+
+/* like pkgdb_search() with PMTAG_NAME and PMTAG_CAP */
+static int dbidx_search_cap(struct dbidx *idx, tn_array **dbpkgs,
+                            const char *name, const tn_array *exclude)
+{
+    tn_array *pkgs;
+    int i, n = 0;
+
+    if ((pkgs = n_hash_get(idx->caps, name)) == NULL)
+        return 0;
+
+    for (i=0; i < n_array_size(pkgs); i++) {
+        struct pkg *pkg = n_array_nth(pkgs, i);
+
+        if (is_excluded(exclude, pkg))
+            continue;
+
+        if (*dbpkgs == NULL)
+            *dbpkgs = pkgs_array_new_ex(16, pkg_cmp_recno);
+
+        if (n_array_bsearch(*dbpkgs, pkg))
+            continue;
+
+        n_array_push(*dbpkgs, pkg_link(pkg));
+        n++;
+    }
+
+    return n;
+}
+
 static
 tn_array *get_orphanedby_pkg(struct uninstall_ctx *uctx, struct pkg *pkg)
 {
     tn_array *orphans;
     struct capreq *selfcap;
+    struct dbidx *idx;
     unsigned ldflags = uninst_LDFLAGS;
     int i, n = 0;
 
@@ -82,16 +365,23 @@ tn_array *get_orphanedby_pkg(struct uninstall_ctx *uctx, struct pkg *pkg)
     DBGF("%s\n", pkg_id(pkg));
 
     orphans = pkgs_array_new_ex(128, pkg_cmp_recno);
+    idx = uninstall_dbidx(uctx);
 
     capreq_new_name_a(pkg->name, selfcap);
-    n += pkgdb_q_what_requires(uctx->db, orphans, selfcap,
-                               uctx->unpkgs, ldflags, 0);
+    if (idx)
+        n += dbidx_what_requires(idx, orphans, selfcap, uctx->unpkgs);
+    else
+        n += pkgdb_q_what_requires(uctx->db, orphans, selfcap,
+                                   uctx->unpkgs, ldflags, 0);
 
     if (pkg->caps)
         for (i=0; i < n_array_size(pkg->caps); i++) {
             struct capreq *cap = n_array_nth(pkg->caps, i);
-            n += pkgdb_q_what_requires(uctx->db, orphans, cap,
-                                       uctx->unpkgs, ldflags, 0);
+            if (idx)
+                n += dbidx_what_requires(idx, orphans, cap, uctx->unpkgs);
+            else
+                n += pkgdb_q_what_requires(uctx->db, orphans, cap,
+                                           uctx->unpkgs, ldflags, 0);
         }
 
     if (pkg->fl) {
@@ -104,10 +394,20 @@ tn_array *get_orphanedby_pkg(struct uninstall_ctx *uctx, struct pkg *pkg)
             capreq_new_name_a(path, cap);
             tracef(0, "%s of %s", pkg_id(pkg), path);
 
-            n += pkgdb_q_what_requires(uctx->db, orphans, cap,
-                                       uctx->unpkgs, ldflags, 0);
+            if (idx)
+                n += dbidx_what_requires(idx, orphans, cap, uctx->unpkgs);
+            else
+                n += pkgdb_q_what_requires(uctx->db, orphans, cap,
+                                           uctx->unpkgs, ldflags, 0);
+            uctx->nqueries++;
         }
     }
+    uctx->nqueries += 1 + (pkg->caps ? n_array_size(pkg->caps) : 0);
+
+    if (idx) {                  /* once, not after every push */
+        n_array_sort(orphans);
+        n_array_uniq(orphans);
+    }
 
     MEMINF("END");
 
@@ -119,9 +419,20 @@ tn_array *get_orphanedby_pkg(struct uninstall_ctx *uctx, struct pkg *pkg)
     return orphans;
 }
 
+static int is_required(struct uninstall_ctx *uctx, struct dbidx *idx,
+                       const struct capreq *cap, const tn_array *exclude)
+{
+    if (idx)
+        return dbidx_is_required(idx, cap, exclude);
+
+    uctx->nqueries++;
+    return pkgdb_q_is_required(uctx->db, cap, exclude);
+}
+
 static int pkg_leave_orphans(struct uninstall_ctx *uctx, struct pkg *pkg)
 {
     struct capreq *selfcap;
+    struct dbidx *idx;
     tn_array *exclude;
     int i;
 
@@ -129,14 +440,16 @@ static int pkg_leave_orphans(struct uninstall_ctx *uctx, struct pkg *pkg)
     /* yep, there are packages which requires themselves */
     n_array_push(exclude, pkg_link(pkg));
 
+    idx = uninstall_dbidx(uctx);
+
     capreq_new_name_a(pkg->name, selfcap);
-    if (pkgdb_q_is_required(uctx->db, selfcap, exclude))
+    if (is_required(uctx, idx, selfcap, exclude))
         goto l_yes;
 
     if (pkg->caps)
         for (i=0; i < n_array_size(pkg->caps); i++) {
             struct capreq *cap = n_array_nth(pkg->caps, i);
-            if (pkgdb_q_is_required(uctx->db, cap, exclude))
+            if (is_required(uctx, idx, cap, exclude))
                 goto l_yes;
         }
 
@@ -148,7 +461,7 @@ static int pkg_leave_orphans(struct uninstall_ctx *uctx, struct pkg *pkg)
         while ((path = pkgfl_it_get(&it, NULL))) {
             struct capreq *cap;
             capreq_new_name_a(path, cap);
-            if (pkgdb_q_is_required(uctx->db, cap, exclude))
+            if (is_required(uctx, idx, cap, exclude))
                 goto l_yes;
         }
     }
@@ -174,17 +487,25 @@ int process_pkg_rev_orphans(int indent, struct uninstall_ctx *uctx,
 {
     int i, j;
     tn_array *dbpkgs = NULL;
+    struct dbidx *idx;
 
     if (pkg->reqs == NULL)
         return 1;
 
     for (i=0; i < n_array_size(pkg->reqs); i++) {
         struct capreq *req = n_array_nth(pkg->reqs, i);
-        pkgdb_search(uctx->db, &dbpkgs, PMTAG_NAME, capreq_name(req),
-                     uctx->unpkgs, uninst_LDFLAGS);
 
-        pkgdb_search(uctx->db, &dbpkgs, PMTAG_CAP, capreq_name(req),
-                     uctx->unpkgs, uninst_LDFLAGS);
+        if ((idx = uninstall_dbidx(uctx))) {
+            dbidx_search_cap(idx, &dbpkgs, capreq_name(req), uctx->unpkgs);
+
+        } else {
+            pkgdb_search(uctx->db, &dbpkgs, PMTAG_NAME, capreq_name(req),
+                         uctx->unpkgs, uninst_LDFLAGS);
+
+            pkgdb_search(uctx->db, &dbpkgs, PMTAG_CAP, capreq_name(req),
+                         uctx->unpkgs, uninst_LDFLAGS);
+            uctx->nqueries += 2;
+        }
 
         if (dbpkgs == NULL)
             continue;
@@ -219,6 +540,18 @@ int process_pkg_rev_orphans(int indent, struct uninstall_ctx *uctx,
     return 1;
 }
 
+/* is req satisfied by installed packages not being removed? */
+static int match_req(struct uninstall_ctx *uctx, const struct capreq *req)
+{
+    struct dbidx *idx;
+
+    if ((idx = uninstall_dbidx(uctx)))
+        return dbidx_match_req(idx, req, uctx->strict, uctx->unpkgs);
+
+    uctx->nqueries++;
+    return pkgdb_match_req(uctx->db, req, uctx->strict, uctx->unpkgs);
+}
+
 static
 int process_pkg_reqs(int indent, struct uninstall_ctx *uctx, struct pkg *pkg,
                      struct pkg *requirer)
@@ -257,7 +590,7 @@ int process_pkg_reqs(int indent, struct uninstall_ctx *uctx, struct pkg *pkg,
                                                  at lower level; TOFIX */
             trace(indent + 2, "- satisfied by itself");
 
-        } else if (pkgdb_match_req(uctx->db, req, uctx->strict, uctx->unpkgs)) {
+        } else if (match_req(uctx, req)) {
             trace(indent + 2, "- satisfied by db");
             msg_i(3, indent, "  %s: satisfied by db\n", capreq_snprintf_s(req));
 
@@ -387,6 +720,8 @@ static void uninstall_ctx_free(struct uninstall_ctx *uctx)
 #endif
     n_array_free(uctx->unpkgs);
     pkgmark_set_free(uctx->pms);
+    if (uctx->dbidx)
+        dbidx_free(uctx->dbidx);
     free(uctx);
 };
 
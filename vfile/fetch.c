@@ -703,6 +703,33 @@ char *vf_url_proto(char *proto, int size, const char *url)
 }
 
 
+int vf_url_host(char *buf, int size, const char *url)
+{
+    const char *p, *q;
+    int len;
+
+    *buf = '\0';
+    if ((p = strstr(url, "://")) == NULL)
+        return 0;
+
+    p += 3;
+    if ((q = strchr(p, '/')) == NULL)
+        q = p + strlen(p);
+
+    for (const char *s = p; s < q; s++) /* skip login:passwd@ */
+        if (*s == '@')
+            p = s + 1;
+
+    len = q - p;
+    if (len >= size)
+        len = size - 1;
+
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+    return len;
+}
+
+
 int vf_url_type(const char *url)
 {
     char *p;
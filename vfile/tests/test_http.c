@@ -0,0 +1,706 @@
+/*
+  vfff HTTP client against local stand-in servers: connection reuse,
+  pipelining, resuming of interrupted downloads, mirrors, external
+  fetchers fallback and rate limiting.
+*/
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <trurl/narray.h>
+
+#include "test.h"
+
+#define FILE_SMALL   (8 * 1024)
+#define FILE_BIG     (256 * 1024)
+#define FILE_RATE    (32 * 1024)
+#define LAST_MODIFIED "Sun, 06 Nov 1994 08:49:37 GMT"
+
+struct httpd {
+    pid_t pid;
+    int   port;
+    int   delay;                /* ms, before every response */
+    int   noget;                /* GET requests are dropped */
+    char  logpath[PATH_MAX];
+    char  dir[PATH_MAX];        /* client's destination */
+};
+
+static struct httpd httpd;      /* the default one */
+static struct httpd *srv;       /* server side: the one being served */
+
+static long file_size(const char *name)
+{
+    if (strncmp(name, "rate", 4) == 0)
+        return FILE_RATE;
+    return strncmp(name, "big", 3) == 0 ? FILE_BIG : FILE_SMALL;
+}
+
+static char file_byte(const char *name, long off)
+{
+    return 'a' + (off + strlen(name)) % 26;
+}
+
+/* server side */
+static void srv_log(const char *fmt, const char *arg)
+{
+    FILE *f;
+
+    if ((f = fopen(srv->logpath, "a"))) {
+        fprintf(f, fmt, arg);
+        fclose(f);
+    }
+}
+
+static int srv_write(int fd, const char *buf, long n)
+{
+    while (n > 0) {
+        int nw = write(fd, buf, n);
+        if (nw <= 0)
+            return 0;
+        buf += nw;
+        n -= nw;
+    }
+    return 1;
+}
+
+/* RET: 0 - close connection */
+static int srv_respond(int fd, const char *req, int *nbigreqs)
+{
+    char method[16], path[256], hdr[512], buf[4096];
+    const char *name, *p;
+    long size, from = 0, len;
+    int head, drop = 0;
+
+    if (sscanf(req, "%15s %255s", method, path) != 2)
+        return 0;
+
+    head = strcmp(method, "HEAD") == 0;
+    name = strrchr(path, '/') + 1;
+    size = file_size(name);
+
+    if ((p = strstr(req, "Range: bytes=")))
+        sscanf(p + 13, "%ld-", &from);
+
+    n_snprintf(hdr, sizeof(hdr), "%s /%s %ld\n", method, name, from);
+    srv_log("%s", hdr);
+
+    if (srv->delay)
+        usleep(srv->delay * 1000);
+
+    if (!head && srv->noget)
+        return 0;
+
+    if (strncmp(name, "missing", 7) == 0) {
+        n_snprintf(hdr, sizeof(hdr), "HTTP/1.1 404 Not Found\r\n"
+                   "Content-Length: 0\r\n\r\n");
+        return srv_write(fd, hdr, strlen(hdr));
+    }
+
+    /* first GET of big file breaks in the middle */
+    if (!head && strncmp(name, "big", 3) == 0 && (*nbigreqs)++ == 0)
+        drop = 1;
+
+    len = size - from;
+    if (from > 0)
+        n_snprintf(hdr, sizeof(hdr), "HTTP/1.1 206 Partial Content\r\n"
+                   "Content-Length: %ld\r\n"
+                   "Content-Range: bytes %ld-%ld/%ld\r\n"
+                   "Last-Modified: %s\r\n\r\n",
+                   len, from, size - 1, size, LAST_MODIFIED);
+    else
+        n_snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\n"
+                   "Content-Length: %ld\r\n"
+                   "Last-Modified: %s\r\n\r\n", len, LAST_MODIFIED);
+
+    if (!srv_write(fd, hdr, strlen(hdr)))
+        return 0;
+
+    if (head)
+        return 1;
+
+    if (drop)
+        len /= 2;
+
+    while (len > 0) {
+        int n = len > (long)sizeof(buf) ? (int)sizeof(buf) : (int)len;
+
+        for (int i=0; i < n; i++)
+            buf[i] = file_byte(name, from + i);
+
+        if (!srv_write(fd, buf, n))
+            return 0;
+
+        from += n;
+        len -= n;
+    }
+
+    return !drop;
+}
+
+static void srv_connection(int fd, int *nbigreqs)
+{
+    char buf[16 * 1024];
+    int n = 0;
+
+    *buf = '\0';
+
+    srv_log("%s", "CONNECT\n");
+
+    while (1) {
+        char *eor;
+        int nr;
+
+        /* respond to all requests already received */
+        while ((eor = strstr(buf, "\r\n\r\n"))) {
+            int len = eor + 4 - buf;
+
+            if (!srv_respond(fd, buf, nbigreqs))
+                return;
+
+            memmove(buf, buf + len, n - len + 1);
+            n -= len;
+
+            if (strstr(buf, "\r\n\r\n"))
+                srv_log("%s", "PIPELINED\n");
+        }
+
+        if ((nr = read(fd, buf + n, sizeof(buf) - n - 1)) <= 0)
+            return;
+
+        n += nr;
+        buf[n] = '\0';
+    }
+}
+
+static void httpd_start(struct httpd *h, const char *name)
+{
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    int sockfd, on = 1;
+
+    n_snprintf(h->dir, sizeof(h->dir), "%s", NTEST_TMPPATH("httpd"));
+    mkdir(h->dir, 0755);
+    n_snprintf(h->logpath, sizeof(h->logpath), "%s/../%s.log", h->dir, name);
+    unlink(h->logpath);
+
+    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    fail_if(sockfd < 0);
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    fail_if(bind(sockfd, (struct sockaddr*)&addr, sizeof(addr)) != 0);
+    fail_if(listen(sockfd, 8) != 0);
+    fail_if(getsockname(sockfd, (struct sockaddr*)&addr, &addrlen) != 0);
+    h->port = ntohs(addr.sin_port);
+
+    if ((h->pid = fork()) == 0) {
+        int *nbigreqs, fd;
+
+        /* connection per process, big file counter is shared */
+        nbigreqs = mmap(NULL, sizeof(*nbigreqs), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        *nbigreqs = 0;
+
+        setpgid(0, 0);
+        signal(SIGCHLD, SIG_IGN);
+        srv = h;
+
+        while ((fd = accept(sockfd, NULL, NULL)) >= 0) {
+            if (fork() == 0) {
+                close(sockfd);
+                srv_connection(fd, nbigreqs);
+                _exit(0);
+            }
+            close(fd);
+        }
+        _exit(0);
+    }
+
+    fail_if(h->pid < 0);
+    setpgid(h->pid, h->pid);
+    close(sockfd);
+}
+
+static void httpd_stop(struct httpd *h)
+{
+    kill(-h->pid, SIGTERM);
+    waitpid(h->pid, NULL, 0);
+}
+
+static int httpd_log_count(const struct httpd *h, const char *line)
+{
+    char buf[1024];
+    FILE *f;
+    int n = 0;
+
+    if ((f = fopen(h->logpath, "r")) == NULL)
+        return 0;
+
+    while (fgets(buf, sizeof(buf), f))
+        if (strncmp(buf, line, strlen(line)) == 0)
+            n++;
+
+    fclose(f);
+    return n;
+}
+
+/* client side */
+static void setup(void)
+{
+    static int verbose = 0;
+    char cmd[PATH_MAX];
+
+    /* no local copies left by previous runs */
+    n_snprintf(cmd, sizeof(cmd), "rm -rf %s", NTEST_TMPPATH("httpd"));
+    fail_if(system(cmd) != 0);
+
+    vfile_configure(VFILE_CONF_VERBOSE, &verbose);
+    vfile_configure(VFILE_CONF_STUBBORN_NRETRIES, 1);
+    vfile_setup();
+    httpd_start(&httpd, "httpd");
+}
+
+static char *url(char *buf, int size, const char *name)
+{
+    n_snprintf(buf, size, "http://127.0.0.1:%d/%s", httpd.port, name);
+    return buf;
+}
+
+static char *repo_url(char *buf, int size, int port, const char *name)
+{
+    n_snprintf(buf, size, "http://127.0.0.1:%d/repo%s%s", port,
+               name ? "/" : "", name ? name : "");
+    return buf;
+}
+
+/* port nobody listens on */
+static int dead_port(void)
+{
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    int sockfd;
+
+    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    fail_if(bind(sockfd, (struct sockaddr*)&addr, sizeof(addr)) != 0);
+    fail_if(getsockname(sockfd, (struct sockaddr*)&addr, &addrlen) != 0);
+    close(sockfd);
+
+    return ntohs(addr.sin_port);
+}
+
+static void setup_mirrors(void)
+{
+    char cachedir[PATH_MAX], path[PATH_MAX];
+
+    setup();
+    n_snprintf(cachedir, sizeof(cachedir), "%s", NTEST_TMPPATH("mcache"));
+    mkdir(cachedir, 0755);
+    n_snprintf(path, sizeof(path), "%s/_mirrors", cachedir);
+    unlink(path);
+
+    vfile_configure(VFILE_CONF_CACHEDIR, cachedir);
+    vfile_configure(VFILE_CONF_MAXCONN, 4);
+    vfile_configure(VFILE_CONF_MAXCONN_PERHOST, 2);
+}
+
+static tn_array *fetchq_jobs(const char **files, int port)
+{
+    tn_array *jobs = n_array_new(8, free, NULL);
+    char buf[256];
+
+    for (int i=0; files[i]; i++) {
+        struct vf_fetchq_job *job = n_calloc(sizeof(*job), 1);
+
+        job->url = n_strdup(repo_url(buf, sizeof(buf), port, files[i]));
+        job->destdir = httpd.dir;
+        job->size = file_size(files[i]);
+        n_array_push(jobs, job);
+    }
+
+    return jobs;
+}
+
+static int mirror_stats_has(const char *url)
+{
+    char path[PATH_MAX], line[1024];
+    FILE *f;
+    int found = 0;
+
+    n_snprintf(path, sizeof(path), "%s/_mirrors", NTEST_TMPPATH("mcache"));
+    if ((f = fopen(path, "r")) == NULL)
+        return 0;
+
+    while (fgets(line, sizeof(line), f))
+        if (strncmp(line, url, strlen(url)) == 0 && line[strlen(url)] == ' ')
+            found = 1;
+
+    fclose(f);
+    return found;
+}
+
+/* failure time of url in mirror stats */
+static long mirror_stats_failed(const char *url)
+{
+    char path[PATH_MAX], line[1024];
+    long failed = 0;
+    FILE *f;
+
+    n_snprintf(path, sizeof(path), "%s/_mirrors", NTEST_TMPPATH("mcache"));
+    if ((f = fopen(path, "r")) == NULL)
+        return 0;
+
+    while (fgets(line, sizeof(line), f))
+        if (strncmp(line, url, strlen(url)) == 0 && line[strlen(url)] == ' ')
+            sscanf(line + strlen(url), " %*f %*f %ld", &failed);
+
+    fclose(f);
+    return failed;
+}
+
+static int file_ok(const char *name)
+{
+    char path[PATH_MAX];
+    long size = file_size(name), off = 0;
+    FILE *f;
+    int c;
+
+    n_snprintf(path, sizeof(path), "%s/%s", httpd.dir, name);
+    if ((f = fopen(path, "r")) == NULL)
+        return 0;
+
+    while ((c = getc(f)) != EOF) {
+        if (off >= size || c != file_byte(name, off))
+            break;
+        off++;
+    }
+
+    fclose(f);
+    return c == EOF && off == size;
+}
+
+START_TEST (test_keepalive) {
+    char buf[256];
+    const char *files[] = { "small1", "small2", "small3", NULL };
+
+    setup();
+    for (int i=0; files[i]; i++) {
+        fail_ifnot(vf_fetch(url(buf, sizeof(buf), files[i]), httpd.dir,
+                            0, NULL, NULL), "%s: fetch failed", files[i]);
+        fail_ifnot(file_ok(files[i]), "%s: content differs", files[i]);
+    }
+
+    fail_if(httpd_log_count(&httpd, "CONNECT") != 1,
+            "%d connections made", httpd_log_count(&httpd, "CONNECT"));
+    httpd_stop(&httpd);
+}
+END_TEST
+
+START_TEST (test_pipelining) {
+    const char *files[] = { "pipe1", "pipe2", "pipe3", "pipe4", NULL };
+    tn_array *urls;
+    char buf[256];
+
+    setup();
+
+    urls = n_array_new(4, free, NULL);
+    for (int i=0; files[i]; i++)
+        n_array_push(urls, n_strdup(url(buf, sizeof(buf), files[i])));
+
+    fail_ifnot(vf_fetcha(urls, httpd.dir, 0, NULL, 0, n_array_size(urls)));
+    for (int i=0; files[i]; i++)
+        fail_ifnot(file_ok(files[i]), "%s: content differs", files[i]);
+
+    fail_if(httpd_log_count(&httpd, "CONNECT") != 1,
+            "%d connections made", httpd_log_count(&httpd, "CONNECT"));
+    fail_if(httpd_log_count(&httpd, "PIPELINED") == 0, "no request pipelined");
+
+    n_array_free(urls);
+    httpd_stop(&httpd);
+}
+END_TEST
+
+/* more files than descriptors available => fetched in chunks */
+START_TEST (test_pipelining_many) {
+    struct rlimit rl, saved_rl;
+    tn_array *urls;
+    char buf[256];
+    int i, n = 100;
+
+    setup();
+
+    urls = n_array_new(n, free, NULL);
+    for (i=0; i < n; i++) {
+        char name[32];
+
+        n_snprintf(name, sizeof(name), "many%.3d", i);
+        n_array_push(urls, n_strdup(url(buf, sizeof(buf), name)));
+    }
+
+    getrlimit(RLIMIT_NOFILE, &saved_rl);
+    rl = saved_rl;
+    rl.rlim_cur = 64;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    fail_ifnot(vf_fetcha(urls, httpd.dir, 0, NULL, 0, n_array_size(urls)));
+    setrlimit(RLIMIT_NOFILE, &saved_rl);
+
+    for (i=0; i < n; i++) {
+        const char *name = n_basenam(n_array_nth(urls, i));
+        fail_ifnot(file_ok(name), "%s: content differs", name);
+    }
+
+    fail_if(httpd_log_count(&httpd, "PIPELINED") == 0, "no request pipelined");
+
+    n_array_free(urls);
+    httpd_stop(&httpd);
+}
+END_TEST
+
+START_TEST (test_resume_retry) {
+    char buf[256];
+
+    setup();
+    vfile_configure(VFILE_CONF_STUBBORN_NRETRIES, 3);
+
+    fail_ifnot(vf_fetch(url(buf, sizeof(buf), "big1"), httpd.dir,
+                        0, NULL, NULL));
+    fail_ifnot(file_ok("big1"), "content differs");
+
+    n_snprintf(buf, sizeof(buf), "GET /big1 %ld", (long)FILE_BIG / 2);
+    fail_if(httpd_log_count(&httpd, buf) != 1, "download not resumed");
+    fail_if(httpd_log_count(&httpd, "GET /big1 0") != 1, "download restarted");
+    httpd_stop(&httpd);
+}
+END_TEST
+
+START_TEST (test_resume_next_fetch) {
+    char buf[256], path[PATH_MAX];
+    struct stat st;
+
+    setup();
+
+    /* no retries, partial file is left */
+    fail_if(vf_fetch(url(buf, sizeof(buf), "big2"), httpd.dir, 0, NULL, NULL));
+
+    n_snprintf(path, sizeof(path), "%s/big2", httpd.dir);
+    fail_if(stat(path, &st) != 0, "partial file removed");
+    fail_if(st.st_size != FILE_BIG / 2);
+
+    fail_ifnot(vf_fetch(url(buf, sizeof(buf), "big2"), httpd.dir,
+                        0, NULL, NULL));
+    fail_ifnot(file_ok("big2"), "content differs");
+
+    n_snprintf(buf, sizeof(buf), "GET /big2 %ld", (long)FILE_BIG / 2);
+    fail_if(httpd_log_count(&httpd, buf) != 1, "download not resumed");
+    httpd_stop(&httpd);
+}
+END_TEST
+
+/* dead primary, vf_fetch() falls back to the mirror */
+START_TEST (test_mirror_failover) {
+    char buf[256], murl[256];
+    int port = dead_port();
+
+    setup_mirrors();
+    fail_ifnot(vf_mirror_add(repo_url(buf, sizeof(buf), port, NULL),
+                             repo_url(murl, sizeof(murl), httpd.port, NULL)));
+
+    fail_ifnot(vf_fetch(repo_url(buf, sizeof(buf), port, "mfailover"),
+                        httpd.dir, 0, NULL, NULL));
+    fail_ifnot(file_ok("mfailover"), "content differs");
+    fail_if(httpd_log_count(&httpd, "GET /mfailover 0") != 1);
+
+    /* both are remembered */
+    fail_ifnot(mirror_stats_has(repo_url(buf, sizeof(buf), port, NULL)));
+    fail_ifnot(mirror_stats_has(repo_url(buf, sizeof(buf), httpd.port, NULL)));
+    httpd_stop(&httpd);
+}
+END_TEST
+
+/* missing file neither marks mirror failed nor is looked for elsewhere */
+START_TEST (test_mirror_filemiss) {
+    static int verbose = 1;     /* 404 is not an error otherwise */
+    struct httpd other;
+    char buf[256], murl[256];
+    int n;
+
+    setup_mirrors();
+    vfile_configure(VFILE_CONF_VERBOSE, &verbose);
+
+    memset(&other, 0, sizeof(other));
+    httpd_start(&other, "other");
+
+    fail_ifnot(vf_mirror_add(repo_url(buf, sizeof(buf), httpd.port, NULL),
+                             repo_url(murl, sizeof(murl), other.port, NULL)));
+
+    fail_if(vf_fetch(repo_url(buf, sizeof(buf), httpd.port, "missing.toc"),
+                     httpd.dir, 0, NULL, NULL), "missing file fetched");
+
+    n = httpd_log_count(&httpd, "GET /missing.toc") +
+        httpd_log_count(&other, "GET /missing.toc");
+    fail_if(n != 1, "%d mirrors asked for missing file", n);
+
+    fail_if(mirror_stats_failed(repo_url(buf, sizeof(buf), httpd.port, NULL)),
+            "mirror marked failed");
+    fail_if(mirror_stats_failed(repo_url(buf, sizeof(buf), other.port, NULL)),
+            "mirror marked failed");
+
+    httpd_stop(&other);
+    httpd_stop(&httpd);
+}
+END_TEST
+
+/* files are spread by expected finish time, most go to faster mirror */
+START_TEST (test_mirror_spread) {
+    const char *files[] = { "ms01", "ms02", "ms03", "ms04", "ms05", "ms06",
+                            "ms07", "ms08", "ms09", "ms10", "ms11", "ms12",
+                            "ms13", "ms14", "ms15", "ms16", NULL };
+    struct httpd slow;
+    tn_array *jobs;
+    char buf[256], murl[256];
+    int nfast, nslow;
+
+    setup_mirrors();
+    memset(&slow, 0, sizeof(slow));
+    slow.delay = 300;
+    httpd_start(&slow, "slow");
+
+    fail_ifnot(vf_mirror_add(repo_url(buf, sizeof(buf), slow.port, NULL),
+                             repo_url(murl, sizeof(murl), httpd.port, NULL)));
+
+    jobs = fetchq_jobs(files, slow.port);
+    fail_ifnot(vf_fetchq(jobs, 0));
+
+    for (int i=0; files[i]; i++)
+        fail_ifnot(file_ok(files[i]), "%s: content differs", files[i]);
+
+    fail_if(httpd_log_count(&httpd, "HEAD") != 1, "fast one not probed");
+    fail_if(httpd_log_count(&slow, "HEAD") != 1, "slow one not probed");
+
+    nfast = httpd_log_count(&httpd, "GET");
+    nslow = httpd_log_count(&slow, "GET");
+    fail_if(nfast + nslow != 16, "%d + %d files retrieved", nfast, nslow);
+    fail_if(nslow == 0, "slow mirror not used");
+    fail_if(nfast <= nslow, "%d from fast, %d from slow mirror", nfast, nslow);
+
+    n_array_free(jobs);
+    httpd_stop(&slow);
+    httpd_stop(&httpd);
+}
+END_TEST
+
+/* chosen mirror fails in the middle of transaction, files are taken
+   from the other one */
+START_TEST (test_mirror_requeue) {
+    const char *files[] = { "mq1", "mq2", "mq3", "mq4", NULL };
+    struct httpd broken;
+    tn_array *jobs;
+    char buf[256], murl[256];
+
+    setup_mirrors();
+    httpd.delay = 100;          /* restarted below */
+    httpd_stop(&httpd);
+    httpd_start(&httpd, "httpd");
+
+    memset(&broken, 0, sizeof(broken));
+    broken.noget = 1;
+    httpd_start(&broken, "broken");
+
+    fail_ifnot(vf_mirror_add(repo_url(buf, sizeof(buf), httpd.port, NULL),
+                             repo_url(murl, sizeof(murl), broken.port, NULL)));
+
+    jobs = fetchq_jobs(files, httpd.port);
+    fail_ifnot(vf_fetchq(jobs, 0));
+
+    for (int i=0; files[i]; i++)
+        fail_ifnot(file_ok(files[i]), "%s: content differs", files[i]);
+
+    fail_if(httpd_log_count(&broken, "GET") == 0, "broken mirror not used");
+    fail_if(httpd_log_count(&httpd, "GET") != 4);
+
+    n_array_free(jobs);
+    httpd_stop(&broken);
+    httpd_stop(&httpd);
+}
+END_TEST
+
+/* external fetchers are used only when internal client fails */
+START_TEST (test_ext_fallback) {
+    char buf[256], script[PATH_MAX], cmd[PATH_MAX + 16], path[PATH_MAX];
+    tn_array *protos;
+    FILE *f;
+
+    setup();
+
+    n_snprintf(script, sizeof(script), "%s", NTEST_TMPPATH("fakeget"));
+    fail_if((f = fopen(script, "w")) == NULL);
+    fprintf(f, "#!/bin/sh\necho fallback > \"$2/${1##*/}\"\n");
+    fclose(f);
+    chmod(script, 0755);
+
+    protos = n_array_new(2, free, NULL);
+    n_array_push(protos, n_strdup("http"));
+    n_snprintf(cmd, sizeof(cmd), "%s %%P %%d", script);
+    fail_ifnot(vfile_register_ext_handler("fakeget", protos, cmd));
+    n_array_free(protos);
+
+    fail_ifnot(vf_fetch(url(buf, sizeof(buf), "ext1"), httpd.dir,
+                        0, NULL, NULL));
+    fail_ifnot(file_ok("ext1"), "external fetcher used");
+    fail_if(httpd_log_count(&httpd, "GET /ext1") != 1);
+
+    n_snprintf(buf, sizeof(buf), "http://127.0.0.1:%d/ext2", dead_port());
+    fail_ifnot(vf_fetch(buf, httpd.dir, 0, NULL, NULL), "no fallback");
+
+    n_snprintf(path, sizeof(path), "%s/ext2", httpd.dir);
+    fail_if((f = fopen(path, "r")) == NULL);
+    fail_if(fgets(buf, sizeof(buf), f) == NULL || strcmp(buf, "fallback\n"));
+    fclose(f);
+
+    httpd_stop(&httpd);
+}
+END_TEST
+
+START_TEST (test_rate_limit) {
+    struct timeval tv0, tv1;
+    char buf[256];
+    double elapsed;
+
+    setup();
+    vfile_configure(VFILE_CONF_RATE_LIMIT, 16);   /* KB/s */
+
+    gettimeofday(&tv0, NULL);
+    fail_ifnot(vf_fetch(url(buf, sizeof(buf), "rate1"), httpd.dir,
+                        0, NULL, NULL));
+    gettimeofday(&tv1, NULL);
+    vfile_configure(VFILE_CONF_RATE_LIMIT, 0);
+
+    fail_ifnot(file_ok("rate1"), "content differs");
+
+    /* 32K at 16K/s, bucket is empty at start */
+    elapsed = (tv1.tv_sec - tv0.tv_sec) + (tv1.tv_usec - tv0.tv_usec) / 1e6;
+    fail_if(elapsed < 1.5, "transfer not throttled (%.2fs)", elapsed);
+    fail_if(elapsed > 4.0, "transfer throttled too much (%.2fs)", elapsed);
+
+    httpd_stop(&httpd);
+}
+END_TEST
+
+NTEST_RUNNER("vfile http", test_keepalive, test_pipelining,
+             test_pipelining_many, test_resume_retry, test_resume_next_fetch,
+             test_mirror_failover, test_mirror_filemiss, test_mirror_spread,
+             test_mirror_requeue, test_ext_fallback, test_rate_limit);
@@ -0,0 +1,162 @@
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "test.h"
+
+void append(const char *path, int vft_io)
+{
+    struct vfile *vf;
+
+    vf = vfile_open(path, vft_io, VFM_APPEND);
+    fail_if(vf == NULL);
+    fail_if(n_stream_write(vf->vf_tnstream, "foo\n", 4) != 4);
+    vfile_close(vf);
+}
+
+START_TEST (test_vfile_append) {
+    int ec;
+
+    char *gzpath = strdup(NTEST_TMPPATH("tmp.txt.gz"));
+    append(gzpath, VFT_TRURLIO);
+    append(gzpath, VFT_TRURLIO);
+    append(gzpath, VFT_TRURLIO);
+
+    char *path = strdup(NTEST_TMPPATH("tmp.txt"));
+    append(path, VFT_TRURLIO);
+    append(path, VFT_TRURLIO);
+    append(path, VFT_TRURLIO);
+
+
+    char cmd[1024];
+    n_snprintf(cmd, sizeof(cmd), "zdiff %s %s\n", gzpath, path);
+    ec = system(cmd);
+    fail_if(ec != 0);
+}
+END_TEST
+
+START_TEST (test_valid_path) {
+    char *inv_paths[] = {
+        "../ala/ma/kota",
+        "foo/bar",
+        "/ala/../foo",
+        NULL
+    };
+    char *valid_paths[] = {
+        "/",
+        "/ala/ma/kota",
+        "/foo/..bar",
+        "/ala../foo",
+	"/home/foo/.poldek-cache/_www.rpm.xx.redhat-7.3../.vflock__home.foo..poldek-cache..www.rpm.xx.redhat-7.3..",
+        NULL
+    };
+    int i;
+
+    i = 0;
+    while (inv_paths[i] != NULL) {
+        fail_if(vf_valid_path(inv_paths[i]),
+                "validated invalid '%s'", inv_paths[i]);
+        i++;
+    }
+
+    i = 0;
+    while (valid_paths[i] != NULL) {
+        fail_if(!vf_valid_path(valid_paths[i]),
+                "invalid valid '%s'", valid_paths[i]);
+        i++;
+    }
+}
+END_TEST
+
+START_TEST (test_store) {
+    char cachedir[PATH_MAX], path[PATH_MAX], path2[PATH_MAX];
+    struct stat st, st2;
+    FILE *f;
+
+    n_snprintf(cachedir, sizeof(cachedir), "%s", NTEST_TMPPATH("store"));
+    mkdir(cachedir, 0755);
+    vfile_configure(VFILE_CONF_CACHEDIR, cachedir);
+
+    n_snprintf(path, sizeof(path), "%s/foo-1.0-1.noarch.rpm", cachedir);
+    n_snprintf(path2, sizeof(path2), "%s/foo.rpm", cachedir);
+    unlink(path2);
+
+    f = fopen(path, "w");
+    fail_if(f == NULL);
+    fprintf(f, "foo\n");
+    fclose(f);
+
+    vfile_configure(VFILE_CONF_STORE, 0);
+    fail_if(vf_store_put("key", path), "stored while disabled");
+
+    vfile_configure(VFILE_CONF_STORE, 1);
+    fail_ifnot(vf_store_put("key", path));
+    fail_ifnot(vf_store_put("key", path)); /* already there */
+    fail_if(vf_store_get("nokey", path2));
+    fail_ifnot(vf_store_get("key", path2));
+
+    fail_if(stat(path, &st) != 0 || stat(path2, &st2) != 0);
+    fail_if(st.st_ino != st2.st_ino, "not hardlinked");
+
+    vf_store_remove("key");
+    fail_if(vf_store_get("key", path2));
+    vfile_configure(VFILE_CONF_STORE, 0);
+}
+END_TEST
+
+/* processes locking not yet existing directory at once: none fails
+   and every one holds the lock alone */
+START_TEST (test_lock_concurrent) {
+    char dir[PATH_MAX], counter[PATH_MAX], cmd[PATH_MAX + 16];
+    const int nproc = 4, nloops = 5;
+    FILE *f;
+    int n = 0;
+
+    n_snprintf(dir, sizeof(dir), "%s", NTEST_TMPPATH("lockdir"));
+    n_snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    fail_if(system(cmd) != 0);
+    n_snprintf(counter, sizeof(counter), "%s.counter", dir);
+
+    f = fopen(counter, "w");
+    fail_if(f == NULL);
+    fprintf(f, "0\n");
+    fclose(f);
+
+    for (int i=0; i < nproc; i++) {
+        if (fork() != 0)
+            continue;
+
+        for (int j=0; j < nloops; j++) {
+            struct vflock *lock;
+            int v = -1;
+
+            if ((lock = vf_lock_mkdir(dir)) == NULL)
+                _exit(1);
+
+            f = fopen(counter, "r+");
+            if (f == NULL || fscanf(f, "%d", &v) != 1)
+                _exit(1);
+            usleep(100);
+            rewind(f);
+            fprintf(f, "%d\n", v + 1);
+            fclose(f);
+
+            vf_lock_release(lock);
+        }
+        _exit(0);
+    }
+
+    for (int i=0; i < nproc; i++) {
+        int st;
+        fail_if(wait(&st) < 0);
+        fail_if(!WIFEXITED(st) || WEXITSTATUS(st) != 0, "lock failed");
+    }
+
+    f = fopen(counter, "r");
+    fail_if(f == NULL || fscanf(f, "%d", &n) != 1);
+    fclose(f);
+    fail_if(n != nproc * nloops, "%d of %d updates", n, nproc * nloops);
+}
+END_TEST
+
+NTEST_RUNNER("vfile", test_vfile_append, test_valid_path, test_store,
+             test_lock_concurrent);
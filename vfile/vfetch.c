@@ -57,6 +57,8 @@ struct vf_module *vfmod_tab[] = {
 #define REQTYPE_FETCH 0
 #define REQTYPE_STAT  1
 
+#define VF_FETCHM_MAX 16          /* requests passed to fetchm at once */
+
 void vfile_setup(void)
 {
     int n;
@@ -72,6 +74,13 @@ void vfile_destroy()
 
     while (vfmod_tab[n] != NULL)
 	vfmod_tab[n++]->destroy();
+
+    vfile__mirror_save();
+}
+
+void vfile_forget_connections(void)
+{
+    vcn_pool_forget();
 }
 
 static
@@ -111,18 +120,47 @@ const struct vf_module *find_vf_module(int reqtype, int urltype)
 static
 const struct vf_module *select_vf_module(const char *path)
 {
-    const struct vf_module *mod = NULL;
-    char proto[64];
+    /* internal modules first, external fetchers are used only for
+       unsupported protocols or as fallback (see is_ext_fallbackable()) */
+    return find_vf_module(REQTYPE_FETCH, vf_url_type(path));
+}
 
-    vf_url_proto(proto, sizeof(proto), path);
+int vfile__is_internal_url(const char *url)
+{
+    struct vf_request *req;
+    int rc;
+
+    if (select_vf_module(url) == NULL)
+        return 0;
+
+    if ((req = vf_request_new(url, NULL)) == NULL)
+        return 0;
 
-    if (!vfile_is_configured_ext_handler(path) ||
-        !n_hash_exists(vfile_conf.default_clients_ht, proto)) {
-        unsigned urltype = vf_url_type(path);
-        mod = find_vf_module(REQTYPE_FETCH, urltype);
+    rc = (req->proxy_url == NULL || select_vf_module(req->proxy_url) != NULL);
+    vf_request_free(req);
+    return rc;
+}
+
+/* keep partially retrieved file to be resumed by next fetch? */
+static int is_resumable(struct vf_request *req)
+{
+    struct stat st;
+
+    if (req->flags & VF_REQ_INT_REDIRECTED)
+        return 0;
+
+    switch (req->req_errno) {
+        case ENOENT:
+        case ENOSPC:
+        case EPERM:
+        case EINVAL:
+            return 0;
     }
 
-    return mod;
+    if (req->dest_fd <= 0 || fstat(req->dest_fd, &st) != 0)
+        return 0;
+
+    return st.st_size > 0;
 }
 
 static
@@ -141,7 +179,8 @@ int do_vfile_req(int reqtype, const struct vf_module *mod,
             req->bar = vf_progress_new(label ? label : req->url);
     }
 
-    if (vfile_conf.flags & VFILE_CONF_STUBBORN_RETR)
+    if ((vfile_conf.flags & VFILE_CONF_STUBBORN_RETR) &&
+        (vf_flags & VF_FETCH_NORETRY) == 0)
         end = vfile_conf.nretries;
 
     while (end-- > 0) {
@@ -203,7 +242,7 @@ int do_vfile_req(int reqtype, const struct vf_module *mod,
     }
 
  l_endloop:
-    if (!rc && req->destpath)
+    if (!rc && req->destpath && !is_resumable(req))
         vf_unlink(req->destpath);
 
     if (req->bar) {
@@ -239,6 +278,19 @@ static int make_url_label(char *buf, size_t size,
     return n;
 }
 
+/* external fetchers are used only if internal one failed for other
+   reason than missing file */
+static int is_ext_fallbackable(struct vf_request *req, unsigned flags)
+{
+    if (flags & VF_FETCH_NORETRY) /* mirror failover, do it quickly */
+        return 0;
+
+    if (req->req_errno == ENOENT || vfile_sigint_reached(0))
+        return 0;
+
+    return vfile_is_configured_ext_handler(req->url);
+}
+
 int vfile__vf_fetch(const char *url, const char *dest_dir, unsigned flags,
                     const char *counter, const char *urlabel,
                     enum vf_fetchrc *ftrc)
@@ -251,6 +303,8 @@ int vfile__vf_fetch(const char *url, const char *dest_dir, unsigned flags,
     char                    url_label[PATH_MAX];
     int                     rc = 0;
 
+    vfile_set_errno(NULL, 0);
+
     if (*vfile_verbose <= 0)
         flags |= VF_FETCH_NOLABEL|VF_FETCH_NOPROGRESS;
 
@@ -277,7 +331,7 @@ int vfile__vf_fetch(const char *url, const char *dest_dir, unsigned flags,
         goto l_end;
     }
 
-    if ((vflock = vf_lock_mkdir(destdir)) == NULL)
+    if ((flags & VF_FETCH_NOLOCK) == 0 && (vflock = vf_lock_mkdir(destdir)) == NULL)
         return 0;
 
     snprintf(destpath, sizeof(destpath), "%s/%s", destdir, n_basenam(url));
@@ -296,7 +350,7 @@ int vfile__vf_fetch(const char *url, const char *dest_dir, unsigned flags,
     if (req->dest_fdoff > 0) { /* non-empty local file  */
         struct vf_stat vfst;
 
-        if ((rc = vf_stat(req->url, destdir, &vfst, urlabel)) &&
+        if ((rc = vfile__vf_stat(req->url, destdir, &vfst, urlabel)) &&
             vfst.vf_size > 0 && vfst.vf_mtime > 0 &&
             vfst.vf_size  == vfst.vf_local_size &&
             vfst.vf_mtime == vfst.vf_local_mtime) {
@@ -306,6 +360,16 @@ int vfile__vf_fetch(const char *url, const char *dest_dir, unsigned flags,
             *ftrc = VF_FETCHRC_UPTODATE;
             goto l_end;
 
+        /* interrupted download of the same file (mtime of partial file
+           is set to remote one on close), get the rest of it */
+        } else if (rc && vfst.vf_size > vfst.vf_local_size &&
+                   vfst.vf_mtime > 0 &&
+                   vfst.vf_mtime == vfst.vf_local_mtime) {
+            if (*vfile_verbose > 1)
+                vf_loginfo("vf_fetch: %s: resuming at %ld of %ld bytes\n",
+                           n_basenam(req->url), (long)vfst.vf_local_size,
+                           (long)vfst.vf_size);
+
         } else {
             if (*vfile_verbose > 1) {
                 if (!rc || vfst.vf_size <= 0 || vfst.vf_mtime <= 0) {
@@ -332,6 +396,14 @@ int vfile__vf_fetch(const char *url, const char *dest_dir, unsigned flags,
         if ((req->flags & VF_REQ_INT_REDIRECTED) == 0) {
             vfile_set_errno(mod->vfmod_name, req->req_errno);
 
+            if (is_ext_fallbackable(req, flags)) {
+                vf_loginfo(_("%s: retrying with external fetcher\n"),
+                           PR_URL(url));
+                vf_request_close_destpath(req);
+                vf_unlink(req->destpath);
+                rc = vf_fetch_ext(url, destdir);
+            }
+
         } else {            /* redirected */
             char redir_url[PATH_MAX];
 
@@ -358,17 +430,53 @@ int vf_fetch(const char *url, const char *dest_dir, unsigned flags,
              const char *counter, const char *urlabel)
 {
     enum vf_fetchrc ftrc;
+
+    if ((flags & VF_FETCH_NOMIRROR) == 0 && vfile__mirror_has(url))
+        return vfile__mirror_fetch(url, dest_dir, flags, counter, urlabel,
+                                   &ftrc);
+
     return vfile__vf_fetch(url, dest_dir, flags, counter, urlabel, &ftrc);
 }
 
+/* status request without any output, RET: bool */
+int vfile__vf_probe(const char *url)
+{
+    const struct vf_module *mod;
+    struct vf_request *req;
+    int rc = 0;
+
+    if ((req = vf_request_new(url, NULL)) == NULL)
+        return 0;
+
+    mod = find_vf_module(REQTYPE_STAT,
+                         vf_url_type(req->proxy_url ? req->proxy_url : req->url));
+    if (mod)
+        rc = do_vfile_req(REQTYPE_STAT, mod, req,
+                          VF_FETCH_NOLABEL | VF_FETCH_NOPROGRESS |
+                          VF_FETCH_NORETRY, NULL);
+
+    vf_request_free(req);
+    return rc;
+}
+
 int vf_stat(const char *url, const char *destdir, struct vf_stat *vfstat,
             const char *urlabel)
+{
+    if (vfile__mirror_has(url))
+        return vfile__mirror_stat(url, destdir, vfstat, urlabel);
+
+    return vfile__vf_stat(url, destdir, vfstat, urlabel);
+}
+
+int vfile__vf_stat(const char *url, const char *destdir, struct vf_stat *vfstat,
+                   const char *urlabel)
 {
     const struct vf_module *mod = NULL;
     struct vf_request *req = NULL;
     unsigned urltype = 0, flags = 0;
     int rc = 0;
 
+    vfile_set_errno(NULL, 0);
     if (*vfile_verbose <= 0)
         flags |= VF_FETCH_NOLABEL|VF_FETCH_NOPROGRESS;
 
@@ -407,9 +515,12 @@ int vf_stat(const char *url, const char *destdir, struct vf_stat *vfstat,
             vfstat->vf_mtime = req->st_remote_mtime > 0 ? req->st_remote_mtime : 0;
 
         } else if (req->flags & VF_REQ_INT_REDIRECTED) {
+            char redir_url[PATH_MAX];
+
+            n_snprintf(redir_url, sizeof(redir_url), "%s", req->url);
             vf_request_free(req);
             req = NULL;
-            rc = vf_stat(destdir, req->url, vfstat, NULL);
+            rc = vfile__vf_stat(redir_url, destdir, vfstat, NULL);
 
         } else {
             vfile_set_errno(mod->vfmod_name, req->req_errno);
@@ -443,6 +554,129 @@ int vf_stat(const char *url, const char *destdir, struct vf_stat *vfstat,
     return rc;
 }
 
+static int str_eq(const char *a, const char *b)
+{
+    if (a == NULL || b == NULL)
+        return a == b;
+    return strcmp(a, b) == 0;
+}
+
+static int is_same_server(const struct vf_request *a,
+                          const struct vf_request *b)
+{
+    return str_eq(a->proto, b->proto) && str_eq(a->host, b->host) &&
+        a->port == b->port && str_eq(a->login, b->login) &&
+        str_eq(a->proxy_host, b->proxy_host) && a->proxy_port == b->proxy_port;
+}
+
+int vfile__vf_fetchm(const char **urls, const char **destdirs, int n,
+                     unsigned flags, const char *urlabel, int *rcs, int *errs)
+{
+    const struct vf_module *mod = NULL;
+    struct vf_request **reqs = NULL;
+    struct vflock **locks = NULL;
+    int i, j, nreqs = 0, nlocks = 0, rc = 1;
+    int *reqidx = NULL;
+
+    for (i=0; i < n; i++) {
+        rcs[i] = -1;            /* not fetched yet */
+        if (errs)
+            errs[i] = 0;
+    }
+
+    if (n > 1 && (mod = select_vf_module(urls[0])) && mod->fetchm) {
+        reqs = alloca(sizeof(*reqs) * VF_FETCHM_MAX);
+        reqidx = alloca(sizeof(*reqidx) * VF_FETCHM_MAX);
+
+        if ((flags & VF_FETCH_NOLOCK) == 0) {
+            locks = alloca(sizeof(*locks) * n);
+
+            for (i=0; i < n; i++) {
+                int j, locked = 0;
+
+                for (j=0; j < i; j++)
+                    if (strcmp(destdirs[j], destdirs[i]) == 0)
+                        locked = 1;
+
+                if (locked)
+                    continue;
+
+                if ((locks[nlocks] = vf_lock_mkdir(destdirs[i])) == NULL) {
+                    mod = NULL;  /* vf_fetch() will wait for it */
+                    break;
+                }
+                nlocks++;
+            }
+        }
+    }
+
+    /* in chunks, every request keeps its destination file open */
+    i = 0;
+    while (mod && mod->fetchm && i < n) {
+        int ndone;
+
+        nreqs = 0;
+        for (; i < n && nreqs < VF_FETCHM_MAX; i++) {
+            char destpath[PATH_MAX];
+            struct vf_request *req;
+
+            if (select_vf_module(urls[i]) != mod)
+                continue;
+
+            n_snprintf(destpath, sizeof(destpath), "%s/%s", destdirs[i],
+                       n_basenam(urls[i]));
+            if ((req = vf_request_new(urls[i], destpath)) == NULL)
+                continue;       /* vf_fetch() will retry it */
+
+            /* local copy exists => vf_fetch() checks it or resumes
+               download */
+            if (req->dest_fdoff > 0 ||
+                (req->proxy_url && select_vf_module(req->proxy_url) != mod) ||
+                (nreqs > 0 && !is_same_server(reqs[0], req))) {
+                vf_request_free(req);
+                continue;
+            }
+
+            reqidx[nreqs] = i;
+            reqs[nreqs++] = req;
+        }
+
+        if (nreqs == 0)
+            break;
+
+        if (*vfile_verbose > 0 && (flags & VF_FETCH_NOLABEL) == 0)
+            vf_loginfo(_("Retrieving %d files from %s...\n"), nreqs,
+                       urlabel ? urlabel : reqs[0]->host);
+
+        ndone = mod->fetchm(reqs, nreqs);
+        for (j=0; j < nreqs; j++) {
+            if (j < ndone)
+                rcs[reqidx[j]] = 1;
+            vf_request_free(reqs[j]);
+        }
+
+        if (ndone == 0)         /* server in trouble, the rest one by one */
+            break;
+    }
+
+    for (i=0; i < nlocks; i++)
+        vf_lock_release(locks[i]);
+
+    /* not pipelined or failed ones, one by one */
+    for (i=0; i < n; i++) {
+        if (rcs[i] == -1) {
+            rcs[i] = vf_fetch(urls[i], destdirs[i], flags, NULL, urlabel);
+            if (errs && !rcs[i])
+                errs[i] = vfile__errno();
+        }
+
+        if (!rcs[i])
+            rc = 0;
+    }
+
+    return rc;
+}
+
 int vf_fetcha(tn_array *urls, const char *destdir, unsigned flags,
               const char *urlabel, int begin, int max)
 {
@@ -453,6 +687,20 @@ int vf_fetcha(tn_array *urls, const char *destdir, unsigned flags,
     if ((mod = select_vf_module(n_array_nth(urls, 0))) == NULL) {
         rc = vf_fetcha_ext(urls, destdir);
 
+    } else if (mod->fetchm && n_array_size(urls) > 1 &&
+               !vfile__mirror_has(n_array_nth(urls, 0))) {
+        int i, n = n_array_size(urls);
+        const char **urlv = alloca(sizeof(*urlv) * n);
+        const char **destdirs = alloca(sizeof(*destdirs) * n);
+        int *rcs = alloca(sizeof(*rcs) * n);
+
+        for (i=0; i < n; i++) {
+            urlv[i] = n_array_nth(urls, i);
+            destdirs[i] = destdir;
+        }
+
+        rc = vfile__vf_fetchm(urlv, destdirs, n, flags, urlabel, rcs, NULL);
+
     } else {
         int i;
 
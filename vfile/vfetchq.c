@@ -0,0 +1,807 @@
+/*
+  Copyright (C) 2000 - 2008 Pawel A. Gajda <mis@pld-linux.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+  Download scheduler: jobs are retrieved by up to vfile_conf.maxconn
+  worker processes, no more than vfile_conf.maxconn_perhost of them
+  talking to the same host. Workers are forked ones, so the rest of
+  vfile (module state, errno, connection pool) need not be thread safe;
+  each worker keeps its own connection pool, and gets jobs from the host
+  it talked to before if possible. Workers report progress through a
+  pipe and it is displayed by the parent as one summary bar. Retrieved
+  files are verified by the worker right away, so verification of one
+  file overlaps downloading of others. Small files from one host are
+  passed to a worker in batches, to be retrieved over one pipelined
+  connection. Jobs with mirrored URLs are spread over the mirrors (see
+  vfmirror.c) and queued again for another one if download fails.
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/param.h>          /* for PATH_MAX */
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <trurl/nassert.h>
+#include <trurl/nmalloc.h>
+#include <trurl/narray.h>
+#include <trurl/nstr.h>
+#include <trurl/n_snprintf.h>
+
+#include "i18n.h"
+#include "vfile.h"
+#include "vfile_intern.h"
+
+#define VFQ_MSG_PROGRESS 1
+#define VFQ_MSG_DONE     2
+
+#define VFQ_BATCH_MAX    8
+#define VFQ_SMALL_FILE   (128 * 1024) /* batched ones */
+
+struct vfq_batch {              /* parent => worker, < PIPE_BUF */
+    int      n;
+    int      jobs[VFQ_BATCH_MAX];
+    int      mirror;            /* of all jobs, -1 if not mirrored */
+    unsigned flags;             /* VF_FETCH_* */
+};
+
+struct vfq_msg {                /* worker => parent, < PIPE_BUF */
+    int   type;
+    int   job;
+    int   rc;                   /* VFQ_MSG_DONE */
+    int   fetched;              /* -"-, regardless of verification */
+    int   err;                  /* -"-, errno of not fetched one */
+    long  total;                /* VFQ_MSG_PROGRESS */
+    long  amount;
+};
+
+struct vfq_worker {
+    pid_t  pid;
+    int    jobfd;               /* parent => worker, struct vfq_batch */
+    int    msgfd;               /* worker => parent, struct vfq_msg */
+    int    njobs;               /* running ones */
+    char   host[128];           /* of last job */
+};
+
+struct vfq_job {
+    struct vf_fetchq_job *job;
+    char   host[128];
+    int    state;               /* 0 - pending, 1 - running, 2 - done */
+    int    worker;              /* running by */
+    long   total;
+    long   amount;
+    int    mirror;              /* assigned one or -1 */
+    unsigned tried;             /* failed mirrors, bit per mirror */
+    double started;
+};
+
+struct vfq {
+    struct vfq_job    *jobs;
+    int               njobs;
+    struct vfq_worker *workers;
+    int               nworkers;
+    unsigned          flags;
+    int               ndone;
+    void              *bar;
+};
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static int verify_job(struct vf_fetchq_job *job)
+{
+    char path[PATH_MAX];
+
+    if (job->verify == NULL)
+        return 1;
+
+    n_snprintf(path, sizeof(path), "%s/%s", job->destdir, n_basenam(job->url));
+    return job->verify(path, job->verify_arg);
+}
+
+/* several jobs are fetched from one host at once, from urls if given;
+   rcs[i]: 1 - done, 0 - not fetched, -1 - fetched, but not verified */
+static void fetch_jobs(struct vf_fetchq_job **jobs, const char **urls, int n,
+                       unsigned flags, const char *counter, int *rcs,
+                       int *errs)
+{
+    const char *jurls[VFQ_BATCH_MAX], *destdirs[VFQ_BATCH_MAX];
+
+    n_assert(n <= VFQ_BATCH_MAX);
+    for (int i=0; i < n; i++) {
+        jurls[i] = urls ? urls[i] : jobs[i]->url;
+        destdirs[i] = jobs[i]->destdir;
+    }
+
+    if (n == 1) {
+        rcs[0] = vf_fetch(jurls[0], destdirs[0], flags, counter,
+                          jobs[0]->label);
+        errs[0] = rcs[0] ? 0 : vfile__errno();
+
+    } else {
+        vfile__vf_fetchm(jurls, destdirs, n, flags, jobs[0]->label, rcs, errs);
+    }
+
+    for (int i=0; i < n; i++)
+        if (rcs[i] && !verify_job(jobs[i]))
+            rcs[i] = -1;
+}
+
+static int is_small_job(const struct vf_fetchq_job *job)
+{
+    return job->size > 0 && job->size <= VFQ_SMALL_FILE;
+}
+
+/* worker side */
+static int worker_msgfd = -1;
+static int worker_job = -1;
+
+struct worker_bar {
+    long  last_amount;
+};
+
+static void *worker_progress_new(void *data, const char *label)
+{
+    (void)data;
+    (void)label;
+    return n_calloc(sizeof(struct worker_bar), 1);
+}
+
+static void worker_progress(void *data, long total, long amount)
+{
+    struct worker_bar *bar = data;
+    struct vfq_msg msg;
+
+    /* do not flood the parent */
+    if (amount != total && amount - bar->last_amount < 32 * 1024)
+        return;
+
+    bar->last_amount = amount;
+
+    msg.type = VFQ_MSG_PROGRESS;
+    msg.job = worker_job;
+    msg.rc = 0;
+    msg.total = total;
+    msg.amount = amount;
+    if (write(worker_msgfd, &msg, sizeof(msg)) != sizeof(msg))
+        return;
+}
+
+static void worker_progress_reset(void *data)
+{
+    struct worker_bar *bar = data;
+    bar->last_amount = 0;
+}
+
+static struct vf_progress worker_bar = {
+    NULL, worker_progress_new, worker_progress, worker_progress_reset, free
+};
+
+static void worker_main(struct vfq *q, int jobfd, int msgfd)
+{
+    /* destination directories are locked by the parent */
+    unsigned flags = q->flags | VF_FETCH_NOLABEL | VF_FETCH_NOLOCK |
+        VF_FETCH_NOMIRROR;
+    struct vfq_batch b;
+    int i;
+
+    /* inherited connections belong to the parent */
+    vcn_pool_forget();
+
+    worker_msgfd = msgfd;
+    vfile_conf.bar = &worker_bar;
+
+    /* rate limits are shared by workers able to run at the same time */
+    if (vfile_conf.rate_limit > 0) {
+        vfile_conf.rate_limit /= q->nworkers;
+        if (vfile_conf.rate_limit == 0)
+            vfile_conf.rate_limit = 1;
+    }
+
+    if (vfile_conf.host_rate_limit > 0) {
+        int n = vfile_conf.maxconn_perhost;
+
+        if (n > q->nworkers)
+            n = q->nworkers;
+
+        vfile_conf.host_rate_limit /= n;
+        if (vfile_conf.host_rate_limit == 0)
+            vfile_conf.host_rate_limit = 1;
+    }
+
+    while (read(jobfd, &b, sizeof(b)) == sizeof(b)) {
+        struct vf_fetchq_job *jobs[VFQ_BATCH_MAX];
+        const char *urls[VFQ_BATCH_MAX];
+        char murls[VFQ_BATCH_MAX][PATH_MAX];
+        int rcs[VFQ_BATCH_MAX], errs[VFQ_BATCH_MAX];
+
+        n_assert(b.n > 0 && b.n <= VFQ_BATCH_MAX);
+        for (i=0; i < b.n; i++) {
+            n_assert(b.jobs[i] >= 0 && b.jobs[i] < q->njobs);
+            jobs[i] = q->jobs[b.jobs[i]].job;
+            rcs[i] = 0;
+            errs[i] = 0;
+
+            /* mirror is chosen by the parent */
+            urls[i] = jobs[i]->url;
+            if (b.mirror >= 0) {
+                vfile__mirror_url(murls[i], PATH_MAX, jobs[i]->url, b.mirror);
+                urls[i] = murls[i];
+            }
+        }
+
+        worker_job = b.jobs[0];
+        if (!vfile_sigint_reached(0))
+            fetch_jobs(jobs, urls, b.n, flags | b.flags, NULL, rcs, errs);
+
+        for (i=0; i < b.n; i++) {
+            struct vfq_msg msg;
+
+            msg.type = VFQ_MSG_DONE;
+            msg.job = b.jobs[i];
+            msg.rc = rcs[i] > 0;
+            msg.fetched = rcs[i] != 0;
+            msg.err = errs[i];
+            msg.total = msg.amount = 0;
+
+            if (write(msgfd, &msg, sizeof(msg)) != sizeof(msg))
+                goto l_end;
+        }
+    }
+
+ l_end:
+    fflush(NULL);
+    _exit(0);
+}
+
+static int start_worker(struct vfq *q, struct vfq_worker *w)
+{
+    int jobp[2], msgp[2];
+
+    if (pipe(jobp) != 0)
+        return 0;
+
+    if (pipe(msgp) != 0) {
+        close(jobp[0]);
+        close(jobp[1]);
+        return 0;
+    }
+
+    fflush(NULL);               /* do not duplicate buffered output */
+
+    if ((w->pid = fork()) < 0) {
+        vf_logerr("fork: %m\n");
+        close(jobp[0]); close(jobp[1]);
+        close(msgp[0]); close(msgp[1]);
+        return 0;
+    }
+
+    if (w->pid == 0) {
+        close(jobp[1]);
+        close(msgp[0]);
+
+        for (int i=0; i < q->nworkers; i++) { /* started before */
+            struct vfq_worker *ww = &q->workers[i];
+            if (ww != w && ww->pid > 0) {
+                close(ww->jobfd);
+                close(ww->msgfd);
+            }
+        }
+
+        worker_main(q, jobp[0], msgp[1]);
+    }
+
+    close(jobp[0]);
+    close(msgp[1]);
+
+    w->jobfd = jobp[1];
+    w->msgfd = msgp[0];
+    w->njobs = 0;
+    *w->host = '\0';
+
+    return 1;
+}
+
+static void stop_worker(struct vfq_worker *w)
+{
+    int st;
+
+    if (w->pid <= 0)
+        return;
+
+    if (w->jobfd >= 0)
+        close(w->jobfd);        /* worker exits on EOF */
+
+    if (w->msgfd >= 0)
+        close(w->msgfd);
+
+    w->jobfd = w->msgfd = -1;
+
+    while (waitpid(w->pid, &st, 0) < 0 && errno == EINTR)
+        ;
+    w->pid = 0;
+}
+
+static int host_nrunning(struct vfq *q, const char *host)
+{
+    int n = 0;
+
+    for (int i=0; i < q->nworkers; i++) {
+        struct vfq_worker *w = &q->workers[i];
+        if (w->njobs > 0 && strcmp(w->host, host) == 0)
+            n++;
+    }
+
+    return n;
+}
+
+/* next job for worker, preferably from the host it is connected to */
+static int select_job(struct vfq *q, struct vfq_worker *w)
+{
+    int i, candidate = -1;
+
+    for (i=0; i < q->njobs; i++) {
+        struct vfq_job *j = &q->jobs[i];
+
+        if (j->state != 0)
+            continue;
+
+        if (host_nrunning(q, j->host) >= vfile_conf.maxconn_perhost)
+            continue;
+
+        if (*w->host && strcmp(j->host, w->host) == 0)
+            return i;
+
+        if (candidate == -1)
+            candidate = i;
+    }
+
+    return candidate;
+}
+
+static int dispatch(struct vfq *q, struct vfq_worker *w)
+{
+    struct vfq_batch b;
+    struct vfq_job *j;
+    int n;
+
+    if ((n = select_job(q, w)) < 0)
+        return 0;
+
+    j = &q->jobs[n];
+    b.n = 0;
+    b.jobs[b.n++] = n;
+    b.mirror = j->mirror;
+    b.flags = 0;
+
+    /* no stubborn retries if there is another mirror to try */
+    if (j->mirror >= 0 && vfile__mirror_nleft(j->job->url, j->tried) > 1)
+        b.flags |= VF_FETCH_NORETRY;
+
+    /* add other small files from the same host */
+    if (is_small_job(j->job)) {
+        for (int i = n + 1; i < q->njobs && b.n < VFQ_BATCH_MAX; i++) {
+            struct vfq_job *jj = &q->jobs[i];
+
+            if (jj->state == 0 && is_small_job(jj->job) &&
+                jj->mirror == j->mirror && jj->tried == j->tried &&
+                strcmp(jj->host, j->host) == 0)
+                b.jobs[b.n++] = i;
+        }
+    }
+
+    if (write(w->jobfd, &b, sizeof(b)) != sizeof(b)) {
+        vf_logerr("vfetchq: worker %d: %m\n", w->pid);
+        return 0;
+    }
+
+    for (int i=0; i < b.n; i++) {
+        q->jobs[b.jobs[i]].state = 1;
+        q->jobs[b.jobs[i]].worker = w - q->workers;
+        q->jobs[b.jobs[i]].started = now();
+    }
+
+    w->njobs = b.n;
+    n_snprintf(w->host, sizeof(w->host), "%s", j->host);
+    return 1;
+}
+
+static void update_bar(struct vfq *q)
+{
+    long total = 0, amount = 0;
+
+    if (q->bar == NULL)
+        return;
+
+    for (int i=0; i < q->njobs; i++) {
+        struct vfq_job *j = &q->jobs[i];
+        long jtotal = j->total > 0 ? j->total : j->job->size;
+
+        total += jtotal;
+        amount += j->state == 2 ? jtotal : j->amount;
+    }
+
+    if (amount >= total)        /* let bar be finished by the end only */
+        amount = total - 1;
+
+    if (total > 0 && amount >= 0)
+        vf_progress(q->bar, total, amount);
+}
+
+static void finish_bar(struct vfq *q)
+{
+    long total = 0;
+
+    if (q->bar == NULL)
+        return;
+
+    for (int i=0; i < q->njobs; i++) {
+        struct vfq_job *j = &q->jobs[i];
+        total += j->total > 0 ? j->total : j->job->size;
+    }
+
+    if (total > 0)
+        vf_progress(q->bar, total, total);
+
+    vf_progress_free(q->bar);
+    q->bar = NULL;
+}
+
+static void job_set_mirror(struct vfq_job *j, int mirror)
+{
+    char url[PATH_MAX];
+
+    j->mirror = mirror;
+    vfile__mirror_url(url, sizeof(url), j->job->url, mirror);
+    vf_url_host(j->host, sizeof(j->host), url);
+}
+
+/* failed mirrored job goes to the next mirror, RET: bool */
+static int requeue_job(struct vfq_job *j)
+{
+    char url[PATH_MAX];
+    int mirror;
+
+    if (j->mirror < 0 || j->mirror >= 32 || vfile_sigint_reached(0))
+        return 0;
+
+    j->tried |= 1U << j->mirror;
+    if ((mirror = vfile__mirror_assign(j->job->url, j->job->size,
+                                       j->tried)) < 0)
+        return 0;
+
+    job_set_mirror(j, mirror);
+    vfile__mirror_url(url, sizeof(url), j->job->url, mirror);
+    if (*vfile_verbose > 1)
+        vf_loginfo(_("Trying mirror %s...\n"), PR_URL(url));
+
+    j->state = 0;
+    j->total = j->amount = 0;
+    return 1;
+}
+
+static int handle_msg(struct vfq *q, struct vfq_worker *w)
+{
+    struct vfq_msg msg;
+    struct vfq_job *j;
+    int n;
+
+    n = read(w->msgfd, &msg, sizeof(msg));
+    if (n != sizeof(msg)) {
+        if (n < 0 && errno == EINTR)
+            return 1;
+
+        for (int i=0; w->njobs > 0 && i < q->njobs; i++) { /* worker died */
+            j = &q->jobs[i];
+
+            if (j->state == 1 && j->worker == w - q->workers) {
+                j->state = 2;
+                j->job->rc = 0;
+                q->ndone++;
+                w->njobs--;
+                vf_logerr("%s: download process died\n", CL_URL(j->job->url));
+            }
+        }
+        w->njobs = 0;
+        stop_worker(w);
+        return 0;
+    }
+
+    n_assert(msg.job >= 0 && msg.job < q->njobs);
+    j = &q->jobs[msg.job];
+
+    switch (msg.type) {
+        case VFQ_MSG_PROGRESS:
+            j->total = msg.total;
+            j->amount = msg.amount;
+            break;
+
+        case VFQ_MSG_DONE:
+            w->njobs--;
+
+            if (j->mirror >= 0) {
+                long size = j->total > 0 ? j->total : j->job->size;
+
+                vfile__mirror_done(j->job->url, j->mirror, j->job->size,
+                                   msg.fetched ? size : 0, msg.fetched,
+                                   msg.err, now() - j->started);
+
+                if (!msg.fetched && !vfile__mirror_is_filemiss(msg.err) &&
+                    requeue_job(j))
+                    break;
+            }
+
+            j->state = 2;
+            j->job->rc = msg.rc;
+            q->ndone++;
+            break;
+
+        default:
+            n_assert(0);
+            break;
+    }
+
+    return 1;
+}
+
+static int fetch_parallel(struct vfq *q)
+{
+    struct pollfd *pfds;
+    void (*sigpipe_fn)(int);
+    int nalive = 0;
+
+    for (int i=0; i < q->nworkers; i++)
+        if (start_worker(q, &q->workers[i]))
+            nalive++;
+
+    if (nalive == 0)
+        return 0;
+
+    sigpipe_fn = signal(SIGPIPE, SIG_IGN); /* worker may die anytime */
+
+    if ((q->flags & VF_FETCH_NOPROGRESS) == 0 &&
+        (vfile_conf.flags & VFILE_CONF_PROGRESS_NONE) == 0 &&
+        *vfile_verbose > 0) {
+        char label[128];
+        /* "Retrieving " is prepended by progress bar */
+        n_snprintf(label, sizeof(label), _("%d files"), q->njobs);
+        q->bar = vf_progress_new(label);
+    }
+
+    pfds = alloca(sizeof(*pfds) * q->nworkers);
+
+    while (q->ndone < q->njobs) {
+        int npfds = 0, nrunning = 0;
+
+        if (vfile_sigint_reached(0))
+            break;
+
+        for (int i=0; i < q->nworkers; i++) {
+            struct vfq_worker *w = &q->workers[i];
+
+            if (w->pid <= 0)
+                continue;
+
+            if (w->njobs == 0)
+                dispatch(q, w);
+
+            if (w->njobs > 0)
+                nrunning++;
+
+            pfds[npfds].fd = w->msgfd;
+            pfds[npfds].events = POLLIN;
+            pfds[npfds].revents = 0;
+            npfds++;
+        }
+
+        if (nrunning == 0)      /* no workers left */
+            break;
+
+        if (poll(pfds, npfds, 500) <= 0)
+            continue;
+
+        for (int i=0, k=0; i < q->nworkers; i++) {
+            struct vfq_worker *w = &q->workers[i];
+
+            if (w->pid <= 0)
+                continue;
+
+            if (pfds[k++].revents & (POLLIN | POLLHUP | POLLERR))
+                handle_msg(q, w);
+        }
+
+        update_bar(q);
+    }
+
+    for (int i=0; i < q->nworkers; i++)
+        stop_worker(&q->workers[i]);
+
+    signal(SIGPIPE, sigpipe_fn);
+
+    if (q->ndone == q->njobs)
+        finish_bar(q);
+    else if (q->bar) {
+        vf_progress_free(q->bar);
+        q->bar = NULL;
+    }
+
+    return q->ndone == q->njobs;
+}
+
+/* jobs not worth or not possible to parallelize, fetched one by one */
+static int fetch_serial(struct vf_fetchq_job **jobs, int njobs, unsigned flags)
+{
+    char counter[32], host[128], jhost[128];
+    int i, nerr = 0;
+
+    for (i=0; i < njobs; i++) {
+        struct vf_fetchq_job *batch[VFQ_BATCH_MAX];
+        int rcs[VFQ_BATCH_MAX], errs[VFQ_BATCH_MAX], n = 0;
+
+        if (vfile_sigint_reached(0))
+            break;
+
+        if (jobs[i] == NULL)    /* fetched in batch */
+            continue;
+
+        batch[n++] = jobs[i];
+
+        /* small files from the same host at once; mirrored ones are
+           fetched one by one by vf_fetch() which fails over to mirrors */
+        if (is_small_job(jobs[i]) && vfile__is_internal_url(jobs[i]->url) &&
+            !vfile__mirror_has(jobs[i]->url)) {
+            vf_url_host(host, sizeof(host), jobs[i]->url);
+
+            for (int k = i + 1; k < njobs && n < VFQ_BATCH_MAX; k++) {
+                if (jobs[k] == NULL || !is_small_job(jobs[k]) ||
+                    vfile__mirror_has(jobs[k]->url))
+                    continue;
+
+                vf_url_host(jhost, sizeof(jhost), jobs[k]->url);
+                if (strcmp(host, jhost) == 0) {
+                    batch[n++] = jobs[k];
+                    jobs[k] = NULL;
+                }
+            }
+        }
+
+        snprintf(counter, sizeof(counter), "[%d/%d] ", i + 1, njobs);
+        fetch_jobs(batch, NULL, n, flags, njobs > 1 ? counter : NULL,
+                   rcs, errs);
+
+        for (int k=0; k < n; k++) {
+            batch[k]->rc = rcs[k] > 0;
+            if (!batch[k]->rc)
+                nerr++;
+        }
+    }
+
+    return nerr;
+}
+
+static int dirlocks_has(tn_array *locked, const char *dir)
+{
+    for (int i=0; i < n_array_size(locked); i++)
+        if (strcmp(n_array_nth(locked, i), dir) == 0)
+            return 1;
+    return 0;
+}
+
+int vf_fetchq(tn_array *jobs, unsigned flags)
+{
+    struct vfq q;
+    struct vf_fetchq_job **serial;
+    tn_array *locks, *locked, *unlockable;
+    int i, nserial = 0, nerr = 0;
+
+    if (n_array_size(jobs) == 0)
+        return 1;
+
+    memset(&q, 0, sizeof(q));
+    q.flags = flags;
+    q.jobs = n_calloc(sizeof(*q.jobs), n_array_size(jobs));
+    serial = alloca(sizeof(*serial) * n_array_size(jobs));
+
+    locks = n_array_new(4, (tn_fn_free)vf_lock_release, NULL);
+    locked = n_array_new(4, NULL, NULL);
+    unlockable = n_array_new(4, NULL, NULL);
+
+    for (i=0; i < n_array_size(jobs); i++) {
+        struct vf_fetchq_job *job = n_array_nth(jobs, i);
+        int parallel = 0;
+
+        job->rc = 0;
+        if (vfile_conf.maxconn > 1 && n_array_size(jobs) > 1 &&
+            vfile__is_internal_url(job->url)) {
+            parallel = 1;
+
+            /* workers do not lock destination directories themselves */
+            if (dirlocks_has(unlockable, job->destdir)) {
+                parallel = 0;
+
+            } else if (!dirlocks_has(locked, job->destdir)) {
+                struct vflock *vflock;
+
+                if ((vflock = vf_lock_mkdir(job->destdir))) {
+                    n_array_push(locks, vflock);
+                    n_array_push(locked, (char*)job->destdir);
+                } else {
+                    n_array_push(unlockable, (char*)job->destdir);
+                    parallel = 0;
+                }
+            }
+        }
+
+        if (parallel) {
+            struct vfq_job *j = &q.jobs[q.njobs++];
+            j->job = job;
+            j->mirror = -1;
+
+            if (vfile__mirror_has(job->url)) {
+                vfile__mirror_probe(job->url);
+                j->mirror = vfile__mirror_assign(job->url, job->size, 0);
+            }
+
+            if (j->mirror >= 0)
+                job_set_mirror(j, j->mirror);
+            else
+                vf_url_host(j->host, sizeof(j->host), job->url);
+
+        } else {
+            serial[nserial++] = job;
+        }
+    }
+
+    if (nserial)
+        nerr += fetch_serial(serial, nserial, flags);
+
+    if (q.njobs > 0 && !vfile_sigint_reached(0)) {
+        q.nworkers = vfile_conf.maxconn;
+        if (q.nworkers > q.njobs)
+            q.nworkers = q.njobs;
+
+        q.workers = n_calloc(sizeof(*q.workers), q.nworkers);
+        for (i=0; i < q.nworkers; i++)
+            q.workers[i].jobfd = q.workers[i].msgfd = -1;
+
+        fetch_parallel(&q);
+
+        for (i=0; i < q.njobs; i++)
+            if (!q.jobs[i].job->rc)
+                nerr++;
+
+        free(q.workers);
+        vfile__mirror_save();
+    }
+
+    n_array_free(locks);
+    n_array_free(locked);
+    n_array_free(unlockable);
+    free(q.jobs);
+
+    return nerr == 0 && !vfile_sigint_reached(0);
+}
@@ -32,6 +32,8 @@
 #include <signal.h>
 
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -61,6 +63,9 @@ extern char *vfff_uri_escape(const char *path);
 
 #define HTTP_UA     "poldek-vhttp/" VERSION
 
+#define HTTP_SKIP_BODY_MAX  (64 * 1024) /* larger ones are not worth reading */
+#define HTTP_PIPELINE_MAX   16          /* GETs sent ahead */
+
 /* HTTP/1.0 status codes from RFC1945, provided for reference.  */
 /* Successful 2xx.  */
 #define HTTP_STATUS_OK			200
@@ -693,6 +698,11 @@ static int status_code_ok(int status_code, const char *msg, const char *path)
             break;
 
         default:
+            if (HTTP_STATUS_IS_SERVER_ERROR(status_code)) { /* not file's fault */
+                vfff_set_err(EIO, "%s: %s", path, msg);
+                break;
+            }
+
             if (errno == 0)
                 errno = EINVAL;
             vfff_set_err(EINVAL, "%s: %m (%s)", path, msg);
@@ -815,29 +825,49 @@ static int is_closing_connection_status(struct http_resp *resp)
     return close_cn;
 }
 
+/* idle keep-alive connection has nothing to say, so if it is readable
+   then server has closed it (or sent junk); no round trip is needed */
 static int vhttp_vcn_is_alive(struct vcn *cn)
 {
-    char req_line[256];
-
     if (cn->state != VCN_ALIVE)
         return 0;
 
-    if (cn->flags & VCN_PROXIED)
+    if (cn->io_select(cn, 0) != 0) {
+        if (*vfff_verbose > 2)
+            vfff_log("%s:%d: connection closed by peer\n", cn->host, cn->port);
+        cn->state = VCN_DEAD;
         return 0;
+    }
 
-    make_req_line(req_line, sizeof(req_line), "HEAD", "/");
+    return 1;
+}
 
-    if (!httpcn_req(cn, req_line, NULL))
+/* read and discard (small) body of response we are not interested in,
+   connection is not reusable otherwise; RET: bool */
+static int http_resp_skip_body(struct vcn *cn, struct http_resp *resp)
+{
+    char buf[4096];
+    long size;
+
+    if (http_resp_get_hdr(resp, "transfer-encoding"))
         return 0;
 
-    if (!httpcn_get_resp(cn)) {
-        cn->state = VCN_DEAD;
+    if (!http_resp_get_hdr_long(resp, "content-length", &size))
         return 0;
-    }
 
-    if (is_closing_connection_status(cn->resp)) {
-        cn->state = VCN_DEAD;
+    if (size > HTTP_SKIP_BODY_MAX)
         return 0;
+
+    while (size > 0) {
+        int n = size > (long)sizeof(buf) ? (int)sizeof(buf) : (int)size;
+
+        if (cn->io_select(cn, VFFF_TIMEOUT) <= 0)
+            return 0;
+
+        if ((n = cn->io_read(cn, buf, n)) <= 0)
+            return 0;
+
+        size -= n;
     }
 
     return 1;
@@ -894,7 +924,8 @@ int vhttp_vcn_stat(struct vcn *cn, struct vfff_req *rreq)
         return 0;
 
     resp = cn->resp;
-    close_cn = is_closing_connection_status(resp);
+    if ((close_cn = is_closing_connection_status(resp)) == 0)
+        cn->flags |= VCN_KEEPALIVE;
 
     if (is_redirected_connection(resp, rreq)) {
         rc = 0;                 /* see the comment in httpcn_retr() */
@@ -922,52 +953,70 @@ int vhttp_vcn_stat(struct vcn *cn, struct vfff_req *rreq)
 }
 
 
-static
-int vhttp_vcn_retr(struct vcn *cn, struct vfff_req *rreq)
+static int retr_prepare(struct vfff_req *rreq)
 {
-    int    close_cn = 0, rc = 1;
-    long   from = 0, to = 0, total = 0, amount = 0;
-    char   req_line[PATH_MAX];
-    const  char *trenc;
-    struct http_resp *resp;
-    struct stat st;
-
-    vfff_errno = 0;
     *rreq->redirected_to = '\0';
     n_assert(rreq->out_fd > 0);
 
+    if (rreq->out_fdoff < 0)
+        rreq->out_fdoff = 0;
+
     if ((lseek(rreq->out_fd, rreq->out_fdoff, SEEK_SET)) == (off_t)-1) {
         vfff_set_err(errno, "%s[%d]: lseek %ld: %m", n_basenam(rreq->uri),
                      rreq->out_fd, rreq->out_fdoff);
-        goto l_err_end;
-    }
-
-    if ((fstat(rreq->out_fd, &st)) != 0) {
-        vfff_set_err(errno, "%s: stat: %m", rreq->out_path);
-        goto l_err_end;
+        return 0;
     }
 
+    return 1;
+}
 
-    if (rreq->out_fdoff < 0)
-        rreq->out_fdoff = 0;
+static int retr_send_req(struct vcn *cn, struct vfff_req *rreq)
+{
+    char req_line[PATH_MAX];
 
     make_req_line(req_line, sizeof(req_line), "GET", rreq->uri);
 
+    /* partially retrieved file, get the rest only */
     if (rreq->out_fdoff > 0)
-        httpcn_req(cn, req_line, "Range: bytes=%ld-\r\n", rreq->out_fdoff);
-    else
-        httpcn_req(cn, req_line, NULL);
+        return httpcn_req(cn, req_line, "Range: bytes=%ld-\r\n",
+                          (long)rreq->out_fdoff);
+
+    return httpcn_req(cn, req_line, NULL);
+}
+
+/* restart download from scratch */
+static int retr_truncate(struct vfff_req *rreq)
+{
+    if (ftruncate(rreq->out_fd, 0) != 0 ||
+        lseek(rreq->out_fd, 0, SEEK_SET) == (off_t)-1) {
+        vfff_set_err(errno, "%s: truncate: %m", rreq->out_path);
+        return 0;
+    }
+
+    rreq->out_fdoff = 0;
+    return 1;
+}
+
+static int retr_read_resp(struct vcn *cn, struct vfff_req *rreq)
+{
+    int    close_cn = 0, rc = 1;
+    long   from = 0, to = 0, total = 0, amount = 0;
+    const  char *trenc;
+    struct http_resp *resp;
 
     if (!httpcn_get_resp(cn))
         goto l_err_end;
 
     resp = cn->resp;
 
-    close_cn = is_closing_connection_status(resp);
+    if ((close_cn = is_closing_connection_status(resp)) == 0)
+        cn->flags |= VCN_KEEPALIVE;
 
     if (is_redirected_connection(resp, rreq)) {
         rc = 0;             /* treat redirects as errors, caller should
                                check rreq's redirected_to  */
+        if (!close_cn && !http_resp_skip_body(cn, resp))
+            close_cn = 1;
         goto l_end;
     }
 
@@ -991,6 +1040,16 @@ int vhttp_vcn_retr(struct vcn *cn, struct vfff_req *rreq)
     if ((trenc = http_resp_get_hdr(resp, "last-modified")) != NULL)
         rreq->st_remote_mtime = parse_date(trenc);
 
+    /* Range ignored by server, whole file is coming */
+    if (rreq->out_fdoff > 0 && resp->code == HTTP_STATUS_OK) {
+        if (*vfff_verbose > 1)
+            vfff_log(_("%s: server does not support resuming, "
+                       "retrieving whole file\n"), rreq->uri);
+
+        if (!retr_truncate(rreq))
+            goto l_err_end;
+    }
+
     if (rreq->out_fdoff == 0)
         total = amount;
 
@@ -1002,14 +1061,15 @@ int vhttp_vcn_retr(struct vcn *cn, struct vfff_req *rreq)
         }
 
         if (resp->code == HTTP_STATUS_BAD_RANGE) {
+            if (!close_cn && !http_resp_skip_body(cn, resp))
+                close_cn = 1;
+
             if (rreq->out_fdoff != total) {
                 if (*vfff_verbose > 1)
                     vfff_log(_("%s: invalid Content-Range, truncate %s\n"),
                              rreq->uri, rreq->out_path);
 
-                if ((ftruncate(rreq->out_fd, 0) == 0))
-                    rreq->out_fdoff = 0;
-
+                retr_truncate(rreq);
                 goto l_err_end;
 
             } else {
@@ -1055,7 +1115,76 @@ int vhttp_vcn_retr(struct vcn *cn, struct vfff_req *rreq)
         vfff_errno = EIO;
 
     goto l_end;
+}
+
+static
+int vhttp_vcn_retr(struct vcn *cn, struct vfff_req *rreq)
+{
+    vfff_errno = 0;
+
+    if (!retr_prepare(rreq)) {
+        vcn_close(cn);
+        return 0;
+    }
+
+    retr_send_req(cn, rreq);    /* on failure cn is dead and reading fails */
+    return retr_read_resp(cn, rreq);
+}
+
+static void http_cork(struct vcn *cn, int on)
+{
+#ifdef TCP_CORK
+    setsockopt(cn->sockfd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+#else
+    (void)cn;
+    (void)on;
+#endif
+}
+
+/* send GETs for several files at once and read the responses in order
+   then; RET: number of (leading) files retrieved */
+static
+int vhttp_vcn_retr_pipe(struct vcn *cn, struct vfff_req **rreqs, int n)
+{
+    int i, nsent = 0, ndone = 0;
+
+    vfff_errno = 0;
+
+    /* do not bother server which closes connections after each request */
+    if ((cn->flags & VCN_KEEPALIVE) == 0) {
+        if (!vhttp_vcn_retr(cn, rreqs[0]))
+            return 0;
+
+        if (cn->state != VCN_ALIVE || (cn->flags & VCN_KEEPALIVE) == 0)
+            return 1;
+
+        return 1 + vhttp_vcn_retr_pipe(cn, rreqs + 1, n - 1);
+    }
+
+    if (n > HTTP_PIPELINE_MAX)
+        n = HTTP_PIPELINE_MAX;
+
+    http_cork(cn, 1);           /* all requests in as few packets as possible */
+    for (i=0; i < n; i++) {
+        if (!retr_prepare(rreqs[i]) || !retr_send_req(cn, rreqs[i]))
+            break;
+        nsent++;
+    }
+    http_cork(cn, 0);
+
+    if (*vfff_verbose > 1)
+        vfff_log("%s: %d requests pipelined\n", cn->host, nsent);
+
+    for (i=0; i < nsent; i++) {
+        if (cn->state != VCN_ALIVE || !retr_read_resp(cn, rreqs[i]))
+            break;
+        ndone++;
+    }
+
+    if (ndone < nsent && cn->state == VCN_ALIVE)
+        vcn_close(cn);          /* responses to the rest are pending */
 
+    return ndone;
 }
 
 void vhttp_vcn_init(struct vcn *cn)
@@ -1065,5 +1194,6 @@ void vhttp_vcn_init(struct vcn *cn)
     cn->m_free = (void (*)(void*))http_resp_free;
     cn->m_is_alive = vhttp_vcn_is_alive;
     cn->m_retr = vhttp_vcn_retr;
+    cn->m_retr_pipe = vhttp_vcn_retr_pipe;
     cn->m_stat = vhttp_vcn_stat;
 }
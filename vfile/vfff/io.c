@@ -15,6 +15,8 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 
@@ -36,7 +38,8 @@ static int raw_read(struct vcn *cn, void *buf, size_t n)
 
 static int raw_write(struct vcn *cn, void *buf, size_t n)
 {
-    return write(cn->sockfd, buf, n);
+    /* server may have closed idle connection, EPIPE is enough */
+    return send(cn->sockfd, buf, n, MSG_NOSIGNAL);
 }
 
 static int raw_select(struct vcn *cn, unsigned timeout)
@@ -96,26 +99,125 @@ static void set_ssl_errors(void)
 }
 
 
+/* one context for all connections, it keeps trusted certificates */
+static SSL_CTX *ssl_ctx = NULL;
+static int ssl_ctx_verify = -1;
+
+/* last session of every host, resumed by next connections */
+#define SSL_NSESSIONS 16
+
+static struct ssl_session {
+    char         *host;
+    int          port;
+    SSL_SESSION  *sess;
+} ssl_sessions[SSL_NSESSIONS];
+
+static struct ssl_session *ssl_session_slot(const struct vcn *cn, int create)
+{
+    struct ssl_session *s, *empty = NULL;
+
+    for (int i=0; i < SSL_NSESSIONS; i++) {
+        s = &ssl_sessions[i];
+
+        if (s->host && s->port == cn->port && strcmp(s->host, cn->host) == 0)
+            return s;
+
+        if (s->host == NULL && empty == NULL)
+            empty = s;
+    }
+
+    if (!create)
+        return NULL;
+
+    if (empty == NULL) {        /* full, evict the first one */
+        empty = &ssl_sessions[0];
+        free(empty->host);
+        if (empty->sess)
+            SSL_SESSION_free(empty->sess);
+    }
+
+    empty->host = n_strdup(cn->host);
+    empty->port = cn->port;
+    empty->sess = NULL;
+    return empty;
+}
+
+static SSL_CTX *get_ssl_ctx(void)
+{
+    if (ssl_ctx && ssl_ctx_verify == vfff_tls_verify)
+        return ssl_ctx;
+
+    if (ssl_ctx) {              /* verification mode changed */
+        for (int i=0; i < SSL_NSESSIONS; i++) {
+            struct ssl_session *s = &ssl_sessions[i];
+            if (s->host) {
+                n_cfree(&s->host);
+                if (s->sess)
+                    SSL_SESSION_free(s->sess);
+                s->sess = NULL;
+            }
+        }
+        SSL_CTX_free(ssl_ctx);
+    }
+
+    if ((ssl_ctx = SSL_CTX_new(TLS_client_method())) == NULL)
+        return NULL;
+
+    ssl_ctx_verify = vfff_tls_verify;
+    SSL_CTX_set_session_cache_mode(ssl_ctx, SSL_SESS_CACHE_CLIENT);
+
+    if (vfff_tls_verify) {
+        if (SSL_CTX_set_default_verify_paths(ssl_ctx) != 1) {
+            SSL_CTX_free(ssl_ctx);
+            ssl_ctx = NULL;
+            return NULL;
+        }
+        SSL_CTX_set_verify(ssl_ctx, SSL_VERIFY_PEER, NULL);
+    }
+
+    return ssl_ctx;
+}
+
 static struct sslmod *init_ssl(const struct vcn *cn)
 {
-    const SSL_METHOD *method = NULL;
+    struct ssl_session *slot;
     SSL_CTX *ctx = NULL;
     SSL *ssl = NULL;
 
-    OpenSSL_add_all_algorithms();
-    SSL_load_error_strings();
-
-    method = TLS_client_method();
-    ctx = SSL_CTX_new(method);
-    if (ctx == NULL)
+    if ((ctx = get_ssl_ctx()) == NULL)
         goto l_err;
 
     ssl = SSL_new(ctx);
     SSL_set_tlsext_host_name(ssl, cn->host);
     SSL_set_fd(ssl, cn->sockfd);
 
-    if (SSL_connect(ssl) != 1)
+    if (vfff_tls_verify)
+        SSL_set1_host(ssl, cn->host);
+
+    if ((slot = ssl_session_slot(cn, 0)) && slot->sess)
+        SSL_set_session(ssl, slot->sess);
+
+    if (SSL_connect(ssl) != 1) {
+        long vrc = SSL_get_verify_result(ssl);
+
+        if (vrc != X509_V_OK) {
+            vfff_set_err(EACCES, "%s: %s", cn->host,
+                         X509_verify_cert_error_string(vrc));
+            SSL_free(ssl);
+            return NULL;
+        }
         goto l_err;
+    }
+
+    if (*vfff_verbose > 2)
+        vfff_log("%s: %s%s\n", cn->host, SSL_get_version(ssl),
+                 SSL_session_reused(ssl) ? ", session resumed" : "");
+
+    if ((slot = ssl_session_slot(cn, 1))) {
+        if (slot->sess)
+            SSL_SESSION_free(slot->sess);
+        slot->sess = SSL_get1_session(ssl);
+    }
 
     struct sslmod *mod = n_malloc(sizeof(*mod));
     mod->ctx = ctx;
@@ -129,9 +231,6 @@ static struct sslmod *init_ssl(const struct vcn *cn)
     if (ssl)
         SSL_free(ssl);
 
-    if (ctx)
-        SSL_CTX_free(ctx);
-
     return NULL;
 }
 
@@ -160,8 +259,7 @@ void vfff_io_destroy(struct vcn *cn)
 {
     struct sslmod *mod = cn->iomod;
     if (mod) {
-        SSL_free(mod->ssl);
-        SSL_CTX_free(mod->ctx);
+        SSL_free(mod->ssl);     /* context is shared, see get_ssl_ctx() */
         free(mod);
         cn->iomod = NULL;
     }
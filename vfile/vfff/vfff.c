@@ -54,6 +54,10 @@ static int verbose = 0;
 
 int vfff_errno = 0;
 int *vfff_verbose = &verbose;
+int vfff_timeout = 30;
+int vfff_tls_verify = 1;
+long vfff_rate_limit = 0;
+long vfff_host_rate_limit = 0;
 void (*vfff_vlog_cb)(const char *fmt, va_list ap) = NULL;
 
 const char *vfff_errmsg(void)
@@ -142,7 +146,8 @@ int vfff_to_connect(const char *host, const char *service, int *af)
         vfff_log("Connecting to %s:%s...\n", host, service);
 
     if ((n = getaddrinfo(host, service, &hints, &res)) != 0) {
-        vfff_set_err(errno, _("unable to connect to %s:%s: %s"),
+        vfff_set_err(n == EAI_SYSTEM ? errno : EHOSTUNREACH,
+                     _("unable to connect to %s:%s: %s"),
                      host, service, gai_strerror(n));
         return -1;
     }
@@ -187,6 +192,7 @@ int vfff_to_connect(const char *host, const char *service, int *af)
 
 static int cn_open(const char *host, int port, int *af)
 {
+    struct timeval tv = { vfff_timeout, 0 };
     int sockfd;
     char portstr[64];
 
@@ -195,6 +201,10 @@ static int cn_open(const char *host, int port, int *af)
     if ((sockfd = vfff_to_connect(host, portstr, af)) < 0)
         return 0;
 
+    /* blocking reads and writes (TLS handshake too) do not hang forever */
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
     return sockfd;
 }
 
@@ -342,7 +352,8 @@ int vcn_is_alive(struct vcn *cn)
 {
     vfff_errno = 0;
 
-    if (cn->ts_is_alive > 0) {
+    /* checking HTTP connection costs nothing, FTP one needs a round trip */
+    if (cn->ts_is_alive > 0 && cn->proto == VCN_PROTO_FTP) {
         time_t ts = time(0);
 
         if (ts - cn->ts_is_alive < VCN_ALIVE_TTL)
@@ -359,12 +370,139 @@ int vcn_retr(struct vcn *cn, struct vfff_req *req)
     return cn->m_retr(cn, req);
 }
 
+int vcn_retr_many(struct vcn *cn, struct vfff_req **reqs, int n)
+{
+    int i;
+
+    vfff_errno = 0;
+    if (n > 1 && cn->m_retr_pipe)
+        return cn->m_retr_pipe(cn, reqs, n);
+
+    for (i=0; i < n; i++) {
+        if (cn->state != VCN_ALIVE || !cn->m_retr(cn, reqs[i]))
+            break;
+    }
+
+    return i;
+}
+
 int vcn_stat(struct vcn *cn, struct vfff_req *req)
 {
     vfff_errno = 0;
     return cn->m_stat(cn, req);
 }
 
+/* token bucket; up to one second of transfer may be accumulated */
+struct ratebucket {
+    long            rate;       /* B/s */
+    double          tokens;
+    struct timeval  tv;
+};
+
+static struct ratebucket global_bucket;
+static tn_hash *host_buckets = NULL;
+
+static struct ratebucket *get_host_bucket(const char *host)
+{
+    struct ratebucket *b;
+
+    if (host_buckets == NULL)
+        host_buckets = n_hash_new(16, free);
+
+    if ((b = n_hash_get(host_buckets, host)) == NULL) {
+        b = n_calloc(sizeof(*b), 1);
+        n_hash_insert(host_buckets, host, b);
+    }
+
+    return b;
+}
+
+static void bucket_refill(struct ratebucket *b, long rate,
+                          const struct timeval *now)
+{
+    if (b->rate != rate || b->tv.tv_sec == 0) { /* new or reconfigured */
+        b->rate = rate;
+        b->tokens = 0;
+
+    } else {
+        double elapsed = (now->tv_sec - b->tv.tv_sec) +
+            (now->tv_usec - b->tv.tv_usec) / 1000000.0;
+
+        if (elapsed > 0)
+            b->tokens += elapsed * rate;
+
+        if (b->tokens > rate)
+            b->tokens = rate;
+    }
+
+    b->tv = *now;
+}
+
+/* wait for rate limit budget; RET: number of bytes (up to n) which
+   may be read now */
+static int throttle(struct vcn *cn, int n)
+{
+    struct ratebucket *bs[2];
+    long rates[2], chunk = 0;
+    int i, nb = 0;
+
+    if (vfff_rate_limit > 0) {
+        bs[nb] = &global_bucket;
+        rates[nb++] = vfff_rate_limit;
+    }
+
+    if (vfff_host_rate_limit > 0) {
+        bs[nb] = get_host_bucket(cn->host);
+        rates[nb++] = vfff_host_rate_limit;
+    }
+
+    if (nb == 0)
+        return n;
+
+    /* read in small chunks to keep transfer smooth */
+    for (i=0; i < nb; i++)
+        if (chunk == 0 || chunk > rates[i] / 8)
+            chunk = rates[i] / 8;
+
+    if (chunk < 512)
+        chunk = 512;
+
+    if (n > chunk)
+        n = chunk;
+
+    while (!vfff_sigint_reached()) {
+        struct timeval now;
+        long delay = 0;
+
+        gettimeofday(&now, NULL);
+        for (i=0; i < nb; i++) {
+            bucket_refill(bs[i], rates[i], &now);
+
+            if (bs[i]->tokens < n) {
+                long d = (n - bs[i]->tokens) * 1000000.0 / rates[i];
+                if (d > delay)
+                    delay = d;
+            }
+        }
+
+        if (delay == 0)
+            break;
+
+        usleep(delay);
+    }
+
+    return n;
+}
+
+static void throttle_consume(struct vcn *cn, int n)
+{
+    if (vfff_rate_limit > 0)
+        global_bucket.tokens -= n;
+
+    if (vfff_host_rate_limit > 0)
+        get_host_bucket(cn->host)->tokens -= n;
+}
+
 int vfff_transfer_file(struct vcn *cn, struct vfff_req *vreq, long total_size)
 {
     int     rc, is_err = 0;
@@ -403,11 +541,19 @@ int vfff_transfer_file(struct vcn *cn, struct vfff_req *vreq, long total_size)
 
         } else if (rc > 0) {
             char buf[8192];
-            int n;
+            int n = sizeof(buf);
+
+            /* do not read into next response of pipelined connection */
+            if (total_size > 0 && total_size - amount < n)
+                n = total_size - amount;
 
-            if ((n = cn->io_read(cn, buf, sizeof(buf))) == 0)
+            n = throttle(cn, n);
+            if ((n = cn->io_read(cn, buf, n)) == 0)
                 break;
 
+            if (n > 0)
+                throttle_consume(cn, n);
+
             if (n > 0) {
                 int nw;
 
@@ -426,6 +572,12 @@ int vfff_transfer_file(struct vcn *cn, struct vfff_req *vreq, long total_size)
         }
     }
 
+    /* connection closed before whole file was sent */
+    if (is_err == 0 && total_size > 0 && amount < total_size) {
+        errno = ECONNRESET;
+        is_err = 1;
+    }
+
     if (is_err) {
         vfff_errno = errno;
         if (vfff_errno == 0)
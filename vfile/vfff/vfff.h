@@ -31,10 +31,14 @@
 # define IPPORT_FTP 21
 #endif
 
-#define VFFF_TIMEOUT 30
+#define VFFF_TIMEOUT vfff_timeout
 
 extern int vfff_errno;
 extern int *vfff_verbose;
+extern int vfff_timeout;        /* s, of any network operation */
+extern int vfff_tls_verify;     /* verify server certificates? */
+extern long vfff_rate_limit;      /* B/s of all transfers, 0 - unlimited */
+extern long vfff_host_rate_limit; /* B/s of transfers from one host */
 
 extern void (*vfff_vlog_cb)(const char *fmt, va_list ap);
 
@@ -60,6 +64,7 @@ struct vfff_req;
 /* flags */
 #define VCN_SUPPORTS_SIZE  (1 << 0)
 #define VCN_SUPPORTS_MDTM  (1 << 1)
+#define VCN_KEEPALIVE      (1 << 2) /* server keeps connection open */
 #define VCN_PROXIED        (1 << 9)
 
 struct vcn {
@@ -89,6 +94,8 @@ struct vcn {
     int       (*m_open)(struct vcn *cn);
     void      (*m_close)(struct vcn *cn);
     int       (*m_retr)(struct vcn *cn, struct vfff_req *req);
+    /* optional, RET: number of leading reqs retrieved */
+    int       (*m_retr_pipe)(struct vcn *cn, struct vfff_req **reqs, int n);
     int       (*m_stat)(struct vcn *cn, struct vfff_req *req);
     int       (*m_is_alive)(struct vcn *cn);
 
@@ -122,6 +129,9 @@ struct vfff_req {
 };
 
 int vcn_retr(struct vcn *cn, struct vfff_req *req);
+/* retrieve several files from cn's server, pipelined if protocol allows it;
+   RET: number of leading reqs retrieved */
+int vcn_retr_many(struct vcn *cn, struct vfff_req **reqs, int n);
 int vcn_stat(struct vcn *cn, struct vfff_req *req);
 
 int vfff_transfer_file(struct vcn *cn, struct vfff_req *vreq, long total_size);
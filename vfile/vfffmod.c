@@ -22,6 +22,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
 
 
 #include <trurl/nassert.h>
@@ -34,6 +35,7 @@
 
 static int do_stat(struct vf_request *req);
 static int do_retr(struct vf_request *req);
+static int do_retr_many(struct vf_request **reqs, int n);
 static int do_init(void);
 static void do_destroy(void);
 
@@ -44,6 +46,7 @@ struct vf_module vf_mod_vfff = {
     do_destroy,
     do_retr,
     do_stat,
+    do_retr_many,
     0
 };
 
@@ -91,7 +94,28 @@ void vcn_pool_vacuum(void)
     n_list_remove_ex(vcn_pool, NULL, toremove_cn_fakecmp);
 }
 
-static struct vcn *vcn_pool_do_connect(struct vf_request *req)
+void vcn_pool_forget(void)
+{
+    tn_list_iterator it;
+    struct vcn *cn;
+
+    if (vcn_pool == NULL)
+        return;
+
+    n_list_iterator_start(vcn_pool, &it);
+    while ((cn = n_list_iterator_get(&it))) {
+        if (cn->state != VCN_CLOSED) { /* close fd without talking to peer */
+            close(cn->sockfd);
+            cn->sockfd = -1;
+            cn->state = VCN_CLOSED;
+        }
+    }
+
+    n_list_free(vcn_pool);
+    vcn_pool = NULL;
+}
+
+static struct vcn *vcn_pool_do_connect(struct vf_request *req, int *reused)
 {
     tn_list_iterator   it;
     struct vcn         *cn;
@@ -166,6 +190,7 @@ static struct vcn *vcn_pool_do_connect(struct vf_request *req)
     if (vcn_pool == NULL)
         do_init();
 
+    *reused = 0;
     vcn_pool_vacuum();
     n_list_iterator_start(vcn_pool, &it);
     while ((cn = n_list_iterator_get(&it))) {
@@ -197,6 +222,7 @@ static struct vcn *vcn_pool_do_connect(struct vf_request *req)
                             cn->login ? cn->login : "",
                             cn->login ? "@" : "",
                             cn->host, cn->port);
+            *reused = 1;
             break;
         }
     }
@@ -223,6 +249,16 @@ struct do_fn {
     int (*fn)(struct vcn *, struct vfff_req *);
 };
 
+/* pass vfile settings to vfff */
+static void set_vfff_conf(void)
+{
+    vfff_verbose = vfile_verbose;
+    vfff_timeout = vfile_conf.timeout;
+    vfff_tls_verify = (vfile_conf.flags & VFILE_CONF_TLS_NOVERIFY) == 0;
+    vfff_rate_limit = vfile_conf.rate_limit * 1024L;
+    vfff_host_rate_limit = vfile_conf.host_rate_limit * 1024L;
+}
+
 static void set_err(struct vf_request *req, int err_no, const char *fmt, ...)
 {
     va_list args;
@@ -233,15 +269,32 @@ static void set_err(struct vf_request *req, int err_no, const char *fmt, ...)
     req->req_errno = err_no;
 }
 
+/* server closed idle connection just before request was sent */
+static int is_stale_cn_error(struct vfff_req *vreq)
+{
+    struct stat st;
+
+    if (vfff_errno != ECONNRESET && vfff_errno != EPIPE)
+        return 0;
+
+    if (*vreq->redirected_to)
+        return 0;
+
+    if (vreq->out_fd <= 0)      /* stat */
+        return 1;
+
+    return fstat(vreq->out_fd, &st) == 0 && st.st_size == vreq->out_fdoff;
+}
+
 static
 int do_vfn(const struct do_fn *dofn, struct vf_request *req,
            int recursion_deep)
 {
     struct vcn        *cn;
     struct vfff_req   vreq;
-    int                rc;
+    int                rc, reused = 0;
 
-    vfff_verbose = vfile_verbose;
+    set_vfff_conf();
     req->req_errno = 0;
 
     if (recursion_deep > 32) {
@@ -249,7 +302,7 @@ int do_vfn(const struct do_fn *dofn, struct vf_request *req,
         return 0;
     }
 
-    if ((cn = vcn_pool_do_connect(req)) == NULL)
+    if ((cn = vcn_pool_do_connect(req, &reused)) == NULL)
         return 0;
 
     memset(&vreq, 0, sizeof(vreq));
@@ -271,7 +324,21 @@ int do_vfn(const struct do_fn *dofn, struct vf_request *req,
         req->st_remote_mtime = vreq.st_remote_mtime;
         req->st_remote_size = vreq.st_remote_size;
 
-    } else if (*vreq.redirected_to) {
+    } else if (reused && is_stale_cn_error(&vreq)) {
+        if (*vfile_verbose > 1)
+            vf_loginfo("%s:%d: connection closed by peer, reconnecting\n",
+                       cn->host, cn->port);
+        if (cn->state == VCN_ALIVE)
+            cn->state = VCN_DEAD; /* the next one is a new connection */
+        rc = do_vfn(dofn, req, recursion_deep);
+
+    } else if (*vreq.redirected_to == '\0') {
+        /* partially retrieved file gets remote mtime, so it is known
+           which version of file it is a part of when resuming */
+        if (vreq.st_remote_mtime > 0)
+            req->st_remote_mtime = vreq.st_remote_mtime;
+
+    } else {
         char topath[PATH_MAX + 128], *topathp = vreq.redirected_to;
         int  foreign_proto = 0;
 
@@ -333,3 +400,56 @@ int do_stat(struct vf_request *req)
 
     return rc;
 }
+
+/* reqs are expected to point to the same server (and destination files
+   to be opened); RET: number of leading reqs retrieved */
+static
+int do_retr_many(struct vf_request **reqs, int n)
+{
+    struct vfff_req   *vreqs, **vreqsp;
+    struct vcn        *cn;
+    int               i, ndone;
+
+    set_vfff_conf();
+
+    if ((cn = vcn_pool_do_connect(reqs[0], &i)) == NULL) {
+        reqs[0]->req_errno = vfff_errno;
+        vf_logerr("%s: %s\n", vf_mod_vfff.vfmod_name, vfff_errmsg());
+        return 0;
+    }
+
+    vreqs = alloca(sizeof(*vreqs) * n);
+    vreqsp = alloca(sizeof(*vreqsp) * n);
+
+    for (i=0; i < n; i++) {
+        struct vf_request *req = reqs[i];
+        struct vfff_req *vreq = &vreqs[i];
+
+        n_assert(req->dest_fd > 0);
+        memset(vreq, 0, sizeof(*vreq));
+        vreq->uri = req->proxy_host ? req->url : req->uri;
+        vreq->out_path = req->destpath;
+        vreq->out_fd = req->dest_fd;
+        vreq->out_fdoff = req->dest_fdoff;
+        req->req_errno = 0;
+        vreqsp[i] = vreq;
+    }
+
+    ndone = vcn_retr_many(cn, vreqsp, n);
+
+    for (i=0; i < ndone; i++) {
+        reqs[i]->st_remote_mtime = vreqs[i].st_remote_mtime;
+        reqs[i]->st_remote_size = vreqs[i].st_remote_size;
+    }
+
+    if (ndone < n) {
+        if (vreqs[ndone].st_remote_mtime > 0)
+            reqs[ndone]->st_remote_mtime = vreqs[ndone].st_remote_mtime;
+
+        reqs[ndone]->req_errno = vfff_errno;
+        if (*vfile_verbose > 1 && *vreqs[ndone].redirected_to == '\0')
+            vf_loginfo("%s: %s\n", vf_mod_vfff.vfmod_name, vfff_errmsg());
+    }
+
+    return ndone;
+}
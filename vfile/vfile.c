@@ -24,6 +24,10 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+# include <sys/syscall.h>
+#endif
 
 #include <trurl/nassert.h>
 #include <trurl/nstr.h>
@@ -51,7 +55,10 @@ struct vfile_configuration vfile_conf = {
     NULL, NULL, NULL,
     &verbose,
     (char*)default_anon_passwd,
-    NULL, NULL, NULL, &vf_tty_progress
+    NULL, NULL, NULL, &vf_tty_progress,
+    1, 1,                       /* maxconn, maxconn_perhost */
+    30,                         /* timeout */
+    0, 0                        /* rate_limit, host_rate_limit */
 };
 
 static inline const char *vfile_cachedir(void)
@@ -67,6 +74,36 @@ const char *vf_cachedir(void) {
     return vfile_cachedir();
 }
 
+int vf_maxconn(void) {
+    return vfile_conf.maxconn;
+}
+
+/* idle I/O scheduling class for this process and its children
+   (download workers), so background fetching does not compete with
+   other disk users; the previous one is restored with on = 0 */
+static void set_idle_io(int on)
+{
+#if defined(__linux__) && defined(SYS_ioprio_set) && defined(SYS_ioprio_get)
+    const int ioprio_who_process = 1;
+    const int ioprio_class_idle = 3, ioprio_class_shift = 13;
+    static int saved_ioprio = -1;
+
+    if (on) {
+        saved_ioprio = syscall(SYS_ioprio_get, ioprio_who_process, 0);
+        if (syscall(SYS_ioprio_set, ioprio_who_process, 0,
+                    ioprio_class_idle << ioprio_class_shift) != 0)
+            vf_loginfo("ioprio_set: %m\n");
+
+    } else if (saved_ioprio >= 0) {
+        if (syscall(SYS_ioprio_set, ioprio_who_process, 0, saved_ioprio) != 0)
+            vf_loginfo("ioprio_set: %m\n");
+        saved_ioprio = -1;
+    }
+#else
+    (void)on;
+#endif
+}
+
 static int do_cachedir_clean(const char *dirpath)
 {
     struct dirent *ent;
@@ -291,6 +328,59 @@ int vfile_configure(int param, ...)
             vfile_conf.nretries = v;
             break;
 
+        case VFILE_CONF_MAXCONN:
+            v = va_arg(ap, int);
+            vfile_conf.maxconn = v > 0 ? v : 1;
+            break;
+
+        case VFILE_CONF_MAXCONN_PERHOST:
+            v = va_arg(ap, int);
+            vfile_conf.maxconn_perhost = v > 0 ? v : 1;
+            break;
+
+        case VFILE_CONF_STORE:
+            v = va_arg(ap, int);
+            if (v)
+                vfile_conf.flags |= VFILE_CONF_STORE;
+            else
+                vfile_conf.flags &= ~VFILE_CONF_STORE;
+            break;
+
+        case VFILE_CONF_TIMEOUT:
+            v = va_arg(ap, int);
+            vfile_conf.timeout = v > 0 ? v : 30;
+            break;
+
+        case VFILE_CONF_TLS_NOVERIFY:
+            v = va_arg(ap, int);
+            if (v)
+                vfile_conf.flags |= VFILE_CONF_TLS_NOVERIFY;
+            else
+                vfile_conf.flags &= ~VFILE_CONF_TLS_NOVERIFY;
+            break;
+
+        case VFILE_CONF_RATE_LIMIT:
+            v = va_arg(ap, int);
+            vfile_conf.rate_limit = v > 0 ? v : 0;
+            break;
+
+        case VFILE_CONF_HOST_RATE_LIMIT:
+            v = va_arg(ap, int);
+            vfile_conf.host_rate_limit = v > 0 ? v : 0;
+            break;
+
+        case VFILE_CONF_IDLE_IO:
+            v = va_arg(ap, int);
+            if (v && (vfile_conf.flags & VFILE_CONF_IDLE_IO) == 0) {
+                set_idle_io(1);
+                vfile_conf.flags |= VFILE_CONF_IDLE_IO;
+
+            } else if (!v && (vfile_conf.flags & VFILE_CONF_IDLE_IO)) {
+                set_idle_io(0);
+                vfile_conf.flags &= ~VFILE_CONF_IDLE_IO;
+            }
+            break;
+
         case VFILE_CONF_SIGINT_REACHED:
             // fails on gcc 2.95
             // vfile_conf.sigint_reached = va_arg(ap, int (*)(int));
@@ -725,6 +815,125 @@ int vf_localunlink(const char *path)
 }
 
 
+/* shared store, files kept under caller's keys in one directory and
+   hardlinked to their per-URL locations */
+#define VF_STORE_DIR "_store"
+
+static int store_path(char *path, size_t size, const char *key)
+{
+    n_assert(strchr(key, '/') == NULL);
+    return n_snprintf(path, size, "%s/%s/%s", vfile_cachedir(), VF_STORE_DIR,
+                      key);
+}
+
+static int copy_file(const char *src, const char *dst)
+{
+    char buf[64 * 1024];
+    int fd, dfd, n = 0;
+
+    if ((fd = open(src, O_RDONLY)) < 0)
+        return 0;
+
+    if ((dfd = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0640)) < 0) {
+        close(fd);
+        return 0;
+    }
+
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        if (write(dfd, buf, n) != n) {
+            n = -1;
+            break;
+        }
+
+    close(fd);
+    if (close(dfd) != 0)
+        n = -1;
+
+    if (n != 0)
+        unlink(dst);
+
+    return n == 0;
+}
+
+/* link or copy src to dst, replacing dst */
+static int link_file(const char *src, const char *dst)
+{
+    char tmp[PATH_MAX];
+
+    n_snprintf(tmp, sizeof(tmp), "%s.vftmp%d", dst, (int)getpid());
+    unlink(tmp);
+
+    if (link(src, tmp) != 0 && !copy_file(src, tmp))
+        return 0;
+
+    if (rename(tmp, dst) != 0) {
+        unlink(tmp);
+        return 0;
+    }
+
+    return 1;
+}
+
+int vf_store_enabled(void)
+{
+    return (vfile_conf.flags & VFILE_CONF_STORE) != 0;
+}
+
+int vf_store_get(const char *key, const char *path)
+{
+    char spath[PATH_MAX];
+    struct stat st;
+
+    if (!vf_store_enabled())
+        return 0;
+
+    store_path(spath, sizeof(spath), key);
+    if (stat(spath, &st) != 0 || !S_ISREG(st.st_mode))
+        return 0;
+
+    if (!link_file(spath, path))
+        return 0;
+
+    if (*vfile_verbose > 1)
+        vf_log(VFILE_LOG_INFO, _("%s: taken from shared cache\n"),
+               n_basenam(path));
+
+    return 1;
+}
+
+int vf_store_put(const char *key, const char *path)
+{
+    char spath[PATH_MAX], dir[PATH_MAX];
+    struct stat st, sst;
+
+    if (!vf_store_enabled())
+        return 0;
+
+    n_snprintf(dir, sizeof(dir), "%s/%s", vfile_cachedir(), VF_STORE_DIR);
+    if (!vf_mkdir(dir))
+        return 0;
+
+    store_path(spath, sizeof(spath), key);
+    if (stat(path, &st) != 0)
+        return 0;
+
+    /* already there */
+    if (stat(spath, &sst) == 0 && st.st_dev == sst.st_dev &&
+        st.st_ino == sst.st_ino)
+        return 1;
+
+    return link_file(path, spath);
+}
+
+void vf_store_remove(const char *key)
+{
+    char spath[PATH_MAX];
+
+    store_path(spath, sizeof(spath), key);
+    unlink(spath);
+}
+
+
 void vf_vlog(int pri, const char *fmt, va_list ap)
 {
     if (vfile_conf.log)
@@ -751,6 +960,11 @@ void vfile_set_errno(const char *ctxname, int vf_errno)
     vfile_err_ctx = ctxname;
 }
 
+int vfile__errno(void)
+{
+    return vfile_err_no;
+}
+
 int vfile_sigint_reached(int reset)
 {
     if (vfile_conf.sigint_reached)
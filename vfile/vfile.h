@@ -51,6 +51,19 @@
                                                        file (de)compression */
 #define VFILE_CONF_PROGRESS_NONE          (1 << 13)
 #define VFILE_CONF_SIGINT_REACHED         (1 << 15)
+#define VFILE_CONF_MAXCONN                (1 << 16) /* int, parallel downloads */
+#define VFILE_CONF_MAXCONN_PERHOST        (1 << 17) /* int, -"- from one host */
+#define VFILE_CONF_STORE                  (1 << 18) /* int 0/non zero, shared
+                                                       store, see vf_store_*() */
+#define VFILE_CONF_TIMEOUT                (1 << 19) /* int, network timeout (s) */
+#define VFILE_CONF_TLS_NOVERIFY           (1 << 20) /* int 0/non zero, do not
+                                                       verify https servers */
+#define VFILE_CONF_RATE_LIMIT             (1 << 21) /* int, KB/s of all
+                                                       downloads, 0 - none */
+#define VFILE_CONF_HOST_RATE_LIMIT        (1 << 22) /* int, KB/s from one host */
+#define VFILE_CONF_IDLE_IO                (1 << 23) /* int 0/non zero, lower
+                                                       process I/O priority
+                                                       (0 restores it) */
 EXPORT int vfile_configure(int param, ...);
 
 /* run it after configuration is done */
@@ -58,6 +71,10 @@ EXPORT void vfile_setup(void);
 
 EXPORT void vfile_destroy(void);
 
+/* to be run by fork()-ed process: drops inherited connections without
+   touching them, they are still parent's */
+EXPORT void vfile_forget_connections(void);
+
 /* vf_type */
 #define VFT_IO       1             /* open(2)                   */
 #define VFT_STDIO    2             /* fopen(3)                  */
@@ -168,8 +185,26 @@ EXPORT int vf_fetch(const char *url, const char *dest_dir, unsigned flags,
 EXPORT int vf_fetcha(tn_array *urls, const char *destdir, unsigned flags,
               const char *urlabel, int begin, int max);
 
+struct vf_fetchq_job {
+    const char *url;
+    const char *destdir;
+    const char *label;          /* urlabel */
+    long       size;            /* expected size (for progress), 0 if unknown */
+    /* optional, called with path of fetched file as soon as it is
+       retrieved (by download process in parallel mode), RET: bool */
+    int        (*verify)(const char *path, void *arg);
+    void       *verify_arg;
+    int        rc;              /* set by vf_fetchq(): fetched and verified */
+};
+
+/* fetch vf_fetchq_job[] using up to VFILE_CONF_MAXCONN connections,
+   RET: bool (all fetched and verified) */
+EXPORT int vf_fetchq(tn_array *jobs, unsigned flags);
+
 EXPORT int vf_url_type(const char *url);
 EXPORT char *vf_url_proto(char *proto, int size, const char *url);
+/* host[:port] part of url, without login:passwd */
+EXPORT int vf_url_host(char *buf, int size, const char *url);
 EXPORT int vf_url_as_dirpath(char *buf, size_t size, const char *url);
 EXPORT int vf_url_as_path(char *buf, size_t size, const char *url);
 
@@ -197,12 +232,27 @@ EXPORT int vf_localdirpath(char *path, size_t size, const char *url);
 /* return configured cache directory */
 EXPORT const char *vf_cachedir(void);
 
+/* return configured number of parallel connections (VFILE_CONF_MAXCONN) */
+EXPORT int vf_maxconn(void);
+
 /* ofdirpath to path under cache dirctory  */
 EXPORT int vf_cachepath(char *path, size_t size, const char *ofdirpath);
 
 /* unlink local copy */
 EXPORT int vf_localunlink(const char *path);
 
+/* register mirror, i.e. alternative location of url prefix; files under
+   url are downloaded from the fastest of them, others are tried if it
+   fails. Statistics are kept in cachedir. */
+EXPORT int vf_mirror_add(const char *url, const char *mirror);
+
+/* shared store (if VFILE_CONF_STORE enabled): files saved under
+   caller's key and hardlinked (copied if not possible) back to path */
+EXPORT int vf_store_enabled(void);
+EXPORT int vf_store_get(const char *key, const char *path);
+EXPORT int vf_store_put(const char *key, const char *path);
+EXPORT void vf_store_remove(const char *key);
+
 EXPORT int vf_userathost(char *buf, int size);
 EXPORT int vf_cleanpath(char *buf, int size, const char *path);
 
@@ -24,6 +24,50 @@ int vfile__vf_fetch(const char *url, const char *dest_dir, unsigned flags,
                     const char *counter, const char *urlabel,
                     enum vf_fetchrc *ftrc);
 
+/* internal vf_fetch() flag: destination directory is already locked */
+#define VF_FETCH_NOLOCK  (1 << 10)
+/* internal: url is not to be replaced by its mirrors */
+#define VF_FETCH_NOMIRROR (1 << 11)
+/* internal: try once, regardless of VFILE_CONF_STUBBORN_RETR */
+#define VF_FETCH_NORETRY (1 << 12)
+
+int vfile__vf_stat(const char *url, const char *destdir, struct vf_stat *vfstat,
+                   const char *urlabel);
+/* quiet status request, RET: bool */
+int vfile__vf_probe(const char *url);
+
+/* vfmirror.c */
+int vfile__mirror_has(const char *url);
+/* url of mirror no */
+int vfile__mirror_url(char *buf, int size, const char *url, int no);
+/* RET: number of url's mirrors not tried yet */
+int vfile__mirror_nleft(const char *url, unsigned tried);
+void vfile__mirror_probe(const char *url);
+/* choose mirror for size bytes of url, RET: mirror no or -1 */
+int vfile__mirror_assign(const char *url, long size, unsigned tried);
+void vfile__mirror_done(const char *url, int no, long size, long bytes,
+                        int ok, int err, double secs);
+/* does err say file is missing (so other mirrors lack it too)? */
+int vfile__mirror_is_filemiss(int err);
+int vfile__mirror_fetch(const char *url, const char *destdir, unsigned flags,
+                        const char *counter, const char *urlabel,
+                        enum vf_fetchrc *ftrc);
+int vfile__mirror_stat(const char *url, const char *destdir,
+                       struct vf_stat *vfstat, const char *urlabel);
+void vfile__mirror_save(void);
+
+/* is url handled by internal module? */
+int vfile__is_internal_url(const char *url);
+
+/* fetch urls[i] into destdirs[i], files from one server are retrieved at
+   once (pipelined) if module can do it; RET: bool, rcs[i] set per url,
+   errs[i] (if not NULL) to errno of failed ones */
+int vfile__vf_fetchm(const char **urls, const char **destdirs, int n,
+                     unsigned flags, const char *urlabel, int *rcs, int *errs);
+
+/* vfffmod.c, drop connections inherited by fork()-ed process */
+void vcn_pool_forget(void);
+
 /* only external handlers are used */
 int vf_fetch_ext(const char *url, const char *destdir);
 int vf_fetcha_ext(tn_array *urls, const char *destdir);
@@ -63,11 +107,18 @@ struct vfile_configuration {
     int        (*sigint_reached)(int reset);
     int        (*term_width)(void);
     struct vf_progress *bar;
+    int        maxconn;         /* parallel downloads, see vfetchq.c */
+    int        maxconn_perhost;
+    int        timeout;         /* s, of network operations */
+    int        rate_limit;      /* KB/s, 0 - unlimited */
+    int        host_rate_limit; /* KB/s per host */
 };
 
 extern struct vfile_configuration vfile_conf;
 
 void vfile_set_errno(const char *ctxname, int vf_errno);
+/* errno of the last failed fetch or stat, 0 if unknown */
+int vfile__errno(void);
 int vfile_sigint_reached(int reset);
 
 #include "vfreq.h"
@@ -81,6 +132,9 @@ struct vf_module {
     void       (*destroy)(void);
     int        (*fetch)(struct vf_request *req);
     int        (*stat)(struct vf_request *req);
+    /* optional, fetch several files from one server at once,
+       RET: number of leading reqs fetched */
+    int        (*fetchm)(struct vf_request **reqs, int n);
     int        _pri;            /* used by vfile only */
 };
 
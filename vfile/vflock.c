@@ -34,6 +34,18 @@
 #include "vfile.h"
 #include "vfile_intern.h"
 
+/* lock files are removed on release, so the one locked might not be
+   the one under lockfile path anymore */
+static int is_lockfile_valid(int fd, const char *lockfile)
+{
+    struct stat st, fst;
+
+    if (fstat(fd, &fst) != 0 || stat(lockfile, &st) != 0)
+        return 0;
+
+    return st.st_dev == fst.st_dev && st.st_ino == fst.st_ino;
+}
+
 static
 int vf_lockfile(const char *lockfile)
 {
@@ -41,6 +53,7 @@ int vf_lockfile(const char *lockfile)
     int    fd;
 
     DBGF("%s\n", lockfile);
+ l_again:
     if ((fd = open(lockfile, O_RDWR | O_CREAT, 0644)) < 0) {
         vf_logerr("open %s: %m\n", lockfile);
         return -1;
@@ -53,7 +66,7 @@ int vf_lockfile(const char *lockfile)
 
     if (fcntl(fd, F_SETLK, &fl) == -1) {
         int an_errno = errno;
-        if (errno != EAGAIN || errno != EACCES)
+        if (errno != EAGAIN && errno != EACCES)
             if (*vfile_verbose > 1)
                 vf_logerr("fcntl %s: %m\n", lockfile);
 
@@ -62,6 +75,10 @@ int vf_lockfile(const char *lockfile)
         if (an_errno == ENOLCK)
             fd = -1;
 
+    } else if (!is_lockfile_valid(fd, lockfile)) {
+        close(fd);              /* released and removed meanwhile */
+        goto l_again;
+
     } else {
         char buf[64];
 
@@ -129,9 +146,9 @@ int vf_lock_obtain(const char *path)
 void vf_lock_release(struct vflock *vflock)
 {
     DBGF("%d %s\n", vflock->fd, vflock->path);
+    vf_unlink(vflock->path);    /* while still locked, see is_lockfile_valid() */
     if (vflock->fd > 0)
         close(vflock->fd);
-    vf_unlink(vflock->path);
     free(vflock);
 }
 
@@ -176,7 +193,8 @@ struct vflock *vf_lock_mkdir(const char *path)
     if ((subdir_vflock = vf_lockdir(dn)) == NULL)
         return NULL;
 
-    if (mkdir(path, 0750) != 0)
+    /* might be created by another process meanwhile */
+    if (mkdir(path, 0750) != 0 && errno != EEXIST)
         vf_logerr("%s: mkdir: %m\n", path);
     else
         vflock = vf_lockdir(path);
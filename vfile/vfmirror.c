@@ -0,0 +1,537 @@
+/*
+  Copyright (C) 2000 - 2008 Pawel A. Gajda <mis@pld-linux.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+  Mirrors: alternative locations of URL prefix (i.e. of source path).
+  Latency of every mirror is measured with status (HEAD) request before
+  it is used for the first time, throughput is taken from completed
+  downloads; both are kept in cachedir between runs. Files are assigned
+  to the mirror which is expected to finish them first, given what is
+  already assigned to it, and moved to another one if it fails.
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/param.h>          /* for PATH_MAX */
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <trurl/nassert.h>
+#include <trurl/nmalloc.h>
+#include <trurl/narray.h>
+#include <trurl/nstr.h>
+#include <trurl/n_snprintf.h>
+
+#include "i18n.h"
+#include "vfile.h"
+#include "vfile_intern.h"
+
+#define MIRROR_STATS_FILE  "_mirrors"
+#define MIRROR_FAILED_TTL  (15 * 60) /* failed mirror is avoided for */
+#define MIRROR_PROBE_TTL   (24 * 3600) /* latency is measured again after */
+#define MIRROR_RATE        (256 * 1024.0) /* assumed if not known yet */
+#define MIRROR_MIN_BYTES   (256 * 1024) /* smaller files say nothing about
+                                           rate (and may be pipelined) */
+
+struct vf_mirror {
+    double  latency;            /* s */
+    double  rate;               /* bytes/s */
+    time_t  failed;             /* last failure */
+    time_t  probed;             /* last latency measurement */
+    double  load;               /* bytes assigned and not done yet */
+    int     len;
+    char    url[0];
+};
+
+struct vf_mirror_group {
+    tn_array *mirrors;          /* struct vf_mirror*, [0] is the original */
+};
+
+static tn_array *mirrors = NULL; /* all of them, struct vf_mirror* */
+static tn_array *groups = NULL;  /* struct vf_mirror_group* */
+static int stats_loaded = 0;
+static int stats_dirty = 0;
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static struct vf_mirror *mirror_get(const char *url, int len, int create)
+{
+    struct vf_mirror *m;
+
+    while (len > 0 && url[len - 1] == '/')
+        len--;
+
+    if (mirrors == NULL) {
+        if (!create)
+            return NULL;
+        mirrors = n_array_new(8, free, NULL);
+    }
+
+    for (int i=0; i < n_array_size(mirrors); i++) {
+        m = n_array_nth(mirrors, i);
+        if (m->len == len && strncmp(m->url, url, len) == 0)
+            return m;
+    }
+
+    if (!create)
+        return NULL;
+
+    m = n_calloc(sizeof(*m) + len + 1, 1);
+    memcpy(m->url, url, len);
+    m->url[len] = '\0';
+    m->len = len;
+    n_array_push(mirrors, m);
+    return m;
+}
+
+static void group_free(struct vf_mirror_group *g)
+{
+    n_array_free(g->mirrors);
+    free(g);
+}
+
+static int is_prefix_of(const struct vf_mirror *m, const char *url)
+{
+    return strncmp(url, m->url, m->len) == 0 &&
+        (url[m->len] == '/' || url[m->len] == '\0');
+}
+
+static struct vf_mirror_group *group_find(const char *url)
+{
+    if (groups == NULL)
+        return NULL;
+
+    for (int i=0; i < n_array_size(groups); i++) {
+        struct vf_mirror_group *g = n_array_nth(groups, i);
+        for (int j=0; j < n_array_size(g->mirrors); j++)
+            if (is_prefix_of(n_array_nth(g->mirrors, j), url))
+                return g;
+    }
+
+    return NULL;
+}
+
+static struct vf_mirror *group_mirror_of(struct vf_mirror_group *g,
+                                         const char *url)
+{
+    for (int j=0; j < n_array_size(g->mirrors); j++) {
+        struct vf_mirror *m = n_array_nth(g->mirrors, j);
+        if (is_prefix_of(m, url))
+            return m;
+    }
+
+    return NULL;
+}
+
+int vf_mirror_add(const char *url, const char *mirror)
+{
+    struct vf_mirror_group *g;
+    struct vf_mirror *m, *orig;
+
+    if ((vf_url_type(url) & VFURL_LOCAL) || (vf_url_type(mirror) & VFURL_LOCAL)) {
+        vf_logerr(_("%s: mirrors of local directories are not supported\n"),
+                  url);
+        return 0;
+    }
+
+    orig = mirror_get(url, strlen(url), 1);
+    m = mirror_get(mirror, strlen(mirror), 1);
+
+    if (groups == NULL)
+        groups = n_array_new(4, (tn_fn_free)group_free, NULL);
+
+    if ((g = group_find(orig->url)) == NULL) {
+        g = n_malloc(sizeof(*g));
+        g->mirrors = n_array_new(4, NULL, NULL);
+        n_array_push(g->mirrors, orig);
+        n_array_push(groups, g);
+    }
+
+    for (int i=0; i < n_array_size(g->mirrors); i++)
+        if (n_array_nth(g->mirrors, i) == m)
+            return 1;
+
+    n_array_push(g->mirrors, m);
+    return 1;
+}
+
+static const char *stats_path(char *path, int size)
+{
+    const char *cachedir = vfile_conf._cachedir;
+
+    if (cachedir == NULL || *cachedir == '\0')
+        return NULL;
+
+    n_snprintf(path, size, "%s/%s", cachedir, MIRROR_STATS_FILE);
+    return path;
+}
+
+/* "url latency rate failed probed" lines */
+static void load_stats(void)
+{
+    char path[PATH_MAX], line[PATH_MAX + 128], url[PATH_MAX];
+    FILE *f;
+
+    if (stats_loaded)
+        return;
+
+    stats_loaded = 1;
+    if (stats_path(path, sizeof(path)) == NULL ||
+        (f = fopen(path, "r")) == NULL)
+        return;
+
+    while (fgets(line, sizeof(line), f)) {
+        struct vf_mirror *m;
+        double latency, rate;
+        long failed, probed;
+
+        if (sscanf(line, "%4095s %lf %lf %ld %ld", url, &latency, &rate,
+                   &failed, &probed) != 5)
+            continue;
+
+        /* not configured ones are kept too, to be saved back */
+        m = mirror_get(url, strlen(url), 1);
+        m->latency = latency;
+        m->rate = rate;
+        m->failed = failed;
+        m->probed = probed;
+    }
+
+    fclose(f);
+}
+
+void vfile__mirror_save(void)
+{
+    char path[PATH_MAX], tmp[PATH_MAX];
+    FILE *f;
+
+    if (!stats_dirty || mirrors == NULL)
+        return;
+
+    if (stats_path(path, sizeof(path)) == NULL)
+        return;
+
+    n_snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    if ((f = fopen(tmp, "w")) == NULL)
+        return;
+
+    for (int i=0; i < n_array_size(mirrors); i++) {
+        struct vf_mirror *m = n_array_nth(mirrors, i);
+
+        if (m->probed == 0 && m->rate == 0 && m->failed == 0)
+            continue;
+
+        fprintf(f, "%s %.4f %.0f %ld %ld\n", m->url, m->latency, m->rate,
+                (long)m->failed, (long)m->probed);
+    }
+
+    if (fclose(f) != 0 || rename(tmp, path) != 0)
+        unlink(tmp);
+    else
+        stats_dirty = 0;
+}
+
+static int is_failed(const struct vf_mirror *m)
+{
+    return m->failed > 0 && time(NULL) - m->failed < MIRROR_FAILED_TTL;
+}
+
+/* expected time of getting size bytes after already assigned ones */
+static double finish_time(const struct vf_mirror *m, long size)
+{
+    double rate = m->rate > 0 ? m->rate : MIRROR_RATE;
+    return m->latency + (m->load + size) / rate;
+}
+
+static int mirror_url(char *buf, int size, const struct vf_mirror *m,
+                      const struct vf_mirror *orig, const char *url)
+{
+    return n_snprintf(buf, size, "%s%s", m->url, url + orig->len);
+}
+
+int vfile__mirror_has(const char *url)
+{
+    return group_find(url) != NULL;
+}
+
+int vfile__mirror_url(char *buf, int size, const char *url, int no)
+{
+    struct vf_mirror_group *g;
+    struct vf_mirror *orig;
+
+    if ((g = group_find(url)) == NULL || no < 0 ||
+        no >= n_array_size(g->mirrors)) {
+        return n_snprintf(buf, size, "%s", url);
+    }
+
+    orig = group_mirror_of(g, url);
+    return mirror_url(buf, size, n_array_nth(g->mirrors, no), orig, url);
+}
+
+int vfile__mirror_nleft(const char *url, unsigned tried)
+{
+    struct vf_mirror_group *g;
+    int n = 0;
+
+    if ((g = group_find(url)) == NULL)
+        return (tried & 1) ? 0 : 1;
+
+    for (int i=0; i < n_array_size(g->mirrors) && i < 32; i++)
+        if ((tried & (1U << i)) == 0)
+            n++;
+
+    return n;
+}
+
+/* measure latency of not (recently) measured mirrors of url */
+void vfile__mirror_probe(const char *url)
+{
+    struct vf_mirror_group *g;
+    struct vf_mirror *orig;
+    time_t t = time(NULL);
+
+    if ((g = group_find(url)) == NULL)
+        return;
+
+    load_stats();
+    orig = group_mirror_of(g, url);
+
+    for (int i=0; i < n_array_size(g->mirrors); i++) {
+        struct vf_mirror *m = n_array_nth(g->mirrors, i);
+        char murl[PATH_MAX];
+        double t0, latency;
+
+        if (m->probed > 0 && t - m->probed < MIRROR_PROBE_TTL)
+            continue;
+
+        if (is_failed(m))
+            continue;
+
+        mirror_url(murl, sizeof(murl), m, orig, url);
+
+        t0 = now();
+        if (vfile__vf_probe(murl)) {
+            latency = now() - t0;
+            m->latency = m->probed ? (m->latency + latency) / 2 : latency;
+            m->failed = 0;
+
+        } else {
+            m->failed = t;
+        }
+
+        m->probed = t;
+        stats_dirty = 1;
+
+        if (*vfile_verbose > 1)
+            vf_loginfo("mirror %s: %s\n", CL_URL(m->url),
+                       m->failed ? "failed" : "ok");
+    }
+}
+
+/* select mirror for url not tried yet (bit per mirror in tried),
+   RET: mirror no or -1 */
+int vfile__mirror_assign(const char *url, long size, unsigned tried)
+{
+    struct vf_mirror_group *g;
+    int best = -1, best_failed = -1;
+    double best_t = 0, best_failed_t = 0;
+
+    if ((g = group_find(url)) == NULL)
+        return (tried & 1) ? -1 : 0;
+
+    load_stats();
+    for (int i=0; i < n_array_size(g->mirrors) && i < 32; i++) {
+        struct vf_mirror *m = n_array_nth(g->mirrors, i);
+        double t;
+
+        if (tried & (1U << i))
+            continue;
+
+        t = finish_time(m, size);
+        if (is_failed(m)) {     /* last resort */
+            if (best_failed == -1 || t < best_failed_t) {
+                best_failed = i;
+                best_failed_t = t;
+            }
+
+        } else if (best == -1 || t < best_t) {
+            best = i;
+            best_t = t;
+        }
+    }
+
+    if (best == -1)
+        best = best_failed;
+
+    if (best >= 0) {
+        struct vf_mirror *m = n_array_nth(g->mirrors, best);
+        m->load += size;
+    }
+
+    return best;
+}
+
+/* is failure with err caused by mirror rather than by the file? */
+static int is_mirror_failure(int err)
+{
+    switch (err) {
+        case ECONNREFUSED:
+        case ECONNRESET:
+        case ECONNABORTED:
+        case ETIMEDOUT:
+        case EHOSTUNREACH:
+        case EHOSTDOWN:
+        case ENETUNREACH:
+        case ENETDOWN:
+        case EPIPE:
+        case EIO:               /* 5xx, broken responses */
+            return 1;
+    }
+
+    return 0;
+}
+
+/* a missing file is missing on the other mirrors too */
+int vfile__mirror_is_filemiss(int err)
+{
+    return err == ENOENT;
+}
+
+/* download of url by mirror no is done, size is assigned one,
+   err is errno of the failed one */
+void vfile__mirror_done(const char *url, int no, long size, long bytes,
+                        int ok, int err, double secs)
+{
+    struct vf_mirror_group *g;
+    struct vf_mirror *m;
+
+    if ((g = group_find(url)) == NULL || no < 0 ||
+        no >= n_array_size(g->mirrors))
+        return;
+
+    m = n_array_nth(g->mirrors, no);
+    m->load -= size;
+    if (m->load < 0)
+        m->load = 0;
+
+    if (!ok) {
+        if (is_mirror_failure(err)) {
+            m->failed = time(NULL);
+            stats_dirty = 1;
+        }
+        return;
+    }
+
+    m->failed = 0;
+    if (bytes >= MIRROR_MIN_BYTES) {
+        double rate, t = secs - m->latency;
+
+        if (t < 0.001)
+            t = 0.001;
+
+        rate = bytes / t;
+        m->rate = m->rate > 0 ? 0.7 * m->rate + 0.3 * rate : rate;
+    }
+
+    stats_dirty = 1;
+}
+
+int vfile__mirror_fetch(const char *url, const char *destdir, unsigned flags,
+                        const char *counter, const char *urlabel,
+                        enum vf_fetchrc *ftrc)
+{
+    char localdir[PATH_MAX], murl[PATH_MAX], destpath[PATH_MAX];
+    unsigned tried = 0;
+    int no, err, rc = 0;
+
+    /* local copy is kept where the original url would put it */
+    if (destdir == NULL) {
+        vf_localdirpath(localdir, sizeof(localdir), url);
+        destdir = localdir;
+    }
+
+    n_snprintf(destpath, sizeof(destpath), "%s/%s", destdir, n_basenam(url));
+    vfile__mirror_probe(url);
+
+    while ((no = vfile__mirror_assign(url, 0, tried)) >= 0) {
+        struct stat st;
+        double t0 = now();
+        long size = 0;
+
+        vfile__mirror_url(murl, sizeof(murl), url, no);
+        if (tried && *vfile_verbose > 0)
+            vf_loginfo(_("Trying mirror %s...\n"), PR_URL(murl));
+
+        /* no stubborn retries if there is another mirror to try */
+        rc = vfile__vf_fetch(murl, destdir, flags | VF_FETCH_NOMIRROR |
+                             (vfile__mirror_nleft(url, tried) > 1 ?
+                              VF_FETCH_NORETRY : 0),
+                             counter, urlabel, ftrc);
+
+        if (rc && *ftrc == VF_FETCHRC_FETCHED && stat(destpath, &st) == 0)
+            size = st.st_size;
+
+        err = rc ? 0 : vfile__errno();
+        vfile__mirror_done(url, no, 0, size, rc, err, now() - t0);
+
+        if (rc || vfile__mirror_is_filemiss(err) || vfile_sigint_reached(0) ||
+            no >= 32)
+            break;
+
+        tried |= 1U << no;
+    }
+
+    vfile__mirror_save();
+    return rc;
+}
+
+int vfile__mirror_stat(const char *url, const char *destdir,
+                       struct vf_stat *vfstat, const char *urlabel)
+{
+    char localdir[PATH_MAX], murl[PATH_MAX];
+    unsigned tried = 0;
+    int no, err, rc = 0;
+
+    if (destdir == NULL) {
+        vf_localdirpath(localdir, sizeof(localdir), url);
+        destdir = localdir;
+    }
+
+    while ((no = vfile__mirror_assign(url, 0, tried)) >= 0) {
+        vfile__mirror_url(murl, sizeof(murl), url, no);
+        rc = vfile__vf_stat(murl, destdir, vfstat, urlabel);
+        err = rc ? 0 : vfile__errno();
+        vfile__mirror_done(url, no, 0, 0, rc, err, 0);
+
+        if (rc || vfile__mirror_is_filemiss(err) || vfile_sigint_reached(0) ||
+            no >= 32)
+            break;
+
+        tried |= 1U << no;
+    }
+
+    return rc;
+}
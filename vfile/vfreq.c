@@ -278,8 +278,12 @@ struct vf_request *vf_request_new(const char *url, const char *destpath)
     else 
         req->uri = n_strdupl(tmp, len);
 
-    len = n_snprintf(tmp, sizeof(tmp), "%s://%s%s", rreq.proto, rreq.host,
-                     req->uri);
+    if (rreq.port > 0)
+        len = n_snprintf(tmp, sizeof(tmp), "%s://%s:%d%s", rreq.proto,
+                         rreq.host, rreq.port, req->uri);
+    else
+        len = n_snprintf(tmp, sizeof(tmp), "%s://%s%s", rreq.proto, rreq.host,
+                         req->uri);
     req->url = n_strdupl(tmp, len);
     req->port = rreq.port;
 